@@ -18,6 +18,11 @@ struct HitPayload
     float alpha;
     int material_type;
     bool done;
+    float coneWidth;  // ray cone width at the ray origin (in), used for texture LOD
+    float coneSpread; // ray cone spread angle (in)
+    uint instanceId;  // top-level instance, triangle (mesh base + primitive) and material of the hit, for the ID AOV
+    uint primitiveId;
+    uint materialId;
 };
 
 const highp float M_PI = 3.14159265358979323846;
@@ -1,4 +1,6 @@
 %VULKAN_SDK%/Bin/glslc.exe --target-env=vulkan1.2 raygen.rgen -o raygen.rgen.spv
 %VULKAN_SDK%/Bin/glslc.exe --target-env=vulkan1.2 closesthit.rchit -o closesthit.rchit.spv
 %VULKAN_SDK%/Bin/glslc.exe --target-env=vulkan1.2 miss.rmiss -o miss.rmiss.spv
+%VULKAN_SDK%/Bin/glslc.exe --target-env=vulkan1.2 display.comp -o display.comp.spv
+%VULKAN_SDK%/Bin/glslc.exe --target-env=vulkan1.2 denoise.comp -o denoise.comp.spv
 pause
\ No newline at end of file
@@ -9,6 +9,7 @@ project "Pathtracer"
         "source/**.cpp",
         "source/**.hpp",
         "../extern/source/tinygltf/tiny_gltf.h",
+        "../extern/source/tinyobjloader/tiny_obj_loader.h",
         "../extern/source/stb/stb_image.h",
         "../extern/source/stb/stb_image_write.h",
         "../extern/source/json/json.hpp"
@@ -18,6 +19,7 @@ project "Pathtracer"
         "source",
         "../extern/source/glfw/include",
         "../extern/source/tinygltf",
+        "../extern/source/tinyobjloader",
         "../extern/source/stb",
         "../extern/source/json",
         "../extern/source",
@@ -29,6 +31,21 @@ project "Pathtracer"
         "glfw"
     }
     
+    -- SPIR-V is compiled from assets/shaders before every build (as compile.bat does), so it never lags the sources
+    local glslc = os.getenv("VULKAN_SDK") and (os.getenv("VULKAN_SDK") .. "/bin/glslc") or "glslc"
+    local shaderDir = path.getabsolute("../assets/shaders")
+    local shaders = {
+        "raygen.rgen",
+        "closesthit.rchit",
+        "miss.rmiss",
+        "display.comp",
+        "denoise.comp"
+    }
+    for _, shader in ipairs(shaders) do
+        local source = shaderDir .. "/" .. shader
+        prebuildcommands { '"' .. glslc .. '" --target-env=vulkan1.2 "' .. source .. '" -o "' .. source .. '.spv"' }
+    end
+    
     filter "system:windows"
         links {
             "opengl32",
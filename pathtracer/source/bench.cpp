@@ -0,0 +1,1104 @@
+#include "bench.h"
+#include "common.h"
+#include "core/allocator.h"
+#include "core/mipmap.h"
+#include "core/thread_pool.h"
+#include "math/half.h"
+#include "math/math_utils.h"
+#include "render/bvh.h"
+#include "render/denoiser.h"
+#include "render/display_transform.h"
+#include "render/gltf_accessor.h"
+#include "render/light_tree.h"
+#include "render/lights.h"
+#include "render/obj_loader.h"
+#include "render/scene_cache.h"
+#include "render/tangents.h"
+#include "render/vertex_format.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Peak resident set of the process so far. Mapped model files count while their pages are resident.
+    double peakMemoryMb() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        rusage usage = {};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+    }
+
+    // Cold load (glTF parse + emissive extraction) against a warm start from the binary cache
+    void benchSceneLoad(SceneData& scene, const std::vector<SceneObject>& objects, const std::string& modelDir) {
+        std::cout << "\n[Scene load]" << std::endl;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        loadScene(scene, objects, modelDir);
+        std::vector<EmissiveTriGPU> emissiveTris = buildEmissiveTriangles(scene);
+        double coldMs = millisecondsSince(start);
+        double coldPeakMb = peakMemoryMb();
+
+        std::string path = (std::filesystem::temp_directory_path() / "pathtracer_bench.cache").string();
+        start = std::chrono::high_resolution_clock::now();
+        uint64_t key = computeSceneCacheKey(objects, modelDir);
+        double keyMs = millisecondsSince(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        if (!writeSceneCache(path, key, scene, emissiveTris)) {
+            throw std::runtime_error("Failed to write " + path);
+        }
+        double writeMs = millisecondsSince(start);
+
+        double warmMs = 1e30;
+        for (int run = 0; run < 3; run++) {
+            SceneData cached;
+            std::vector<EmissiveTriGPU> cachedTris;
+            start = std::chrono::high_resolution_clock::now();
+            if (!readSceneCache(path, key, cached, cachedTris)) {
+                throw std::runtime_error("Failed to read back " + path);
+            }
+            warmMs = std::min(warmMs, millisecondsSince(start));
+
+            if (cached.vertices.size() != scene.vertices.size() || cached.indices != scene.indices ||
+                cached.textureFiles != scene.textureFiles || cachedTris.size() != emissiveTris.size() ||
+                cached.meshes.size() != scene.meshes.size() || cached.instances.size() != scene.instances.size()) {
+                throw std::runtime_error("Scene cache round trip mismatch");
+            }
+        }
+
+        std::error_code ec;
+        double cacheMb = std::filesystem::file_size(path, ec) / (1024.0 * 1024.0);
+        std::filesystem::remove(path, ec);
+
+        std::cout << "cold parse: " << coldMs << " ms, peak memory " << coldPeakMb << " MB" << std::endl;
+        std::cout << "warm start: " << keyMs + warmMs << " ms (key " << keyMs << " ms + read " << warmMs << " ms), "
+            << coldMs / (keyMs + warmMs) << "x faster" << std::endl;
+        std::cout << "cache file: " << cacheMb << " MB, written in " << writeMs << " ms" << std::endl;
+
+        SceneGeometrySize size = getSceneGeometrySize(scene);
+        std::cout << "instancing: " << scene.meshes.size() << " meshes, " << scene.instances.size() << " instances, "
+            << size.instancedBytes / (1024.0 * 1024.0) << " MB of geometry instead of " << size.flattenedBytes / (1024.0 * 1024.0)
+            << " MB flattened (" << (size.flattenedBytes - std::min(size.flattenedBytes, size.instancedBytes)) / (1024.0 * 1024.0)
+            << " MB saved)" << std::endl;
+    }
+
+    // Vertex welding and Morton reordering against the raw glTF data: vertex counts, and the locality of the
+    // closest-hit fetches (index triple, three vertices, face material) of primary rays traced in 8x8 tiles,
+    // counted as distinct 64-byte lines per tile the way a GPU wave would touch them
+    void benchMeshOptimization(const std::vector<SceneObject>& objects, const std::string& modelDir) {
+        std::cout << "\n[Mesh optimization]" << std::endl;
+        SceneData raw, optimized;
+        loadScene(raw, objects, modelDir, false);
+        loadScene(optimized, objects, modelDir, true);
+
+        struct Locality {
+            double linesPerTile = 0.0;
+            double linesPerHit = 0.0;
+        };
+        auto measure = [](const SceneData& scene) {
+            // Instances are copied in mesh order, so the flattened arrays have the meshes' layout
+            const SceneData world = flattenScene(scene);
+            Bvh bvh;
+            bvh.build(world.vertices, world.indices);
+            const Vec3 center = bvh.getNodes()[0].bounds.center();
+
+            const uint32_t size = 256, tileSize = 8;
+            const uint64_t INDEX_LINES = 1ull << 60, VERTEX_LINES = 2ull << 60, MATERIAL_LINES = 3ull << 60;
+            const Vec3 forwards[4] = { Vec3(1.0f, 0.0f, 0.0f), Vec3(-1.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 1.0f), Vec3(0.0f, 0.0f, -1.0f) };
+
+            uint64_t lines = 0, tiles = 0, hits = 0;
+            std::vector<uint64_t> touched;
+            for (const Vec3& forward : forwards) {
+                Vec3 right = normalize(cross(forward, Vec3(0.0f, 1.0f, 0.0f)));
+                Vec3 up = cross(right, forward);
+                for (uint32_t ty = 0; ty < size; ty += tileSize) {
+                    for (uint32_t tx = 0; tx < size; tx += tileSize) {
+                        touched.clear();
+                        for (uint32_t y = ty; y < ty + tileSize; y++) {
+                            for (uint32_t x = tx; x < tx + tileSize; x++) {
+                                Ray ray;
+                                ray.origin = center;
+                                ray.direction = normalize(forward + right * ((x + 0.5f) / size * 2.0f - 1.0f) + up * ((y + 0.5f) / size * 2.0f - 1.0f));
+                                RayHit hit;
+                                if (!bvh.intersect(ray, hit)) continue;
+                                hits++;
+
+                                uint64_t indexByte = 3ull * hit.primitive * sizeof(uint32_t);
+                                touched.push_back(INDEX_LINES | indexByte / 64);
+                                touched.push_back(INDEX_LINES | (indexByte + 3 * sizeof(uint32_t) - 1) / 64);
+                                for (uint32_t k = 0; k < 3; k++) {
+                                    uint64_t vertexByte = static_cast<uint64_t>(world.indices[3 * hit.primitive + k]) * sizeof(Vertex);
+                                    touched.push_back(VERTEX_LINES | vertexByte / 64);
+                                    touched.push_back(VERTEX_LINES | (vertexByte + sizeof(Vertex) - 1) / 64);
+                                }
+                                touched.push_back(MATERIAL_LINES | hit.primitive * sizeof(uint32_t) / 64);
+                            }
+                        }
+                        if (touched.empty()) continue;
+                        std::sort(touched.begin(), touched.end());
+                        lines += std::unique(touched.begin(), touched.end()) - touched.begin();
+                        tiles++;
+                    }
+                }
+            }
+
+            Locality locality;
+            locality.linesPerTile = tiles ? static_cast<double>(lines) / tiles : 0.0;
+            locality.linesPerHit = hits ? static_cast<double>(lines) / hits : 0.0;
+            return locality;
+        };
+
+        Locality before = measure(raw);
+        Locality after = measure(optimized);
+        std::cout << std::fixed << std::setprecision(2)
+            << "vertices:  " << raw.vertices.size() << " -> " << optimized.vertices.size() << " ("
+            << 100.0 * (1.0 - static_cast<double>(optimized.vertices.size()) / std::max<size_t>(raw.vertices.size(), 1)) << "% fewer)" << std::endl
+            << "locality:  " << before.linesPerTile << " -> " << after.linesPerTile << " cache lines per 8x8 tile ("
+            << before.linesPerHit << " -> " << after.linesPerHit << " per hit)" << std::defaultfloat << std::endl;
+    }
+
+    // Tangent generation for every mesh of the scene, one mesh after another and spread over the pool by mesh
+    // (as the loaders run it, per glTF primitive)
+    void benchTangentGeneration(const SceneData& scene) {
+        std::cout << "\n[Tangents] " << scene.meshes.size() << " meshes, " << scene.vertices.size() << " vertices, "
+            << scene.indices.size() / 3 << " triangles" << std::endl;
+
+        auto generate = [&](std::vector<Vertex>& vertices, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const MeshRange& mesh = scene.meshes[i];
+                generateTangents(vertices.data() + mesh.firstVertex, mesh.vertexCount, scene.indices.data() + mesh.firstIndex,
+                    mesh.indexCount, mesh.firstVertex);
+            }
+        };
+
+        std::vector<Vertex> serial, parallel;
+        double serialMs = 1e30, parallelMs = 1e30;
+        for (int run = 0; run < 3; run++) {
+            serial = scene.vertices;
+            auto start = std::chrono::high_resolution_clock::now();
+            generate(serial, 0, scene.meshes.size());
+            serialMs = std::min(serialMs, millisecondsSince(start));
+
+            parallel = scene.vertices;
+            start = std::chrono::high_resolution_clock::now();
+            ThreadPool::global().parallelFor(scene.meshes.size(), 1, [&](size_t begin, size_t end) { generate(parallel, begin, end); });
+            parallelMs = std::min(parallelMs, millisecondsSince(start));
+        }
+        if (!(serial == parallel)) {
+            throw std::runtime_error("Tangents differ between the serial and the parallel run");
+        }
+
+        std::cout << "one thread: " << serialMs << " ms, " << ThreadPool::global().size() << " threads: " << parallelMs << " ms ("
+            << scene.vertices.size() / std::max(parallelMs, 1e-3) / 1000.0 << " M vertices/s)" << std::endl;
+    }
+
+    // Round trip of the packed GPU vertex: bytes per vertex, pack time, and the error closesthit.rchit sees
+    // (normal/tangent angle in degrees, texture coordinates in texels of a 4096 texture)
+    void benchVertexPacking(const SceneData& scene) {
+        std::cout << "\n[Vertex packing]" << std::endl;
+
+        // Every finite half must survive half -> float -> half unchanged
+        uint32_t halfMismatches = 0;
+        for (uint32_t bits = 0; bits < 0x10000u; bits++) {
+            if ((bits & 0x7C00u) == 0x7C00u && (bits & 0x3FFu)) continue;
+            if (floatToHalf(halfToFloat(static_cast<uint16_t>(bits))) != bits) halfMismatches++;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<PackedVertex> packed = packVertices(scene.vertices);
+        double packMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        // atan2 keeps its precision for tiny angles, where acos of a float dot product does not
+        auto angleDegrees = [](const Vec3& a, const Vec3& b) {
+            return degrees(std::atan2(cross(a, b).length(), dot(a, b)));
+        };
+
+        double maxNormal = 0.0, sumNormal = 0.0, maxTangent = 0.0, maxTexel = 0.0;
+        uint64_t positionMismatches = 0, directions = 0;
+        for (size_t i = 0; i < scene.vertices.size(); i++) {
+            const Vertex& original = scene.vertices[i];
+            const Vertex decoded = unpackVertex(packed[i]);
+            if (!(decoded.position == original.position)) positionMismatches++;
+            if (original.normal.lengthSquared() > 0.0f) {
+                double normalError = angleDegrees(original.normal, decoded.normal);
+                maxNormal = std::max(maxNormal, normalError);
+                sumNormal += normalError;
+                directions++;
+            }
+            if (original.tangent.lengthSquared() > 0.0f) {
+                maxTangent = std::max(maxTangent, static_cast<double>(angleDegrees(original.tangent, decoded.tangent)));
+            }
+            for (int k = 0; k < 2; k++) {
+                maxTexel = std::max(maxTexel, 4096.0 * std::abs(decoded.texCoord[k] - original.texCoord[k]));
+            }
+        }
+
+        std::cout << std::fixed << std::setprecision(4)
+            << "size:     " << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " bytes per vertex, "
+            << scene.vertices.size() * sizeof(Vertex) / (1024.0 * 1024.0) << " -> "
+            << packed.size() * sizeof(PackedVertex) / (1024.0 * 1024.0) << " MB, packed in " << packMs << " ms" << std::endl
+            << "normal:   max " << maxNormal << " deg, mean " << (directions ? sumNormal / directions : 0.0) << " deg" << std::endl
+            << "tangent:  max " << maxTangent << " deg" << std::endl
+            << "uv:       max " << maxTexel << " texels at 4096" << std::endl
+            << "exact:    " << positionMismatches << " position mismatches, " << halfMismatches << " half round-trip mismatches"
+            << std::defaultfloat << std::endl;
+    }
+
+    // Build time and tree quality of the SAH builder for 1, 2, 4, ... threads
+    void benchBvhBuild(const SceneData& scene) {
+        const uint32_t triCount = static_cast<uint32_t>(scene.indices.size() / 3);
+        const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::cout << "\n[BVH build] " << triCount << " triangles" << std::endl;
+        std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup"
+            << std::setw(12) << "Mtris/s" << std::setw(10) << "SAH" << std::setw(10) << "nodes" << std::setw(8) << "depth" << std::endl;
+
+        double singleThreadMs = 0.0;
+        for (uint32_t threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+            ThreadPool pool(threads);
+            Bvh bvh;
+
+            // Best of three to keep page faults and frequency ramp-up out of the numbers
+            BvhBuildStats best;
+            best.buildMs = 1e30;
+            for (int run = 0; run < 3; run++) {
+                bvh.build(scene.vertices, scene.indices, pool);
+                if (bvh.getBuildStats().buildMs < best.buildMs) best = bvh.getBuildStats();
+            }
+            if (threads == 1) singleThreadMs = best.buildMs;
+
+            std::cout << std::fixed << std::setprecision(2)
+                << std::setw(8) << threads
+                << std::setw(12) << best.buildMs
+                << std::setw(10) << singleThreadMs / best.buildMs
+                << std::setw(12) << triCount / (best.buildMs * 1e3)
+                << std::setw(10) << best.sahCost
+                << std::setw(10) << best.nodeCount
+                << std::setw(8) << best.maxDepth << std::endl;
+
+            if (threads == maxThreads) break;
+        }
+        std::cout << std::defaultfloat;
+    }
+
+    // Bulk accessor conversion against a per-element loop like the one the loader used, in GB/s of source data.
+    // The results must match the scalar reference exactly.
+    void benchAccessorDecode() {
+        const size_t bytes = 64ull << 20;
+        std::vector<uint8_t> source(bytes);
+        uint32_t state = 7u;
+        for (uint8_t& b : source) {
+            state = state * 1664525u + 1013904223u;
+            b = static_cast<uint8_t>(state >> 24);
+        }
+
+        std::cout << "\n[glTF accessors] " << (bytes >> 20) << " MB per run" << std::endl;
+        std::cout << std::setw(20) << "data" << std::setw(14) << "loop GB/s" << std::setw(14) << "bulk GB/s" << std::endl;
+
+        auto bestSeconds = [](const std::function<void()>& func) {
+            double bestMs = 1e30;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                func();
+                bestMs = std::min(bestMs, millisecondsSince(start));
+            }
+            return bestMs / 1000.0;
+        };
+        auto report = [&](const char* name, double loopSeconds, double bulkSeconds, bool match) {
+            std::cout << std::fixed << std::setprecision(2)
+                << std::setw(20) << name << std::setw(14) << bytes / loopSeconds / 1e9 << std::setw(14) << bytes / bulkSeconds / 1e9
+                << (match ? "" : "  MISMATCH") << std::defaultfloat << std::endl;
+        };
+
+        struct IndexCase { const char* name; ComponentType type; };
+        for (const IndexCase& c : { IndexCase{ "indices u8", ComponentType::UnsignedByte },
+                                    IndexCase{ "indices u16", ComponentType::UnsignedShort },
+                                    IndexCase{ "indices u32", ComponentType::UnsignedInt } }) {
+            const size_t size = componentSize(static_cast<uint32_t>(c.type));
+            const size_t count = bytes / size;
+            std::vector<uint32_t> loop(count), bulk(count);
+            double loopSeconds = bestSeconds([&] {
+                for (size_t i = 0; i < count; i++) {
+                    if (c.type == ComponentType::UnsignedByte) loop[i] = 100u + source[i];
+                    else if (c.type == ComponentType::UnsignedShort) loop[i] = 100u + reinterpret_cast<const uint16_t*>(source.data())[i];
+                    else loop[i] = 100u + reinterpret_cast<const uint32_t*>(source.data())[i];
+                }
+            });
+            double bulkSeconds = bestSeconds([&] {
+                convertIndices(source.data(), count, static_cast<uint32_t>(c.type), 100u, bulk.data());
+            });
+            report(c.name, loopSeconds, bulkSeconds, loop == bulk);
+        }
+
+        // Normalized types of KHR_mesh_quantization (normals, tangents, texture coordinates)
+        struct AttributeCase { const char* name; ComponentType type; float scale; bool isSigned; };
+        for (const AttributeCase& c : { AttributeCase{ "snorm8", ComponentType::Byte, 1.0f / 127.0f, true },
+                                        AttributeCase{ "unorm8", ComponentType::UnsignedByte, 1.0f / 255.0f, false },
+                                        AttributeCase{ "snorm16", ComponentType::Short, 1.0f / 32767.0f, true },
+                                        AttributeCase{ "unorm16", ComponentType::UnsignedShort, 1.0f / 65535.0f, false } }) {
+            const size_t size = componentSize(static_cast<uint32_t>(c.type));
+            const size_t count = bytes / size;
+            std::vector<float> loop(count), bulk(count);
+            double loopSeconds = bestSeconds([&] {
+                for (size_t i = 0; i < count; i++) {
+                    float value;
+                    if (c.type == ComponentType::Byte) value = static_cast<float>(reinterpret_cast<const int8_t*>(source.data())[i]);
+                    else if (c.type == ComponentType::UnsignedByte) value = static_cast<float>(source[i]);
+                    else if (c.type == ComponentType::Short) value = static_cast<float>(reinterpret_cast<const int16_t*>(source.data())[i]);
+                    else value = static_cast<float>(reinterpret_cast<const uint16_t*>(source.data())[i]);
+                    loop[i] = c.isSigned ? std::max(value * c.scale, -1.0f) : value * c.scale;
+                }
+            });
+            double bulkSeconds = bestSeconds([&] {
+                convertComponents(source.data(), count, static_cast<uint32_t>(c.type), true, bulk.data());
+            });
+            report(c.name, loopSeconds, bulkSeconds, loop == bulk);
+        }
+    }
+
+    // OBJ import of a generated wavy grid with positions, texture coordinates and normals (all three sharing
+    // their index, as scans are written) and one without any, as MB of text per second
+    void benchObjImport() {
+        const int size = 700;
+        std::cout << "\n[OBJ import] " << size << "x" << size << " grid, " << ThreadPool::global().size() << " threads" << std::endl;
+        std::cout << std::setw(20) << "file" << std::setw(10) << "MB" << std::setw(14) << "parse MB/s" << std::setw(14) << "total MB/s"
+            << std::setw(12) << "vertices" << std::setw(12) << "triangles" << std::endl;
+
+        for (bool attributes : { true, false }) {
+            const std::string path = (std::filesystem::temp_directory_path() /
+                (attributes ? "pathtracer_bench_full.obj" : "pathtracer_bench_plain.obj")).string();
+            {
+                std::ofstream file(path, std::ios::binary);
+                file << std::fixed << std::setprecision(6);
+                auto height = [&](int i, int j) { return 0.3f * std::sin(i * 0.05f) * std::cos(j * 0.05f); };
+                for (int j = 0; j < size; j++) {
+                    for (int i = 0; i < size; i++) file << "v " << i * 0.01f << " " << height(i, j) << " " << j * 0.01f << "\n";
+                }
+                if (attributes) {
+                    for (int j = 0; j < size; j++) {
+                        for (int i = 0; i < size; i++) file << "vt " << i / (size - 1.0f) << " " << j / (size - 1.0f) << "\n";
+                    }
+                    for (int j = 0; j < size; j++) {
+                        for (int i = 0; i < size; i++) {
+                            Vec3 n = normalize(Vec3(height(i, j) - height(i + 1, j), 0.01f, height(i, j) - height(i, j + 1)));
+                            file << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+                        }
+                    }
+                }
+                for (int j = 0; j + 1 < size; j++) {
+                    for (int i = 0; i + 1 < size; i++) {
+                        const int a = j * size + i + 1, b = a + 1, c = a + size + 1, d = a + size;
+                        if (attributes) {
+                            file << "f " << a << "/" << a << "/" << a << " " << d << "/" << d << "/" << d << " "
+                                << c << "/" << c << "/" << c << " " << b << "/" << b << "/" << b << "\n";
+                        } else {
+                            file << "f " << a << " " << d << " " << c << " " << b << "\n";
+                        }
+                    }
+                }
+                if (!file) throw std::runtime_error("Failed to write " + path);
+            }
+
+            double parseMs = 1e30, totalMs = 1e30;
+            size_t fileSize = 0;
+            ModelLayout layout;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                ObjFile obj(path);
+                parseMs = std::min(parseMs, millisecondsSince(start));
+
+                layout = obj.getLayout();
+                std::vector<Vertex> vertices(layout.vertexCount);
+                std::vector<uint32_t> indices(layout.indexCount), faceMaterials(layout.indexCount / 3);
+                obj.decode(vertices.data(), indices.data(), faceMaterials.data(), 0, 0);
+                totalMs = std::min(totalMs, millisecondsSince(start));
+                fileSize = obj.getFileSize();
+            }
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+
+            if (layout.vertexCount != static_cast<uint32_t>(size * size) || layout.indexCount != 6u * (size - 1) * (size - 1)) {
+                throw std::runtime_error("OBJ import produced the wrong vertex or triangle count");
+            }
+            const double mb = fileSize / (1024.0 * 1024.0);
+            std::cout << std::fixed << std::setprecision(1)
+                << std::setw(20) << (attributes ? "v/vt/vn" : "positions only") << std::setw(10) << mb
+                << std::setw(14) << mb / (parseMs / 1000.0) << std::setw(14) << mb / (totalMs / 1000.0)
+                << std::setw(12) << layout.vertexCount << std::setw(12) << layout.indexCount / 3 << std::defaultfloat << std::endl;
+        }
+    }
+
+    // Host mip generation throughput, counted in source pixels read
+    void benchMipmaps() {
+        const uint32_t size = 4096;
+        std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+        uint32_t state = 1u;
+        for (uint8_t& p : pixels) {
+            state = state * 1664525u + 1013904223u;
+            p = static_cast<uint8_t>(state >> 24);
+        }
+        std::vector<uint8_t> half(pixels.size() / 4);
+        const double megapixels = double(size) * size / 1e6;
+
+        std::cout << "\n[Mipmaps] " << size << "x" << size << " RGBA8" << std::endl;
+        std::cout << std::setw(16) << "filter" << std::setw(12) << "ms" << std::setw(12) << "MPix/s" << std::endl;
+
+        auto report = [&](const char* name, double ms) {
+            std::cout << std::fixed << std::setprecision(2)
+                << std::setw(16) << name << std::setw(12) << ms << std::setw(12) << megapixels / (ms / 1000.0)
+                << std::defaultfloat << std::endl;
+        };
+
+        for (bool srgb : { false, true }) {
+            double bestMs = 1e30;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                downsampleRgba8(pixels.data(), size, size, half.data(), srgb);
+                bestMs = std::min(bestMs, millisecondsSince(start));
+            }
+            report(srgb ? "box sRGB" : "box linear", bestMs);
+        }
+
+        // The whole chain reads ~1.33x the base level
+        auto start = std::chrono::high_resolution_clock::now();
+        MipChain chain = generateMipChain(pixels.data(), size, size, true);
+        report("chain sRGB", millisecondsSince(start));
+        if (chain.levels.size() + 1 != mipLevelCount(size, size)) {
+            throw std::runtime_error("Unexpected mip level count");
+        }
+    }
+
+    // TLSF throughput and fragmentation under a device-memory-like churn: log-uniform sizes from 256 B to 4 MB,
+    // Vulkan-like alignments, the heap kept around 75% full while random allocations are replaced
+    void benchAllocator() {
+        const uint64_t heapSize = 256ull * 1024 * 1024;
+        const uint64_t targetUsed = heapSize * 3 / 4;
+        const uint32_t churnCount = 1000000;
+        const uint64_t alignments[] = { 16, 256, 4096, 65536 };
+
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        auto next = [&] {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        auto randomSize = [&] {
+            double t = (next() >> 11) * (1.0 / 9007199254740992.0);
+            return static_cast<uint64_t>(256.0 * std::pow(16384.0, t));
+        };
+
+        TlsfAllocator allocator(heapSize);
+        std::vector<uint64_t> live;
+        uint64_t failed = 0;
+        auto allocateOne = [&] {
+            uint64_t offset = allocator.allocate(randomSize(), alignments[next() % 4]);
+            if (offset == TlsfAllocator::INVALID_OFFSET) failed++;
+            else live.push_back(offset);
+        };
+
+        while (allocator.getUsedSize() < targetUsed) allocateOne();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < churnCount; i++) {
+            if (allocator.getUsedSize() < targetUsed || live.empty()) {
+                allocateOne();
+            }
+            else {
+                size_t index = next() % live.size();
+                allocator.free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        double churnMs = millisecondsSince(start);
+
+        std::cout << "\n[Allocator] TLSF, " << heapSize / (1024 * 1024) << " MB heap, " << churnCount << " operations" << std::endl;
+        std::cout << std::fixed << std::setprecision(2)
+            << "throughput:    " << churnCount / (churnMs * 1e3) << " Mops/s (" << churnMs * 1e6 / churnCount << " ns/op)" << std::endl
+            << "live:          " << allocator.getAllocationCount() << " allocations, "
+            << 100.0 * allocator.getUsedSize() / heapSize << "% of the heap" << std::endl
+            << "fragmentation: " << 100.0 * allocator.getFragmentation() << "% (largest free "
+            << allocator.getLargestFreeBlock() / 1024 << " KB in " << allocator.getFreeBlockCount() << " free blocks)" << std::endl
+            << "failed:        " << failed << " allocations" << std::defaultfloat << std::endl;
+    }
+
+    // The running average raygen.rgen keeps in the accumulation image, stored at each precision after every frame:
+    // error against a double average of the same samples over 10k frames. Per-pixel means are log-uniform over
+    // four decades with exponentially distributed samples, a rough stand-in for path traced radiance.
+    void benchAccumulationPrecision() {
+        const uint32_t pixelCount = 1024;
+        const int frameCount = 10000;
+        std::cout << "\n[Accumulation precision] " << pixelCount << " pixels, " << frameCount << " frames" << std::endl;
+
+        struct Precision {
+            const char* name;
+            uint32_t bytesPerPixel;
+            std::function<float(float)> store;
+        };
+        const Precision precisions[] = {
+            { "rgba32f", 16, [](float v) { return v; } },
+            { "rgba16f", 8, [](float v) { return halfToFloat(floatToHalf(v)); } },
+            { "rgba8", 4, [](float v) { return std::round(std::min(std::max(v, 0.0f), 1.0f) * 255.0f) / 255.0f; } },
+        };
+        const size_t precisionCount = sizeof(precisions) / sizeof(precisions[0]);
+
+        std::vector<double> means(pixelCount);
+        uint64_t state = 0x2545F4914F6CDD1Dull;
+        auto uniform = [&] {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return (static_cast<double>(state >> 11) + 0.5) / 9007199254740992.0;
+        };
+        for (double& mean : means) mean = std::pow(10.0, 4.0 * uniform() - 2.0);
+
+        std::vector<double> reference(pixelCount, 0.0);
+        std::vector<float> stored(pixelCount * precisionCount, 0.0f);
+
+        std::cout << std::setw(8) << "frames";
+        for (const Precision& precision : precisions) std::cout << std::setw(14) << precision.name << " rms" << std::setw(12) << "max";
+        std::cout << "  (relative error)" << std::endl;
+
+        std::vector<double> finalRms(precisionCount);
+        for (int frame = 0; frame < frameCount; frame++) {
+            for (uint32_t i = 0; i < pixelCount; i++) {
+                const float sample = static_cast<float>(-std::log(uniform()) * means[i]);
+                reference[i] += (sample - reference[i]) / (frame + 1);
+                for (size_t p = 0; p < precisionCount; p++) {
+                    float& value = stored[i * precisionCount + p];
+                    value = precisions[p].store((value * static_cast<float>(frame) + sample) / static_cast<float>(frame + 1));
+                }
+            }
+
+            const int frames = frame + 1;
+            if (frames != 10 && frames != 100 && frames != 1000 && frames != frameCount) continue;
+            std::cout << std::setw(8) << frames << std::scientific << std::setprecision(2);
+            for (size_t p = 0; p < precisionCount; p++) {
+                double sumSquared = 0.0, maxError = 0.0;
+                for (uint32_t i = 0; i < pixelCount; i++) {
+                    double error = std::fabs(stored[i * precisionCount + p] - reference[i]) / reference[i];
+                    sumSquared += error * error;
+                    maxError = std::max(maxError, error);
+                }
+                finalRms[p] = std::sqrt(sumSquared / pixelCount);
+                std::cout << std::setw(18) << finalRms[p] << std::setw(12) << maxError;
+            }
+            std::cout << std::defaultfloat << std::endl;
+        }
+
+        std::cout << "bandwidth: ";
+        for (const Precision& precision : precisions) {
+            std::cout << precision.name << " " << 2.0 * precision.bytesPerPixel * WIDTH * HEIGHT / (1024.0 * 1024.0) << " MB  ";
+        }
+        std::cout << "read + written per frame at " << WIDTH << "x" << HEIGHT << std::endl;
+
+        if (finalRms[0] > 1e-4) {
+            throw std::runtime_error("The float running average drifted from the exact mean");
+        }
+    }
+
+    // CPU display transform (the offline writer's copy of display.comp): throughput per tonemap, curves that
+    // never decrease with brightness, and dithering that doesn't shift the mean level of a flat area
+    void benchDisplayTransform() {
+        const uint32_t width = WIDTH, height = HEIGHT;
+        std::cout << "\n[Display transform] " << width << "x" << height << " over " << ThreadPool::global().size() << " threads" << std::endl;
+
+        std::vector<float> image(static_cast<size_t>(width) * height * 4);
+        uint32_t state = 7u;
+        for (size_t i = 0; i < image.size(); i++) {
+            state = state * 1664525u + 1013904223u;
+            image[i] = (i % 4 == 3) ? 1.0f : std::exp2(static_cast<float>(state >> 8) / 16777216.0f * 16.0f - 10.0f);
+        }
+
+        const std::pair<const char*, Tonemap> tonemaps[] = { { "clamp", Tonemap::Clamp }, { "aces", Tonemap::Aces }, { "agx", Tonemap::AgX } };
+        for (const auto& [name, tonemap] : tonemaps) {
+            DisplaySettings settings;
+            settings.tonemap = tonemap;
+            double bestMs = 1e30;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                std::vector<uint8_t> display = applyDisplayTransform(image.data(), width, height, settings);
+                bestMs = std::min(bestMs, millisecondsSince(start));
+            }
+
+            // Gray ramp over 20 stops
+            float previous = -1.0f;
+            for (int step = 0; step <= 2000; step++) {
+                float value = applyTonemap(Vec3(std::exp2(step / 100.0f - 12.0f)), tonemap).x;
+                if (value < previous) {
+                    throw std::runtime_error(std::string("The ") + name + " tonemap curve decreases");
+                }
+                previous = value;
+            }
+
+            std::cout << std::fixed << std::setprecision(2) << std::setw(8) << name << std::setw(10) << bestMs << " ms "
+                << std::setw(10) << double(width) * height / 1e3 / bestMs << " MPix/s, mid gray 0.18 -> "
+                << applyTonemap(Vec3(0.18f), tonemap).x << std::defaultfloat << std::endl;
+        }
+
+        // A flat area between two levels: dithered pixels average back to it, plain rounding doesn't
+        const float flat = 0.3f;
+        std::vector<float> flatImage(256 * 256 * 4, flat);
+        DisplaySettings settings;
+        settings.tonemap = Tonemap::Clamp;
+        std::vector<uint8_t> dithered = applyDisplayTransform(flatImage.data(), 256, 256, settings);
+        settings.dither = false;
+        std::vector<uint8_t> rounded = applyDisplayTransform(flatImage.data(), 256, 256, settings);
+        double ditheredMean = 0.0;
+        for (size_t i = 0; i < dithered.size(); i += 4) ditheredMean += dithered[i];
+        ditheredMean /= dithered.size() / 4;
+        const double exact = linearToSrgb(flat) * 255.0;
+        std::cout << std::fixed << std::setprecision(3) << "dither:  level " << exact << ", dithered mean " << ditheredMean
+            << ", rounded " << int(rounded[0]) << std::defaultfloat << std::endl;
+        if (std::fabs(ditheredMean - exact) > 0.05) {
+            throw std::runtime_error("Dithering shifts the mean display level");
+        }
+    }
+
+    // A view with known radiance, traced the way raygen.rgen accumulates it: a checkered floor receding to the horizon,
+    // a back wall and a sphere in front of it under smooth lighting. Every frame's illumination is the true one times
+    // exponential noise (mean 1, like a path traced estimate); the guides are exact.
+    DenoiserInputs makeSyntheticDenoiserInputs(uint32_t width, uint32_t height, int frames) {
+        DenoiserInputs inputs;
+        inputs.width = width;
+        inputs.height = height;
+        inputs.frameCount = frames;
+        const size_t size = static_cast<size_t>(width) * height * 4;
+        inputs.accum.assign(size, 0.0f);
+        inputs.normalDepth.assign(size, 0.0f);
+        inputs.albedo.assign(size, 0.0f);
+        inputs.reference.assign(size, 0.0f);
+
+        std::vector<float> lighting(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const size_t p = static_cast<size_t>(y) * width + x;
+                const size_t i = p * 4;
+                float normal[3] = { 0.0f, 0.0f, 1.0f };
+                float depth = 10.0f;
+                float albedo[3] = { 0.6f, 0.6f, 0.6f };
+
+                const float horizon = height * 0.5f;
+                const float dx = (x - width * 0.5f) / (height * 0.25f);
+                const float dy = (y - horizon * 0.8f) / (height * 0.25f);
+                if (dx * dx + dy * dy < 1.0f) {
+                    normal[0] = dx;
+                    normal[1] = -dy;
+                    normal[2] = std::sqrt(1.0f - dx * dx - dy * dy);
+                    depth = 5.0f - normal[2];
+                    albedo[0] = 0.9f, albedo[1] = 0.3f, albedo[2] = 0.2f;
+                }
+                else if (y > horizon) {
+                    normal[0] = 0.0f, normal[1] = 1.0f, normal[2] = 0.0f;
+                    depth = 2.0f * horizon / (y - horizon);
+                    // Checkers of one unit on the floor
+                    const float u = (x - width * 0.5f) * depth / horizon;
+                    const bool dark = (static_cast<int>(std::floor(u)) + static_cast<int>(std::floor(depth))) & 1;
+                    albedo[0] = albedo[1] = albedo[2] = dark ? 0.1f : 0.8f;
+                }
+
+                for (int c = 0; c < 3; c++) {
+                    inputs.normalDepth[i + c] = normal[c];
+                    inputs.albedo[i + c] = albedo[c];
+                }
+                inputs.normalDepth[i + 3] = depth;
+                lighting[p] = 1.0f + 0.6f * std::sin(x / 40.0f) * std::cos(y / 30.0f);
+                for (int c = 0; c < 3; c++) {
+                    inputs.reference[i + c] = albedo[c] * lighting[p];
+                }
+                inputs.reference[i + 3] = 1.0f;
+            }
+        }
+
+        uint64_t state = 0x853C49E6748FEA9Bull;
+        for (int frame = 0; frame < frames; frame++) {
+            for (size_t p = 0; p < lighting.size(); p++) {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                const float u = (static_cast<float>(state >> 40) + 0.5f) / 16777216.0f;
+                const float illumination = lighting[p] * -std::log(u);
+                const size_t i = p * 4;
+                const float sample[4] = { illumination * inputs.albedo[i], illumination * inputs.albedo[i + 1],
+                    illumination * inputs.albedo[i + 2], std::min(illumination * illumination, 60000.0f) };
+                for (int c = 0; c < 4; c++) {
+                    inputs.accum[i + c] = (inputs.accum[i + c] * frame + sample[c]) / (frame + 1);
+                }
+                inputs.albedo[i + 3] = (inputs.albedo[i + 3] * frame + illumination) / (frame + 1);
+            }
+        }
+        return inputs;
+    }
+
+    // Mean relative squared error of the rgb channels, the usual denoiser metric: dark areas count as much as bright
+    double relativeMse(const std::vector<float>& image, const std::vector<float>& reference) {
+        double sum = 0.0;
+        for (size_t i = 0; i < image.size(); i++) {
+            if (i % 4 == 3) continue;
+            const double difference = image[i] - reference[i];
+            sum += difference * difference / (static_cast<double>(reference[i]) * reference[i] + 1e-2);
+        }
+        return sum / (image.size() / 4 * 3);
+    }
+
+    // Error against time for 1 to 5 iterations. The input's error falls as 1 / frames, so the ratio of the errors is
+    // the factor of frames the filter saves.
+    void benchDenoiserOn(const std::string& name, const DenoiserInputs& inputs) {
+        std::cout << std::setprecision(3) << name << ": " << inputs.width << "x" << inputs.height << ", " << inputs.frameCount << " frames";
+        const bool hasReference = !inputs.reference.empty();
+        const double inputError = hasReference ? relativeMse(inputs.accum, inputs.reference) : 0.0;
+        if (hasReference) std::cout << ", input relMSE " << inputError;
+        std::cout << std::endl;
+
+        for (int iterations = 1; iterations <= 5; iterations++) {
+            DenoiserSettings settings;
+            settings.iterations = iterations;
+            double bestMs = 1e30;
+            std::vector<float> first, denoised;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                denoised = denoise(inputs, settings);
+                bestMs = std::min(bestMs, millisecondsSince(start));
+                if (run == 0) first = denoised;
+            }
+            // Rows run on the pool, but every pixel is computed the same way whichever thread takes it
+            if (std::memcmp(first.data(), denoised.data(), first.size() * sizeof(float)) != 0) {
+                throw std::runtime_error("The denoiser reference isn't deterministic");
+            }
+
+            std::cout << std::fixed << std::setprecision(2) << "  " << iterations << " iterations " << std::setw(9) << bestMs << " ms"
+                << std::defaultfloat << std::setprecision(3);
+            if (hasReference) {
+                const double error = relativeMse(denoised, inputs.reference);
+                std::cout << ", relMSE " << error << " (" << inputError / error << "x fewer frames)";
+                if (iterations == 5 && error >= inputError) {
+                    throw std::runtime_error("Denoising " + name + " increases its error");
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    void benchDenoiser(const std::vector<std::string>& inputPaths) {
+        std::cout << "\n[Denoiser] CPU reference over " << ThreadPool::global().size() << " threads" << std::endl;
+        if (inputPaths.empty()) {
+            for (int frames : { 1, 4, 16 }) {
+                benchDenoiserOn("synthetic", makeSyntheticDenoiserInputs(640, 360, frames));
+            }
+        }
+        for (const std::string& path : inputPaths) {
+            benchDenoiserOn(path, readDenoiserInputs(path));
+        }
+        std::cout << std::setprecision(6);
+    }
+
+    // Alias table build (one thread against the pool), sampling cost against the CDF binary search it replaced,
+    // and a chi-square test of alias samples against the CDF's probabilities
+    void benchLightSampling(const std::string& name, const std::vector<double>& weights) {
+        const size_t n = weights.size();
+        std::cout << "\n[Light sampling] " << name << ", " << n << " emissive triangles" << std::endl;
+        if (n == 0) return;
+
+        double singleMs = 1e30, parallelMs = 1e30;
+        std::vector<EmissiveAliasEntry> table;
+        {
+            ThreadPool single(1);
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                table = buildEmissiveAliasTable(weights, single);
+                singleMs = std::min(singleMs, millisecondsSince(start));
+            }
+        }
+        for (int run = 0; run < 3; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            table = buildEmissiveAliasTable(weights);
+            parallelMs = std::min(parallelMs, millisecondsSince(start));
+        }
+
+        // The distribution a table encodes can be read back exactly: every bucket hands 1 - probability to its alias
+        double total = 0.0;
+        for (double w : weights) total += w;
+        std::vector<double> implied(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            implied[i] += table[i].probability;
+            implied[table[i].alias] += 1.0 - table[i].probability;
+        }
+        double maxError = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            maxError = std::max(maxError, std::fabs(implied[i] / n - weights[i] / total) * n);
+        }
+
+        // The CDF the alias table replaced, built from the same weights
+        std::vector<float> cdf(n);
+        double accum = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            accum += weights[i];
+            cdf[i] = static_cast<float>(accum / total);
+        }
+        auto sampleCdf = [&](float r) {
+            return static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end() - 1, r) - cdf.begin());
+        };
+
+        const uint32_t sampleCount = 20000000;
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        auto random = [&] {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return static_cast<float>(state >> 40) * (1.0f / 16777216.0f);
+        };
+
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t checksum = 0;
+        for (uint32_t s = 0; s < sampleCount; s++) checksum += sampleCdf(random());
+        double cdfMs = millisecondsSince(start);
+
+        std::vector<uint32_t> counts(n, 0);
+        start = std::chrono::high_resolution_clock::now();
+        for (uint32_t s = 0; s < sampleCount; s++) {
+            float pdf;
+            float u = random();
+            counts[sampleEmissiveAlias(table, u, random(), pdf)]++;
+        }
+        double aliasMs = millisecondsSince(start);
+
+        // Neighbouring triangles are merged into bins of at least 100 expected samples, enough that the
+        // rounding of the float CDF itself stays well below the sampling noise
+        double chiSquare = 0.0;
+        uint32_t bins = 0;
+        double expected = 0.0, observed = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            double p = cdf[i] - (i > 0 ? cdf[i - 1] : 0.0f);
+            expected += p * sampleCount;
+            observed += counts[i];
+            if (expected >= 100.0 || i + 1 == n) {
+                if (expected > 0.0) {
+                    chiSquare += (observed - expected) * (observed - expected) / expected;
+                    bins++;
+                }
+                expected = observed = 0.0;
+            }
+        }
+        const double dof = std::max(1.0, bins - 1.0);
+        // Wilson-Hilferty: chi-square over dof is close to normal with mean 1 - 2/(9 dof)
+        const double z = (std::cbrt(chiSquare / dof) - (1.0 - 2.0 / (9.0 * dof))) / std::sqrt(2.0 / (9.0 * dof));
+
+        std::cout << std::fixed << std::setprecision(2)
+            << "build:       " << singleMs << " ms on 1 thread, " << parallelMs << " ms on " << ThreadPool::global().size()
+            << " threads (" << singleMs / parallelMs << "x)" << std::endl
+            << "sampling:    CDF " << cdfMs * 1e6 / sampleCount << " ns, alias " << aliasMs * 1e6 / sampleCount
+            << " ns per sample (" << cdfMs / aliasMs << "x)" << std::endl
+            << std::defaultfloat
+            << "table error: " << maxError << " (largest bucket mass off the weights)" << std::endl
+            << "chi-square:  " << chiSquare << " over " << bins - 1 << " dof, z = " << z << " (checksum " << checksum % 10 << ")" << std::endl;
+
+        if (maxError > 1e-5 || z > 5.0) {
+            throw std::runtime_error("Alias table does not reproduce the emissive distribution");
+        }
+    }
+
+    // Next-event estimation at random surface points with the power-only alias table against the light tree:
+    // per-point variance of a diffuse direct lighting estimate (with shadow rays), agreement of the means
+    // and the normalization of the tree's pdf
+    void benchLightTree(const SceneData& scene, const std::vector<EmissiveTriGPU>& emissiveTris) {
+        const uint32_t lightCount = static_cast<uint32_t>(emissiveTris.size());
+        std::cout << "\n[Light tree] " << lightCount << " emissive triangles" << std::endl;
+        if (lightCount == 0) return;
+
+        LightTree tree;
+        tree.build(emissiveTris);
+        const LightTreeBuildStats& treeStats = tree.getBuildStats();
+        std::vector<EmissiveAliasEntry> table = buildEmissiveAliasTable(emissiveTris);
+
+        Bvh bvh;
+        bvh.build(scene.vertices, scene.indices);
+
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        auto random = [&] {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return static_cast<float>(state >> 40) * (1.0f / 16777216.0f);
+        };
+        auto position = [](const float* v) { return Vec3(v[0], v[1], v[2]); };
+
+        // Lambertian surface with unit albedo, so the estimate is irradiance / pi
+        auto estimate = [&](const Vec3& p, const Vec3& n, int light, float pdf) {
+            if (light < 0 || pdf <= 0.0f) return 0.0;
+            const EmissiveTriGPU& et = emissiveTris[light];
+            float sr1 = std::sqrt(random());
+            float b1 = random() * sr1;
+            Vec3 pOnLight = position(et.v0) * (1.0f - sr1) + position(et.v1) * b1 + position(et.v2) * (sr1 - b1);
+
+            Vec3 toLight = pOnLight - p;
+            float dist2 = dot(toLight, toLight);
+            if (dist2 <= 0.0f) return 0.0;
+            Vec3 l = toLight / std::sqrt(dist2);
+            float cosSurface = dot(n, l);
+            float cosLight = -dot(position(et.normal), l);
+            if (cosSurface <= 0.0f || cosLight <= 0.0f) return 0.0;
+
+            const float eps = 1e-4f;
+            Ray shadow;
+            shadow.origin = p + n * eps;
+            shadow.direction = l;
+            shadow.tMin = 0.0f;
+            shadow.tMax = std::sqrt(dist2) - 2.0f * eps;
+            if (bvh.occluded(shadow, false)) return 0.0;
+
+            float lum = 0.2126f * et.emission[0] + 0.7152f * et.emission[1] + 0.0722f * et.emission[2];
+            return static_cast<double>(lum) * cosSurface * cosLight / dist2 * et.area[0] / pdf / 3.14159265358979;
+        };
+
+        const uint32_t pointCount = 512;
+        const uint32_t samplesPerPoint = 64;
+        const uint32_t triCount = static_cast<uint32_t>(scene.indices.size() / 3);
+        double varianceAlias = 0.0, varianceTree = 0.0;
+        double sumAlias = 0.0, sumTree = 0.0;
+        double maxPdfSum = 0.0, maxPdfMismatch = 0.0;
+        uint32_t litPoints = 0, treeMisses = 0;
+        double aliasMs = 0.0, treeMs = 0.0;
+
+        for (uint32_t point = 0; point < pointCount; point++) {
+            uint32_t tri = std::min(triCount - 1, static_cast<uint32_t>(random() * triCount));
+            const Vertex& v0 = scene.vertices[scene.indices[3 * tri + 0]];
+            const Vertex& v1 = scene.vertices[scene.indices[3 * tri + 1]];
+            const Vertex& v2 = scene.vertices[scene.indices[3 * tri + 2]];
+            float sr1 = std::sqrt(random());
+            float b1 = random() * sr1;
+            Vec3 p = v0.position * (1.0f - sr1) + v1.position * b1 + v2.position * (sr1 - b1);
+            Vec3 n = normalize(v0.normal * (1.0f - sr1) + v1.normal * b1 + v2.normal * (sr1 - b1));
+            if (n.lengthSquared() == 0.0f) continue;
+
+            double meanAlias = 0.0, squaresAlias = 0.0, meanTree = 0.0, squaresTree = 0.0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t s = 0; s < samplesPerPoint; s++) {
+                float pdf = 0.0f;
+                float u = random();
+                int light = sampleEmissiveAlias(table, u, random(), pdf);
+                double value = estimate(p, n, light, pdf);
+                meanAlias += value;
+                squaresAlias += value * value;
+            }
+            aliasMs += millisecondsSince(start);
+
+            start = std::chrono::high_resolution_clock::now();
+            for (uint32_t s = 0; s < samplesPerPoint; s++) {
+                float pdf = 0.0f;
+                int light = tree.sample(p, n, random(), pdf);
+                double value = estimate(p, n, light, pdf);
+                meanTree += value;
+                squaresTree += value * value;
+
+                if (light < 0) treeMisses++;
+                else {
+                    maxPdfMismatch = std::max(maxPdfMismatch, static_cast<double>(std::fabs(tree.pdf(p, n, light) - pdf) / pdf));
+                }
+            }
+            treeMs += millisecondsSince(start);
+
+            meanAlias /= samplesPerPoint;
+            meanTree /= samplesPerPoint;
+            varianceAlias += squaresAlias / samplesPerPoint - meanAlias * meanAlias;
+            varianceTree += squaresTree / samplesPerPoint - meanTree * meanTree;
+            sumAlias += meanAlias;
+            sumTree += meanTree;
+            if (meanAlias > 0.0 || meanTree > 0.0) litPoints++;
+
+            // Over all lights the tree's pdf sums to at most one: the rest is the chance of the descent reaching a node
+            // whose children both can't light the point, which sample() reports as a miss
+            if (point < 8 && lightCount <= 100000) {
+                double pdfSum = 0.0;
+                for (uint32_t light = 0; light < lightCount; light++) pdfSum += tree.pdf(p, n, light);
+                maxPdfSum = std::max(maxPdfSum, pdfSum);
+            }
+        }
+
+        // Both estimators are unbiased, so their means over all points agree up to the sampling noise
+        const double standardError = std::sqrt((varianceAlias + varianceTree) / samplesPerPoint);
+        const double z = standardError > 0.0 ? (sumAlias - sumTree) / standardError : 0.0;
+        const double totalSamples = static_cast<double>(pointCount) * samplesPerPoint;
+
+        std::cout << std::fixed << std::setprecision(2)
+            << "build:    " << treeStats.buildMs << " ms, " << treeStats.nodeCount << " nodes, depth " << treeStats.maxDepth << std::endl
+            << "sampling: alias " << aliasMs * 1e6 / totalSamples << " ns, tree " << treeMs * 1e6 / totalSamples
+            << " ns per estimate (with the shadow ray)" << std::endl
+            << std::defaultfloat
+            << "variance: alias " << varianceAlias / pointCount << ", tree " << varianceTree / pointCount << " ("
+            << (varianceTree > 0.0 ? varianceAlias / varianceTree : 0.0) << "x lower) over " << litPoints << " lit points" << std::endl
+            << "mean:     alias " << sumAlias / pointCount << ", tree " << sumTree / pointCount << ", z = " << z << std::endl
+            << "pdf:      largest sum " << maxPdfSum << ", sample/pdf() mismatch " << maxPdfMismatch << ", "
+            << 100.0 * treeMisses / totalSamples << "% of tree samples found no light" << std::endl;
+
+        if (maxPdfSum > 1.0 + 1e-3 || maxPdfMismatch > 1e-3 || std::fabs(z) > 5.0) {
+            throw std::runtime_error("Light tree sampling is biased or its pdf is inconsistent");
+        }
+    }
+}
+
+int runBenchmarks(const std::vector<SceneObject>& objects, const std::string& modelDir,
+    const std::vector<std::string>& denoiseInputPaths) {
+    SceneData scene;
+    benchSceneLoad(scene, objects, modelDir);
+    if (scene.vertices.empty() || scene.indices.empty()) {
+        throw std::runtime_error("No vertices or indices loaded for the scene");
+    }
+
+    benchMeshOptimization(objects, modelDir);
+    benchTangentGeneration(scene);
+    benchVertexPacking(scene);
+
+    // The CPU BVH is single level, it is built over the instances baked into world space
+    const SceneData world = flattenScene(scene);
+    benchBvhBuild(world);
+    benchAccessorDecode();
+    benchObjImport();
+    benchMipmaps();
+    benchAllocator();
+    benchAccumulationPrecision();
+    benchDisplayTransform();
+    benchDenoiser(denoiseInputPaths);
+
+    std::vector<EmissiveTriGPU> emissiveTris = buildEmissiveTriangles(scene);
+    benchLightSampling("scene", computeEmissiveWeights(emissiveTris));
+    benchLightTree(world, emissiveTris);
+
+    // Many small lights with weights over six orders of magnitude, where the float CDF loses resolution
+    std::vector<double> manyLights(1000000);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (double& w : manyLights) {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        w = std::pow(10.0, 6.0 * static_cast<double>(state >> 11) / 9007199254740992.0 - 6.0);
+    }
+    benchLightSampling("synthetic", manyLights);
+    return 0;
+}
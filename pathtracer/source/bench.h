@@ -0,0 +1,11 @@
+#pragma once
+
+#include "render/scene.h"
+
+#include <string>
+#include <vector>
+
+// Offline measurements for the CPU-side systems (run with --bench), no window or Vulkan device needed.
+// The denoiser is measured on the given input dumps (see writeDenoiserInputs), or on synthetic inputs without any.
+int runBenchmarks(const std::vector<SceneObject>& objects, const std::string& modelDir,
+    const std::vector<std::string>& denoiseInputPaths);
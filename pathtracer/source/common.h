@@ -1,6 +1,14 @@
 #pragma once
 
+#include <cstdint>
+
 const char APP_NAME[32] = "Vulkan Path Tracer";
 static constexpr int WIDTH = 1280;
 static constexpr int HEIGHT = 720;
-static constexpr int DENOISER_WG_SIZE = 16;
\ No newline at end of file
+static constexpr int DENOISER_WG_SIZE = 16;
+// Workgroup edge of display.comp (local_size_x/y there)
+static constexpr int DISPLAY_WG_SIZE = 16;
+// Frames the CPU may record ahead of the GPU
+static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Size of the texture descriptor array (binding 7, partially bound); the descriptor pool holds as many samplers
+static constexpr uint32_t MAX_TEXTURES = 1024;
@@ -2,6 +2,7 @@
 
 #include "core/buffer.h"
 #include "core/context.h"
+#include "core/upload_queue.h"
 #include "math/mat4.h"
 #include "render/model.h"
 
@@ -35,14 +36,22 @@ struct Accel {
         buildGeometryInfo.setScratchData(scratchBuffer.deviceAddress);
         buildGeometryInfo.setDstAccelerationStructure(*accel);
 
-        context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {  //
+        // Recorded with the pending uploads (vertex / instance data), runs with the next flush
+        context.uploader->record([&](vk::CommandBuffer commandBuffer) {  //
             vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo;
             buildRangeInfo.setPrimitiveCount(primitiveCount);
             buildRangeInfo.setFirstVertex(0);
             buildRangeInfo.setPrimitiveOffset(0);
             buildRangeInfo.setTransformOffset(0);
             commandBuffer.buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
+
+            // A TLAS built later in the same batch reads this one, so do the ray tracing shaders
+            vk::MemoryBarrier barrier(vk::AccessFlagBits::eAccelerationStructureWriteKHR, vk::AccessFlagBits::eAccelerationStructureReadKHR);
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                {}, barrier, nullptr, nullptr);
             });
+        context.uploader->keepAlive(std::move(scratchBuffer));
 
         descAccelInfo.setAccelerationStructures(*accel);
     }
@@ -0,0 +1,248 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    // Index of the lowest / highest set bit, value must not be 0
+    uint32_t lowestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+#ifdef _WIN64
+        _BitScanForward64(&index, value);
+#else
+        if (static_cast<uint32_t>(value)) _BitScanForward(&index, static_cast<uint32_t>(value));
+        else { _BitScanForward(&index, static_cast<uint32_t>(value >> 32)); index += 32; }
+#endif
+        return index;
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+    }
+
+    uint32_t highestBit(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+#ifdef _WIN64
+        _BitScanReverse64(&index, value);
+#else
+        if (value >> 32) { _BitScanReverse(&index, static_cast<uint32_t>(value >> 32)); index += 32; }
+        else _BitScanReverse(&index, static_cast<uint32_t>(value));
+#endif
+        return index;
+#else
+        return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Sizes below this get one exact second level bin per MIN_ALIGNMENT step (all in first level 0)
+    constexpr uint64_t SMALL_BLOCK_SIZE = 512;
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t size) : size(size & ~(MIN_ALIGNMENT - 1)) {
+    for (auto& lists : freeLists) {
+        std::fill(std::begin(lists), std::end(lists), NONE);
+    }
+
+    if (this->size > 0) {
+        uint32_t block = newBlock();
+        blocks[block].size = this->size;
+        insertFree(block);
+    }
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    static_assert(SMALL_BLOCK_SIZE == SL_COUNT * MIN_ALIGNMENT, "small bins must cover first level 0 exactly");
+    if (size < SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = static_cast<uint32_t>(size / MIN_ALIGNMENT);
+        return;
+    }
+    uint32_t log = highestBit(size);
+    fl = log - highestBit(SMALL_BLOCK_SIZE) + 1;
+    sl = static_cast<uint32_t>(size >> (log - SL_BITS)) - SL_COUNT;
+}
+
+uint32_t TlsfAllocator::findFreeBlock(uint64_t size) const {
+    // Round up to the next bin so every block found is large enough ("good fit")
+    uint64_t rounded = size;
+    if (size >= SMALL_BLOCK_SIZE) {
+        rounded += (1ull << (highestBit(size) - SL_BITS)) - 1;
+    }
+
+    uint32_t fl, sl;
+    mapping(rounded, fl, sl);
+    if (fl < FL_COUNT) {
+        uint32_t slMap = sl < SL_COUNT ? slBitmap[fl] & (~0u << sl) : 0;
+        if (!slMap) {
+            uint64_t flMap = fl + 1 < FL_COUNT ? flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap) {
+                fl = lowestBit(flMap);
+                slMap = slBitmap[fl];
+            }
+        }
+        if (slMap) {
+            return freeLists[fl][lowestBit(slMap)];
+        }
+    }
+
+    // Nothing in the larger bins, the bin of `size` itself may still hold a block that fits
+    mapping(size, fl, sl);
+    for (uint32_t block = freeLists[fl][sl]; block != NONE; block = blocks[block].nextFree) {
+        if (blocks[block].size >= size) return block;
+    }
+    return NONE;
+}
+
+uint64_t TlsfAllocator::allocate(uint64_t requestSize, uint64_t alignment) {
+    if ((alignment & (alignment - 1)) != 0) {
+        throw std::runtime_error("TlsfAllocator: alignment must be a power of two");
+    }
+    const uint64_t blockSize = alignUp(std::max<uint64_t>(requestSize, 1), MIN_ALIGNMENT);
+    alignment = std::max(alignment, MIN_ALIGNMENT);
+
+    // Any block this big can be aligned in place
+    const uint64_t searchSize = blockSize + alignment - MIN_ALIGNMENT;
+    if (searchSize > size || blockSize < requestSize) return INVALID_OFFSET;
+
+    uint32_t block = findFreeBlock(searchSize);
+    if (block == NONE) return INVALID_OFFSET;
+    removeFree(block);
+
+    // Leading padding stays behind as a free block
+    const uint64_t offset = alignUp(blocks[block].offset, alignment);
+    if (offset != blocks[block].offset) {
+        uint32_t aligned = split(block, offset - blocks[block].offset);
+        insertFree(block);
+        block = aligned;
+    }
+
+    // Give the unused tail back
+    if (blocks[block].size - blockSize >= MIN_ALIGNMENT) {
+        insertFree(split(block, blockSize));
+    }
+
+    usedSize += blocks[block].size;
+    allocated[offset] = block;
+    return offset;
+}
+
+void TlsfAllocator::free(uint64_t offset) {
+    auto it = allocated.find(offset);
+    if (it == allocated.end()) {
+        throw std::runtime_error("TlsfAllocator: freeing an offset that is not allocated");
+    }
+    uint32_t block = it->second;
+    allocated.erase(it);
+    usedSize -= blocks[block].size;
+
+    // Coalesce with free neighbours, so no two free blocks are ever adjacent
+    uint32_t prev = blocks[block].prevPhysical;
+    if (prev != NONE && blocks[prev].free) {
+        removeFree(prev);
+        merge(prev, block);
+        block = prev;
+    }
+    uint32_t next = blocks[block].nextPhysical;
+    if (next != NONE && blocks[next].free) {
+        removeFree(next);
+        merge(block, next);
+    }
+    insertFree(block);
+}
+
+uint64_t TlsfAllocator::getLargestFreeBlock() const {
+    if (!flBitmap) return 0;
+
+    // The largest block is somewhere in the highest non-empty bin
+    uint32_t fl = highestBit(flBitmap);
+    uint32_t sl = highestBit(slBitmap[fl]);
+    uint64_t largest = 0;
+    for (uint32_t block = freeLists[fl][sl]; block != NONE; block = blocks[block].nextFree) {
+        largest = std::max(largest, blocks[block].size);
+    }
+    return largest;
+}
+
+float TlsfAllocator::getFragmentation() const {
+    uint64_t freeSize = size - usedSize;
+    if (freeSize == 0) return 0.0f;
+    return 1.0f - static_cast<float>(static_cast<double>(getLargestFreeBlock()) / static_cast<double>(freeSize));
+}
+
+void TlsfAllocator::insertFree(uint32_t block) {
+    uint32_t fl, sl;
+    mapping(blocks[block].size, fl, sl);
+
+    uint32_t head = freeLists[fl][sl];
+    blocks[block].free = true;
+    blocks[block].prevFree = NONE;
+    blocks[block].nextFree = head;
+    if (head != NONE) blocks[head].prevFree = block;
+    freeLists[fl][sl] = block;
+
+    flBitmap |= 1ull << fl;
+    slBitmap[fl] |= 1u << sl;
+    freeBlockCount++;
+}
+
+void TlsfAllocator::removeFree(uint32_t block) {
+    uint32_t fl, sl;
+    mapping(blocks[block].size, fl, sl);
+
+    Block& b = blocks[block];
+    if (b.prevFree != NONE) blocks[b.prevFree].nextFree = b.nextFree;
+    if (b.nextFree != NONE) blocks[b.nextFree].prevFree = b.prevFree;
+    if (freeLists[fl][sl] == block) {
+        freeLists[fl][sl] = b.nextFree;
+        if (b.nextFree == NONE) {
+            slBitmap[fl] &= ~(1u << sl);
+            if (!slBitmap[fl]) flBitmap &= ~(1ull << fl);
+        }
+    }
+    b.free = false;
+    b.prevFree = b.nextFree = NONE;
+    freeBlockCount--;
+}
+
+uint32_t TlsfAllocator::split(uint32_t block, uint64_t at) {
+    uint32_t upper = newBlock(); // may reallocate `blocks`, so no references before this
+    Block& b = blocks[block];
+    Block& u = blocks[upper];
+    u.offset = b.offset + at;
+    u.size = b.size - at;
+    u.prevPhysical = block;
+    u.nextPhysical = b.nextPhysical;
+    if (b.nextPhysical != NONE) blocks[b.nextPhysical].prevPhysical = upper;
+    b.size = at;
+    b.nextPhysical = upper;
+    return upper;
+}
+
+void TlsfAllocator::merge(uint32_t block, uint32_t next) {
+    Block& b = blocks[block];
+    b.size += blocks[next].size;
+    b.nextPhysical = blocks[next].nextPhysical;
+    if (b.nextPhysical != NONE) blocks[b.nextPhysical].prevPhysical = block;
+
+    blocks[next] = Block();
+    unusedBlocks.push_back(next);
+}
+
+uint32_t TlsfAllocator::newBlock() {
+    if (!unusedBlocks.empty()) {
+        uint32_t block = unusedBlocks.back();
+        unusedBlocks.pop_back();
+        return block;
+    }
+    blocks.emplace_back();
+    return static_cast<uint32_t>(blocks.size() - 1);
+}
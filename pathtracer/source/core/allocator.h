@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Two-level segregated fit (TLSF) allocator over an abstract [0, size) range.
+// It only hands out offsets, so the same code manages device memory blocks and runs on the CPU for benchmarks.
+// Free blocks are binned by power of two (first level) and a linear subdivision of it (second level);
+// two bitmaps find a big enough non-empty bin, so allocate and free are O(1).
+class TlsfAllocator {
+public:
+    static constexpr uint64_t INVALID_OFFSET = ~0ull;
+    // Every offset and block size is a multiple of this
+    static constexpr uint64_t MIN_ALIGNMENT = 16;
+
+    explicit TlsfAllocator(uint64_t size = 0);
+
+    // alignment must be a power of two, returns INVALID_OFFSET when no free block fits
+    uint64_t allocate(uint64_t size, uint64_t alignment = MIN_ALIGNMENT);
+    // offset must have been returned by allocate() and not freed since
+    void free(uint64_t offset);
+
+    uint64_t getSize() const { return size; }
+    uint64_t getUsedSize() const { return usedSize; }
+    uint32_t getAllocationCount() const { return static_cast<uint32_t>(allocated.size()); }
+    uint32_t getFreeBlockCount() const { return freeBlockCount; }
+    uint64_t getLargestFreeBlock() const;
+    // 0 when the free space is one block, towards 1 the more it is split into small pieces
+    float getFragmentation() const;
+    bool isEmpty() const { return allocated.empty(); }
+
+private:
+    static constexpr uint32_t SL_BITS = 5;
+    static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+    static constexpr uint32_t FL_COUNT = 64;
+    static constexpr uint32_t NONE = ~0u;
+
+    struct Block {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t prevPhysical = NONE;
+        uint32_t nextPhysical = NONE;
+        uint32_t prevFree = NONE;
+        uint32_t nextFree = NONE;
+        bool free = false;
+    };
+
+    static void mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+    uint32_t findFreeBlock(uint64_t size) const;
+    void insertFree(uint32_t block);
+    void removeFree(uint32_t block);
+    // Cuts the block at `at` bytes and returns the (unlinked from any free list) upper part
+    uint32_t split(uint32_t block, uint64_t at);
+    // Absorbs `next` into `block`; both must be neighbours and out of the free lists
+    void merge(uint32_t block, uint32_t next);
+    uint32_t newBlock();
+
+    uint64_t size = 0;
+    uint64_t usedSize = 0;
+    uint32_t freeBlockCount = 0;
+
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedBlocks;
+    std::unordered_map<uint64_t, uint32_t> allocated; // offset -> block
+
+    uint64_t flBitmap = 0;
+    uint32_t slBitmap[FL_COUNT] = {};
+    uint32_t freeLists[FL_COUNT][SL_COUNT];
+};
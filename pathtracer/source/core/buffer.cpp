@@ -1,5 +1,8 @@
 #include "buffer.h"
+#include "upload_queue.h"
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
 Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const void* data) {
     vk::BufferUsageFlags usageFlags;
@@ -44,6 +47,12 @@ Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const voi
         memoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
         break;
 
+    case Type::Readback:
+        usageFlags = vk::BufferUsageFlagBits::eTransferDst;
+        memoryFlags = vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent;
+        break;
+
     case Type::Storage:
         usageFlags = vk::BufferUsageFlagBits::eStorageBuffer |
             vk::BufferUsageFlagBits::eShaderDeviceAddress;
@@ -57,6 +66,11 @@ Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const voi
         break;
     }
 
+    // Initial data for device local memory arrives through a transfer
+    if (data != nullptr && (memoryFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)) {
+        usageFlags |= vk::BufferUsageFlagBits::eTransferDst;
+    }
+
     // Create buffer
     vk::BufferCreateInfo bufferInfo({}, size, usageFlags, vk::SharingMode::eExclusive);
     buffer = context.device->createBufferUnique(bufferInfo);
@@ -64,20 +78,17 @@ Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const voi
     // Get memory requirements
     vk::MemoryRequirements memRequirements = context.device->getBufferMemoryRequirements(*buffer);
 
-    // Allocate memory
-    vk::MemoryAllocateInfo allocInfo(memRequirements.size,
-        context.findMemoryType(memRequirements.memoryTypeBits, memoryFlags));
-
-    // For buffers that need device address, add the flag
-    if (usageFlags & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
-        vk::MemoryAllocateFlagsInfo flagsInfo(vk::MemoryAllocateFlagBits::eDeviceAddress);
-        allocInfo.pNext = &flagsInfo;
+    // Sub-allocations don't start at offset 0; scratch addresses must honour
+    // minAccelerationStructureScratchOffsetAlignment, which is at most 256
+    if (type == Type::Scratch) {
+        memRequirements.alignment = std::max<vk::DeviceSize>(memRequirements.alignment, 256);
     }
 
-    memory = context.device->allocateMemoryUnique(allocInfo);
+    // Sub-allocate memory (blocks are allocated with the device address flag)
+    memory = context.allocator->allocate(memRequirements, memoryFlags, true);
 
     // Bind memory to buffer
-    context.device->bindBufferMemory(*buffer, *memory, 0);
+    context.device->bindBufferMemory(*buffer, memory.getMemory(), memory.getOffset());
 
     // Set up descriptor buffer info
     descBufferInfo.buffer = *buffer;
@@ -92,36 +103,29 @@ Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const voi
 
     // If data is provided, copy it to the buffer
     if (data != nullptr) {
-        // For device local buffers, we need to use a staging buffer
+        // Device local buffers are filled through the upload queue (copied on its next flush)
         if (memoryFlags & vk::MemoryPropertyFlagBits::eDeviceLocal) {
-            // Create a staging buffer
-            Buffer staging(context, Type::TransferSrc, size, data);
-
-            // Copy from staging to device local buffer
-            context.oneTimeSubmit([&](vk::CommandBuffer cmdBuffer) {
-                vk::BufferCopy copyRegion(0, 0, size);
-                cmdBuffer.copyBuffer(*staging.buffer, *buffer, copyRegion);
-                });
+            context.uploader->uploadBuffer(*buffer, 0, data, size);
         }
         else {
-            // For host visible buffers, map memory and copy directly
-            void* mappedData = context.device->mapMemory(*memory, 0, size);
-            memcpy(mappedData, data, size);
-            context.device->unmapMemory(*memory);
+            // Host visible memory stays mapped, copy directly
+            memcpy(memory.getMapped(), data, size);
         }
     }
 }
 
 void* Buffer::map(const Context& context) {
-    return context.device->mapMemory(*memory, 0, descBufferInfo.range);
+    // Host visible blocks are persistently mapped by the allocator (and host coherent)
+    if (!memory.getMapped()) {
+        throw std::runtime_error("Buffer::map on memory that is not host visible");
+    }
+    return memory.getMapped();
 }
 
 void Buffer::unmap(const Context& context) {
-    context.device->unmapMemory(*memory);
+    // Nothing to do, the block stays mapped until the allocator releases it
 }
 
 void Buffer::upload(const Context& context, const void* data, size_t size, size_t offset) {
-    void* mappedData = context.device->mapMemory(*memory, offset, size);
-    memcpy(mappedData, data, size);
-    context.device->unmapMemory(*memory);
+    memcpy(static_cast<uint8_t*>(map(context)) + offset, data, size);
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ public:
         ShaderBindingTable,
         TransferSrc,
         TransferDst,
+        Readback,   // host visible copy target, for reading images and buffers back on the CPU
         Storage,
         Uniform,
     };
@@ -25,8 +26,9 @@ public:
     void unmap(const Context& context);
     void upload(const Context& context, const void* data, size_t size, size_t offset = 0);
 
+    // Declared before the buffer so the buffer is destroyed first
+    DeviceAllocation memory;
     vk::UniqueBuffer buffer;
-    vk::UniqueDeviceMemory memory;
     vk::DescriptorBufferInfo descBufferInfo;
     uint64_t deviceAddress = 0;
 };
\ No newline at end of file
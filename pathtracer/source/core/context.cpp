@@ -1,5 +1,6 @@
 #include "context.h"
 #include "common.h"
+#include "upload_queue.h"
 #include "render/model_loader.h"
 
 #include <stdexcept>
@@ -19,9 +20,8 @@ const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
 
-// Required device extensions
+// Required device extensions (the swapchain extension is added when there is a window)
 const std::vector<const char*> deviceExtensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
     VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
     VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
@@ -29,7 +29,7 @@ const std::vector<const char*> deviceExtensions = {
     VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 };
 
-Context::Context() {
+Context::Context(bool headless) : headless(headless) {
     // Initialize Vulkan dynamic loader
     dl = vk::detail::DynamicLoader();
     VULKAN_HPP_DEFAULT_DISPATCHER.init(dl.getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
@@ -67,11 +67,13 @@ Context::Context() {
 }
 
 std::vector<const char*> Context::getRequiredInstanceExtensions() {
-    // This will be called by GLFW to get required extensions
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    // Surface extensions come from GLFW, which a headless context never initializes
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -83,14 +85,26 @@ std::vector<const char*> Context::getRequiredInstanceExtensions() {
     return extensions;
 }
 
-// Add a new method to initialize device with a surface
+// Defined here, where UploadQueue is a complete type
+Context::~Context() = default;
+
 void Context::initDevice(GLFWwindow* window) {
-    // Create surface
-    VkSurfaceKHR surfaceRaw;
-    if (glfwCreateWindowSurface(*instance, window, nullptr, &surfaceRaw) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create window surface");
+    // Create surface, unless rendering headless
+    if (window) {
+        if (headless) {
+            throw std::runtime_error("A headless context can't present to a window");
+        }
+        VkSurfaceKHR surfaceRaw;
+        if (glfwCreateWindowSurface(*instance, window, nullptr, &surfaceRaw) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create window surface");
+        }
+        surface = vk::UniqueSurfaceKHR(vk::SurfaceKHR(surfaceRaw), *instance);
+    }
+
+    std::vector<const char*> extensions = deviceExtensions;
+    if (surface) {
+        extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     }
-    surface = vk::UniqueSurfaceKHR(vk::SurfaceKHR(surfaceRaw), *instance);
 
     // Select physical device
     auto physicalDevices = instance->enumeratePhysicalDevices();
@@ -100,7 +114,7 @@ void Context::initDevice(GLFWwindow* window) {
 
     // Select the first suitable device
     for (const auto& device : physicalDevices) {
-        if (checkDeviceExtensionSupport(device, deviceExtensions)) {
+        if (checkDeviceExtensionSupport(device, extensions)) {
             physicalDevice = device;
             break;
         }
@@ -113,7 +127,14 @@ void Context::initDevice(GLFWwindow* window) {
     // Find queue family
     auto queueFamilies = physicalDevice.getQueueFamilyProperties();
     for (uint32_t i = 0; i < queueFamilies.size(); i++) {
-        if (queueFamilies[i].queueFlags & vk::QueueFlagBits::eGraphics) {
+        if (!surface) {
+            // Ray tracing and the transfers only need a compute queue
+            if (queueFamilies[i].queueFlags & vk::QueueFlagBits::eCompute) {
+                queueFamilyIndex = i;
+                break;
+            }
+        }
+        else if (queueFamilies[i].queueFlags & vk::QueueFlagBits::eGraphics) {
             // Check if this queue family supports presentation
             if (physicalDevice.getSurfaceSupportKHR(i, *surface)) {
                 queueFamilyIndex = i;
@@ -129,6 +150,10 @@ void Context::initDevice(GLFWwindow* window) {
     // Enable required features (descriptor indexing / runtimeDescriptorArray + bufferDeviceAddress + ray tracing)
     vk::PhysicalDeviceFeatures2 deviceFeatures2{};
 
+    // The accumulation image is declared without a format in raygen.rgen, so it can be fp32 or fp16
+    deviceFeatures2.features.setShaderStorageImageReadWithoutFormat(VK_TRUE);
+    deviceFeatures2.features.setShaderStorageImageWriteWithoutFormat(VK_TRUE);
+
     // Descriptor indexing features (VK_EXT_descriptor_indexing) - use this instead of VkPhysicalDeviceVulkan12Features in pNext
     vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
     descriptorIndexingFeatures.setRuntimeDescriptorArray(VK_TRUE);
@@ -157,7 +182,7 @@ void Context::initDevice(GLFWwindow* window) {
     float queuePriority = 1.0f;
     vk::DeviceQueueCreateInfo queueInfo({}, queueFamilyIndex, 1, &queuePriority);
     vk::DeviceCreateInfo deviceInfo({}, queueInfo);
-    deviceInfo.setPEnabledExtensionNames(deviceExtensions);
+    deviceInfo.setPEnabledExtensionNames(extensions);
     deviceInfo.pNext = &deviceFeatures2;
 
     if (enableValidationLayers) {
@@ -170,6 +195,8 @@ void Context::initDevice(GLFWwindow* window) {
     // Get queue
     queue = device->getQueue(queueFamilyIndex, 0);
 
+    allocator = std::make_unique<DeviceAllocator>(physicalDevice, *device);
+
     // Create command pool (allow resetting command buffers)
     vk::CommandPoolCreateInfo cmdPoolInfo;
     cmdPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
@@ -179,7 +206,7 @@ void Context::initDevice(GLFWwindow* window) {
     // Create descriptor pool: bump combined sampler count to support many textures (e.g. Sponza ~70)
     std::vector<vk::DescriptorPoolSize> poolSizes = {
         {vk::DescriptorType::eAccelerationStructureKHR, 10},
-        {vk::DescriptorType::eStorageImage, 10},
+        {vk::DescriptorType::eStorageImage, 32},
         {vk::DescriptorType::eUniformBuffer, 10},
         {vk::DescriptorType::eStorageBuffer, 50},
         // allow many combined image samplers (make this large enough for your scenes)
@@ -193,6 +220,8 @@ void Context::initDevice(GLFWwindow* window) {
     );
 
     descPool = device->createDescriptorPoolUnique(descPoolInfo);
+
+    uploader = std::make_unique<UploadQueue>(*this);
 }
 
 bool Context::checkDeviceExtensionSupport(const vk::PhysicalDevice& device,
@@ -222,6 +251,9 @@ uint32_t Context::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags pr
 }
 
 void Context::oneTimeSubmit(const std::function<void(vk::CommandBuffer)>& func) const {
+    // Whatever is submitted here may depend on batched uploads
+    if (uploader) uploader->finish();
+
     // Allocate command buffer
     vk::CommandBufferAllocateInfo allocInfo(*commandPool, vk::CommandBufferLevel::ePrimary, 1);
     auto commandBuffers = device->allocateCommandBuffersUnique(allocInfo);
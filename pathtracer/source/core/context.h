@@ -4,12 +4,20 @@
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
 #include <functional>
+#include <memory>
+
+#include "device_memory.h"
+
+class UploadQueue;
 
 class Context {
 public:
-    Context();
+    // A headless context doesn't ask GLFW for instance extensions; pair it with initDevice(nullptr)
+    explicit Context(bool headless = false);
+    ~Context();
 
-    // Instance and device setup
+    // Instance and device setup. Without a window there is no surface and no swapchain extension,
+    // and any queue family with compute support is used.
     void initDevice(GLFWwindow* window);
     std::vector<const char*> getRequiredInstanceExtensions();
     bool checkDeviceExtensionSupport(const vk::PhysicalDevice& device,
@@ -34,6 +42,8 @@ public:
         vk::DebugUtilsMessengerCallbackDataEXT const* pCallbackData,
         void* pUserData);
 
+    bool headless = false;
+
     // Vulkan handles
     vk::detail::DynamicLoader dl;
     vk::UniqueInstance instance;
@@ -47,4 +57,9 @@ public:
     vk::Queue queue;
     vk::UniqueCommandPool commandPool;
     vk::UniqueDescriptorPool descPool;
+
+    // Memory for every Buffer and Image; declared after the device so it is destroyed before it
+    std::unique_ptr<DeviceAllocator> allocator;
+    // Batched uploads and acceleration structure builds; its ring buffer comes from the allocator
+    std::unique_ptr<UploadQueue> uploader;
 };
\ No newline at end of file
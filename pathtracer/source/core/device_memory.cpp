@@ -0,0 +1,193 @@
+#include "device_memory.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+DeviceAllocation& DeviceAllocation::operator=(DeviceAllocation&& other) noexcept {
+    if (this != &other) {
+        release();
+        allocator = other.allocator;
+        memory = other.memory;
+        offset = other.offset;
+        size = other.size;
+        mapped = other.mapped;
+        pool = other.pool;
+        block = other.block;
+        other.allocator = nullptr;
+        other.memory = nullptr;
+        other.mapped = nullptr;
+    }
+    return *this;
+}
+
+void DeviceAllocation::release() {
+    if (allocator && memory) {
+        allocator->free(*this);
+    }
+    allocator = nullptr;
+    memory = nullptr;
+    mapped = nullptr;
+}
+
+DeviceAllocator::DeviceAllocator(vk::PhysicalDevice physicalDevice, vk::Device device)
+    : device(device), memoryProperties(physicalDevice.getMemoryProperties()) {
+    pools.resize(memoryProperties.memoryTypeCount * 2);
+    for (uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++) {
+        const vk::MemoryType& memoryType = memoryProperties.memoryTypes[type];
+        // Small heaps (e.g. the 256 MB host visible device local one) get smaller blocks
+        vk::DeviceSize heapSize = memoryProperties.memoryHeaps[memoryType.heapIndex].size;
+        for (uint32_t linear = 0; linear < 2; linear++) {
+            Pool& pool = pools[type * 2 + linear];
+            pool.blockSize = std::min(BLOCK_SIZE, std::max<vk::DeviceSize>(heapSize / 8, 1024 * 1024));
+            pool.hostVisible = static_cast<bool>(memoryType.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+        }
+    }
+}
+
+DeviceAllocator::~DeviceAllocator() {
+    DeviceMemoryStats stats = getStats();
+    if (stats.allocationCount > 0 || stats.dedicatedCount > 0) {
+        std::cout << "Warning: " << stats.allocationCount + stats.dedicatedCount
+            << " device allocations still alive when the allocator was destroyed" << std::endl;
+    }
+
+    for (Pool& pool : pools) {
+        for (MemoryBlock& block : pool.blocks) {
+            if (block.memory) freeMemory(block.memory, block.mapped);
+        }
+    }
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) &&
+            (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+vk::DeviceMemory DeviceAllocator::allocateMemory(vk::DeviceSize size, uint32_t memoryType, void** mapped) {
+    // Any block may end up holding a buffer that needs a device address
+    vk::MemoryAllocateFlagsInfo flagsInfo(vk::MemoryAllocateFlagBits::eDeviceAddress);
+    vk::MemoryAllocateInfo allocInfo(size, memoryType);
+    allocInfo.pNext = &flagsInfo;
+    vk::DeviceMemory memory = device.allocateMemory(allocInfo);
+
+    *mapped = nullptr;
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        *mapped = device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+    }
+    return memory;
+}
+
+void DeviceAllocator::freeMemory(vk::DeviceMemory memory, void* mapped) {
+    if (mapped) device.unmapMemory(memory);
+    device.freeMemory(memory);
+}
+
+DeviceAllocation DeviceAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear) {
+    const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    const uint32_t poolIndex = memoryType * 2 + (linear ? 1 : 0);
+
+    DeviceAllocation allocation;
+    allocation.allocator = this;
+    allocation.pool = poolIndex;
+    allocation.size = requirements.size;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pool& pool = pools[poolIndex];
+
+    // Big resources would mostly waste a shared block, they get their own memory
+    if (requirements.size > pool.blockSize / 2) {
+        allocation.memory = allocateMemory(requirements.size, memoryType, &allocation.mapped);
+        allocation.block = DEDICATED_BLOCK;
+        dedicatedCount++;
+        dedicatedBytes += requirements.size;
+        return allocation;
+    }
+
+    auto tryBlock = [&](uint32_t index) {
+        MemoryBlock& block = pool.blocks[index];
+        if (!block.memory) return false;
+        uint64_t offset = block.heap.allocate(requirements.size, requirements.alignment);
+        if (offset == TlsfAllocator::INVALID_OFFSET) return false;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.block = index;
+        allocation.mapped = block.mapped ? static_cast<uint8_t*>(block.mapped) + offset : nullptr;
+        return true;
+    };
+
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+        if (tryBlock(i)) return allocation;
+    }
+
+    // Every block is full, open a new one (reusing a released slot if there is one)
+    MemoryBlock block;
+    block.memory = allocateMemory(pool.blockSize, memoryType, &block.mapped);
+    block.heap = TlsfAllocator(pool.blockSize);
+
+    auto slot = std::find_if(pool.blocks.begin(), pool.blocks.end(), [](const MemoryBlock& b) { return !b.memory; });
+    uint32_t index = static_cast<uint32_t>(slot - pool.blocks.begin());
+    if (slot == pool.blocks.end()) {
+        pool.blocks.push_back(std::move(block));
+    }
+    else {
+        *slot = std::move(block);
+    }
+
+    if (!tryBlock(index)) {
+        throw std::runtime_error("DeviceAllocator: allocation does not fit in an empty block");
+    }
+    return allocation;
+}
+
+void DeviceAllocator::free(DeviceAllocation& allocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (allocation.block == DEDICATED_BLOCK) {
+        freeMemory(allocation.memory, allocation.mapped);
+        dedicatedCount--;
+        dedicatedBytes -= allocation.size;
+        return;
+    }
+
+    Pool& pool = pools[allocation.pool];
+    MemoryBlock& block = pool.blocks[allocation.block];
+    block.heap.free(allocation.offset);
+
+    // Keep one empty block per pool around so a free/allocate pattern doesn't hit the driver every time
+    if (block.heap.isEmpty()) {
+        for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+            const MemoryBlock& other = pool.blocks[i];
+            if (i != allocation.block && other.memory && other.heap.isEmpty()) {
+                freeMemory(block.memory, block.mapped);
+                block = MemoryBlock();
+                break;
+            }
+        }
+    }
+}
+
+DeviceMemoryStats DeviceAllocator::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    DeviceMemoryStats stats;
+    for (const Pool& pool : pools) {
+        for (const MemoryBlock& block : pool.blocks) {
+            if (!block.memory) continue;
+            stats.blockCount++;
+            stats.allocationCount += block.heap.getAllocationCount();
+            stats.reservedBytes += block.heap.getSize();
+            stats.usedBytes += block.heap.getUsedSize();
+        }
+    }
+    stats.dedicatedCount = dedicatedCount;
+    stats.reservedBytes += dedicatedBytes;
+    stats.usedBytes += dedicatedBytes;
+    return stats;
+}
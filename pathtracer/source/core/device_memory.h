@@ -0,0 +1,101 @@
+#pragma once
+
+#include "allocator.h"
+
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#include <vulkan/vulkan.hpp>
+
+#include <mutex>
+#include <vector>
+
+class DeviceAllocator;
+
+// A range of device memory owned by a Buffer or Image, handed back to the allocator on destruction
+class DeviceAllocation {
+public:
+    DeviceAllocation() = default;
+    ~DeviceAllocation() { release(); }
+
+    DeviceAllocation(DeviceAllocation&& other) noexcept { *this = std::move(other); }
+    DeviceAllocation& operator=(DeviceAllocation&& other) noexcept;
+    DeviceAllocation(const DeviceAllocation&) = delete;
+    DeviceAllocation& operator=(const DeviceAllocation&) = delete;
+
+    void release();
+
+    vk::DeviceMemory getMemory() const { return memory; }
+    vk::DeviceSize getOffset() const { return offset; }
+    vk::DeviceSize getSize() const { return size; }
+    // Start of the allocation in host address space, null unless the memory is host visible
+    void* getMapped() const { return mapped; }
+    explicit operator bool() const { return static_cast<bool>(memory); }
+
+private:
+    friend class DeviceAllocator;
+
+    DeviceAllocator* allocator = nullptr;
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t pool = 0;
+    uint32_t block = 0; // DEDICATED_BLOCK for allocations with their own vkDeviceMemory
+};
+
+struct DeviceMemoryStats {
+    uint32_t blockCount = 0;      // pooled vkDeviceMemory blocks
+    uint32_t dedicatedCount = 0;  // allocations too large to share a block
+    uint32_t allocationCount = 0; // live sub-allocations
+    uint64_t reservedBytes = 0;   // device memory allocated from the driver
+    uint64_t usedBytes = 0;       // part of it handed out to resources
+};
+
+// Sub-allocates buffers and images out of a few large vkDeviceMemory blocks, each managed by a TlsfAllocator,
+// instead of one driver allocation per resource (maxMemoryAllocationCount is often just 4096).
+// There is one pool per memory type and resource kind, linear buffers and optimal-tiling images never share
+// a block so bufferImageGranularity can be ignored. Host visible blocks stay mapped while they live.
+class DeviceAllocator {
+public:
+    DeviceAllocator(vk::PhysicalDevice physicalDevice, vk::Device device);
+    ~DeviceAllocator();
+
+    DeviceAllocator(const DeviceAllocator&) = delete;
+    DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+    // Picks the first memory type allowed by `requirements` that has all `properties`.
+    // `linear` is true for buffers and linear images, false for optimal-tiling images. Thread safe.
+    DeviceAllocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear);
+
+    DeviceMemoryStats getStats() const;
+
+private:
+    friend class DeviceAllocation;
+
+    static constexpr vk::DeviceSize BLOCK_SIZE = 64ull * 1024 * 1024;
+    static constexpr uint32_t DEDICATED_BLOCK = ~0u;
+
+    struct MemoryBlock {
+        vk::DeviceMemory memory;
+        TlsfAllocator heap;
+        void* mapped = nullptr;
+    };
+
+    struct Pool {
+        std::vector<MemoryBlock> blocks; // released blocks keep their slot with a null memory handle
+        vk::DeviceSize blockSize = 0;
+        bool hostVisible = false;
+    };
+
+    uint32_t findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags properties) const;
+    vk::DeviceMemory allocateMemory(vk::DeviceSize size, uint32_t memoryType, void** mapped);
+    void freeMemory(vk::DeviceMemory memory, void* mapped);
+    void free(DeviceAllocation& allocation);
+
+    vk::Device device;
+    vk::PhysicalDeviceMemoryProperties memoryProperties;
+    std::vector<Pool> pools; // [memoryType * 2 + linear]
+
+    mutable std::mutex mutex;
+    uint32_t dedicatedCount = 0;
+    uint64_t dedicatedBytes = 0;
+};
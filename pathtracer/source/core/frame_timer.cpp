@@ -0,0 +1,61 @@
+#include "frame_timer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    FrameTimingPercentiles percentiles(std::vector<double>& values) {
+        FrameTimingPercentiles result;
+        if (values.empty()) return result;
+
+        // Nearest rank; each nth_element only has to look at the part above the previous rank
+        auto rank = [&](double p) {
+            size_t index = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+            return values.begin() + static_cast<std::ptrdiff_t>(index);
+        };
+        auto p50 = rank(0.50), p95 = rank(0.95), p99 = rank(0.99);
+        std::nth_element(values.begin(), p50, values.end());
+        std::nth_element(p50, p95, values.end());
+        std::nth_element(p95, p99, values.end());
+        result.p50 = *p50;
+        result.p95 = *p95;
+        result.p99 = *p99;
+        result.max = *std::max_element(p99, values.end());
+        return result;
+    }
+}
+
+void FrameTimer::addFrame(const FrameTiming& timing) {
+    history[next] = timing;
+    next = (next + 1) % HISTORY_SIZE;
+    count = std::min(count + 1, HISTORY_SIZE);
+}
+
+void FrameTimer::setLatency(uint32_t framesAgo, double latencyMs) {
+    if (framesAgo == 0 || framesAgo > count) return;
+    history[(next + HISTORY_SIZE - framesAgo) % HISTORY_SIZE].latencyMs = latencyMs;
+}
+
+FrameTimingReport FrameTimer::getReport() const {
+    FrameTimingReport report;
+    report.frames = count;
+
+    std::vector<double> wait, record, present, latency;
+    wait.reserve(count);
+    record.reserve(count);
+    present.reserve(count);
+    latency.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const FrameTiming& timing = history[i];
+        wait.push_back(timing.waitMs);
+        record.push_back(timing.recordMs);
+        present.push_back(timing.presentMs);
+        if (timing.latencyMs >= 0.0) latency.push_back(timing.latencyMs);
+    }
+
+    report.wait = percentiles(wait);
+    report.record = percentiles(record);
+    report.present = percentiles(present);
+    report.latency = percentiles(latency);
+    return report;
+}
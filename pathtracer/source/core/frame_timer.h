@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// CPU-side timings of one frame of the render loop, in milliseconds
+struct FrameTiming {
+    double waitMs = 0.0;    // blocked on the frame slot's fence and on acquiring a swapchain image
+    double recordMs = 0.0;  // command recording up to the queue submit
+    double presentMs = 0.0; // inside vkQueuePresentKHR
+    double latencyMs = -1.0; // submit until the frame's fence was seen signaled (an upper bound), negative until known
+};
+
+struct FrameTimingPercentiles {
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+struct FrameTimingReport {
+    uint32_t frames = 0; // samples the percentiles were taken over
+    FrameTimingPercentiles wait;
+    FrameTimingPercentiles record;
+    FrameTimingPercentiles present;
+    FrameTimingPercentiles latency; // over the frames whose latency is known
+};
+
+// Keeps the timings of the last HISTORY_SIZE frames in a ring and reports their percentiles
+class FrameTimer {
+public:
+    static constexpr uint32_t HISTORY_SIZE = 512;
+
+    void addFrame(const FrameTiming& timing);
+    // Latency is only known once the GPU is done, `framesAgo` is 1 for the last added frame
+    void setLatency(uint32_t framesAgo, double latencyMs);
+
+    uint32_t getFrameCount() const { return count; }
+    FrameTimingReport getReport() const;
+
+private:
+    std::array<FrameTiming, HISTORY_SIZE> history{};
+    uint32_t next = 0;  // slot the next frame goes to
+    uint32_t count = 0; // valid entries, at most HISTORY_SIZE
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Non-cryptographic 64-bit hashing for cache keys and hash tables.
+// Consumes 8 bytes per step, so hashing whole source files stays cheap.
+inline uint64_t hashMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t hashCombine(uint64_t seed, uint64_t value) {
+    return hashMix(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = (h ^ hashMix(word)) * 0x9e3779b97f4a7c15ull;
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    return hashMix(h ^ tail);
+}
@@ -9,13 +9,14 @@ Image::Image(const Context& context,
     vk::Extent2D extent,
     vk::Format format,
     vk::ImageUsageFlags usage,
-    vk::ImageLayout finalLayout) {
+    vk::ImageLayout finalLayout,
+    uint32_t mipLevels) {
 
     // Create image
     vk::ImageCreateInfo imageInfo;
     imageInfo.setImageType(vk::ImageType::e2D);
     imageInfo.setExtent({ extent.width, extent.height, 1 });
-    imageInfo.setMipLevels(1);
+    imageInfo.setMipLevels(mipLevels);
     imageInfo.setArrayLayers(1);
     imageInfo.setFormat(format);
     imageInfo.setTiling(vk::ImageTiling::eOptimal);
@@ -26,25 +27,19 @@ Image::Image(const Context& context,
 
     image = context.device->createImageUnique(imageInfo);
 
-    // Allocate memory
+    // Sub-allocate memory from the optimal-tiling pool
     vk::MemoryRequirements requirements = context.device->getImageMemoryRequirements(*image);
-    uint32_t memoryTypeIndex = context.findMemoryType(requirements.memoryTypeBits,
-        vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    vk::MemoryAllocateInfo memoryInfo;
-    memoryInfo.setAllocationSize(requirements.size);
-    memoryInfo.setMemoryTypeIndex(memoryTypeIndex);
-    memory = context.device->allocateMemoryUnique(memoryInfo);
+    memory = context.allocator->allocate(requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false);
 
     // Bind memory and image
-    context.device->bindImageMemory(*image, *memory, 0);
+    context.device->bindImageMemory(*image, memory.getMemory(), memory.getOffset());
 
     // Create image view
     vk::ImageViewCreateInfo imageViewInfo;
     imageViewInfo.setImage(*image);
     imageViewInfo.setViewType(vk::ImageViewType::e2D);
     imageViewInfo.setFormat(format);
-    imageViewInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+    imageViewInfo.setSubresourceRange({ vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1 });
     view = context.device->createImageViewUnique(imageViewInfo);
 
     // Set image info
@@ -98,7 +93,8 @@ void Image::setImageLayout(
     imageMemoryBarrier.setOldLayout(oldImageLayout);
     imageMemoryBarrier.setNewLayout(newImageLayout);
     imageMemoryBarrier.setImage(image);
-    imageMemoryBarrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+    // Covers the whole mip chain, images without mips only have the one level anyway
+    imageMemoryBarrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, VK_REMAINING_MIP_LEVELS, 0, 1);
 
     // Source layouts
     switch (oldImageLayout) {
@@ -199,10 +195,10 @@ void Image::copyFromBuffer(const Context& context, const Buffer& buffer, vk::Ext
 
 void Image::copyToBuffer(const Context& context, Buffer& buffer, vk::Extent2D extent) const {
     context.oneTimeSubmit([&](vk::CommandBuffer cmdBuffer) {
-        // Transition image to transfer source layout
+        // Transition image to transfer source layout, after whatever stage wrote it last
         setImageLayout(cmdBuffer, *image, descImageInfo.imageLayout,
             vk::ImageLayout::eTransferSrcOptimal,
-            vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eAllCommands,
             vk::PipelineStageFlagBits::eTransfer);
 
         // Copy image to buffer
@@ -222,6 +218,11 @@ void Image::copyToBuffer(const Context& context, Buffer& buffer, vk::Extent2D ex
             1, &region
         );
 
+        // Make the copy visible to the host once the submit's fence is signaled
+        vk::MemoryBarrier hostBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+            {}, hostBarrier, nullptr, nullptr);
+
         // Transition image back to the original layout
         setImageLayout(cmdBuffer, *image, vk::ImageLayout::eTransferSrcOptimal,
             descImageInfo.imageLayout,
@@ -3,6 +3,8 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
 
+#include "device_memory.h"
+
 class Context;
 class Buffer;
 
@@ -13,7 +15,8 @@ public:
         vk::Extent2D extent,
         vk::Format format,
         vk::ImageUsageFlags usage,
-        vk::ImageLayout finalLayout = vk::ImageLayout::eGeneral);
+        vk::ImageLayout finalLayout = vk::ImageLayout::eGeneral,
+        uint32_t mipLevels = 1);
 
     static vk::AccessFlags toAccessFlags(vk::ImageLayout layout);
     static void setImageLayout(
@@ -29,8 +32,9 @@ public:
     void copyFromBuffer(const Context& context, const Buffer& buffer, vk::Extent2D extent);
     void copyToBuffer(const Context& context, Buffer& buffer, vk::Extent2D extent) const;
 
+    // Declared first so it outlives the image and view
+    DeviceAllocation memory;
     vk::UniqueImage image;
     vk::UniqueImageView view;
-    vk::UniqueDeviceMemory memory;
     vk::DescriptorImageInfo descImageInfo;
 };
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "image_source.h"
+#include "core/mapped_file.h"
+
+#include <stb_image.h>
+
+#include <climits>
+#include <cstdlib>
+
+std::string makeEmbeddedImagePath(const std::string& file, uint64_t offset, uint64_t length) {
+    return file + "#" + std::to_string(offset) + "," + std::to_string(length);
+}
+
+unsigned char* loadImageRgba(const std::string& path, int& width, int& height) {
+    int channels = 0;
+
+    // "<file>#<offset>,<length>": both numbers have to parse completely, anything else is an ordinary path
+    const size_t hash = path.rfind('#');
+    const size_t comma = path.rfind(',');
+    if (hash != std::string::npos && comma != std::string::npos && comma > hash + 1 && comma + 1 < path.size()) {
+        char* end = nullptr;
+        const uint64_t offset = std::strtoull(path.c_str() + hash + 1, &end, 10);
+        const bool offsetValid = end == path.c_str() + comma;
+        const uint64_t length = std::strtoull(path.c_str() + comma + 1, &end, 10);
+        if (offsetValid && *end == '\0') {
+            MappedFile file;
+            if (!file.open(path.substr(0, hash)) || offset + length > file.size() || length > INT_MAX) {
+                return nullptr;
+            }
+            return stbi_load_from_memory(file.data() + offset, static_cast<int>(length), &width, &height, &channels, STBI_rgb_alpha);
+        }
+    }
+
+    return stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+}
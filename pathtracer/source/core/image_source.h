@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Texture files are named by a path: an image file, or "<file>#<offset>,<length>" for an encoded image stored
+// inside another file (a bufferView of a .glb binary chunk or of a .bin buffer), read through a mapping of it.
+
+std::string makeEmbeddedImagePath(const std::string& file, uint64_t offset, uint64_t length);
+
+// stbi_load with STBI_rgb_alpha on either kind of path. Returns nullptr on failure; free with stbi_image_free.
+unsigned char* loadImageRgba(const std::string& path, int& width, int& height);
@@ -0,0 +1,159 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // sRGB <-> linear tables; the encode table is indexed by linear * (ENCODE_SIZE - 1)
+    constexpr uint32_t ENCODE_SIZE = 1u << 13;
+
+    struct SrgbTables {
+        float toLinear[256];
+        uint8_t toSrgb[ENCODE_SIZE];
+
+        SrgbTables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (uint32_t i = 0; i < ENCODE_SIZE; i++) {
+                float l = i / float(ENCODE_SIZE - 1);
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                toSrgb[i] = static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+            }
+        }
+    };
+
+    const SrgbTables& srgbTables() {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    // Averages the 2x2 block at (2x, 2y) for dst pixels [xBegin, xEnd)
+    void downsampleRowScalar(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth,
+        uint8_t* dst, uint32_t xBegin, uint32_t xEnd) {
+        for (uint32_t x = xBegin; x < xEnd; x++) {
+            uint32_t x0 = 2 * x;
+            uint32_t x1 = std::min(x0 + 1, srcWidth - 1);
+            for (uint32_t c = 0; c < 4; c++) {
+                uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+                dst[x * 4 + c] = static_cast<uint8_t>((sum + 2) >> 2);
+            }
+        }
+    }
+
+    void downsampleRowSrgb(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth, uint8_t* dst, uint32_t dstWidth) {
+        const SrgbTables& t = srgbTables();
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            uint32_t x0 = 2 * x;
+            uint32_t x1 = std::min(x0 + 1, srcWidth - 1);
+            for (uint32_t c = 0; c < 3; c++) {
+                float sum = t.toLinear[row0[x0 * 4 + c]] + t.toLinear[row0[x1 * 4 + c]] +
+                    t.toLinear[row1[x0 * 4 + c]] + t.toLinear[row1[x1 * 4 + c]];
+                dst[x * 4 + c] = t.toSrgb[static_cast<uint32_t>(sum * (0.25f * (ENCODE_SIZE - 1)) + 0.5f)];
+            }
+            uint32_t alpha = row0[x0 * 4 + 3] + row0[x1 * 4 + 3] + row1[x0 * 4 + 3] + row1[x1 * 4 + 3];
+            dst[x * 4 + 3] = static_cast<uint8_t>((alpha + 2) >> 2);
+        }
+    }
+
+#ifdef MIPMAP_SSE2
+    // Four dst pixels (eight src pixels per row) per iteration, returns the first pixel left for the scalar tail
+    uint32_t downsampleRowSse2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t dstWidth) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rounding = _mm_set1_epi16(2);
+
+        uint32_t x = 0;
+        for (; x + 4 <= dstWidth; x += 4) {
+            __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+            __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+            __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+            __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+
+            // Vertical sums in 16 bits, two source pixels per register
+            __m128i v0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero)); // p0 p1
+            __m128i v1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)); // p2 p3
+            __m128i v2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero)); // p4 p5
+            __m128i v3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero)); // p6 p7
+
+            // Horizontal pairs: low half + high half of every register
+            __m128i h0 = _mm_add_epi16(v0, _mm_srli_si128(v0, 8));
+            __m128i h1 = _mm_add_epi16(v1, _mm_srli_si128(v1, 8));
+            __m128i h2 = _mm_add_epi16(v2, _mm_srli_si128(v2, 8));
+            __m128i h3 = _mm_add_epi16(v3, _mm_srli_si128(v3, 8));
+
+            __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h0, h1), rounding), 2);
+            __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h2, h3), rounding), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(lo, hi));
+        }
+        return x;
+    }
+#endif
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1u, width / 2);
+        height = std::max(1u, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+void downsampleRgba8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, bool srgb) {
+    const uint32_t dstWidth = std::max(1u, srcWidth / 2);
+    const uint32_t dstHeight = std::max(1u, srcHeight / 2);
+    const size_t srcPitch = static_cast<size_t>(srcWidth) * 4;
+
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        const uint8_t* row0 = src + (2 * y) * srcPitch;
+        const uint8_t* row1 = src + std::min(2 * y + 1, srcHeight - 1) * srcPitch;
+        uint8_t* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+        if (srgb) {
+            downsampleRowSrgb(row0, row1, srcWidth, out, dstWidth);
+            continue;
+        }
+
+        uint32_t x = 0;
+#ifdef MIPMAP_SSE2
+        // A 1 pixel wide source needs the clamped scalar path
+        if (srcWidth >= 2) x = downsampleRowSse2(row0, row1, out, dstWidth);
+#endif
+        downsampleRowScalar(row0, row1, srcWidth, out, x, dstWidth);
+    }
+}
+
+MipChain generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb) {
+    MipChain chain;
+    const uint32_t levelCount = mipLevelCount(width, height);
+    chain.levels.reserve(levelCount - 1);
+
+    size_t size = 0;
+    uint32_t w = width, h = height;
+    for (uint32_t level = 1; level < levelCount; level++) {
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+        chain.levels.push_back({ w, h, size });
+        size += static_cast<size_t>(w) * h * 4;
+    }
+    chain.data.resize(size);
+
+    // Every level is filtered from the one above it
+    const uint8_t* src = pixels;
+    uint32_t srcWidth = width, srcHeight = height;
+    for (const MipLevel& level : chain.levels) {
+        uint8_t* dst = chain.data.data() + level.offset;
+        downsampleRgba8(src, srcWidth, srcHeight, dst, srgb);
+        src = dst;
+        srcWidth = level.width;
+        srcHeight = level.height;
+    }
+    return chain;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MipLevel {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t offset = 0; // bytes into MipChain::data
+};
+
+// Levels 1..n-1 of an RGBA8 image stored back to back, level 0 stays with the caller
+struct MipChain {
+    std::vector<uint8_t> data;
+    std::vector<MipLevel> levels; // levels[0] is mip 1
+};
+
+// Levels of a full chain down to 1x1, including the base level
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+// Halves an RGBA8 image (floor sizes, never below 1) with a 2x2 box filter.
+// srgb averages the color channels in linear light, alpha is always averaged as is.
+// The linear path uses SSE2 where available.
+void downsampleRgba8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, bool srgb);
+
+MipChain generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, bool srgb);
@@ -1,76 +1,270 @@
 #include "texture.h"
 #include "context.h"
 #include "buffer.h"
+#include "thread_pool.h"
+#include "mipmap.h"
+#include "image_source.h"
+#include "upload_queue.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 
+namespace {
+    using Clock = std::chrono::high_resolution_clock;
+
+    double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    vk::UniqueSampler createTextureSampler(const Context& context, float maxLod) {
+        vk::SamplerCreateInfo samplerInfo{};
+        samplerInfo.magFilter = vk::Filter::eLinear;
+        samplerInfo.minFilter = vk::Filter::eLinear;
+        samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+        samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+        samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+        samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
+        samplerInfo.mipLodBias = 0.0f;
+        samplerInfo.anisotropyEnable = VK_FALSE;  // requires device feature enabled
+        samplerInfo.maxAnisotropy = 1;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = vk::CompareOp::eAlways;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = maxLod;
+        samplerInfo.borderColor = vk::BorderColor::eIntOpaqueBlack;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        return context.device->createSamplerUnique(samplerInfo);
+    }
+
+    // Staging bytes for the base level followed by its mip chain
+    vk::DeviceSize stagedSize(uint32_t width, uint32_t height, const MipChain& mips) {
+        return vk::DeviceSize(width) * height * 4 + mips.data.size();
+    }
+
+    // Writes every level to `mapped + offset` and returns one copy region per level
+    std::vector<vk::BufferImageCopy> stageMipLevels(uint8_t* mapped, vk::DeviceSize offset,
+        const uint8_t* pixels, uint32_t width, uint32_t height, const MipChain& mips) {
+        const vk::DeviceSize baseSize = vk::DeviceSize(width) * height * 4;
+        std::memcpy(mapped + offset, pixels, baseSize);
+        if (!mips.data.empty()) {
+            std::memcpy(mapped + offset + baseSize, mips.data.data(), mips.data.size());
+        }
+
+        std::vector<vk::BufferImageCopy> regions;
+        regions.reserve(mips.levels.size() + 1);
+
+        vk::BufferImageCopy region;
+        region.bufferOffset = offset;
+        region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+        region.imageExtent = vk::Extent3D(width, height, 1);
+        regions.push_back(region);
+
+        for (size_t i = 0; i < mips.levels.size(); i++) {
+            const MipLevel& level = mips.levels[i];
+            region.bufferOffset = offset + baseSize + level.offset;
+            region.imageSubresource.mipLevel = static_cast<uint32_t>(i + 1);
+            region.imageExtent = vk::Extent3D(level.width, level.height, 1);
+            regions.push_back(region);
+        }
+        return regions;
+    }
+
+    // Stages every level and records the copies (and the layout change to shader read) on the upload queue
+    void queueTextureUpload(const Context& context, vk::Image image,
+        const uint8_t* pixels, uint32_t width, uint32_t height, const MipChain& mips) {
+        UploadQueue& uploader = *context.uploader;
+        UploadQueue::StagingRange staging = uploader.allocateStaging(stagedSize(width, height, mips));
+        std::vector<vk::BufferImageCopy> regions = stageMipLevels(staging.data, 0, pixels, width, height, mips);
+        uploader.copyToImage(staging, image, std::move(regions), vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+
+    struct StbiDeleter {
+        void operator()(stbi_uc* pixels) const { stbi_image_free(pixels); }
+    };
+
+    struct DecodedImage {
+        std::unique_ptr<stbi_uc, StbiDeleter> pixels;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        MipChain mips;
+        double decodeMs = 0.0;
+        double mipMs = 0.0;
+    };
+}
+
 
-Texture createTexture(const Context& context, const std::string& path) {
+Texture createTexture(const Context& context, const std::string& path, bool srgb) {
     // 1. Load image pixels from file using stb_image
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    int texWidth, texHeight;
+    stbi_uc* pixels = loadImageRgba(path, texWidth, texHeight);
     if (!pixels) {
         throw std::runtime_error("Failed to load texture image: " + path);
     }
-    vk::DeviceSize imageSize = texWidth * texHeight * 4;
+    const uint32_t width = static_cast<uint32_t>(texWidth);
+    const uint32_t height = static_cast<uint32_t>(texHeight);
 
-    // 2. Staging buffer
-    Buffer stagingBuffer(context, Buffer::Type::TransferSrc, imageSize, pixels);
-    stbi_image_free(pixels); // We can now free the CPU-side pixels
+    // 2. Build the mip chain
+    MipChain mips = generateMipChain(pixels, width, height, srgb);
+    const uint32_t mipLevels = static_cast<uint32_t>(mips.levels.size()) + 1;
 
     // 3. Create the destination GPU image
-    vk::Extent2D extent = { (uint32_t)texWidth, (uint32_t)texHeight };
+    vk::Extent2D extent = { width, height };
     vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
-    // We pass eUndefined to prevent the automatic layout transition
-    Image gpuImage(context, extent, vk::Format::eR8G8B8A8Unorm, usage, vk::ImageLayout::eUndefined);
-
-    // 4. Copy data from staging buffer to GPU image and set the correct layout for shaders
-    context.oneTimeSubmit([&](vk::CommandBuffer cmd) {
-        // Transition layout to be ready for copying
-        Image::setImageLayout(cmd, *gpuImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    Image gpuImage(context, extent, vk::Format::eR8G8B8A8Unorm, usage, vk::ImageLayout::eShaderReadOnlyOptimal, mipLevels);
 
-        // Copy the data
-        vk::BufferImageCopy region;
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 1;
-        region.imageOffset = vk::Offset3D(0, 0, 0);
-        region.imageExtent = vk::Extent3D(extent.width, extent.height, 1);
-        cmd.copyBufferToImage(*stagingBuffer.buffer, *gpuImage.image, vk::ImageLayout::eTransferDstOptimal, region);
-
-        // Transition layout to be ready for shader reading
-        Image::setImageLayout(cmd, *gpuImage.image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
-    });
+    // 4. Stage every level; the copies run with the next flush of the upload queue
+    queueTextureUpload(context, *gpuImage.image, pixels, width, height, mips);
+    stbi_image_free(pixels); // We can now free the CPU-side pixels
 
     // 5. Create a texture sampler
-    vk::SamplerCreateInfo samplerInfo{};
-    samplerInfo.magFilter = vk::Filter::eLinear;
-    samplerInfo.minFilter = vk::Filter::eLinear;
-    samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
-    samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
-    samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
-    samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.anisotropyEnable = VK_FALSE;  // requires device feature enabled
-    samplerInfo.maxAnisotropy = 1; //context.physicalDevice.getProperties().limits.maxSamplerAnisotropy;
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = vk::CompareOp::eAlways;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = 0.0f;
-    samplerInfo.borderColor = vk::BorderColor::eIntOpaqueBlack;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-    vk::UniqueSampler sampler = context.device->createSamplerUnique(samplerInfo);
+    vk::UniqueSampler sampler = createTextureSampler(context, static_cast<float>(mipLevels));
 
     // 6. Return the completed texture object
     return { std::move(gpuImage), std::move(sampler) };
 }
 
+std::vector<Texture> loadTextures(const Context& context, const std::vector<std::string>& paths,
+    const std::vector<bool>& srgb, TextureLoadStats* stats) {
+    auto start = Clock::now();
+    TextureLoadStats localStats;
+    TextureLoadStats& s = stats ? *stats : localStats;
+    s = TextureLoadStats();
+
+    ThreadPool& pool = ThreadPool::global();
+    const size_t count = paths.size();
+    std::vector<Texture> textures(count);
+    std::vector<DecodedImage> decoded(count);
+
+    // Decoded images waiting for upload, in completion order
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+    std::deque<size_t> ready;
+
+    // Declared last so it is destroyed (and waits for outstanding decodes) before the state above
+    TaskGroup decodes(pool);
+
+    // Caps the number of decoded images held in memory at once
+    const size_t maxPending = 2 * static_cast<size_t>(pool.size());
+    size_t nextDecode = 0;
+    size_t pending = 0;
+    auto launchDecodes = [&] {
+        while (nextDecode < count && pending < maxPending) {
+            size_t index = nextDecode++;
+            pending++;
+            decodes.run([&, index] {
+                auto decodeStart = Clock::now();
+                int width = 0, height = 0;
+                DecodedImage& image = decoded[index];
+                image.pixels.reset(loadImageRgba(paths[index], width, height));
+                image.width = static_cast<uint32_t>(width);
+                image.height = static_cast<uint32_t>(height);
+                image.decodeMs = millisecondsSince(decodeStart);
+
+                if (image.pixels) {
+                    auto mipStart = Clock::now();
+                    bool isSrgb = index < srgb.size() && srgb[index];
+                    image.mips = generateMipChain(image.pixels.get(), image.width, image.height, isSrgb);
+                    image.mipMs = millisecondsSince(mipStart);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    ready.push_back(index);
+                }
+                readyCondition.notify_one();
+            });
+        }
+    };
+
+    UploadQueue& uploader = *context.uploader;
+    const uint32_t flushesBefore = uploader.getStats().flushes;
+
+    auto upload = [&](size_t index) {
+        DecodedImage& image = decoded[index];
+        if (!image.pixels) {
+            throw std::runtime_error("Failed to load texture image: " + paths[index]);
+        }
+        const vk::DeviceSize imageSize = stagedSize(image.width, image.height, image.mips);
+        const uint32_t mipLevels = static_cast<uint32_t>(image.mips.levels.size()) + 1;
+        s.decodeMs += image.decodeMs;
+        s.mipMs += image.mipMs;
+        s.bytes += imageSize;
+
+        auto recordStart = Clock::now();
+        vk::Extent2D extent = { image.width, image.height };
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+        Texture& texture = textures[index];
+        texture.image = Image(context, extent, vk::Format::eR8G8B8A8Unorm, usage, vk::ImageLayout::eShaderReadOnlyOptimal, mipLevels);
+        texture.sampler = createTextureSampler(context, static_cast<float>(mipLevels));
+        s.submitMs += millisecondsSince(recordStart);
+
+        // Ring space may only free up after a flush and fence wait, that part counts as submit time
+        auto stagingStart = Clock::now();
+        const double stallBefore = uploader.getStats().stallMs;
+        queueTextureUpload(context, *texture.image.image, image.pixels.get(), image.width, image.height, image.mips);
+        const double stallMs = uploader.getStats().stallMs - stallBefore;
+        s.stagingMs += millisecondsSince(stagingStart) - stallMs;
+        s.submitMs += stallMs;
+
+        image.pixels.reset();
+        image.mips = MipChain();
+    };
+
+    try {
+        launchDecodes();
+        for (size_t uploaded = 0; uploaded < count; uploaded++) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                while (ready.empty()) {
+                    // Decode on this thread too when the workers haven't picked everything up yet
+                    lock.unlock();
+                    bool helped = pool.runPendingTask();
+                    lock.lock();
+                    if (helped || !ready.empty()) continue;
+
+                    // Nothing to stage for a while, let the GPU start on what is recorded
+                    lock.unlock();
+                    uploader.flush();
+                    lock.lock();
+                    if (!ready.empty()) continue;
+
+                    auto waitStart = Clock::now();
+                    readyCondition.wait(lock, [&] { return !ready.empty(); });
+                    s.waitMs += millisecondsSince(waitStart);
+                }
+                index = ready.front();
+                ready.pop_front();
+            }
+
+            pending--;
+            launchDecodes();
+            upload(index);
+        }
+
+        auto finishStart = Clock::now();
+        uploader.finish();
+        s.submitMs += millisecondsSince(finishStart);
+    }
+    catch (...) {
+        // Staging memory may still be in use by the GPU
+        context.queue.waitIdle();
+        throw;
+    }
+
+    s.batches = uploader.getStats().flushes - flushesBefore;
+    s.totalMs = millisecondsSince(start);
+    return textures;
+}
+
 Texture createTextureFromMemory(const Context& context, const unsigned char* data, size_t size) {
     // Load image from memory using STB image
     int texWidth, texHeight, texChannels;
@@ -84,11 +278,8 @@ Texture createTextureFromMemory(const Context& context, const unsigned char* dat
     // Create a temporary path for the createTexture function
     // We'll use a different approach here
     Texture texture;
-    vk::DeviceSize imageSize = texWidth * texHeight * 4;
 
     try {
-        Buffer stagingBuffer(context, Buffer::Type::TransferSrc, imageSize, pixels);
-
         texture.image = Image(
             context,
             vk::Extent2D(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight)),
@@ -97,47 +288,9 @@ Texture createTextureFromMemory(const Context& context, const unsigned char* dat
             vk::ImageLayout::eShaderReadOnlyOptimal
         );
 
-        // Copy from staging buffer to image (same as in createTexture)
-        context.oneTimeSubmit([&](vk::CommandBuffer cmdBuffer) {
-            Image::setImageLayout(
-                cmdBuffer,
-                *texture.image.image,
-                vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eTransferDstOptimal,
-                vk::PipelineStageFlagBits::eTopOfPipe,
-                vk::PipelineStageFlagBits::eTransfer
-            );
-
-            vk::BufferImageCopy region;
-            region.bufferOffset = 0;
-            region.bufferRowLength = 0;
-            region.bufferImageHeight = 0;
-            region.imageSubresource = vk::ImageSubresourceLayers(
-                vk::ImageAspectFlagBits::eColor, 0, 0, 1
-            );
-            region.imageOffset = vk::Offset3D(0, 0, 0);
-            region.imageExtent = vk::Extent3D(
-                static_cast<uint32_t>(texWidth),
-                static_cast<uint32_t>(texHeight),
-                1
-            );
-
-            cmdBuffer.copyBufferToImage(
-                *stagingBuffer.buffer,
-                *texture.image.image,
-                vk::ImageLayout::eTransferDstOptimal,
-                1, &region
-            );
-
-            Image::setImageLayout(
-                cmdBuffer,
-                *texture.image.image,
-                vk::ImageLayout::eTransferDstOptimal,
-                vk::ImageLayout::eShaderReadOnlyOptimal,
-                vk::PipelineStageFlagBits::eTransfer,
-                vk::PipelineStageFlagBits::eFragmentShader
-            );
-            });
+        // Copy through the upload queue (same as in createTexture)
+        queueTextureUpload(context, *texture.image.image, pixels,
+            static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), MipChain());
 
         // Create sampler (same as in createTexture)
         vk::SamplerCreateInfo samplerInfo;
@@ -173,11 +326,8 @@ Texture createTextureFromMemory(const Context& context, const unsigned char* dat
 Texture createTextureFromData(const Context& context, uint32_t width, uint32_t height,
     vk::Format format, const void* data) {
     Texture texture;
-    vk::DeviceSize imageSize = width * height * 4; // Assuming 4 bytes per pixel
 
     try {
-        Buffer stagingBuffer(context, Buffer::Type::TransferSrc, imageSize, data);
-
         texture.image = Image(
             context,
             vk::Extent2D(width, height),
@@ -186,43 +336,8 @@ Texture createTextureFromData(const Context& context, uint32_t width, uint32_t h
             vk::ImageLayout::eShaderReadOnlyOptimal
         );
 
-        // Copy from staging buffer to image (same as before)
-        context.oneTimeSubmit([&](vk::CommandBuffer cmdBuffer) {
-            Image::setImageLayout(
-                cmdBuffer,
-                *texture.image.image,
-                vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eTransferDstOptimal,
-                vk::PipelineStageFlagBits::eTopOfPipe,
-                vk::PipelineStageFlagBits::eTransfer
-            );
-
-            vk::BufferImageCopy region;
-            region.bufferOffset = 0;
-            region.bufferRowLength = 0;
-            region.bufferImageHeight = 0;
-            region.imageSubresource = vk::ImageSubresourceLayers(
-                vk::ImageAspectFlagBits::eColor, 0, 0, 1
-            );
-            region.imageOffset = vk::Offset3D(0, 0, 0);
-            region.imageExtent = vk::Extent3D(width, height, 1);
-
-            cmdBuffer.copyBufferToImage(
-                *stagingBuffer.buffer,
-                *texture.image.image,
-                vk::ImageLayout::eTransferDstOptimal,
-                1, &region
-            );
-
-            Image::setImageLayout(
-                cmdBuffer,
-                *texture.image.image,
-                vk::ImageLayout::eTransferDstOptimal,
-                vk::ImageLayout::eShaderReadOnlyOptimal,
-                vk::PipelineStageFlagBits::eTransfer,
-                vk::PipelineStageFlagBits::eFragmentShader
-            );
-            });
+        // Copy through the upload queue (same as before)
+        queueTextureUpload(context, *texture.image.image, static_cast<const uint8_t*>(data), width, height, MipChain());
 
         // Create sampler (same as before)
         vk::SamplerCreateInfo samplerInfo;
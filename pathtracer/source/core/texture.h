@@ -5,6 +5,9 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
 
+#include <string>
+#include <vector>
+
 class Context;
 
 struct Texture {
@@ -12,7 +15,30 @@ struct Texture {
     vk::UniqueSampler sampler;
 };
 
-Texture createTexture(const Context& context, const std::string& path);
+// Textures are staged on context.uploader: they are usable once it has been finished (oneTimeSubmit finishes it too)
+
+// Uploads the image with a full mip chain; srgb marks color data so the chain is filtered in linear light
+Texture createTexture(const Context& context, const std::string& path, bool srgb = false);
+
+// Where the time of loadTextures goes. Decode is summed over every thread that decoded,
+// the other stages are measured on the uploading thread.
+struct TextureLoadStats {
+    double decodeMs = 0.0;  // stbi_load
+    double mipMs = 0.0;     // mip chain generation, summed like decode
+    double stagingMs = 0.0; // copies into the upload queue's staging ring
+    double submitMs = 0.0;  // image creation, command recording, waits for ring space and the final finish
+    double waitMs = 0.0;    // uploading thread idle, waiting for a decode to finish
+    double totalMs = 0.0;
+    uint64_t bytes = 0;
+    uint32_t batches = 0;   // upload queue flushes while loading
+};
+
+// Decodes the files on the thread pool while the calling thread stages finished ones on the upload queue,
+// which is finished before returning.
+// Every texture gets a full mip chain, built on the decoding thread; srgb[i] marks color textures
+// (missing entries count as linear data). Textures are returned in the same order as `paths`.
+std::vector<Texture> loadTextures(const Context& context, const std::vector<std::string>& paths,
+    const std::vector<bool>& srgb, TextureLoadStats* stats = nullptr);
 
 Texture createTextureFromMemory(const Context& context, const unsigned char* data, size_t size);
 Texture createTextureFromData(const Context& context, uint32_t width, uint32_t height,
@@ -0,0 +1,194 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+    // Identifies the pool (and deque) the current thread works for
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local uint32_t currentQueue = 0;
+
+    // Yields a waiting thread spins through before it sleeps, most groups finish within them
+    constexpr uint32_t WAIT_SPIN_COUNT = 64;
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    queues.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    // The waiting thread always takes part, so spawn one less
+    for (uint32_t i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func) {
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+
+    // Not worth waking anyone up
+    if (workers.empty() || count <= grain) {
+        func(0, count);
+        return;
+    }
+
+    // One runner per thread, each pulling chunks until the range is exhausted
+    const size_t chunkCount = (count + grain - 1) / grain;
+    const size_t runnerCount = std::min<size_t>(chunkCount, size());
+    std::atomic<size_t> nextChunk{ 0 };
+
+    TaskGroup group(*this);
+    for (size_t r = 0; r < runnerCount; r++) {
+        group.run([&] {
+            for (;;) {
+                size_t begin = nextChunk.fetch_add(1) * grain;
+                if (begin >= count) break;
+                func(begin, std::min(count, begin + grain));
+            }
+        });
+    }
+    group.wait();
+}
+
+void ThreadPool::submit(Task task) {
+    uint32_t queueIndex = (currentPool == this) ? currentQueue : 0;
+    {
+        std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+
+    // Bump the counter before taking the mutex so a worker about to sleep can't miss it
+    queuedTasks.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_one();
+    progress.notify_all();
+}
+
+bool ThreadPool::popTask(Task& task) {
+    if (queuedTasks.load() == 0) return false;
+
+    const uint32_t own = (currentPool == this) ? currentQueue : 0;
+
+    // Newest task of our own queue first, it is the most likely to be cache-hot
+    {
+        WorkQueue& queue = *queues[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Otherwise steal the oldest (usually largest) task from someone else
+    const uint32_t queueCount = static_cast<uint32_t>(queues.size());
+    for (uint32_t i = 1; i < queueCount; i++) {
+        WorkQueue& queue = *queues[(own + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queuedTasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ThreadPool::runPendingTask() {
+    Task task;
+    if (!popTask(task)) return false;
+
+    try {
+        task.func();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(task.group->errorMutex);
+        if (!task.group->error) task.group->error = std::current_exception();
+    }
+
+    // The group may be destroyed as soon as pending reaches 0, only the pool is touched after that
+    if (task.group->pending.fetch_sub(1) == 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        progress.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(uint32_t queueIndex) {
+    currentPool = this;
+    currentQueue = queueIndex;
+
+    for (;;) {
+        if (runPendingTask()) continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stopping || queuedTasks.load() > 0; });
+        if (stopping) return;
+    }
+}
+
+void TaskGroup::run(std::function<void()> func) {
+    pending.fetch_add(1);
+    pool.submit({ std::move(func), this });
+}
+
+void TaskGroup::wait() {
+    waitNoThrow();
+
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void TaskGroup::waitNoThrow() {
+    uint32_t idleSpins = 0;
+    while (pending.load() > 0) {
+        if (pool.runPendingTask()) {
+            idleSpins = 0;
+            continue;
+        }
+        if (idleSpins < WAIT_SPIN_COUNT) {
+            idleSpins++;
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Nothing to help with: sleep until the group is done or a task is queued. Both are signalled after
+        // their counter changes and under the pool mutex, so the wakeup can't be missed.
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.progress.wait(lock, [&] { return pending.load() == 0 || pool.queuedTasks.load() > 0; });
+        idleSpins = 0;
+    }
+}
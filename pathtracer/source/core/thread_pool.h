@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Work-stealing pool: every worker owns a deque it pushes to and pops from (LIFO),
+// idle workers steal from the other end of someone else's deque (FIFO).
+// Threads that wait on a TaskGroup execute pending tasks instead of blocking, so nesting is safe; they only
+// sleep when there is nothing left to help with.
+class ThreadPool {
+public:
+    // threadCount = 0 uses every hardware thread (the waiting thread counts as one of them)
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Splits [0, count) into chunks of `grain` items and runs them on the workers and the calling thread.
+    // Blocks until every chunk has finished; the first exception thrown by a chunk is rethrown here.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& func);
+
+    // Runs one queued task on the calling thread, returns false if there was nothing to run.
+    // Lets a thread that waits for results produced by the pool help instead of idling.
+    bool runPendingTask();
+
+    uint32_t size() const { return static_cast<uint32_t>(workers.size()) + 1; }
+
+    // Process-wide pool shared by the loaders and the CPU renderer
+    static ThreadPool& global();
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> func;
+        TaskGroup* group = nullptr;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void submit(Task task);
+    bool popTask(Task& task);
+    void workerLoop(uint32_t queueIndex);
+
+    std::vector<std::thread> workers;
+    // queues[0] is fed by threads outside the pool, queues[i + 1] belongs to workers[i]
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    // TaskGroup waiters: notified when a group's last task finishes and when a task is queued
+    std::condition_variable progress;
+    std::atomic<uint32_t> queuedTasks{ 0 };
+    bool stopping = false;
+};
+
+// Set of tasks that can be waited on together. Tasks may spawn more tasks into the same group.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::global()) : pool(pool) {}
+    ~TaskGroup() { waitNoThrow(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void run(std::function<void()> func);
+    // Helps executing tasks until every task of this group has finished, then rethrows the first failure
+    void wait();
+
+private:
+    friend class ThreadPool;
+
+    void waitNoThrow();
+
+    ThreadPool& pool;
+    std::atomic<uint32_t> pending{ 0 };
+    std::mutex errorMutex;
+    std::exception_ptr error;
+};
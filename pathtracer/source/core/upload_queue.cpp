@@ -0,0 +1,201 @@
+#include "upload_queue.h"
+#include "context.h"
+#include "image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    using Clock = std::chrono::high_resolution_clock;
+
+    double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+    constexpr vk::DeviceSize NO_OFFSET = ~vk::DeviceSize(0);
+}
+
+UploadQueue::UploadQueue(const Context& context, vk::DeviceSize ringSize)
+    : context(context), ringSize(ringSize) {
+    vk::CommandPoolCreateInfo poolInfo;
+    poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+    poolInfo.setQueueFamilyIndex(context.queueFamilyIndex);
+    commandPool = context.device->createCommandPoolUnique(poolInfo);
+
+    ring = Buffer(context, Buffer::Type::TransferSrc, ringSize);
+    ringData = static_cast<uint8_t*>(ring.map(context));
+}
+
+UploadQueue::~UploadQueue() {
+    try {
+        finish();
+    }
+    catch (...) {
+        // The device is going away anyway, don't throw from a destructor
+    }
+}
+
+vk::CommandBuffer UploadQueue::getCommandBuffer() {
+    if (!current.commandBuffer) {
+        vk::CommandBufferAllocateInfo allocInfo(*commandPool, vk::CommandBufferLevel::ePrimary, 1);
+        current.commandBuffer = std::move(context.device->allocateCommandBuffersUnique(allocInfo)[0]);
+        current.commandBuffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    }
+    return *current.commandBuffer;
+}
+
+UploadQueue::StagingRange UploadQueue::allocateStaging(vk::DeviceSize size) {
+    const vk::DeviceSize alignedSize = (std::max<vk::DeviceSize>(size, 1) + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    stats.bytesStaged += size;
+
+    // Doesn't fit the ring at all, use a buffer of its own that lives as long as the batch
+    if (alignedSize > ringSize) {
+        Buffer staging(context, Buffer::Type::TransferSrc, alignedSize);
+        StagingRange range{ static_cast<uint8_t*>(staging.map(context)), *staging.buffer, 0 };
+        current.keepAlive.push_back(std::move(staging));
+        return range;
+    }
+
+    retireFinished();
+    for (;;) {
+        if (used == 0) head = tail = 0;
+
+        vk::DeviceSize offset = NO_OFFSET;
+        if (used < ringSize) {
+            if (head >= tail) {
+                if (ringSize - head >= alignedSize) {
+                    offset = head;
+                }
+                else if (tail >= alignedSize) {
+                    // Skip the end of the ring, the padding is released together with this batch
+                    current.ringBytes += ringSize - head;
+                    used += ringSize - head;
+                    offset = 0;
+                }
+            }
+            else if (tail - head >= alignedSize) {
+                offset = head;
+            }
+        }
+
+        if (offset != NO_OFFSET) {
+            head = offset + alignedSize;
+            used += alignedSize;
+            current.ringBytes += alignedSize;
+            return { ringData + offset, *ring.buffer, offset };
+        }
+
+        // Ring is full: submit what is pending if nothing else can free space, then wait for the oldest batch
+        auto stallStart = Clock::now();
+        if (inFlight.empty()) flush();
+        retireOldest();
+        stats.stallMs += millisecondsSince(stallStart);
+    }
+}
+
+void UploadQueue::copyToImage(const StagingRange& staging, vk::Image image, std::vector<vk::BufferImageCopy> regions, vk::ImageLayout finalLayout) {
+    for (auto& region : regions) {
+        region.bufferOffset += staging.offset;
+    }
+
+    vk::CommandBuffer cmd = getCommandBuffer();
+    Image::setImageLayout(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    cmd.copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, regions);
+    Image::setImageLayout(cmd, image, vk::ImageLayout::eTransferDstOptimal, finalLayout);
+    stats.copies++;
+}
+
+void UploadQueue::copyToBuffer(const StagingRange& staging, vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size) {
+    vk::CommandBuffer cmd = getCommandBuffer();
+    cmd.copyBuffer(staging.buffer, buffer, vk::BufferCopy(staging.offset, offset, size));
+    copiesSinceBarrier = true;
+    stats.copies++;
+}
+
+void UploadQueue::uploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void* data, vk::DeviceSize size) {
+    // Chunks of a quarter ring keep big uploads streaming through the ring instead of a temporary buffer
+    const vk::DeviceSize chunkSize = std::max<vk::DeviceSize>(ringSize / 4, STAGING_ALIGNMENT);
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (vk::DeviceSize done = 0; done < size; done += chunkSize) {
+        vk::DeviceSize chunk = std::min(chunkSize, size - done);
+        StagingRange staging = allocateStaging(chunk);
+        std::memcpy(staging.data, bytes + done, chunk);
+        copyToBuffer(staging, buffer, offset + done, chunk);
+    }
+}
+
+void UploadQueue::barrierAfterCopies() {
+    if (!copiesSinceBarrier) return;
+
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eAccelerationStructureReadKHR);
+    getCommandBuffer().pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+        {}, barrier, nullptr, nullptr);
+    copiesSinceBarrier = false;
+}
+
+void UploadQueue::record(const std::function<void(vk::CommandBuffer)>& func) {
+    vk::CommandBuffer cmd = getCommandBuffer();
+    barrierAfterCopies();
+    func(cmd);
+}
+
+void UploadQueue::keepAlive(Buffer&& buffer) {
+    current.keepAlive.push_back(std::move(buffer));
+}
+
+void UploadQueue::flush() {
+    if (!current.commandBuffer && current.ringBytes == 0 && current.keepAlive.empty()) return;
+
+    // The barrier also covers commands of later submissions, so whatever is submitted next sees the uploads
+    getCommandBuffer();
+    barrierAfterCopies();
+    current.commandBuffer->end();
+
+    current.fence = context.device->createFenceUnique(vk::FenceCreateInfo());
+    vk::SubmitInfo submitInfo;
+    submitInfo.setCommandBuffers(*current.commandBuffer);
+    context.queue.submit(submitInfo, *current.fence);
+
+    current.ringEnd = head;
+    inFlight.push_back(std::move(current));
+    current = Submission();
+    stats.flushes++;
+}
+
+void UploadQueue::finish() {
+    flush();
+
+    auto waitStart = Clock::now();
+    while (!inFlight.empty()) {
+        retireOldest();
+    }
+    stats.waitMs += millisecondsSince(waitStart);
+}
+
+void UploadQueue::retire(Submission& submission) {
+    // Submissions complete in order, so the ring is released from the tail. A batch without ring bytes (only
+    // dedicated staging buffers) holds a head that may be stale since the ring emptied and restarted at 0.
+    if (submission.ringBytes == 0) return;
+    used -= submission.ringBytes;
+    tail = submission.ringEnd;
+}
+
+void UploadQueue::retireOldest() {
+    Submission& oldest = inFlight.front();
+    if (context.device->waitForFences(*oldest.fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed waiting for an upload batch");
+    }
+    retire(oldest);
+    inFlight.pop_front();
+}
+
+void UploadQueue::retireFinished() {
+    while (!inFlight.empty() && context.device->getFenceStatus(*inFlight.front().fence) == vk::Result::eSuccess) {
+        retire(inFlight.front());
+        inFlight.pop_front();
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "buffer.h"
+
+#define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
+#include <vulkan/vulkan.hpp>
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+class Context;
+
+struct UploadStats {
+    uint64_t bytesStaged = 0; // bytes copied through staging memory
+    uint32_t copies = 0;      // recorded buffer / image copies
+    uint32_t flushes = 0;     // queue submissions
+    double stallMs = 0.0;     // blocked until the GPU released ring space
+    double waitMs = 0.0;      // blocked in finish()
+};
+
+// Records uploads (buffer and image copies, acceleration structure builds) into one command buffer and
+// submits them together instead of one fenced submit per resource. Staging memory comes from a persistently
+// mapped ring buffer whose space is reclaimed once the submission using it has completed; larger uploads get
+// a temporary staging buffer. Nothing reaches the GPU before flush() or finish(), destination resources must
+// stay alive until then. Not thread safe.
+class UploadQueue {
+public:
+    struct StagingRange {
+        uint8_t* data = nullptr;
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+    };
+
+    explicit UploadQueue(const Context& context, vk::DeviceSize ringSize = 64ull * 1024 * 1024);
+    ~UploadQueue();
+
+    UploadQueue(const UploadQueue&) = delete;
+    UploadQueue& operator=(const UploadQueue&) = delete;
+
+    // Host memory for one copy; record the copy before calling anything else on the queue
+    StagingRange allocateStaging(vk::DeviceSize size);
+    // Buffer offsets in `regions` are relative to the staging range; the image goes from undefined to finalLayout
+    void copyToImage(const StagingRange& staging, vk::Image image, std::vector<vk::BufferImageCopy> regions, vk::ImageLayout finalLayout);
+    void copyToBuffer(const StagingRange& staging, vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size);
+    // Stages `data` (in ring-sized chunks when it is bigger than the ring) and records the copies
+    void uploadBuffer(vk::Buffer buffer, vk::DeviceSize offset, const void* data, vk::DeviceSize size);
+
+    // Records other commands, ordered after every copy recorded so far
+    void record(const std::function<void(vk::CommandBuffer)>& func);
+    // Keeps a buffer (e.g. build scratch) alive until the commands recorded so far have executed
+    void keepAlive(Buffer&& buffer);
+
+    // Submits everything recorded since the last flush without waiting for it
+    void flush();
+    // Submits and waits until every upload has completed
+    void finish();
+
+    const UploadStats& getStats() const { return stats; }
+
+private:
+    struct Submission {
+        vk::UniqueCommandBuffer commandBuffer;
+        vk::UniqueFence fence;
+        vk::DeviceSize ringEnd = 0;   // ring head when submitted
+        vk::DeviceSize ringBytes = 0; // ring space (wrap padding included) released on completion
+        std::vector<Buffer> keepAlive;
+    };
+
+    vk::CommandBuffer getCommandBuffer();
+    // Makes the copies recorded so far visible to whatever is recorded next
+    void barrierAfterCopies();
+    void retire(Submission& submission);
+    void retireOldest();
+    void retireFinished();
+
+    const Context& context;
+    vk::UniqueCommandPool commandPool;
+
+    Buffer ring;
+    uint8_t* ringData = nullptr;
+    vk::DeviceSize ringSize = 0;
+    vk::DeviceSize head = 0; // next free byte
+    vk::DeviceSize tail = 0; // oldest byte still in use
+    vk::DeviceSize used = 0; // bytes between tail and head, so head == tail can mean empty or full
+
+    Submission current;
+    bool copiesSinceBarrier = false;
+    std::deque<Submission> inFlight;
+
+    UploadStats stats;
+};
@@ -1,15 +1,36 @@
+#include "bench.h"
 #include "common.h"
 #include "core/context.h"
 #include "core/texture.h"
 #include "core/accel.h"
+#include "core/thread_pool.h"
+#include "core/upload_queue.h"
+#include "core/frame_timer.h"
 #include "math/math_utils.h"
 #include "math/mat4.h"
+#include "math/half.h"
 #include "render/camera.h"
 #include "render/model_loader.h"
+#include "render/scene.h"
+#include "render/scene_cache.h"
+#include "render/scene_file.h"
+#include "render/scene_streamer.h"
+#include "render/vertex_format.h"
+#include "render/lights.h"
+#include "render/cpu_tracer.h"
+#include "render/image_writer.h"
+#include "render/display_transform.h"
+#include "render/denoiser.h"
 
 #include <map>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <algorithm>
 #include <cmath>
 #include <string>
+#include <sstream>
 #include <fstream>
 #include <iostream>
 #include <functional>
@@ -22,10 +43,8 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 ///////////// MODEL LOADER /////////////
 
-struct SceneObject {
-    std::string modelPath;
-    Mat4 transform;
-};
+const std::string MODEL_DIR = "../assets/models/";
+const std::string CACHE_DIR = "../assets/cache/";
 
 std::vector<SceneObject> MODELS_TO_LOAD = {
     //{"chess/ABeautifulGame.gltf", Mat4::identity()},
@@ -49,14 +68,38 @@ bool firstMouse = true;
 double lastX = WIDTH / 2.0;
 double lastY = HEIGHT / 2.0;
 
+// Scene resources read by the ray tracing pipeline, updated as the streamer adds objects.
+// Textures and bottom-level structures are kept across updates: appended meshes leave the existing ones in place.
+struct GpuScene {
+    std::vector<Texture> textures;
+    Buffer vertexBuffer;
+    Buffer indexBuffer;
+    Buffer materialBuffer;
+    Buffer faceMaterialIndexBuffer;
+    Buffer emissiveBuffer;
+    Buffer emissiveAliasBuffer;
+    Buffer lightCountBuffer;
+    std::vector<Accel> bottomAccels;
+    std::vector<uint64_t> meshAccelAddresses;
+    Buffer instancesBuffer;
+    Accel topAccel;
+};
+
 // Function declarations
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void processInput(GLFWwindow* window, float deltaTime);
+int runCpuReference(const SceneFile& sceneFile, int frames);
+std::vector<float> parseFloatList(const std::string& text);
+std::vector<float> readImageRgba(const Context& context, const Image& image, vk::Format format, vk::Extent2D extent);
+void writeAovs(const std::string& outputPath, const DenoiserInputs& inputs, const std::vector<uint32_t>& ids);
+void updateGpuScene(const Context& context, GpuScene& gpu, const SceneData& scene, const std::vector<EmissiveTriGPU>& emissiveTris);
 
 // Push constants and matrix buffer structures
 struct PushConstants {
     int frame;
-    float pad1, pad2, pad3;
+    int samplesPerFrame;
+    int maxDepth;
+    float skyIntensity;
     Vec3 cameraPos;
     float pad4;
     Vec3 cameraFront;
@@ -66,343 +109,265 @@ struct PushConstants {
     Vec3 cameraRight;
 };
 
-struct EmissiveTriGPU {
-    alignas(16) float v0[4];       // xyz, pad
-    alignas(16) float v1[4];
-    alignas(16) float v2[4];
-    alignas(16) float normal[4];   // xyz, pad
-    alignas(16) float emission[4]; // rgb radiance (linear), pad
-    alignas(16) float area[4];     // area in .x, rest pad
+// Push constants of display.comp
+struct DisplayConstants {
+    float exposureScale;
+    int tonemap;
+    int dither;
+};
+
+// Push constants of denoise.comp
+struct DenoiseConstants {
+    int pass;
+    int stepSize;
+    int frameCount;
+    int remodulate;
+    float sigmaDepth;
+    float sigmaLuminance;
 };
 
-int main() {
-    // 1. Initialize GLFW and create window
-    if (!glfwInit()) {
-        throw std::runtime_error("Failed to initialize GLFW");
+int main(int argc, char** argv) {
+    using Clock = std::chrono::high_resolution_clock;
+    auto startTime = Clock::now();
+
+    // Command line: --scene loads a scene file instead of MODELS_TO_LOAD, --cpu renders the scene with the CPU
+    // reference tracer instead of opening a window, --bench runs the CPU-side benchmarks on the same scene.
+    // --headless renders --spp samples per pixel at --width x --height on the GPU without a window and writes
+    // the accumulated image to --output (.hdr is written linear, anything else as PNG).
+    // --camera x,y,z[,yaw,pitch] overrides the scene file's camera. --accum-fp16 keeps the running average in
+    // half floats: half the bandwidth, but it stops converging after a few thousand frames (see --bench).
+    // --traces-per-present K traces K frames before each present, 0 keeps presenting the image without tracing.
+    // --denoise runs the a-trous denoiser before display. --denoise-dump file saves the denoiser's inputs after
+    // --denoise-dump-frames frames of a headless render with the finished render as their reference; --bench
+    // measures the denoiser on every --denoise-input file (on synthetic inputs without one). --aovs also writes the
+    // first-hit albedo, normal, depth and IDs of a headless render next to the output, as <output>_<aov>.pfm.
+    bool cpuReference = false;
+    bool benchmarks = false;
+    bool headless = false;
+    bool accumHalf = false;
+    int cpuFrames = 16;
+    uint32_t renderWidth = WIDTH;
+    uint32_t renderHeight = HEIGHT;
+    int samplesPerPixel = 256;
+    int tracesPerPresent = 1;
+    std::string outputPath = "render.png";
+    bool denoiseRequested = false;
+    bool writeAovFiles = false;
+    int denoiseDumpFrames = 4;
+    std::string denoiseDumpPath;
+    std::vector<std::string> denoiseInputPaths;
+    std::vector<float> cameraOverride;
+    std::string scenePath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cpu") cpuReference = true;
+        else if (arg == "--bench") benchmarks = true;
+        else if (arg == "--headless") headless = true;
+        else if (arg == "--accum-fp16") accumHalf = true;
+        else if (arg == "--traces-per-present" && i + 1 < argc) tracesPerPresent = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--frames" && i + 1 < argc) cpuFrames = std::stoi(argv[++i]);
+        else if (arg == "--scene" && i + 1 < argc) scenePath = argv[++i];
+        else if (arg == "--width" && i + 1 < argc) renderWidth = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--height" && i + 1 < argc) renderHeight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--spp" && i + 1 < argc) samplesPerPixel = std::stoi(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg == "--camera" && i + 1 < argc) cameraOverride = parseFloatList(argv[++i]);
+        else if (arg == "--denoise") denoiseRequested = true;
+        else if (arg == "--aovs") writeAovFiles = true;
+        else if (arg == "--denoise-dump" && i + 1 < argc) denoiseDumpPath = argv[++i];
+        else if (arg == "--denoise-dump-frames" && i + 1 < argc) denoiseDumpFrames = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--denoise-input" && i + 1 < argc) denoiseInputPaths.push_back(argv[++i]);
     }
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    // The window and swapchain stay at the default size
+    if (!headless) {
+        renderWidth = WIDTH;
+        renderHeight = HEIGHT;
+    }
+    if (renderWidth == 0 || renderHeight == 0 || samplesPerPixel <= 0) {
+        throw std::runtime_error("--width, --height and --spp must be positive");
+    }
 
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, APP_NAME, nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        throw std::runtime_error("Failed to create GLFW window");
+    SceneFile sceneFile;
+    if (scenePath.empty()) {
+        sceneFile.objects = MODELS_TO_LOAD;
+    }
+    else {
+        sceneFile = loadSceneFile(scenePath);
+        std::cout << "Scene file " << scenePath << ": " << sceneFile.objects.size() << " models" << std::endl;
     }
+    camera = sceneFile.camera;
+    if (denoiseRequested) sceneFile.denoiser.enabled = true;
+
+    if (!cameraOverride.empty()) {
+        if (cameraOverride.size() != 3 && cameraOverride.size() != 5) {
+            throw std::runtime_error("--camera takes x,y,z or x,y,z,yaw,pitch");
+        }
+        camera.position = Vec3(cameraOverride[0], cameraOverride[1], cameraOverride[2]);
+        if (cameraOverride.size() == 5) {
+            camera.yaw = cameraOverride[3];
+            camera.pitch = cameraOverride[4];
+        }
+        camera.updateCameraVectors();
+    }
+
+    if (benchmarks) {
+        return runBenchmarks(sceneFile.objects, MODEL_DIR, denoiseInputPaths);
+    }
+    if (cpuReference) {
+        return runCpuReference(sceneFile, cpuFrames);
+    }
+
+    // 1. Initialize GLFW and create window (headless renders have neither)
+    GLFWwindow* window = nullptr;
+    if (!headless) {
+        if (!glfwInit()) {
+            throw std::runtime_error("Failed to initialize GLFW");
+        }
 
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+        window = glfwCreateWindow(WIDTH, HEIGHT, APP_NAME, nullptr, nullptr);
+        if (!window) {
+            glfwTerminate();
+            throw std::runtime_error("Failed to create GLFW window");
+        }
+
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // 2. Initialize Vulkan context
-    Context context;
+    Context context(headless);
     context.initDevice(window);
 
-    vk::SwapchainCreateInfoKHR swapchainInfo;
-    swapchainInfo.setSurface(*context.surface);
-    swapchainInfo.setMinImageCount(3);
-    swapchainInfo.setImageFormat(vk::Format::eB8G8R8A8Unorm);
-    swapchainInfo.setImageColorSpace(vk::ColorSpaceKHR::eSrgbNonlinear);
-    swapchainInfo.setImageExtent({ WIDTH, HEIGHT });
-    swapchainInfo.setImageArrayLayers(1);
-    swapchainInfo.setImageUsage(vk::ImageUsageFlagBits::eTransferDst);
-    swapchainInfo.setPreTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity);
-    swapchainInfo.setPresentMode(vk::PresentModeKHR::eFifo);
-    swapchainInfo.setClipped(true);
-    swapchainInfo.setQueueFamilyIndices(context.queueFamilyIndex);
-    vk::UniqueSwapchainKHR swapchain = context.device->createSwapchainKHRUnique(swapchainInfo);
-
-    std::vector<vk::Image> swapchainImages = context.device->getSwapchainImagesKHR(*swapchain);
+    vk::UniqueSwapchainKHR swapchain;
+    std::vector<vk::Image> swapchainImages;
+    if (!headless) {
+        vk::SwapchainCreateInfoKHR swapchainInfo;
+        swapchainInfo.setSurface(*context.surface);
+        swapchainInfo.setMinImageCount(3);
+        swapchainInfo.setImageFormat(vk::Format::eB8G8R8A8Unorm);
+        swapchainInfo.setImageColorSpace(vk::ColorSpaceKHR::eSrgbNonlinear);
+        swapchainInfo.setImageExtent({ WIDTH, HEIGHT });
+        swapchainInfo.setImageArrayLayers(1);
+        swapchainInfo.setImageUsage(vk::ImageUsageFlagBits::eTransferDst);
+        swapchainInfo.setPreTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity);
+        swapchainInfo.setPresentMode(vk::PresentModeKHR::eFifo);
+        swapchainInfo.setClipped(true);
+        swapchainInfo.setQueueFamilyIndices(context.queueFamilyIndex);
+        swapchain = context.device->createSwapchainKHRUnique(swapchainInfo);
+
+        swapchainImages = context.device->getSwapchainImagesKHR(*swapchain);
+    }
+
+    // One command buffer, fence and acquire semaphore per frame in flight
+    struct FrameSlot {
+        vk::UniqueCommandBuffer commandBuffer;
+        vk::UniqueFence fence;
+        vk::UniqueSemaphore imageAcquired;
+        std::chrono::high_resolution_clock::time_point submitTime;
+        uint64_t submitted = 0; // frame number + 1 of the last submit, 0 when its latency was recorded
+    };
 
     vk::CommandBufferAllocateInfo commandBufferInfo;
     commandBufferInfo.setCommandPool(*context.commandPool);
-    commandBufferInfo.setCommandBufferCount(static_cast<uint32_t>(swapchainImages.size()));
+    commandBufferInfo.setCommandBufferCount(MAX_FRAMES_IN_FLIGHT);
     std::vector<vk::UniqueCommandBuffer> commandBuffers = context.device->allocateCommandBuffersUnique(commandBufferInfo);
 
+    std::vector<FrameSlot> frameSlots(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        frameSlots[i].commandBuffer = std::move(commandBuffers[i]);
+        frameSlots[i].fence = context.device->createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+        frameSlots[i].imageAcquired = context.device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+    }
+
+    // Present waits on these; indexed by swapchain image, which can't be presented again before it is reacquired
+    std::vector<vk::UniqueSemaphore> renderFinished(swapchainImages.size());
+    for (auto& semaphore : renderFinished) {
+        semaphore = context.device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+    }
+
+    const vk::Extent2D renderExtent{ renderWidth, renderHeight };
     Image outputImage{
         context,
-        {WIDTH, HEIGHT},
+        renderExtent,
         vk::Format::eB8G8R8A8Unorm,
         vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
     };
 
+    // raygen.rgen declares the accumulation image without a format, either float format works
+    const vk::Format accumFormat = accumHalf ? vk::Format::eR16G16B16A16Sfloat : vk::Format::eR32G32B32A32Sfloat;
     Image accumImage{
         context,
-        {WIDTH, HEIGHT},
-        vk::Format::eB8G8R8A8Unorm,
+        renderExtent,
+        accumFormat,
         vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
     };
 
-    std::vector<Vertex> sceneVertices;
-    std::vector<uint32_t> sceneIndices;
-    std::vector<Material> sceneMaterials;
-    std::vector<uint32_t> sceneFaceMaterialIndices;
-    std::vector<std::string> sceneTextureFiles;
-    std::unordered_map<std::string, int> textureIndexMap; // To de-duplicate textures across files
-
-    // Keep track of offsets as we load each model
-    uint32_t vertexOffset = 0;
-    uint32_t indexOffset = 0; // Not strictly needed for appending, but good for clarity
-    uint32_t materialOffset = 0;
-
-    std::cout << "Loading scene..." << std::endl;
-
-    // 3. Loop through and load each object
-    for (const auto& object : MODELS_TO_LOAD) {
-        // Use temporary vectors for each model load
-        std::vector<Vertex> tempVertices;
-        std::vector<uint32_t> tempIndices;
-        std::vector<Material> tempMaterials;
-        std::vector<uint32_t> tempFaceMaterialIndices;
-        std::vector<std::string> tempTextureFiles;
-
-        std::string fullPath = "../assets/models/" + object.modelPath;
-        loadFromFile(tempVertices, tempIndices, tempMaterials, tempFaceMaterialIndices, tempTextureFiles, fullPath);
-
-        // --- Apply Transformation ---
-        Mat4 transform = object.transform;
-        Mat3 normalTransform = transform.toMat3().inverse().transpose(); // For normals
-        for (auto& vertex : tempVertices) {
-            vertex.position = transform.transformPoint(vertex.position);
-            vertex.normal = normalTransform * vertex.normal;
-            // Tangent should also be transformed if used for lighting
-            if (vertex.tangent != Vec3(0.0f, 0.0f, 0.0f)) {
-                vertex.tangent = normalTransform * vertex.tangent;
-            }
+    // First-hit AOVs, which are also the denoiser's guides, accumulated by raygen.rgen next to the color: normal +
+    // linear depth and albedo. The IDs of the first sample (instance, triangle, material) are written on frame 0.
+    Image normalDepthImage{ context, renderExtent, accumFormat, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst };
+    Image albedoImage{ context, renderExtent, accumFormat, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst };
+    Image idImage{ context, renderExtent, vk::Format::eR32G32B32A32Uint, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc };
+
+    // denoise.comp ping-pongs between these: illumination + variance, radiance after the last iteration (in
+    // denoiseImages[denoisedIndex]). Only allocated with the denoiser on.
+    std::vector<Image> denoiseImages;
+    if (sceneFile.denoiser.enabled) {
+        for (int i = 0; i < 2; i++) {
+            denoiseImages.emplace_back(context, renderExtent, vk::Format::eR32G32B32A32Sfloat,
+                vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc);
         }
-
-        // --- Append and Offset Data ---
-        for (const auto& index : tempIndices) {
-            sceneIndices.push_back(vertexOffset + index);
+    }
+    const int denoisedIndex = sceneFile.denoiser.iterations % 2;
+
+    // Frame 0 multiplies the previous average by zero, which only clears it if it holds numbers and not NaNs
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+        for (const Image* image : { &accumImage, &normalDepthImage, &albedoImage }) {
+            Image::setImageLayout(commandBuffer, *image->image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+            commandBuffer.clearColorImage(*image->image, vk::ImageLayout::eGeneral, vk::ClearColorValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 0.0f }),
+                vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
         }
-        for (const auto& matIndex : tempFaceMaterialIndices) {
-            sceneFaceMaterialIndices.push_back(materialOffset + matIndex);
+        Image::setImageLayout(commandBuffer, *idImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        for (const Image& image : denoiseImages) {
+            Image::setImageLayout(commandBuffer, *image.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
         }
+        vk::MemoryBarrier clearBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+            {}, clearBarrier, nullptr, nullptr);
+    });
 
-        // De-duplicate and append textures
-        for (auto& material : tempMaterials) {
-            if (material.diffuseTextureID != -1) {
-                const std::string& path = tempTextureFiles[material.diffuseTextureID];
-                if (textureIndexMap.find(path) == textureIndexMap.end()) {
-                    textureIndexMap[path] = sceneTextureFiles.size();
-                    sceneTextureFiles.push_back(path);
-                }
-                material.diffuseTextureID = textureIndexMap[path];
-            }
-            // Repeat for metalRoughTextureID and normalTextureID
-            if (material.metalRoughTextureID != -1) {
-                const std::string& path = tempTextureFiles[material.metalRoughTextureID];
-                if (textureIndexMap.find(path) == textureIndexMap.end()) {
-                    textureIndexMap[path] = sceneTextureFiles.size();
-                    sceneTextureFiles.push_back(path);
-                }
-                material.metalRoughTextureID = textureIndexMap[path];
-            }
-            if (material.normalTextureID != -1) {
-                const std::string& path = tempTextureFiles[material.normalTextureID];
-                if (textureIndexMap.find(path) == textureIndexMap.end()) {
-                    textureIndexMap[path] = sceneTextureFiles.size();
-                    sceneTextureFiles.push_back(path);
-                }
-                material.normalTextureID = textureIndexMap[path];
-            }
-            /*if (material.emissiveTextureID != -1) {
-                const std::string& path = tempTextureFiles[material.emissiveTextureID];
-                if (textureIndexMap.find(path) == textureIndexMap.end()) {
-                    textureIndexMap[path] = sceneTextureFiles.size();
-                    sceneTextureFiles.push_back(path);
-                }
-                material.emissiveTextureID = textureIndexMap[path];
-            }
-            if (material.occlusionTextureID != -1) {
-                const std::string& path = tempTextureFiles[material.occlusionTextureID];
-                if (textureIndexMap.find(path) == textureIndexMap.end()) {
-                    textureIndexMap[path] = sceneTextureFiles.size();
-                    sceneTextureFiles.push_back(path);
-                }
-                material.occlusionTextureID = textureIndexMap[path];
-            }*/
-        }
-
-        sceneVertices.insert(sceneVertices.end(), tempVertices.begin(), tempVertices.end());
-        sceneMaterials.insert(sceneMaterials.end(), tempMaterials.begin(), tempMaterials.end());
-
-        // Update offsets for the next model
-        vertexOffset += static_cast<uint32_t>(tempVertices.size());
-        indexOffset += static_cast<uint32_t>(tempIndices.size());
-        materialOffset += static_cast<uint32_t>(tempMaterials.size());
-
-        std::cout << " - Loaded " << object.modelPath << std::endl;
-    }
-
-    // 4. Create GPU buffers from the final, concatenated scene data
-    // (Replace old vectors with the 'scene' vectors)
-    if (sceneVertices.empty() || sceneIndices.empty()) {
-        throw std::runtime_error("No vertices or indices loaded for the scene");
-    }
-
-    std::cout
-        << sceneVertices.size() << " vertices" << std::endl
-        << sceneIndices.size() << " indices" << std::endl
-        << sceneMaterials.size() << " unique materials, " << std::endl
-        << sceneTextureFiles.size() << " textures" << std::endl;
-
-    // Load textures
-    std::vector<Texture> textures;
-    textures.reserve(sceneTextureFiles.size());
-    for (const auto& filePath : sceneTextureFiles) {
-        textures.push_back(createTexture(context, filePath));
-    }
-
-    Buffer vertexBuffer{ context, Buffer::Type::AccelInput, sizeof(Vertex) * sceneVertices.size(), sceneVertices.data() };
-    Buffer indexBuffer{ context, Buffer::Type::AccelInput, sizeof(uint32_t) * sceneIndices.size(), sceneIndices.data() };
-    Buffer materialBuffer{ context, Buffer::Type::AccelInput, sizeof(Material) * sceneMaterials.size(), sceneMaterials.data() };
-    Buffer faceMaterialIndexBuffer{ context, Buffer::Type::AccelInput, sizeof(uint32_t) * sceneFaceMaterialIndices.size(), sceneFaceMaterialIndices.data() };
+    // 3. Stream the scene in, nearest objects first; rendering starts as soon as the first one is there
+    std::cout << "Loading scene..." << std::endl;
 
-    // 5. Build emissive triangle list and CDF
+    SceneStreamer streamer(sceneFile.objects, camera.position, MODEL_DIR, CACHE_DIR);
+    SceneData scene;
     std::vector<EmissiveTriGPU> emissiveTris;
-    emissiveTris.reserve(256);
-
-    const uint32_t primitiveCount = static_cast<uint32_t>(sceneIndices.size() / 3);
-    for (uint32_t prim = 0; prim < primitiveCount; ++prim) {
-        uint32_t i0 = sceneIndices[3 * prim + 0];
-        uint32_t i1 = sceneIndices[3 * prim + 1];
-        uint32_t i2 = sceneIndices[3 * prim + 2];
-
-        Vec3 p0 = sceneVertices[i0].position;
-        Vec3 p1 = sceneVertices[i1].position;
-        Vec3 p2 = sceneVertices[i2].position;
-
-        // face->material index
-        uint32_t matIdx = sceneFaceMaterialIndices[prim];
-        if (matIdx >= sceneMaterials.size()) continue;
-        Material mat = sceneMaterials[matIdx];
-
-        // Compute per-triangle emission. We use material.emission * material.albedo (component-wise)
-        // You can change this to include emissive textures averaging later.
-        Vec3 triEmission = { mat.emission.x * mat.albedo.x,
-                             mat.emission.y * mat.albedo.y,
-                             mat.emission.z * mat.albedo.z };
-
-        // luminance check
-        float lum = 0.2126f * triEmission.x + 0.7152f * triEmission.y + 0.0722f * triEmission.z;
-        if (lum <= 1e-6f) continue;
-
-        // area and normal
-        Vec3 e1 = p1 - p0;
-        Vec3 e2 = p2 - p0;
-        Vec3 n = cross(e1, e2);
-        float area = 0.5f * n.length();
-        if (area <= 1e-9f) continue;
-        n = normalize(n);
-
-        EmissiveTriGPU et{};
-        et.v0[0] = p0.x; et.v0[1] = p0.y; et.v0[2] = p0.z; et.v0[3] = 0.0f;
-        et.v1[0] = p1.x; et.v1[1] = p1.y; et.v1[2] = p1.z; et.v1[3] = 0.0f;
-        et.v2[0] = p2.x; et.v2[1] = p2.y; et.v2[2] = p2.z; et.v2[3] = 0.0f;
-        et.normal[0] = n.x; et.normal[1] = n.y; et.normal[2] = n.z; et.normal[3] = 0.0f;
-        et.emission[0] = triEmission.x; et.emission[1] = triEmission.y; et.emission[2] = triEmission.z; et.emission[3] = 0.0f;
-        et.area[0] = area; et.area[1] = et.area[2] = et.area[3] = 0.0f;
-
-        emissiveTris.push_back(et);
-    }
-
-    // Build CDF (weight = area * luminance)
-    std::vector<float> emissiveCdf;
-    emissiveCdf.reserve(emissiveTris.size());
-    float accum = 0.0f;
-    for (size_t i = 0; i < emissiveTris.size(); ++i) {
-        const EmissiveTriGPU& et = emissiveTris[i];
-        float lum = 0.2126f * et.emission[0] + 0.7152f * et.emission[1] + 0.0722f * et.emission[2];
-        float w = std::max(1e-6f, lum) * std::max(1e-9f, et.area[0]);
-        accum += w;
-        emissiveCdf.push_back(accum);
-    }
-
-    if (accum > 0.0f) {
-        // normalize CDF to [0,1]
-        for (auto& v : emissiveCdf) v /= accum;
-    }
-
-    // Create GPU buffers (safe even if there are no emissives)
-    size_t emissiveTriCount = emissiveTris.empty() ? 1 : emissiveTris.size();
-    size_t emissiveCdfCount = emissiveCdf.empty() ? 1 : emissiveCdf.size();
-
-    // Dummy data for empty case
-    EmissiveTriGPU dummyTri{};
-    float dummyCdf = 1.0f;
-
-    Buffer emissiveBuffer{
-        context,
-        Buffer::Type::AccelInput,
-        sizeof(EmissiveTriGPU) * emissiveTriCount,
-        emissiveTris.empty() ? &dummyTri : emissiveTris.data()
-    };
-
-    Buffer emissiveCdfBuffer{
-        context,
-        Buffer::Type::AccelInput,
-        sizeof(float) * emissiveCdfCount,
-        emissiveCdf.empty() ? &dummyCdf : emissiveCdf.data()
-    };
-
-    // light count uniform
-    int lightCountInt = static_cast<int>(emissiveTris.size());
-    Buffer lightCountBuffer{
-        context,
-        Buffer::Type::AccelInput,
-        sizeof(int),
-        &lightCountInt
-    };
-
-    // debug output
-    std::cout << "Emissive triangles: " << emissiveTris.size() << ", CDF size: " << emissiveCdf.size() << std::endl;
-
-    // 6. Build a single BLAS for the whole scene
-    vk::AccelerationStructureGeometryTrianglesDataKHR triangleData;
-    triangleData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
-    triangleData.setVertexData(vertexBuffer.deviceAddress);
-    triangleData.setVertexStride(sizeof(Vertex));
-    triangleData.setMaxVertex(static_cast<uint32_t>(sceneVertices.size()));
-    triangleData.setIndexType(vk::IndexType::eUint32);
-    triangleData.setIndexData(indexBuffer.deviceAddress);
-
-    vk::AccelerationStructureGeometryKHR triangleGeometry;
-    triangleGeometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
-    triangleGeometry.setGeometry({ triangleData });
-    triangleGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
-
-    Accel bottomAccel{ context, triangleGeometry, primitiveCount, vk::AccelerationStructureTypeKHR::eBottomLevel };
-
-    // 7. Build a TLAS with one instance pointing to the scene BLAS
-    // (The transform is identity because we already applied it to the vertices)
-    vk::TransformMatrixKHR transformMatrix = std::array{
-        std::array{1.0f, 0.0f, 0.0f, 0.0f},
-        std::array{0.0f, 1.0f, 0.0f, 0.0f},
-        std::array{0.0f, 0.0f, 1.0f, 0.0f},
+    size_t objectsLoaded = 0;
+
+    // Appends every object the streamer has ready, returns false if there was none
+    auto takeStreamedObjects = [&](bool wait) {
+        SceneStreamer::Part part;
+        bool added = false;
+        while (streamer.next(part, wait && !added)) {
+            appendScene(scene, part.scene);
+            emissiveTris.insert(emissiveTris.end(), part.emissiveTris.begin(), part.emissiveTris.end());
+            objectsLoaded++;
+            added = true;
+        }
+        return added;
     };
 
-    vk::AccelerationStructureInstanceKHR accelInstance;
-    accelInstance.setTransform(transformMatrix);
-    accelInstance.setMask(0xFF);
-    accelInstance.setAccelerationStructureReference(bottomAccel.buffer.deviceAddress);
-    accelInstance.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
-
-    Buffer instancesBuffer{ context, Buffer::Type::AccelInput, sizeof(vk::AccelerationStructureInstanceKHR), &accelInstance };
-
-    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
-    instancesData.setArrayOfPointers(false);
-    instancesData.setData(instancesBuffer.deviceAddress);
-
-    vk::AccelerationStructureGeometryKHR instanceGeometry;
-    instanceGeometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
-    instanceGeometry.setGeometry({ instancesData });
-    instanceGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
-
-    Accel topAccel{ context, instanceGeometry, 1, vk::AccelerationStructureTypeKHR::eTopLevel };
-
-    if (topAccel.buffer.deviceAddress == 0) {
-        throw std::runtime_error("TLAS device address is zero");
+    GpuScene gpuScene;
+    takeStreamedObjects(true);
+    // An offline render needs the whole scene before its first sample
+    while (headless && objectsLoaded < streamer.getObjectCount()) {
+        takeStreamedObjects(true);
     }
+    std::cout << "Scene: " << objectsLoaded << " of " << streamer.getObjectCount() << " objects loaded" << std::endl;
+    updateGpuScene(context, gpuScene, scene, emissiveTris);
 
     // Load shaders
     const std::vector<char> raygenCode = readFile("../assets/shaders/raygen.rgen.spv");
@@ -433,35 +398,43 @@ int main() {
     shaderGroups[1] = { vk::RayTracingShaderGroupTypeKHR::eGeneral, 1, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR };
     shaderGroups[2] = { vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup, VK_SHADER_UNUSED_KHR, 2, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR };
 
-    // Note: Ensure your device supports enough samplers. Sponza has ~50 textures.
-    // A size of 0 is invalid, so handle the no-texture case.
-    const uint32_t textureCount = textures.empty() ? 1u : static_cast<uint32_t>(textures.size());
-
     // create ray tracing pipeline
+    const uint32_t TEXTURE_BINDING = 7;
     std::vector<vk::DescriptorSetLayoutBinding> bindings{
         {0, vk::DescriptorType::eAccelerationStructureKHR, 1, vk::ShaderStageFlagBits::eRaygenKHR},             // 0 = TLAS
-        {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                         // 1 = accumImage (rgba32f)
-        {2, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                         // 2 = outputImage (rgba8)
+        {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                         // 1 = accumImage (rgba32f / rgba16f)
         {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},                    // 3 = Vertices
         {4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},                    // 4 = Indices
         {5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},                    // 5 = Materials
         {6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},                    // 6 = Face Material Indices
-        {7, vk::DescriptorType::eCombinedImageSampler, textureCount, vk::ShaderStageFlagBits::eClosestHitKHR},  // 7 = Textures
+        {TEXTURE_BINDING, vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES, vk::ShaderStageFlagBits::eClosestHitKHR}, // 7 = Textures
         {8, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 8 = EmissiveTris SSBO
-        {9, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 9 = Emissive CDF SSBO (float[])
+        {9, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 9 = Emissive alias table SSBO
         {10, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eRaygenKHR},                       // 10 = Light count UBO
+        {11, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 11 = normal + depth guide
+        {12, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 12 = albedo guide
+        {13, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},                        // 13 = ID AOV (rgba32ui)
     };
 
+    // Only the textures loaded so far are written, the array grows as the scene streams in
+    std::vector<vk::DescriptorBindingFlags> bindingFlags(bindings.size());
+    for (size_t i = 0; i < bindings.size(); i++) {
+        if (bindings[i].binding == TEXTURE_BINDING) bindingFlags[i] = vk::DescriptorBindingFlagBits::ePartiallyBound;
+    }
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo;
+    bindingFlagsInfo.setBindingFlags(bindingFlags);
+
     // Create desc set layout
     vk::DescriptorSetLayoutCreateInfo descSetLayoutInfo;
     descSetLayoutInfo.setBindings(bindings);
+    descSetLayoutInfo.setPNext(&bindingFlagsInfo);
     vk::UniqueDescriptorSetLayout descSetLayout = context.device->createDescriptorSetLayoutUnique(descSetLayoutInfo);
 
     // Create pipeline layout
     vk::PushConstantRange pushRange;
     pushRange.setOffset(0);
     pushRange.setSize(sizeof(PushConstants));
-    pushRange.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
+    pushRange.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR);
 
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
     pipelineLayoutInfo.setSetLayouts(*descSetLayout);
@@ -524,138 +497,413 @@ int main() {
     // Create desc set
     vk::UniqueDescriptorSet descSet = context.allocateDescSet(*descSetLayout);
 
-    // Create dummy resources that persist until the end of the program
-    vk::UniqueSampler dummySampler;
-    vk::UniqueImageView dummyImageView;
-
-    // Prepare the texture info for the descriptor write
-    std::vector<vk::DescriptorImageInfo> imageInfos;
-    if (textures.empty()) {
-        // Create a dummy texture/sampler for the case when there are no textures
-        vk::SamplerCreateInfo samplerInfo{};
-        samplerInfo.magFilter = vk::Filter::eLinear;
-        samplerInfo.minFilter = vk::Filter::eLinear;
-        samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
-        samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
-        samplerInfo.addressModeW = vk::SamplerAddressMode::eRepeat;
-        dummySampler = context.device->createSamplerUnique(samplerInfo);
-
-        // Create a dummy 1x1 black texture
-        Image dummyImage{
-            context,
-            {1, 1},
-            vk::Format::eR8G8B8A8Unorm,
-            vk::ImageUsageFlagBits::eSampled,
-            vk::ImageLayout::eShaderReadOnlyOptimal
-        };
-
-        dummyImageView = std::move(dummyImage.view);
+    // Points the descriptors at the current scene resources (again after every streaming update)
+    auto writeSceneDescriptors = [&] {
+        // Create the descriptor writes
+        std::vector<vk::WriteDescriptorSet> writes;
+        writes.resize(13);
+
+        // 0: TLAS
+        vk::WriteDescriptorSetAccelerationStructureKHR tlasInfo(*gpuScene.topAccel.accel);
+        writes[0].setDstSet(*descSet);
+        writes[0].setDstBinding(0);
+        writes[0].setDescriptorCount(1);
+        writes[0].setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
+        writes[0].setPNext(&tlasInfo);
+
+        // 1: accumImage (32 or 16-bit float)
+        writes[1].setDstSet(*descSet);
+        writes[1].setDstBinding(1);
+        writes[1].setDescriptorCount(1);
+        writes[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+        writes[1].setImageInfo(accumImage.descImageInfo);
+
+        // 3: vertices buffer
+        writes[2].setDstSet(*descSet);
+        writes[2].setDstBinding(3);
+        writes[2].setDescriptorCount(1);
+        writes[2].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[2].setBufferInfo(gpuScene.vertexBuffer.descBufferInfo);
+
+        // 4: indices buffer
+        writes[3].setDstSet(*descSet);
+        writes[3].setDstBinding(4);
+        writes[3].setDescriptorCount(1);
+        writes[3].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[3].setBufferInfo(gpuScene.indexBuffer.descBufferInfo);
+
+        // 5: materials buffer
+        writes[4].setDstSet(*descSet);
+        writes[4].setDstBinding(5);
+        writes[4].setDescriptorCount(1);
+        writes[4].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[4].setBufferInfo(gpuScene.materialBuffer.descBufferInfo);
+
+        // 6: face material indices buffer
+        writes[5].setDstSet(*descSet);
+        writes[5].setDstBinding(6);
+        writes[5].setDescriptorCount(1);
+        writes[5].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[5].setBufferInfo(gpuScene.faceMaterialIndexBuffer.descBufferInfo);
+
+        // 7: textures array (partially bound, left out while there are none)
+        std::vector<vk::DescriptorImageInfo> imageInfos;
+        for (const auto& texture : gpuScene.textures) {
+            imageInfos.push_back({ *texture.sampler, *texture.image.view, vk::ImageLayout::eShaderReadOnlyOptimal });
+        }
+        writes[6].setDstSet(*descSet);
+        writes[6].setDstBinding(TEXTURE_BINDING);
+        writes[6].setDescriptorCount(static_cast<uint32_t>(imageInfos.size()));
+        writes[6].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+        writes[6].setImageInfo(imageInfos);
+
+        // 8: emissive triangles SSBO
+        writes[7].setDstSet(*descSet);
+        writes[7].setDstBinding(8);
+        writes[7].setDescriptorCount(1);
+        writes[7].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[7].setBufferInfo(gpuScene.emissiveBuffer.descBufferInfo);
+
+        // 9: emissive alias table SSBO
+        writes[8].setDstSet(*descSet);
+        writes[8].setDstBinding(9);
+        writes[8].setDescriptorCount(1);
+        writes[8].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+        writes[8].setBufferInfo(gpuScene.emissiveAliasBuffer.descBufferInfo);
+
+        // 10: lightCount uniform buffer
+        writes[9].setDstSet(*descSet);
+        writes[9].setDstBinding(10);
+        writes[9].setDescriptorCount(1);
+        writes[9].setDescriptorType(vk::DescriptorType::eUniformBuffer);
+        writes[9].setBufferInfo(gpuScene.lightCountBuffer.descBufferInfo);
+
+        // 11, 12: denoiser guides
+        writes[10].setDstSet(*descSet);
+        writes[10].setDstBinding(11);
+        writes[10].setDescriptorCount(1);
+        writes[10].setDescriptorType(vk::DescriptorType::eStorageImage);
+        writes[10].setImageInfo(normalDepthImage.descImageInfo);
+        writes[11].setDstSet(*descSet);
+        writes[11].setDstBinding(12);
+        writes[11].setDescriptorCount(1);
+        writes[11].setDescriptorType(vk::DescriptorType::eStorageImage);
+        writes[11].setImageInfo(albedoImage.descImageInfo);
+
+        // 13: ID AOV
+        writes[12].setDstSet(*descSet);
+        writes[12].setDstBinding(13);
+        writes[12].setDescriptorCount(1);
+        writes[12].setDescriptorType(vk::DescriptorType::eStorageImage);
+        writes[12].setImageInfo(idImage.descImageInfo);
+
+        // Descriptor set validation
+        for (auto& write : writes) {
+            if (write.dstSet == VK_NULL_HANDLE) {
+                throw std::runtime_error("Descriptor set is null");
+            }
+        }
 
-        // Add the dummy descriptor
-        imageInfos.push_back({ *dummySampler, *dummyImageView, vk::ImageLayout::eShaderReadOnlyOptimal });
+        if (imageInfos.empty()) {
+            writes.erase(std::remove_if(writes.begin(), writes.end(),
+                [&](const vk::WriteDescriptorSet& write) { return write.dstBinding == TEXTURE_BINDING; }), writes.end());
+        }
+        context.device->updateDescriptorSets(writes, nullptr);
+    };
+    writeSceneDescriptors();
+
+    // Denoiser: a variance pass, then the filter iterations ping-pong between the two denoise images.
+    // Set k reads denoise image k and writes the other one.
+    std::vector<vk::DescriptorSetLayoutBinding> denoiseBindings{
+        {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 0 = accumImage
+        {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 1 = normal + depth guide
+        {2, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 2 = albedo guide
+        {3, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 3 = input (rgba32f)
+        {4, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 4 = output (rgba32f)
+    };
+    vk::UniqueDescriptorSetLayout denoiseSetLayout;
+    context.createDescriptorSetLayout(denoiseBindings, denoiseSetLayout);
+
+    vk::PushConstantRange denoisePushRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(DenoiseConstants));
+    vk::PipelineLayoutCreateInfo denoisePipelineLayoutInfo;
+    denoisePipelineLayoutInfo.setSetLayouts(*denoiseSetLayout);
+    denoisePipelineLayoutInfo.setPushConstantRanges(denoisePushRange);
+    vk::UniquePipelineLayout denoisePipelineLayout = context.device->createPipelineLayoutUnique(denoisePipelineLayoutInfo);
+    vk::UniquePipeline denoisePipeline;
+    if (sceneFile.denoiser.enabled) {
+        context.createComputePipeline("../assets/shaders/denoise.comp.spv", denoisePipelineLayout, denoisePipeline);
     }
-    else {
-        for (const auto& texture : textures) {
-            imageInfos.push_back({ *texture.sampler, *texture.image.view, vk::ImageLayout::eShaderReadOnlyOptimal });
+
+    std::vector<vk::UniqueDescriptorSet> denoiseSets;
+    for (size_t k = 0; k < denoiseImages.size(); k++) {
+        denoiseSets.push_back(context.allocateDescSet(*denoiseSetLayout));
+        const vk::DescriptorImageInfo* images[5] = { &accumImage.descImageInfo, &normalDepthImage.descImageInfo,
+            &albedoImage.descImageInfo, &denoiseImages[k].descImageInfo, &denoiseImages[1 - k].descImageInfo };
+        std::vector<vk::WriteDescriptorSet> denoiseWrites(5);
+        for (uint32_t binding = 0; binding < 5; binding++) {
+            denoiseWrites[binding].setDstSet(*denoiseSets[k]);
+            denoiseWrites[binding].setDstBinding(binding);
+            denoiseWrites[binding].setDescriptorCount(1);
+            denoiseWrites[binding].setDescriptorType(vk::DescriptorType::eStorageImage);
+            denoiseWrites[binding].setImageInfo(*images[binding]);
         }
+        context.device->updateDescriptorSets(denoiseWrites, nullptr);
     }
 
-    // Create the descriptor writes
-    std::vector<vk::WriteDescriptorSet> writes;
-    writes.resize(11);
-
-    // 0: TLAS
-    writes[0].setDstSet(*descSet);
-    writes[0].setDstBinding(0);
-    writes[0].setDescriptorCount(1);
-    writes[0].setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
-    writes[0].setPNext(&topAccel.descAccelInfo);
-
-    // 1: accumImage (32-bit float)
-    writes[1].setDstSet(*descSet);
-    writes[1].setDstBinding(1);
-    writes[1].setDescriptorCount(1);
-    writes[1].setDescriptorType(vk::DescriptorType::eStorageImage);
-    writes[1].setImageInfo(accumImage.descImageInfo);
-
-    // 2: outputImage (8-bit unorm)
-    writes[2].setDstSet(*descSet);
-    writes[2].setDstBinding(2);
-    writes[2].setDescriptorCount(1);
-    writes[2].setDescriptorType(vk::DescriptorType::eStorageImage);
-    writes[2].setImageInfo(outputImage.descImageInfo);
-
-    // 3: vertices buffer
-    writes[3].setDstSet(*descSet);
-    writes[3].setDstBinding(3);
-    writes[3].setDescriptorCount(1);
-    writes[3].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[3].setBufferInfo(vertexBuffer.descBufferInfo);
-
-    // 4: indices buffer
-    writes[4].setDstSet(*descSet);
-    writes[4].setDstBinding(4);
-    writes[4].setDescriptorCount(1);
-    writes[4].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[4].setBufferInfo(indexBuffer.descBufferInfo);
-
-    // 5: materials buffer
-    writes[5].setDstSet(*descSet);
-    writes[5].setDstBinding(5);
-    writes[5].setDescriptorCount(1);
-    writes[5].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[5].setBufferInfo(materialBuffer.descBufferInfo);
-
-    // 6: face material indices buffer
-    writes[6].setDstSet(*descSet);
-    writes[6].setDstBinding(6);
-    writes[6].setDescriptorCount(1);
-    writes[6].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[6].setBufferInfo(faceMaterialIndexBuffer.descBufferInfo);
-
-    // 7: textures array
-    writes[7].setDstSet(*descSet);
-    writes[7].setDstBinding(7);
-    writes[7].setDescriptorCount(textureCount);
-    writes[7].setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-    writes[7].setImageInfo(imageInfos);
-
-    // 8: emissive triangles SSBO
-    writes[8].setDstSet(*descSet);
-    writes[8].setDstBinding(8);
-    writes[8].setDescriptorCount(1);
-    writes[8].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[8].setBufferInfo(emissiveBuffer.descBufferInfo);
-
-    // 9: emissive CDF SSBO (float[])
-    writes[9].setDstSet(*descSet);
-    writes[9].setDstBinding(9);
-    writes[9].setDescriptorCount(1);
-    writes[9].setDescriptorType(vk::DescriptorType::eStorageBuffer);
-    writes[9].setBufferInfo(emissiveCdfBuffer.descBufferInfo);
-
-    // 10: lightCount uniform buffer
-    writes[10].setDstSet(*descSet);
-    writes[10].setDstBinding(10);
-    writes[10].setDescriptorCount(1);
-    writes[10].setDescriptorType(vk::DescriptorType::eUniformBuffer);
-    writes[10].setBufferInfo(lightCountBuffer.descBufferInfo);
-
-    // Descriptor set validation
-    for (auto& write : writes) {
-        if (write.dstSet == VK_NULL_HANDLE) {
-            throw std::runtime_error("Descriptor set is null");
-        }
-    }
-
-    context.device->updateDescriptorSets(writes, nullptr);
+    // Display pass: tonemaps the accumulation (or the denoised image) into the output image, however many frames
+    // were traced before it
+    std::vector<vk::DescriptorSetLayoutBinding> displayBindings{
+        {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 0 = accumImage or denoised image
+        {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute}, // 1 = outputImage (rgba8)
+    };
+    vk::UniqueDescriptorSetLayout displaySetLayout;
+    context.createDescriptorSetLayout(displayBindings, displaySetLayout);
+
+    vk::PushConstantRange displayPushRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(DisplayConstants));
+    vk::PipelineLayoutCreateInfo displayPipelineLayoutInfo;
+    displayPipelineLayoutInfo.setSetLayouts(*displaySetLayout);
+    displayPipelineLayoutInfo.setPushConstantRanges(displayPushRange);
+    vk::UniquePipelineLayout displayPipelineLayout = context.device->createPipelineLayoutUnique(displayPipelineLayoutInfo);
+    vk::UniquePipeline displayPipeline;
+    context.createComputePipeline("../assets/shaders/display.comp.spv", displayPipelineLayout, displayPipeline);
+
+    vk::UniqueDescriptorSet displaySet = context.allocateDescSet(*displaySetLayout);
+    std::vector<vk::WriteDescriptorSet> displayWrites(2);
+    displayWrites[0].setDstSet(*displaySet);
+    displayWrites[0].setDstBinding(0);
+    displayWrites[0].setDescriptorCount(1);
+    displayWrites[0].setDescriptorType(vk::DescriptorType::eStorageImage);
+    displayWrites[0].setImageInfo(sceneFile.denoiser.enabled ? denoiseImages[denoisedIndex].descImageInfo : accumImage.descImageInfo);
+    displayWrites[1].setDstSet(*displaySet);
+    displayWrites[1].setDstBinding(1);
+    displayWrites[1].setDescriptorCount(1);
+    displayWrites[1].setDescriptorType(vk::DescriptorType::eStorageImage);
+    displayWrites[1].setImageInfo(outputImage.descImageInfo);
+    context.device->updateDescriptorSets(displayWrites, nullptr);
+
+    // Records one frame of tracing into the accumulation image
+    auto recordTrace = [&](vk::CommandBuffer commandBuffer, int frame) {
+        PushConstants pc;
+        pc.frame = frame;
+        pc.samplesPerFrame = sceneFile.settings.samplesPerFrame;
+        pc.maxDepth = sceneFile.settings.maxDepth;
+        pc.skyIntensity = sceneFile.settings.skyIntensity;
+        pc.cameraPos = camera.position;
+        pc.cameraFront = camera.front;
+        pc.cameraUp = camera.up;
+        pc.cameraRight = camera.right;
+
+        // The previous frame may still be tracing: its accumulation writes must land before this frame reads them,
+        // and a display pass still reading the accumulation must finish before it is overwritten
+        vk::MemoryBarrier accumBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eRayTracingShaderKHR, {}, accumBarrier, nullptr, nullptr);
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSet, nullptr);
+        commandBuffer.pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR, 0,
+            sizeof(PushConstants), &pc);
+        commandBuffer.traceRaysKHR(raygenRegion, missRegion, hitRegion, {}, renderWidth, renderHeight, 1);
+    };
+
+    // Records the denoiser over an accumulation of frameCount frames; the result lands in denoiseImages[denoisedIndex]
+    auto recordDenoise = [&](vk::CommandBuffer commandBuffer, int frameCount) {
+        const DenoiserSettings& settings = sceneFile.denoiser;
+        DenoiseConstants dc;
+        dc.frameCount = std::max(1, frameCount);
+        dc.sigmaDepth = settings.sigmaDepth;
+        dc.sigmaLuminance = settings.sigmaLuminance;
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *denoisePipeline);
+        for (int pass = 0; pass <= settings.iterations; pass++) {
+            // Every pass reads what the traces or the previous pass wrote, and overwrites what the one before read
+            vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader,
+                vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+            // The variance pass writes denoise image 0, iteration i reads image i % 2
+            dc.pass = pass == 0 ? 0 : 1;
+            dc.stepSize = pass == 0 ? 1 : 1 << (pass - 1);
+            dc.remodulate = pass == settings.iterations ? 1 : 0;
+            const vk::DescriptorSet set = *denoiseSets[pass == 0 ? 1 : (pass - 1) % 2];
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *denoisePipelineLayout, 0, set, nullptr);
+            commandBuffer.pushConstants(*denoisePipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(DenoiseConstants), &dc);
+            commandBuffer.dispatch((renderWidth + DENOISER_WG_SIZE - 1) / DENOISER_WG_SIZE, (renderHeight + DENOISER_WG_SIZE - 1) / DENOISER_WG_SIZE, 1);
+        }
+    };
+
+    // Records the display pass over the current accumulation (or denoised image) into the output image
+    auto recordDisplay = [&](vk::CommandBuffer commandBuffer) {
+        DisplayConstants dc;
+        dc.exposureScale = std::exp2(sceneFile.display.exposure);
+        dc.tonemap = static_cast<int>(sceneFile.display.tonemap);
+        dc.dither = sceneFile.display.dither ? 1 : 0;
+
+        vk::MemoryBarrier accumBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader, {}, accumBarrier, nullptr, nullptr);
+
+        Image::setImageLayout(commandBuffer, *outputImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *displayPipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *displayPipelineLayout, 0, *displaySet, nullptr);
+        commandBuffer.pushConstants(*displayPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(DisplayConstants), &dc);
+        commandBuffer.dispatch((renderWidth + DISPLAY_WG_SIZE - 1) / DISPLAY_WG_SIZE, (renderHeight + DISPLAY_WG_SIZE - 1) / DISPLAY_WG_SIZE, 1);
+    };
+
+    auto secondsSince = [](Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // Reads back what the denoiser sees after frameCount frames
+    auto readDenoiserInputsFromGpu = [&](int frameCount) {
+        DenoiserInputs inputs;
+        inputs.width = renderWidth;
+        inputs.height = renderHeight;
+        inputs.frameCount = frameCount;
+        inputs.accum = readImageRgba(context, accumImage, accumFormat, renderExtent);
+        inputs.normalDepth = readImageRgba(context, normalDepthImage, accumFormat, renderExtent);
+        inputs.albedo = readImageRgba(context, albedoImage, accumFormat, renderExtent);
+        return inputs;
+    };
+
+    // Offline render: whole frames until the sample count is reached, then the accumulation (denoised or not) goes
+    // to the output file
+    if (headless) {
+        const int samplesPerFrame = sceneFile.settings.samplesPerFrame;
+        const int frames = std::max(1, (samplesPerPixel + samplesPerFrame - 1) / samplesPerFrame);
+        std::cout << "Headless render: " << frames << " frames of " << samplesPerFrame << " spp at "
+            << renderWidth << "x" << renderHeight << ", " << vk::to_string(accumFormat) << " accumulation" << std::endl;
+
+        // The dump is taken early in the render and the finished accumulation becomes its reference
+        DenoiserInputs denoiserDump;
+        const int dumpFrames = std::min(denoiseDumpFrames, frames);
+
+        auto renderStart = Clock::now();
+        const int progressStep = std::max(1, frames / 10);
+        for (int frame = 0; frame < frames; frame++) {
+            FrameSlot& slot = frameSlots[frame % MAX_FRAMES_IN_FLIGHT];
+            if (context.device->waitForFences(*slot.fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
+                throw std::runtime_error("Failed waiting for a frame fence");
+            }
+            context.device->resetFences(*slot.fence);
+
+            vk::CommandBuffer commandBuffer = *slot.commandBuffer;
+            commandBuffer.reset();
+            commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            recordTrace(commandBuffer, frame);
+            // The last frame also runs the GPU denoiser and display pass, to check them against the CPU
+            if (frame == frames - 1) {
+                if (sceneFile.denoiser.enabled) recordDenoise(commandBuffer, frames);
+                recordDisplay(commandBuffer);
+            }
+            commandBuffer.end();
+
+            vk::SubmitInfo submitInfo;
+            submitInfo.setCommandBuffers(commandBuffer);
+            context.queue.submit(submitInfo, *slot.fence);
+
+            if ((frame + 1) % progressStep == 0) {
+                std::cout << "  frame " << frame + 1 << " of " << frames << std::endl;
+            }
+            if (!denoiseDumpPath.empty() && frame + 1 == dumpFrames && dumpFrames < frames) {
+                context.device->waitIdle();
+                denoiserDump = readDenoiserInputsFromGpu(dumpFrames);
+            }
+        }
+        context.device->waitIdle();
+        double renderSeconds = secondsSince(renderStart);
+
+        DenoiserInputs finalInputs = readDenoiserInputsFromGpu(frames);
+        std::vector<float> image = finalInputs.accum;
+        if (sceneFile.denoiser.enabled) {
+            // The CPU reference does the same float operations in the same order, so every bit should match
+            image = readImageRgba(context, denoiseImages[denoisedIndex], vk::Format::eR32G32B32A32Sfloat, renderExtent);
+            auto denoiseStart = Clock::now();
+            std::vector<float> cpuDenoised = denoise(finalInputs, sceneFile.denoiser);
+            double cpuMs = secondsSince(denoiseStart) * 1e3;
+            size_t differing = 0;
+            for (size_t i = 0; i < image.size(); i++) {
+                if (std::memcmp(&image[i], &cpuDenoised[i], sizeof(float)) != 0) differing++;
+            }
+            std::cout << "Denoiser: " << differing << " of " << image.size() << " values differ between GPU and CPU (CPU took "
+                << cpuMs << " ms)" << std::endl;
+        }
+
+        if (!denoiseDumpPath.empty()) {
+            if (denoiserDump.accum.empty()) {
+                std::cout << "The render has no more than " << dumpFrames << " frames, the denoiser dump has no reference" << std::endl;
+                denoiserDump = finalInputs;
+            }
+            else {
+                denoiserDump.reference = finalInputs.accum;
+            }
+            if (!writeDenoiserInputs(denoiseDumpPath, denoiserDump)) {
+                throw std::runtime_error("Failed to write " + denoiseDumpPath);
+            }
+            std::cout << "Wrote denoiser inputs after " << denoiserDump.frameCount << " frames to " << denoiseDumpPath << std::endl;
+        }
+
+        if (!writeImage(outputPath, renderWidth, renderHeight, image.data(), sceneFile.display)) {
+            throw std::runtime_error("Failed to write " + outputPath);
+        }
+        std::cout << "Wrote " << outputPath << std::endl;
+
+        if (writeAovFiles) {
+            Buffer readback{ context, Buffer::Type::Readback, static_cast<size_t>(renderWidth) * renderHeight * 4 * sizeof(uint32_t) };
+            idImage.copyToBuffer(context, readback, renderExtent);
+            const uint32_t* idData = static_cast<const uint32_t*>(readback.map(context));
+            writeAovs(outputPath, finalInputs, std::vector<uint32_t>(idData, idData + static_cast<size_t>(renderWidth) * renderHeight * 4));
+        }
+
+        // Only the transcendentals differ, so a level of difference is expected on a few pixels
+        std::vector<uint8_t> cpuDisplay = applyDisplayTransform(image.data(), renderWidth, renderHeight, sceneFile.display);
+        std::vector<float> gpuDisplay = readImageRgba(context, outputImage, vk::Format::eB8G8R8A8Unorm, renderExtent);
+        int maxDifference = 0;
+        size_t differing = 0;
+        for (size_t i = 0; i < cpuDisplay.size(); i++) {
+            int difference = std::abs(static_cast<int>(gpuDisplay[i] * 255.0f + 0.5f) - cpuDisplay[i]);
+            maxDifference = std::max(maxDifference, difference);
+            if (difference != 0) differing++;
+        }
+        std::cout << "Display pass: GPU and CPU differ by at most " << maxDifference << " levels in "
+            << 100.0 * differing / cpuDisplay.size() << "% of the channels" << std::endl;
+
+        double samples = static_cast<double>(renderWidth) * renderHeight * frames * samplesPerFrame;
+        std::cout << "Total " << secondsSince(startTime) << " s, rendering " << renderSeconds << " s: "
+            << frames * samplesPerFrame << " spp, " << samples / renderSeconds / 1e6 << " Msamples/s" << std::endl;
+        return 0;
+    }
 
     // Main loop
+    auto millisecondsSince = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
     uint32_t imageIndex = 0;
     int frame = 0;
-    vk::UniqueSemaphore imageAcquiredSemaphore = context.device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+    uint64_t framesSubmitted = 0;
+    FrameTimer frameTimer;
+
+    // Frame latency is the time from submit until the fence is seen signaled
+    auto recordLatency = [&](FrameSlot& slot) {
+        if (slot.submitted == 0) return;
+        frameTimer.setLatency(static_cast<uint32_t>(framesSubmitted - slot.submitted + 1), millisecondsSince(slot.submitTime));
+        slot.submitted = 0;
+    };
+
+    auto printFrameTimings = [&] {
+        FrameTimingReport report = frameTimer.getReport();
+        auto print = [](const char* name, const FrameTimingPercentiles& p) {
+            std::cout << "  " << name << " p50 " << p.p50 << " / p95 " << p.p95 << " / p99 " << p.p99 << " / max " << p.max << " ms" << std::endl;
+        };
+        std::cout << "Frame timings over the last " << report.frames << " frames (" << MAX_FRAMES_IN_FLIGHT << " in flight):" << std::endl;
+        print("wait   ", report.wait);
+        print("record ", report.record);
+        print("present", report.present);
+        print("latency", report.latency);
+    };
 
     std::cout << "Starting main loop..." << std::endl;
 
@@ -680,29 +928,54 @@ int main() {
             frame = 0;
         }
 
+        // Objects that finished streaming join the scene between frames, the image restarts with them
+        if (objectsLoaded < streamer.getObjectCount() && takeStreamedObjects(false)) {
+            context.device->waitIdle();
+            std::cout << "Scene: " << objectsLoaded << " of " << streamer.getObjectCount() << " objects loaded" << std::endl;
+            updateGpuScene(context, gpuScene, scene, emissiveTris);
+            writeSceneDescriptors();
+            frame = 0;
+        }
+
+        FrameTiming timing;
+
+        // Pick up finished frames early so their latency isn't inflated by waiting for their slot to come around
+        for (FrameSlot& slot : frameSlots) {
+            if (slot.submitted != 0 && context.device->getFenceStatus(*slot.fence) == vk::Result::eSuccess) {
+                recordLatency(slot);
+            }
+        }
+
+        // Wait until the GPU is done with this slot's command buffer
+        auto waitStart = Clock::now();
+        FrameSlot& slot = frameSlots[framesSubmitted % MAX_FRAMES_IN_FLIGHT];
+        if (context.device->waitForFences(*slot.fence, VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
+            throw std::runtime_error("Failed waiting for a frame fence");
+        }
+        recordLatency(slot);
+
         // Acquire next image
-        auto acquireResult = context.device->acquireNextImageKHR(*swapchain, UINT64_MAX, *imageAcquiredSemaphore);
-        if (acquireResult.result != vk::Result::eSuccess) {
+        auto acquireResult = context.device->acquireNextImageKHR(*swapchain, UINT64_MAX, *slot.imageAcquired);
+        if (acquireResult.result != vk::Result::eSuccess && acquireResult.result != vk::Result::eSuboptimalKHR) {
             throw std::runtime_error("Failed to acquire next image");
         }
         imageIndex = acquireResult.value;
+        timing.waitMs = millisecondsSince(waitStart);
 
-        // Populate and push constants
-        PushConstants pc;
-        pc.frame = frame;
-        pc.cameraPos = camera.position;
-        pc.cameraFront = camera.front;
-        pc.cameraUp = camera.up;
-        pc.cameraRight = camera.right;
+        auto recordStart = Clock::now();
+        context.device->resetFences(*slot.fence);
 
-        // Record commands
-        vk::CommandBuffer commandBuffer = *commandBuffers[imageIndex];
-        commandBuffer.begin(vk::CommandBufferBeginInfo());
-        Image::setImageLayout(commandBuffer, *outputImage.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSet, nullptr);
-        commandBuffer.pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(PushConstants), &pc);
-        commandBuffer.traceRaysKHR(raygenRegion, missRegion, hitRegion, {}, WIDTH, HEIGHT, 1);
+        // Record commands: K traces (or none), the denoiser and the display pass
+        vk::CommandBuffer commandBuffer = *slot.commandBuffer;
+        commandBuffer.reset();
+        commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        for (int trace = 0; trace < tracesPerPresent; trace++) {
+            recordTrace(commandBuffer, frame++);
+        }
+        if (sceneFile.denoiser.enabled) {
+            recordDenoise(commandBuffer, frame);
+        }
+        recordDisplay(commandBuffer);
 
         vk::Image srcImage = *outputImage.image;
         vk::Image dstImage = swapchainImages[imageIndex];
@@ -714,27 +987,359 @@ int main() {
 
         commandBuffer.end();
 
-        // Submit
-        context.queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer));
+        // Submit; the copy into the swapchain image waits for the acquire
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+        vk::SubmitInfo submitInfo;
+        submitInfo.setWaitSemaphores(*slot.imageAcquired);
+        submitInfo.setWaitDstStageMask(waitStage);
+        submitInfo.setCommandBuffers(commandBuffer);
+        submitInfo.setSignalSemaphores(*renderFinished[imageIndex]);
+        context.queue.submit(submitInfo, *slot.fence);
+        slot.submitTime = Clock::now();
+        slot.submitted = ++framesSubmitted;
+        timing.recordMs = millisecondsSince(recordStart);
 
         // Present image
+        auto presentStart = Clock::now();
         vk::PresentInfoKHR presentInfo;
         presentInfo.setSwapchains(*swapchain);
         presentInfo.setImageIndices(imageIndex);
-        presentInfo.setWaitSemaphores(*imageAcquiredSemaphore);
+        presentInfo.setWaitSemaphores(*renderFinished[imageIndex]);
         auto result = context.queue.presentKHR(presentInfo);
-        if (result != vk::Result::eSuccess) {
+        if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
             throw std::runtime_error("failed to present.");
         }
-        context.queue.waitIdle();
-        frame++;
+        timing.presentMs = millisecondsSince(presentStart);
+
+        frameTimer.addFrame(timing);
+        if (framesSubmitted % FrameTimer::HISTORY_SIZE == 0) {
+            printFrameTimings();
+        }
     }
 
     context.device->waitIdle();
+    for (FrameSlot& slot : frameSlots) {
+        recordLatency(slot);
+    }
+    if (frameTimer.getFrameCount() > 0) {
+        printFrameTimings();
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
 }
 
+int runCpuReference(const SceneFile& sceneFile, int frames) {
+    std::cout << "Loading scene..." << std::endl;
+
+    SceneData scene;
+    std::vector<EmissiveTriGPU> emissiveTris;
+    loadSceneCached(scene, emissiveTris, sceneFile.objects, MODEL_DIR, CACHE_DIR);
+    if (scene.vertices.empty() || scene.indices.empty()) {
+        throw std::runtime_error("No vertices or indices loaded for the scene");
+    }
+
+    std::vector<EmissiveAliasEntry> emissiveAlias = buildEmissiveAliasTable(emissiveTris);
+
+    CpuPathTracer tracer(scene, emissiveTris, emissiveAlias);
+    tracer.resize(WIDTH, HEIGHT);
+    tracer.setSettings(sceneFile.settings);
+
+    const BvhBuildStats& bvhStats = tracer.getBvh().getBuildStats();
+    std::cout << "BVH: " << bvhStats.nodeCount << " nodes, depth " << bvhStats.maxDepth
+        << ", SAH cost " << bvhStats.sahCost << ", built in " << bvhStats.buildMs << " ms" << std::endl;
+
+    std::cout << "CPU reference: " << frames << " frames at " << WIDTH << "x" << HEIGHT << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        tracer.renderFrame(camera, frame);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    uint32_t threads = ThreadPool::global().size();
+    double raysPerSecond = tracer.getRayCount() / seconds;
+    std::cout << "Rendered in " << seconds << " s, "
+        << raysPerSecond / 1e6 << " Mrays/s (" << raysPerSecond / threads / 1e6 << " Mrays/s per core, "
+        << threads << " threads)" << std::endl;
+
+    const std::vector<float>& accum = tracer.getAccumulation();
+    std::vector<uint8_t> display = applyDisplayTransform(accum.data(), WIDTH, HEIGHT, sceneFile.display);
+
+    writeHdr("cpu_reference.hdr", WIDTH, HEIGHT, accum.data());
+    writePng("cpu_reference.png", WIDTH, HEIGHT, display.data());
+    std::cout << "Wrote cpu_reference.hdr / cpu_reference.png" << std::endl;
+    return 0;
+}
+
+std::vector<float> parseFloatList(const std::string& text) {
+    std::vector<float> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::stof(item));
+    }
+    return values;
+}
+
+std::vector<float> readImageRgba(const Context& context, const Image& image, vk::Format format, vk::Extent2D extent) {
+    const size_t pixelCount = static_cast<size_t>(extent.width) * extent.height;
+    std::vector<float> rgba(pixelCount * 4);
+
+    if (format == vk::Format::eR32G32B32A32Sfloat) {
+        Buffer readback{ context, Buffer::Type::Readback, pixelCount * 4 * sizeof(float) };
+        image.copyToBuffer(context, readback, extent);
+        memcpy(rgba.data(), readback.map(context), rgba.size() * sizeof(float));
+    }
+    else if (format == vk::Format::eR16G16B16A16Sfloat) {
+        Buffer readback{ context, Buffer::Type::Readback, pixelCount * 4 * sizeof(uint16_t) };
+        image.copyToBuffer(context, readback, extent);
+        const uint16_t* halves = static_cast<const uint16_t*>(readback.map(context));
+        for (size_t i = 0; i < rgba.size(); i++) {
+            rgba[i] = halfToFloat(halves[i]);
+        }
+    }
+    else if (format == vk::Format::eB8G8R8A8Unorm) {
+        Buffer readback{ context, Buffer::Type::Readback, pixelCount * 4 };
+        image.copyToBuffer(context, readback, extent);
+        const uint8_t* bgra = static_cast<const uint8_t*>(readback.map(context));
+        for (size_t i = 0; i < pixelCount; i++) {
+            rgba[i * 4 + 0] = bgra[i * 4 + 2] / 255.0f;
+            rgba[i * 4 + 1] = bgra[i * 4 + 1] / 255.0f;
+            rgba[i * 4 + 2] = bgra[i * 4 + 0] / 255.0f;
+            rgba[i * 4 + 3] = bgra[i * 4 + 3] / 255.0f;
+        }
+    }
+    else {
+        throw std::runtime_error("readImageRgba: unsupported image format");
+    }
+    return rgba;
+}
+
+void writeAovs(const std::string& outputPath, const DenoiserInputs& inputs, const std::vector<uint32_t>& ids) {
+    const size_t pixelCount = static_cast<size_t>(inputs.width) * inputs.height;
+    const std::filesystem::path stem = std::filesystem::path(outputPath).replace_extension();
+
+    // Depth is the normal image's fourth channel; IDs become floats, exact below 2^24, with -1 where nothing was hit
+    std::vector<float> depth(pixelCount * 4, 0.0f);
+    std::vector<float> idFloats(pixelCount * 4, 0.0f);
+    bool idsExact = true;
+    for (size_t i = 0; i < pixelCount; i++) {
+        depth[i * 4] = inputs.normalDepth[i * 4 + 3];
+        for (int c = 0; c < 3; c++) {
+            const uint32_t id = ids[i * 4 + c];
+            idFloats[i * 4 + c] = id == 0xFFFFFFFFu ? -1.0f : static_cast<float>(id);
+            if (id != 0xFFFFFFFFu && id >= (1u << 24)) idsExact = false;
+        }
+    }
+    if (!idsExact) {
+        std::cout << "Some IDs are 2^24 or more and lose precision as floats" << std::endl;
+    }
+
+    struct Aov {
+        const char* name;
+        int channels;
+        const float* rgba;
+    };
+    const Aov aovs[] = {
+        { "albedo", 3, inputs.albedo.data() },
+        { "normal", 3, inputs.normalDepth.data() },
+        { "depth", 1, depth.data() },
+        { "ids", 3, idFloats.data() },
+    };
+    for (const Aov& aov : aovs) {
+        const std::string path = stem.string() + "_" + aov.name + ".pfm";
+        if (!writePfm(path, inputs.width, inputs.height, aov.channels, aov.rgba)) {
+            throw std::runtime_error("Failed to write " + path);
+        }
+        std::cout << "Wrote " << path << std::endl;
+    }
+}
+
+void updateGpuScene(const Context& context, GpuScene& gpu, const SceneData& scene, const std::vector<EmissiveTriGPU>& emissiveTris) {
+    // Create GPU buffers from the concatenated scene data
+    if (scene.vertices.empty() || scene.indices.empty()) {
+        throw std::runtime_error("No vertices or indices loaded for the scene");
+    }
+    if (scene.textureFiles.size() > MAX_TEXTURES) {
+        throw std::runtime_error("Scene has more textures than the texture descriptor array holds");
+    }
+
+    SceneGeometrySize geometrySize = getSceneGeometrySize(scene);
+    std::cout
+        << scene.vertices.size() << " vertices" << std::endl
+        << scene.indices.size() << " indices" << std::endl
+        << scene.meshes.size() << " meshes, " << scene.instances.size() << " instances" << std::endl
+        << scene.materials.size() << " unique materials, " << std::endl
+        << scene.textureFiles.size() << " textures" << std::endl
+        << "Geometry: " << geometrySize.instancedBytes / (1024.0 * 1024.0) << " MB instanced, "
+        << geometrySize.flattenedBytes / (1024.0 * 1024.0) << " MB if flattened" << std::endl;
+
+    // Load the textures that are new since the last update (decoded on the thread pool, uploaded in batches as they finish)
+    const size_t firstTexture = gpu.textures.size();
+    if (scene.textureFiles.size() > firstTexture) {
+        std::vector<std::string> paths(scene.textureFiles.begin() + firstTexture, scene.textureFiles.end());
+        std::vector<bool> srgb = getSrgbTextureMask(scene);
+        srgb.erase(srgb.begin(), srgb.begin() + firstTexture);
+
+        TextureLoadStats textureStats;
+        std::vector<Texture> textures = loadTextures(context, paths, srgb, &textureStats);
+        std::cout << "Textures: " << textureStats.bytes / (1024 * 1024) << " MB in " << textureStats.totalMs << " ms ("
+            << "decode " << textureStats.decodeMs << " ms, mips " << textureStats.mipMs << " ms over " << ThreadPool::global().size() << " threads, "
+            << "staging " << textureStats.stagingMs << " ms, "
+            << "submit " << textureStats.submitMs << " ms in " << textureStats.batches << " batches, "
+            << "waiting on decode " << textureStats.waitMs << " ms)" << std::endl;
+        for (Texture& texture : textures) {
+            gpu.textures.push_back(std::move(texture));
+        }
+    }
+
+    // The shaders and BLAS builds read the packed 24-byte vertices
+    std::vector<PackedVertex> packedVertices = packVertices(scene.vertices);
+    gpu.vertexBuffer = Buffer{ context, Buffer::Type::AccelInput, sizeof(PackedVertex) * packedVertices.size(), packedVertices.data() };
+    gpu.indexBuffer = Buffer{ context, Buffer::Type::AccelInput, sizeof(uint32_t) * scene.indices.size(), scene.indices.data() };
+    gpu.materialBuffer = Buffer{ context, Buffer::Type::AccelInput, sizeof(Material) * scene.materials.size(), scene.materials.data() };
+    gpu.faceMaterialIndexBuffer = Buffer{ context, Buffer::Type::AccelInput, sizeof(uint32_t) * scene.faceMaterialIndices.size(), scene.faceMaterialIndices.data() };
+
+    // Emissive triangle alias table (the triangle list comes with the scene)
+    auto aliasStart = std::chrono::high_resolution_clock::now();
+    std::vector<EmissiveAliasEntry> emissiveAlias = buildEmissiveAliasTable(emissiveTris);
+    double aliasMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - aliasStart).count();
+
+    // Create GPU buffers (safe even if there are no emissives)
+    size_t emissiveTriCount = emissiveTris.empty() ? 1 : emissiveTris.size();
+    size_t emissiveAliasCount = emissiveAlias.empty() ? 1 : emissiveAlias.size();
+
+    // Dummy data for empty case
+    EmissiveTriGPU dummyTri{};
+    EmissiveAliasEntry dummyAlias{ 1.0f, 0, 1.0f, 0.0f };
+
+    gpu.emissiveBuffer = Buffer{
+        context,
+        Buffer::Type::AccelInput,
+        sizeof(EmissiveTriGPU) * emissiveTriCount,
+        emissiveTris.empty() ? &dummyTri : emissiveTris.data()
+    };
+
+    gpu.emissiveAliasBuffer = Buffer{
+        context,
+        Buffer::Type::AccelInput,
+        sizeof(EmissiveAliasEntry) * emissiveAliasCount,
+        emissiveAlias.empty() ? &dummyAlias : emissiveAlias.data()
+    };
+
+    // light count uniform
+    int lightCountInt = static_cast<int>(emissiveTris.size());
+    gpu.lightCountBuffer = Buffer{
+        context,
+        Buffer::Type::AccelInput,
+        sizeof(int),
+        &lightCountInt
+    };
+
+    // debug output
+    std::cout << "Emissive triangles: " << emissiveTris.size() << ", alias table built in " << aliasMs << " ms" << std::endl;
+
+    // One BLAS per unique mesh, all built from the shared vertex and index buffers.
+    // Meshes are only ever appended and a BLAS doesn't read its inputs after the build, so only new ones are built.
+    const size_t firstMesh = gpu.meshAccelAddresses.size();
+    gpu.meshAccelAddresses.resize(scene.meshes.size(), 0);
+    for (size_t i = firstMesh; i < scene.meshes.size(); i++) {
+        const MeshRange& mesh = scene.meshes[i];
+        if (mesh.indexCount == 0) continue;
+
+        // Indices are absolute, so the vertex data starts at the buffer and the index data at the mesh
+        vk::AccelerationStructureGeometryTrianglesDataKHR triangleData;
+        triangleData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
+        triangleData.setVertexData(gpu.vertexBuffer.deviceAddress);
+        triangleData.setVertexStride(sizeof(PackedVertex));
+        triangleData.setMaxVertex(mesh.firstVertex + mesh.vertexCount - 1);
+        triangleData.setIndexType(vk::IndexType::eUint32);
+        triangleData.setIndexData(gpu.indexBuffer.deviceAddress + sizeof(uint32_t) * mesh.firstIndex);
+
+        vk::AccelerationStructureGeometryKHR triangleGeometry;
+        triangleGeometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
+        triangleGeometry.setGeometry({ triangleData });
+        triangleGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+        gpu.bottomAccels.emplace_back(context, triangleGeometry, mesh.indexCount / 3, vk::AccelerationStructureTypeKHR::eBottomLevel);
+        gpu.meshAccelAddresses[i] = gpu.bottomAccels.back().buffer.deviceAddress;
+    }
+
+    // Build a TLAS with one instance per mesh placement
+    std::vector<vk::AccelerationStructureInstanceKHR> accelInstances;
+    accelInstances.reserve(scene.instances.size());
+    for (const MeshInstance& instance : scene.instances) {
+        const MeshRange& mesh = scene.meshes[instance.mesh];
+        if (gpu.meshAccelAddresses[instance.mesh] == 0) continue;
+
+        // closesthit.rchit finds the mesh's triangles through the 24-bit custom index
+        const uint32_t firstTriangle = mesh.firstIndex / 3;
+        if (firstTriangle >= (1u << 24)) {
+            throw std::runtime_error("Scene has too many triangles for the instance custom index");
+        }
+
+        // Row-major 3x4, Mat4 is stored by column
+        vk::TransformMatrixKHR transformMatrix;
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 4; col++) {
+                transformMatrix.matrix[row][col] = instance.transform.m[col][row];
+            }
+        }
+
+        // Facing is decided in object space; mirroring transforms flip it as baking them into the vertices did
+        vk::GeometryInstanceFlagsKHR instanceFlags = vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable;
+        if (instance.transform.toMat3().determinant() < 0.0f) {
+            instanceFlags |= vk::GeometryInstanceFlagBitsKHR::eTriangleFlipFacing;
+        }
+
+        vk::AccelerationStructureInstanceKHR accelInstance;
+        accelInstance.setTransform(transformMatrix);
+        accelInstance.setInstanceCustomIndex(firstTriangle);
+        accelInstance.setMask(0xFF);
+        accelInstance.setAccelerationStructureReference(gpu.meshAccelAddresses[instance.mesh]);
+        accelInstance.setFlags(instanceFlags);
+        accelInstances.push_back(accelInstance);
+    }
+    if (accelInstances.empty()) {
+        throw std::runtime_error("No mesh instances to build the TLAS from");
+    }
+
+    gpu.instancesBuffer = Buffer{ context, Buffer::Type::AccelInput, sizeof(vk::AccelerationStructureInstanceKHR) * accelInstances.size(), accelInstances.data() };
+
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
+    instancesData.setArrayOfPointers(false);
+    instancesData.setData(gpu.instancesBuffer.deviceAddress);
+
+    vk::AccelerationStructureGeometryKHR instanceGeometry;
+    instanceGeometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
+    instanceGeometry.setGeometry({ instancesData });
+    instanceGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+
+    gpu.topAccel.accel.reset(); // before the buffer holding it
+    gpu.topAccel = Accel{ context, instanceGeometry, static_cast<uint32_t>(accelInstances.size()), vk::AccelerationStructureTypeKHR::eTopLevel };
+
+    if (gpu.topAccel.buffer.deviceAddress == 0) {
+        throw std::runtime_error("TLAS device address is zero");
+    }
+
+    // Everything above was only recorded, run it all before the next frame
+    context.uploader->finish();
+    const UploadStats& uploadStats = context.uploader->getStats();
+    std::cout << "Uploads: " << uploadStats.bytesStaged / (1024 * 1024) << " MB staged in " << uploadStats.copies << " copies, "
+        << uploadStats.flushes << " submits, stalled " << uploadStats.stallMs << " ms on a full ring, "
+        << "waited " << uploadStats.waitMs << " ms for completion" << std::endl;
+
+    vk::DeviceSize bottomAccelBytes = 0;
+    for (const Accel& accel : gpu.bottomAccels) bottomAccelBytes += accel.buffer.descBufferInfo.range;
+    std::cout << "Acceleration structures: " << gpu.bottomAccels.size() << " BLAS (" << bottomAccelBytes / (1024 * 1024) << " MB), "
+        << accelInstances.size() << " TLAS instances" << std::endl;
+
+    DeviceMemoryStats memoryStats = context.allocator->getStats();
+    std::cout << "Device memory: " << memoryStats.usedBytes / (1024 * 1024) << " MB used of "
+        << memoryStats.reservedBytes / (1024 * 1024) << " MB in " << memoryStats.blockCount << " blocks + "
+        << memoryStats.dedicatedCount << " dedicated, " << memoryStats.allocationCount << " sub-allocations" << std::endl;
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     if (firstMouse) {
         lastX = xpos;
@@ -15,11 +15,13 @@ struct Vec3 {
     Vec3 operator-(const Vec3& other) const { return { x - other.x, y - other.y, z - other.z }; }
 
     Vec3 operator*(float scalar) const { return { x * scalar, y * scalar, z * scalar }; }
+    Vec3 operator*(const Vec3& other) const { return { x * other.x, y * other.y, z * other.z }; }
     Vec3 operator/(float scalar) const { return { x / scalar, y / scalar, z / scalar }; }
 
     Vec3& operator+=(const Vec3& other) { x += other.x; y += other.y; z += other.z; return *this; }
     Vec3& operator-=(const Vec3& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
     Vec3& operator*=(float scalar) { x *= scalar; y *= scalar; z *= scalar; return *this; }
+    Vec3& operator*=(const Vec3& other) { x *= other.x; y *= other.y; z *= other.z; return *this; }
     Vec3& operator/=(float scalar) { x /= scalar; y /= scalar; z /= scalar; return *this; }
 
     bool operator==(const Vec3& other) const { return x == other.x && y == other.y && z == other.z; }
@@ -27,6 +29,7 @@ struct Vec3 {
 
     float lengthSquared() const { return x * x + y * y + z * z; }
     float length() const { return std::sqrt(lengthSquared()); }
+    float maxComponent() const { return std::fmax(x, std::fmax(y, z)); }
 
     float dot(const Vec3& other) const { return x * other.x + y * other.y + z * other.z; }
 
@@ -0,0 +1,473 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+    constexpr uint32_t MAX_LEAF_SIZE = 4;
+    constexpr uint32_t BIN_COUNT = 16;
+    constexpr float TRAVERSAL_COST = 1.0f;
+    constexpr float INTERSECTION_COST = 1.0f;
+
+    // Nodes at least this large bin and partition with parallelFor instead of on one thread
+    constexpr uint32_t PARALLEL_NODE_SIZE = 1u << 16;
+    constexpr size_t PARALLEL_GRAIN = 1u << 14;
+    // Subtrees at least this large are handed to the pool as a separate task
+    constexpr uint32_t TASK_NODE_SIZE = 1u << 12;
+    // Past this depth splits are forced to the median so the tree stays within Bvh::MAX_DEPTH
+    constexpr uint32_t SAH_MAX_DEPTH = 64;
+
+    // Slab test, returns the entry distance or 1e30 when the box is missed
+    float intersectAabb(const Aabb& box, const Vec3& origin, const Vec3& invDir, float tMin, float tMax) {
+        float tx1 = (box.min.x - origin.x) * invDir.x, tx2 = (box.max.x - origin.x) * invDir.x;
+        float tNear = std::fmin(tx1, tx2), tFar = std::fmax(tx1, tx2);
+        float ty1 = (box.min.y - origin.y) * invDir.y, ty2 = (box.max.y - origin.y) * invDir.y;
+        tNear = std::fmax(tNear, std::fmin(ty1, ty2)); tFar = std::fmin(tFar, std::fmax(ty1, ty2));
+        float tz1 = (box.min.z - origin.z) * invDir.z, tz2 = (box.max.z - origin.z) * invDir.z;
+        tNear = std::fmax(tNear, std::fmin(tz1, tz2)); tFar = std::fmin(tFar, std::fmax(tz1, tz2));
+        tNear = std::fmax(tNear, tMin);
+        tFar = std::fmin(tFar, tMax);
+        return tNear <= tFar ? tNear : 1e30f;
+    }
+
+    Vec3 safeInverse(const Vec3& d) {
+        auto inv = [](float x) { return std::fabs(x) > 1e-20f ? 1.0f / x : (x < 0.0f ? -1e30f : 1e30f); };
+        return Vec3(inv(d.x), inv(d.y), inv(d.z));
+    }
+
+    float axisValue(const Vec3& v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+    struct Bin {
+        Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    struct BinSet {
+        Bin bins[3][BIN_COUNT];
+
+        void merge(const BinSet& other) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (uint32_t b = 0; b < BIN_COUNT; b++) {
+                    bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                    bins[axis][b].count += other.bins[axis][b].count;
+                }
+            }
+        }
+    };
+
+    // Primitives whose centroid lands in bins [0, bin] go left
+    struct Split {
+        int axis = -1;
+        uint32_t bin = 0;
+        float cost = 1e30f;
+        Aabb left, right;
+    };
+
+    // Bounds travel with the primitive through partitioning so every pass streams memory in order
+    struct PrimRef {
+        Aabb bounds;
+        uint32_t index;
+
+        Vec3 centroid() const { return bounds.center(); }
+    };
+
+    // Maps centroids of a node to bins; binning and partitioning must use the exact same expression
+    struct BinMapping {
+        Vec3 origin;
+        Vec3 scale;
+
+        explicit BinMapping(const Aabb& centroidBounds) : origin(centroidBounds.min) {
+            Vec3 e = centroidBounds.extent();
+            auto s = [](float x) { return x > 0.0f ? BIN_COUNT * 0.9999f / x : 0.0f; };
+            scale = Vec3(s(e.x), s(e.y), s(e.z));
+        }
+
+        uint32_t operator()(const Vec3& c, int axis) const {
+            float b = (axisValue(c, axis) - axisValue(origin, axis)) * axisValue(scale, axis);
+            return std::min(BIN_COUNT - 1, static_cast<uint32_t>(std::max(b, 0.0f)));
+        }
+    };
+}
+
+// Shared state of one Bvh::build; nodes are preallocated so tasks can write them without locking
+struct BvhBuilder {
+    Bvh& bvh;
+    ThreadPool& pool;
+    TaskGroup tasks;
+
+    std::vector<PrimRef> refs;
+    std::vector<PrimRef> scratch; // partition target, every node only touches its own range
+    std::atomic<uint32_t> nodeCount{ 1 };
+    std::atomic<uint32_t> maxDepth{ 0 };
+
+    BvhBuilder(Bvh& bvh, ThreadPool& pool) : bvh(bvh), pool(pool), tasks(pool) {}
+
+    // Union of get(refs[i]) over [begin, end)
+    template <typename Get>
+    Aabb reduceBounds(uint32_t begin, uint32_t end, const Get& get) {
+        const uint32_t count = end - begin;
+        if (count < PARALLEL_NODE_SIZE) {
+            Aabb bounds;
+            for (uint32_t i = begin; i < end; i++) bounds.grow(get(refs[i]));
+            return bounds;
+        }
+
+        std::vector<Aabb> partial((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+        pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t b, size_t e) {
+            Aabb& bounds = partial[b / PARALLEL_GRAIN];
+            for (size_t i = begin + b; i < begin + e; i++) bounds.grow(get(refs[i]));
+        });
+
+        Aabb bounds;
+        for (const Aabb& p : partial) bounds.grow(p);
+        return bounds;
+    }
+
+    void binRange(uint32_t begin, uint32_t end, const BinMapping& mapping, BinSet& bins) const {
+        for (uint32_t i = begin; i < end; i++) {
+            const PrimRef& ref = refs[i];
+            Vec3 centroid = ref.centroid();
+            for (int axis = 0; axis < 3; axis++) {
+                Bin& bin = bins.bins[axis][mapping(centroid, axis)];
+                bin.bounds.grow(ref.bounds);
+                bin.count++;
+            }
+        }
+    }
+
+    BinSet binPrimitives(uint32_t begin, uint32_t end, const BinMapping& mapping) {
+        const uint32_t count = end - begin;
+        BinSet bins;
+        if (count < PARALLEL_NODE_SIZE) {
+            binRange(begin, end, mapping, bins);
+            return bins;
+        }
+
+        std::vector<BinSet> partial((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+        pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t b, size_t e) {
+            binRange(begin + static_cast<uint32_t>(b), begin + static_cast<uint32_t>(e), mapping, partial[b / PARALLEL_GRAIN]);
+        });
+        for (const BinSet& p : partial) bins.merge(p);
+        return bins;
+    }
+
+    // Sweeps the bin boundaries of every axis and keeps the cheapest split
+    static Split findSplit(const BinSet& bins, const Aabb& centroidBounds, float nodeArea) {
+        Split best;
+        const float invArea = 1.0f / std::max(nodeArea, 1e-30f);
+        const Vec3 extent = centroidBounds.extent();
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (axisValue(extent, axis) <= 0.0f) continue;
+
+            // Right-to-left sweep first so the left-to-right one can evaluate costs directly
+            float rightArea[BIN_COUNT];
+            uint32_t rightCount[BIN_COUNT];
+            Aabb bounds;
+            uint32_t count = 0;
+            for (uint32_t b = BIN_COUNT - 1; b > 0; b--) {
+                bounds.grow(bins.bins[axis][b].bounds);
+                count += bins.bins[axis][b].count;
+                rightArea[b] = bounds.surfaceArea();
+                rightCount[b] = count;
+            }
+
+            Aabb left;
+            uint32_t leftCount = 0;
+            for (uint32_t b = 0; b < BIN_COUNT - 1; b++) {
+                left.grow(bins.bins[axis][b].bounds);
+                leftCount += bins.bins[axis][b].count;
+                if (leftCount == 0 || rightCount[b + 1] == 0) continue;
+
+                float cost = TRAVERSAL_COST + INTERSECTION_COST * invArea *
+                    (left.surfaceArea() * leftCount + rightArea[b + 1] * rightCount[b + 1]);
+                if (cost < best.cost) {
+                    best.axis = axis;
+                    best.bin = b;
+                    best.cost = cost;
+                    best.left = left;
+                }
+            }
+        }
+
+        if (best.axis >= 0) {
+            for (uint32_t b = best.bin + 1; b < BIN_COUNT; b++) best.right.grow(bins.bins[best.axis][b].bounds);
+        }
+        return best;
+    }
+
+    // Stable within chunks; large ranges count per chunk, scatter through `scratch` and copy back
+    template <typename Pred>
+    uint32_t partition(uint32_t begin, uint32_t end, const Pred& goesLeft) {
+        std::vector<PrimRef>& prims = refs;
+        const uint32_t count = end - begin;
+        if (count < PARALLEL_NODE_SIZE) {
+            return static_cast<uint32_t>(std::partition(prims.begin() + begin, prims.begin() + end, goesLeft) - prims.begin());
+        }
+
+        const size_t chunkCount = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+        std::vector<uint32_t> leftCounts(chunkCount, 0);
+        pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t b, size_t e) {
+            uint32_t n = 0;
+            for (size_t i = begin + b; i < begin + e; i++) n += goesLeft(prims[i]) ? 1 : 0;
+            leftCounts[b / PARALLEL_GRAIN] = n;
+        });
+
+        // Exclusive prefix sums give every chunk its output offsets on both sides
+        std::vector<uint32_t> leftOffsets(chunkCount), rightOffsets(chunkCount);
+        uint32_t totalLeft = 0;
+        for (size_t c = 0; c < chunkCount; c++) {
+            leftOffsets[c] = totalLeft;
+            totalLeft += leftCounts[c];
+        }
+        uint32_t totalRight = 0;
+        for (size_t c = 0; c < chunkCount; c++) {
+            rightOffsets[c] = totalLeft + totalRight;
+            uint32_t chunkSize = static_cast<uint32_t>(std::min<size_t>(PARALLEL_GRAIN, count - c * PARALLEL_GRAIN));
+            totalRight += chunkSize - leftCounts[c];
+        }
+
+        pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t b, size_t e) {
+            size_t c = b / PARALLEL_GRAIN;
+            uint32_t l = begin + leftOffsets[c];
+            uint32_t r = begin + rightOffsets[c];
+            for (size_t i = begin + b; i < begin + e; i++) {
+                const PrimRef& ref = prims[i];
+                scratch[goesLeft(ref) ? l++ : r++] = ref;
+            }
+        });
+        pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t b, size_t e) {
+            std::copy(scratch.begin() + begin + b, scratch.begin() + begin + e, prims.begin() + begin + b);
+        });
+
+        return begin + totalLeft;
+    }
+
+    void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth) {
+        uint32_t deepest = maxDepth.load();
+        while (depth > deepest && !maxDepth.compare_exchange_weak(deepest, depth)) {}
+
+        BvhNode& node = bvh.nodes[nodeIndex];
+        const uint32_t count = end - begin;
+
+        uint32_t mid = begin;
+        Aabb leftBounds, rightBounds;
+        bool split = false;
+
+        if (count > 1 && depth < SAH_MAX_DEPTH) {
+            Aabb centroidBounds = reduceBounds(begin, end, [](const PrimRef& ref) { return ref.centroid(); });
+            BinMapping mapping(centroidBounds);
+            Split best = findSplit(binPrimitives(begin, end, mapping), centroidBounds, node.bounds.surfaceArea());
+
+            // Oversized leaves are never allowed, small ones only when splitting doesn't pay off
+            if (best.axis >= 0 && (best.cost < count * INTERSECTION_COST || count > MAX_LEAF_SIZE)) {
+                mid = partition(begin, end, [&](const PrimRef& ref) { return mapping(ref.centroid(), best.axis) <= best.bin; });
+                leftBounds = best.left;
+                rightBounds = best.right;
+                split = true;
+            }
+        }
+
+        if (!split) {
+            if (count <= MAX_LEAF_SIZE) {
+                node.first = begin;
+                node.count = count;
+                return;
+            }
+
+            // Coincident centroids or too deep: median split along the longest axis of the node
+            Vec3 extent = node.bounds.extent();
+            int axis = 0;
+            if (extent.y > extent.x) axis = 1;
+            if (extent.z > axisValue(extent, axis)) axis = 2;
+
+            mid = begin + count / 2;
+            std::nth_element(refs.begin() + begin, refs.begin() + mid, refs.begin() + end,
+                [&](const PrimRef& a, const PrimRef& b) { return axisValue(a.centroid(), axis) < axisValue(b.centroid(), axis); });
+
+            auto getBounds = [](const PrimRef& ref) -> const Aabb& { return ref.bounds; };
+            leftBounds = reduceBounds(begin, mid, getBounds);
+            rightBounds = reduceBounds(mid, end, getBounds);
+        }
+
+        const uint32_t children = nodeCount.fetch_add(2);
+        bvh.nodes[children].bounds = leftBounds;
+        bvh.nodes[children + 1].bounds = rightBounds;
+        node.first = children;
+        node.count = 0;
+
+        // Hand the left subtree to the pool (idle threads steal it) and keep the right one on this thread
+        if (count >= TASK_NODE_SIZE) {
+            tasks.run([this, children, begin, mid, depth] { buildNode(children, begin, mid, depth + 1); });
+        }
+        else {
+            buildNode(children, begin, mid, depth + 1);
+        }
+        buildNode(children + 1, mid, end, depth + 1);
+    }
+};
+
+void Bvh::build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, ThreadPool& pool) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const uint32_t triCount = static_cast<uint32_t>(indices.size() / 3);
+    BvhBuilder builder(*this, pool);
+
+    triangles.resize(triCount);
+    primIndices.resize(triCount);
+    builder.refs.resize(triCount);
+    builder.scratch.resize(triCount);
+
+    pool.parallelFor(triCount, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Vec3& p0 = vertices[indices[3 * i + 0]].position;
+            const Vec3& p1 = vertices[indices[3 * i + 1]].position;
+            const Vec3& p2 = vertices[indices[3 * i + 2]].position;
+            triangles[i] = { p0, p1 - p0, p2 - p0 };
+
+            PrimRef& ref = builder.refs[i];
+            ref.bounds = Aabb();
+            ref.bounds.grow(p0);
+            ref.bounds.grow(p1);
+            ref.bounds.grow(p2);
+            ref.index = static_cast<uint32_t>(i);
+        }
+    });
+
+    // A binary tree with N leaves has at most 2N - 1 nodes
+    nodes.assign(triCount > 0 ? 2 * triCount - 1 : 1, BvhNode());
+    nodes[0].count = triCount;
+
+    if (triCount > 0) {
+        nodes[0].bounds = builder.reduceBounds(0, triCount, [](const PrimRef& ref) -> const Aabb& { return ref.bounds; });
+        builder.buildNode(0, 0, triCount, 0);
+        builder.tasks.wait();
+
+        pool.parallelFor(triCount, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) primIndices[i] = builder.refs[i].index;
+        });
+        nodes.resize(builder.nodeCount.load());
+        nodes.shrink_to_fit();
+    }
+
+    stats = BvhBuildStats();
+    stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.maxDepth = builder.maxDepth.load();
+
+    // SAH cost of the finished tree, relative to the root surface area
+    double cost = 0.0;
+    for (const BvhNode& node : nodes) {
+        double area = node.bounds.surfaceArea();
+        if (node.isLeaf()) {
+            cost += area * node.count * INTERSECTION_COST;
+            stats.leafCount++;
+        }
+        else {
+            cost += area * TRAVERSAL_COST;
+        }
+    }
+    float rootArea = nodes[0].bounds.surfaceArea();
+    stats.sahCost = rootArea > 0.0f ? static_cast<float>(cost / rootArea) : 0.0f;
+}
+
+bool Bvh::intersectTriangle(const Triangle& tri, const Ray& ray, float tMax, RayHit& hit) const {
+    Vec3 pvec = cross(ray.direction, tri.e2);
+    float det = dot(tri.e1, pvec);
+    if (std::fabs(det) < 1e-12f) return false;
+
+    float invDet = 1.0f / det;
+    Vec3 tvec = ray.origin - tri.v0;
+    float u = dot(tvec, pvec) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    Vec3 qvec = cross(tvec, tri.e1);
+    float v = dot(ray.direction, qvec) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    float t = dot(tri.e2, qvec) * invDet;
+    if (t <= ray.tMin || t >= tMax) return false;
+
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    hit.frontFace = det > 0.0f;
+    return true;
+}
+
+bool Bvh::intersect(const Ray& ray, RayHit& hit) const {
+    if (nodes.empty() || triangles.empty()) return false;
+
+    Vec3 invDir = safeInverse(ray.direction);
+    float closest = ray.tMax;
+    bool found = false;
+
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BvhNode& node = nodes[stack[--stackSize]];
+        if (intersectAabb(node.bounds, ray.origin, invDir, ray.tMin, closest) == 1e30f) continue;
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t prim = primIndices[i];
+                RayHit candidate;
+                if (intersectTriangle(triangles[prim], ray, closest, candidate)) {
+                    closest = candidate.t;
+                    candidate.primitive = prim;
+                    hit = candidate;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first
+        uint32_t left = node.first;
+        uint32_t right = node.first + 1;
+        float tLeft = intersectAabb(nodes[left].bounds, ray.origin, invDir, ray.tMin, closest);
+        float tRight = intersectAabb(nodes[right].bounds, ray.origin, invDir, ray.tMin, closest);
+        if (tLeft > tRight) {
+            std::swap(left, right);
+            std::swap(tLeft, tRight);
+        }
+        if (tRight != 1e30f) stack[stackSize++] = right;
+        if (tLeft != 1e30f) stack[stackSize++] = left;
+    }
+
+    return found;
+}
+
+bool Bvh::occluded(const Ray& ray, bool ignoreBackFaces) const {
+    if (nodes.empty() || triangles.empty()) return false;
+
+    Vec3 invDir = safeInverse(ray.direction);
+
+    uint32_t stack[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BvhNode& node = nodes[stack[--stackSize]];
+        if (intersectAabb(node.bounds, ray.origin, invDir, ray.tMin, ray.tMax) == 1e30f) continue;
+
+        if (node.isLeaf()) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                RayHit candidate;
+                if (intersectTriangle(triangles[primIndices[i]], ray, ray.tMax, candidate)) {
+                    if (ignoreBackFaces && !candidate.frontFace) continue;
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.first + 1;
+        stack[stackSize++] = node.first;
+    }
+
+    return false;
+}
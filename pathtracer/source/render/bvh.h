@@ -0,0 +1,98 @@
+#pragma once
+
+#include "core/thread_pool.h"
+#include "math/vec3.h"
+#include "render/model_loader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct Aabb {
+    Vec3 min = Vec3(1e30f);
+    Vec3 max = Vec3(-1e30f);
+
+    void grow(const Vec3& p) {
+        min = Vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+    // Component-wise so that merging an empty box is a no-op
+    void grow(const Aabb& b) {
+        min = Vec3(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+        max = Vec3(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+    }
+
+    Vec3 extent() const { return max - min; }
+    Vec3 center() const { return (min + max) * 0.5f; }
+    float surfaceArea() const {
+        Vec3 e = extent();
+        if (e.x < 0.0f) return 0.0f;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// Interior nodes store their left child in `first` (right child is first + 1),
+// leaves store `count` triangles starting at primIndices[first]
+struct BvhNode {
+    Aabb bounds;
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    bool isLeaf() const { return count > 0; }
+};
+
+struct Ray {
+    Vec3 origin;
+    Vec3 direction;
+    float tMin = 0.0f;
+    float tMax = 1e30f;
+};
+
+struct RayHit {
+    float t = 1e30f;
+    uint32_t primitive = ~0u;
+    float u = 0.0f;        // barycentric weight of vertex 1 (matches hitAttributeEXT.x)
+    float v = 0.0f;        // barycentric weight of vertex 2 (matches hitAttributeEXT.y)
+    bool frontFace = true; // counter-clockwise winding as seen from the ray origin
+};
+
+struct BvhBuildStats {
+    double buildMs = 0.0;
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+    float sahCost = 0.0f; // expected traversal + intersection cost of a random ray hitting the root
+};
+
+class Bvh {
+public:
+    // Binned SAH; subtrees are built as tasks on `pool` and the top levels bin/partition in parallel
+    void build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, ThreadPool& pool = ThreadPool::global());
+
+    // Closest hit in (tMin, tMax)
+    bool intersect(const Ray& ray, RayHit& hit) const;
+    // Any hit in (tMin, tMax); back faces are skipped when requested
+    bool occluded(const Ray& ray, bool ignoreBackFaces) const;
+
+    const std::vector<BvhNode>& getNodes() const { return nodes; }
+    uint32_t getTriangleCount() const { return static_cast<uint32_t>(triangles.size()); }
+    const BvhBuildStats& getBuildStats() const { return stats; }
+
+    // Traversal stack depth, the builder falls back to median splits well before reaching it
+    static constexpr uint32_t MAX_DEPTH = 128;
+
+private:
+    friend struct BvhBuilder;
+
+    // Pre-transformed triangle (v0 + two edges) for Moller-Trumbore
+    struct Triangle {
+        Vec3 v0, e1, e2;
+    };
+
+    bool intersectTriangle(const Triangle& tri, const Ray& ray, float tMax, RayHit& hit) const;
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> primIndices;
+    std::vector<Triangle> triangles;
+    BvhBuildStats stats;
+};
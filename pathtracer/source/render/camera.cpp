@@ -1,4 +1,4 @@
-#include "Camera.h"
+#include "camera.h"
 #include <cmath>
 
 const float PI = 3.14159265359f;
@@ -1,5 +1,5 @@
 #pragma once
-#include "math/Vec3.h"
+#include "math/vec3.h"
 #include <string>
 
 struct Camera {
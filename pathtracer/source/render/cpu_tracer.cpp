@@ -0,0 +1,569 @@
+#include "cpu_tracer.h"
+#include "core/image_source.h"
+#include "core/thread_pool.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Everything below mirrors common.glsl / raygen.rgen / closesthit.rchit / miss.rmiss line by line,
+// including the order in which random numbers are drawn, so both renderers converge to the same image.
+namespace {
+    const float M_PI_F = 3.14159265358979323846f;
+    const float EPS = 1e-5f;
+
+    // --- RNG (pcg/rand) ---
+    uint32_t pcg(uint32_t& state) {
+        uint32_t prev = state * 747796405u + 2891336453u;
+        uint32_t word = ((prev >> ((prev >> 28u) + 4u)) ^ prev) * 277803737u;
+        state = prev;
+        return (word >> 22u) ^ word;
+    }
+
+    void pcg2d(uint32_t& x, uint32_t& y) {
+        x = x * 1664525u + 1013904223u;
+        y = y * 1664525u + 1013904223u;
+        x += y * 1664525u;
+        y += x * 1664525u;
+        x = x ^ (x >> 16u);
+        y = y ^ (y >> 16u);
+        x += y * 1664525u;
+        y += x * 1664525u;
+        x = x ^ (x >> 16u);
+        y = y ^ (y >> 16u);
+    }
+
+    float rand(uint32_t& seed) {
+        uint32_t val = pcg(seed);
+        return static_cast<float>(val) * (1.0f / static_cast<float>(0xffffffffu));
+    }
+
+    float saturate(float x) { return std::clamp(x, 0.0f, 1.0f); }
+
+    Vec3 mix(const Vec3& a, const Vec3& b, float t) { return a * (1.0f - t) + b * t; }
+
+    Vec3 reflect(const Vec3& I, const Vec3& N) { return I - N * (2.0f * dot(N, I)); }
+
+    Vec3 refract(const Vec3& I, const Vec3& N, float eta) {
+        float NdotI = dot(N, I);
+        float k = 1.0f - eta * eta * (1.0f - NdotI * NdotI);
+        if (k < 0.0f) return Vec3(0.0f);
+        return I * eta - N * (eta * NdotI + std::sqrt(k));
+    }
+
+    // --- Coordinate system helper ---
+    void createCoordinateSystem(const Vec3& N, Vec3& T, Vec3& B) {
+        if (std::fabs(N.x) > std::fabs(N.y))
+            T = normalize(Vec3(N.z, 0.0f, -N.x));
+        else
+            T = normalize(Vec3(0.0f, -N.z, N.y));
+        B = cross(N, T);
+    }
+
+    // --- GGX / Fresnel / Smith helpers ---
+    float schlickFresnel(float cosTheta, float F0) {
+        return F0 + (1.0f - F0) * std::pow(1.0f - cosTheta, 5.0f);
+    }
+    Vec3 fresnelSchlick(float cosTheta, const Vec3& F0) {
+        return F0 + (Vec3(1.0f) - F0) * std::pow(1.0f - cosTheta, 5.0f);
+    }
+
+    float roughnessToAlpha(float roughness) {
+        return std::max(0.001f, roughness * roughness);
+    }
+
+    float GGX_D(float NdotH, float alpha) {
+        float a2 = alpha * alpha;
+        float NdotH2 = NdotH * NdotH;
+        float denom = NdotH2 * (a2 - 1.0f) + 1.0f;
+        denom = M_PI_F * denom * denom;
+        return a2 / denom;
+    }
+
+    float smithG1(float NdotV, float alpha) {
+        float k = (alpha * alpha) / 2.0f; // UE4 style
+        return NdotV / (NdotV * (1.0f - k) + k);
+    }
+    float smithG(float NdotV, float NdotL, float alpha) {
+        return smithG1(NdotV, alpha) * smithG1(NdotL, alpha);
+    }
+
+    Vec3 sampleGGX(const Vec3& N, const Vec3& V, float roughness, uint32_t& seed) {
+        float a = roughnessToAlpha(roughness);
+        float r1 = rand(seed);
+        float r2 = rand(seed);
+
+        float phi = 2.0f * M_PI_F * r1;
+        float cosTheta = std::sqrt((1.0f - r2) / (1.0f + (a * a - 1.0f) * r2));
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+
+        Vec3 Ht(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+
+        Vec3 T, B;
+        createCoordinateSystem(N, T, B);
+        Vec3 H = normalize(T * Ht.x + B * Ht.y + N * Ht.z);
+
+        return normalize(reflect(-V, H));
+    }
+
+    Vec3 sampleCosineHemisphere(const Vec3& N, uint32_t& seed) {
+        float r1 = rand(seed);
+        float r2 = rand(seed);
+        float phi = 2.0f * M_PI_F * r1;
+        float r = std::sqrt(r2);
+        float x = r * std::cos(phi);
+        float y = r * std::sin(phi);
+        float z = std::sqrt(std::max(0.0f, 1.0f - r2));
+        Vec3 T, B;
+        createCoordinateSystem(N, T, B);
+        return normalize(T * x + B * y + N * z);
+    }
+
+    float pdfCosineHemisphere(float NdotL) {
+        return NdotL / M_PI_F;
+    }
+    float pdfGGX(const Vec3& N, const Vec3& V, const Vec3& L, float roughness) {
+        Vec3 H = normalize(V + L);
+        float NdotH = std::max(dot(N, H), 0.0f);
+        float VdotH = std::max(dot(V, H), EPS);
+        float D = GGX_D(NdotH, roughnessToAlpha(roughness));
+        return (D * NdotH) / (4.0f * VdotH);
+    }
+
+    Vec3 evalBRDF(const Vec3& N, const Vec3& V, const Vec3& L, const Vec3& albedo, float metallic, float roughness) {
+        float NdotL = std::max(dot(N, L), 0.0f);
+        float NdotV = std::max(dot(N, V), 0.0f);
+        if (NdotL <= 0.0f || NdotV <= 0.0f) return Vec3(0.0f);
+
+        Vec3 H = normalize(V + L);
+        float NdotH = std::max(dot(N, H), 0.0f);
+        float VdotH = std::max(dot(V, H), 0.0f);
+
+        Vec3 F0 = mix(Vec3(0.04f), albedo, metallic);
+        Vec3 F = fresnelSchlick(VdotH, F0);
+
+        float alpha = roughnessToAlpha(roughness);
+        float D = GGX_D(NdotH, alpha);
+        float G = smithG(NdotV, NdotL, alpha);
+
+        Vec3 spec = F * (D * G / (4.0f * NdotV * NdotL + 1e-6f));
+        Vec3 diff = albedo * ((1.0f - metallic) / M_PI_F);
+        return diff + spec;
+    }
+
+    // miss.rmiss
+    Vec3 skyColorSimple(const Vec3& dir) {
+        float t = std::clamp(0.5f * (dir.y + 1.0f), 0.0f, 1.0f);
+        return mix(Vec3(0.6f, 0.7f, 0.9f), Vec3(0.02f, 0.02f, 0.05f), std::pow(1.0f - t, 2.0f));
+    }
+
+    Vec3 emissivePosition(const float v[4]) { return Vec3(v[0], v[1], v[2]); }
+}
+
+bool CpuTexture::load(const std::string& path, bool srgb) {
+    int texWidth, texHeight;
+    stbi_uc* data = loadImageRgba(path, texWidth, texHeight);
+    if (!data) return false;
+
+    width = static_cast<uint32_t>(texWidth);
+    height = static_cast<uint32_t>(texHeight);
+    pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(data);
+
+    mips = generateMipChain(pixels.data(), width, height, srgb);
+    return true;
+}
+
+void CpuTexture::sample(float u, float v, float lod, float out[4]) const {
+    if (pixels.empty()) {
+        out[0] = out[1] = out[2] = out[3] = 0.0f;
+        return;
+    }
+
+    // Sampler has minLod 0 and maxLod = level count, the level index is clamped to the chain
+    const float maxLevel = static_cast<float>(mips.levels.size());
+    lod = std::clamp(lod, 0.0f, maxLevel);
+    const uint32_t level0 = static_cast<uint32_t>(lod);
+    const float t = lod - static_cast<float>(level0);
+
+    sampleLevel(level0, u, v, out);
+    if (t > 0.0f && level0 + 1 <= mips.levels.size()) {
+        float next[4];
+        sampleLevel(level0 + 1, u, v, next);
+        for (int c = 0; c < 4; c++) {
+            out[c] += (next[c] - out[c]) * t;
+        }
+    }
+}
+
+void CpuTexture::sampleLevel(uint32_t level, float u, float v, float out[4]) const {
+    const uint8_t* texels = pixels.data();
+    uint32_t w = width, h = height;
+    if (level > 0) {
+        const MipLevel& mip = mips.levels[level - 1];
+        texels = mips.data.data() + mip.offset;
+        w = mip.width;
+        h = mip.height;
+    }
+
+    // Texel centers are at half-integer coordinates, same as the Vulkan linear filter
+    float x = u * w - 0.5f;
+    float y = v * h - 0.5f;
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    float tx = x - fx;
+    float ty = y - fy;
+
+    auto wrap = [](int64_t i, uint32_t size) { return static_cast<uint32_t>(((i % size) + size) % size); };
+    uint32_t x0 = wrap(static_cast<int64_t>(fx), w), x1 = wrap(static_cast<int64_t>(fx) + 1, w);
+    uint32_t y0 = wrap(static_cast<int64_t>(fy), h), y1 = wrap(static_cast<int64_t>(fy) + 1, h);
+
+    const uint8_t* p00 = &texels[(static_cast<size_t>(y0) * w + x0) * 4];
+    const uint8_t* p10 = &texels[(static_cast<size_t>(y0) * w + x1) * 4];
+    const uint8_t* p01 = &texels[(static_cast<size_t>(y1) * w + x0) * 4];
+    const uint8_t* p11 = &texels[(static_cast<size_t>(y1) * w + x1) * 4];
+
+    for (int c = 0; c < 4; c++) {
+        float top = p00[c] + (p10[c] - p00[c]) * tx;
+        float bottom = p01[c] + (p11[c] - p01[c]) * tx;
+        out[c] = (top + (bottom - top) * ty) / 255.0f;
+    }
+}
+
+CpuPathTracer::CpuPathTracer(const SceneData& scene,
+    const std::vector<EmissiveTriGPU>& emissiveTris,
+    const std::vector<EmissiveAliasEntry>& emissiveAlias)
+    : scene(flattenScene(scene)), emissiveTris(emissiveTris), emissiveAlias(emissiveAlias) {
+
+    bvh.build(this->scene.vertices, this->scene.indices);
+
+    textures.resize(scene.textureFiles.size());
+    const std::vector<bool> srgb = getSrgbTextureMask(scene);
+    ThreadPool::global().parallelFor(textures.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (!textures[i].load(scene.textureFiles[i], srgb[i])) {
+                std::cerr << "Failed to load texture image: " << scene.textureFiles[i] << std::endl;
+            }
+        }
+    });
+}
+
+void CpuPathTracer::resize(uint32_t newWidth, uint32_t newHeight) {
+    width = newWidth;
+    height = newHeight;
+    accumulation.assign(static_cast<size_t>(width) * height * 4, 0.0f);
+}
+
+void CpuPathTracer::renderFrame(const Camera& camera, int frame) {
+    const int maxSamples = settings.samplesPerFrame; // spp per frame
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    const float tanFov = std::tan((70.0f * 0.5f) * M_PI_F / 180.0f);
+    const float coneSpread = std::atan(2.0f * tanFov / static_cast<float>(height));
+
+    ThreadPool::global().parallelFor(height, 1, [&](size_t rowBegin, size_t rowEnd) {
+        uint64_t rays = 0;
+
+        for (size_t y = rowBegin; y < rowEnd; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                Vec3 sampleAccum(0.0f);
+                Vec3 albedoAccum(0.0f);
+
+                for (int s = 0; s < maxSamples; ++s) {
+                    // RNG seed (int multiply wraps the same way as the GLSL ivec2 * int)
+                    uint32_t scale = static_cast<uint32_t>(s + maxSamples * frame + 1);
+                    uint32_t sx = x * scale;
+                    uint32_t sy = static_cast<uint32_t>(y) * scale;
+                    pcg2d(sx, sy);
+                    uint32_t seed = sx ^ sy;
+
+                    // jittered AA
+                    float jx = rand(seed);
+                    float jy = rand(seed);
+                    float dx = ((x + jx) / width) * 2.0f - 1.0f;
+                    float dy = ((y + jy) / height) * 2.0f - 1.0f;
+                    Vec3 rayDir = normalize(
+                        camera.front +
+                        camera.right * (dx * aspect * tanFov) +
+                        camera.up * (dy * tanFov)
+                    );
+
+                    Vec3 firstAlbedo;
+                    sampleAccum += tracePath(camera.position, rayDir, coneSpread, seed, rays, firstAlbedo);
+                    albedoAccum += firstAlbedo;
+                }
+
+                sampleAccum /= static_cast<float>(maxSamples);
+                albedoAccum /= static_cast<float>(maxSamples);
+
+                // Squared luminance of the illumination (radiance over albedo), capped like in rgba16f
+                Vec3 illumination(sampleAccum.x / std::max(albedoAccum.x, 1e-3f), sampleAccum.y / std::max(albedoAccum.y, 1e-3f),
+                    sampleAccum.z / std::max(albedoAccum.z, 1e-3f));
+                float illuminationLuminance = dot(illumination, Vec3(0.2126f, 0.7152f, 0.0722f));
+                float luminanceSquare = std::min(illuminationLuminance * illuminationLuminance, 60000.0f);
+
+                // Temporal accumulation (linear)
+                float* accum = &accumulation[(y * width + x) * 4];
+                accum[0] = (accum[0] * frame + sampleAccum.x) / (frame + 1);
+                accum[1] = (accum[1] * frame + sampleAccum.y) / (frame + 1);
+                accum[2] = (accum[2] * frame + sampleAccum.z) / (frame + 1);
+                accum[3] = (accum[3] * frame + luminanceSquare) / (frame + 1);
+            }
+        }
+
+        rayCount += rays;
+    });
+}
+
+Vec3 CpuPathTracer::tracePath(Vec3 origin, Vec3 direction, float coneSpread, uint32_t& seed, uint64_t& rays,
+    Vec3& firstAlbedo) const {
+    const int lightCount = static_cast<int>(emissiveTris.size());
+
+    Vec3 throughput(1.0f);
+    Vec3 radiance(0.0f);
+    HitPayload payload;
+    float coneWidth = 0.0f;
+
+    for (int depth = 0; depth < settings.maxDepth; ++depth) {
+        payload.coneWidth = coneWidth;
+        payload.coneSpread = coneSpread;
+        traceRay(origin, direction, 0.001f, 1e20f, payload);
+        rays++;
+
+        radiance += throughput * payload.emission * 10.0f;
+
+        // What the camera ray hits first, white for the sky
+        if (depth == 0) firstAlbedo = payload.done ? Vec3(1.0f) : payload.albedo;
+        if (payload.done) break;
+        coneWidth += coneSpread * (payload.position - origin).length();
+
+        // shading basis
+        Vec3 N = normalize(payload.normal);
+        Vec3 V = normalize(-direction);
+        Vec3 albedo = payload.albedo;
+        float metallic = payload.metallic;
+        float roughness = payload.roughness;
+
+        // alpha test
+        if (payload.alpha < 0.99f && rand(seed) > payload.alpha) {
+            origin = payload.position + direction * 0.001f;
+            continue;
+        }
+
+        // Dielectric (refraction) handling
+        if (payload.materialType == MAT_DIELECTRIC) {
+            Vec3 I = normalize(direction);
+            Vec3 Nl = N;
+            float eta = payload.ior;
+            float cosi = dot(I, N);
+            float niOverNt = (cosi > 0.0f) ? eta : 1.0f / eta;
+            if (cosi > 0.0f) Nl = -N;
+
+            Vec3 refr = refract(I, Nl, niOverNt);
+            float reflectProb = saturate(schlickFresnel(std::fabs(cosi), 0.04f));
+            if (refr == Vec3(0.0f) || rand(seed) < reflectProb)
+                direction = reflect(I, N);
+            else
+                direction = refr;
+
+            origin = payload.position + direction * 0.001f;
+            continue;
+        }
+
+        // ----------------------- NEXT-EVENT ESTIMATION (NEE) -----------------------
+        if (lightCount > 0) {
+            float u = rand(seed);
+            float v = rand(seed);
+            float pTri = 0.0f;
+            int triIdx = sampleEmissiveAlias(emissiveAlias, u, v, pTri);
+            if (triIdx >= 0 && triIdx < lightCount) {
+                const EmissiveTriGPU& et = emissiveTris[triIdx];
+                Vec3 v0 = emissivePosition(et.v0);
+                Vec3 v1 = emissivePosition(et.v1);
+                Vec3 v2 = emissivePosition(et.v2);
+                Vec3 lightNormal = emissivePosition(et.normal);
+                Vec3 Le = emissivePosition(et.emission);
+                float area = et.area[0];
+
+                // uniform point on the triangle
+                float r1 = rand(seed);
+                float r2 = rand(seed);
+                float sr1 = std::sqrt(r1);
+                float b0 = 1.0f - sr1;
+                float b1 = r2 * sr1;
+                Vec3 pOnLight = v0 * b0 + v1 * b1 + v2 * (1.0f - b0 - b1);
+
+                float pA = pTri / std::max(area, EPS);
+
+                Vec3 surfPos = payload.position;
+                Vec3 toLight = pOnLight - surfPos;
+                float dist2 = std::max(dot(toLight, toLight), EPS);
+                Vec3 L = normalize(toLight);
+                float NdotL = std::max(dot(N, L), 0.0f);
+                float NlDot = std::max(dot(lightNormal, -L), 0.0f);
+
+                if (NdotL > 0.0f && NlDot > 0.0f) {
+                    const float eps = 1e-4f;
+                    Vec3 rayOrigin = surfPos + N * eps;
+                    float fullDist = std::sqrt(dist2);
+                    float tmax = std::max(0.0f, fullDist - eps);
+                    Vec3 targetNudge = pOnLight - lightNormal * eps;
+                    Vec3 shadowDir = normalize(targetNudge - rayOrigin);
+
+                    rays++;
+                    if (visible(rayOrigin, shadowDir, tmax)) {
+                        Vec3 f = evalBRDF(N, V, L, albedo, metallic, roughness);
+
+                        // p_omega for light sampling (areaPdfToSolidAnglePdf)
+                        Vec3 Lx = pOnLight - surfPos;
+                        float d2 = std::max(dot(Lx, Lx), EPS);
+                        float NlPdf = std::max(dot(lightNormal, -normalize(Lx)), EPS);
+                        float pOmegaLight = pA * (d2 / NlPdf);
+
+                        float chooseSpec = std::clamp(metallic + (1.0f - roughness) * 0.5f, 0.0f, 1.0f);
+                        float pdfSpec = pdfGGX(N, V, L, roughness);
+                        float pdfDiff = pdfCosineHemisphere(std::max(dot(N, L), 0.0f));
+                        float pdfBsdf = std::max(chooseSpec * pdfSpec + (1.0f - chooseSpec) * pdfDiff, 1e-6f);
+
+                        // MIS weight (power heuristic beta=2)
+                        float w = (pOmegaLight * pOmegaLight) / (pOmegaLight * pOmegaLight + pdfBsdf * pdfBsdf);
+
+                        float G = (NdotL * NlDot) / dist2;
+                        radiance += throughput * f * Le * ((G / std::max(pA, 1e-12f)) * w);
+                    }
+                }
+            }
+        }
+
+        // ----------------------- BSDF sampling -----------------------
+        float chooseSpec = rand(seed);
+        Vec3 Lsample;
+        float pdf = 1.0f;
+        if (chooseSpec < std::clamp(metallic + (1.0f - roughness) * 0.5f, 0.0f, 1.0f)) {
+            Lsample = sampleGGX(N, V, roughness, seed);
+            pdf = std::max(pdfGGX(N, V, Lsample, roughness), 1e-6f);
+        }
+        else {
+            Lsample = sampleCosineHemisphere(N, seed);
+            pdf = std::max(pdfCosineHemisphere(std::max(dot(N, Lsample), 0.0f)), 1e-6f);
+        }
+
+        float NdotL = std::max(dot(N, Lsample), 0.0f);
+        if (NdotL <= 0.0f) break;
+
+        Vec3 f = evalBRDF(N, V, Lsample, albedo, metallic, roughness);
+
+        direction = normalize(Lsample);
+        origin = payload.position + direction * 0.001f;
+        throughput *= f * (NdotL / pdf);
+
+        // Russian roulette
+        if (depth > 3) {
+            float p = std::clamp(throughput.maxComponent(), 0.05f, 0.95f);
+            if (rand(seed) > p) break;
+            throughput /= p;
+        }
+        if (throughput.maxComponent() < 1e-4f) break;
+    }
+
+    return radiance;
+}
+
+void CpuPathTracer::traceRay(const Vec3& origin, const Vec3& direction, float tMin, float tMax, HitPayload& payload) const {
+    Ray ray{ origin, direction, tMin, tMax };
+    RayHit hit;
+    if (!bvh.intersect(ray, hit)) {
+        // miss.rmiss
+        payload.emission = skyColorSimple(normalize(direction)) * settings.skyIntensity;
+        payload.done = true;
+        return;
+    }
+    closestHit(hit, direction, payload);
+}
+
+void CpuPathTracer::closestHit(const RayHit& hit, const Vec3& direction, HitPayload& payload) const {
+    const Vertex& v0 = scene.vertices[scene.indices[3 * hit.primitive + 0]];
+    const Vertex& v1 = scene.vertices[scene.indices[3 * hit.primitive + 1]];
+    const Vertex& v2 = scene.vertices[scene.indices[3 * hit.primitive + 2]];
+
+    // Attrib interpolation
+    const float b0 = 1.0f - hit.u - hit.v;
+    const float b1 = hit.u;
+    const float b2 = hit.v;
+    Vec3 position = v0.position * b0 + v1.position * b1 + v2.position * b2;
+    Vec3 normal = normalize(v0.normal * b0 + v1.normal * b1 + v2.normal * b2);
+    float texCoord[2] = {
+        v0.texCoord[0] * b0 + v1.texCoord[0] * b1 + v2.texCoord[0] * b2,
+        v0.texCoord[1] * b0 + v1.texCoord[1] * b1 + v2.texCoord[1] * b2
+    };
+    Vec3 tangent = normalize(v0.tangent * b0 + v1.tangent * b1 + v2.tangent * b2);
+
+    // --- Ray cone texture LOD ---
+    const Vec3 e1 = v1.position - v0.position;
+    const Vec3 e2 = v2.position - v0.position;
+    const float uv1[2] = { v1.texCoord[0] - v0.texCoord[0], v1.texCoord[1] - v0.texCoord[1] };
+    const float uv2[2] = { v2.texCoord[0] - v0.texCoord[0], v2.texCoord[1] - v0.texCoord[1] };
+    const Vec3 geoNormal = cross(e1, e2);
+    const float worldArea = std::max(geoNormal.length(), 1e-12f);
+    const float uvArea = std::max(std::fabs(uv1[0] * uv2[1] - uv2[0] * uv1[1]), 1e-12f);
+    const float coneWidth = std::max(payload.coneWidth + payload.coneSpread * hit.t, 1e-8f);
+    const float cosTheta = std::max(std::fabs(dot(geoNormal / worldArea, direction)), 1e-4f);
+    const float lodBase = 0.5f * std::log2(uvArea / worldArea) + std::log2(coneWidth / cosTheta);
+    auto textureLod = [&](const CpuTexture& texture) {
+        return lodBase + 0.5f * std::log2(static_cast<float>(texture.width) * static_cast<float>(texture.height));
+    };
+
+    const Material& material = scene.materials[scene.faceMaterialIndices[hit.primitive]];
+
+    // --- Albedo (UNORM -> must linearize) ---
+    Vec3 albedoColor = material.albedo;
+    float alpha = material.alpha;
+    if (material.diffuseTextureID != -1) {
+        float tex[4];
+        const CpuTexture& texture = textures[material.diffuseTextureID];
+        texture.sample(texCoord[0], texCoord[1], textureLod(texture), tex);
+        albedoColor = Vec3(std::pow(tex[0], 2.2f), std::pow(tex[1], 2.2f), std::pow(tex[2], 2.2f));
+        alpha *= tex[3];
+    }
+
+    // --- Metallic/Roughness ---
+    float metallic = material.metallic;
+    float roughness = material.roughness;
+    if (material.metalRoughTextureID != -1) {
+        float mr[4];
+        const CpuTexture& texture = textures[material.metalRoughTextureID];
+        texture.sample(texCoord[0], texCoord[1], textureLod(texture), mr);
+        roughness *= mr[1];
+        metallic *= mr[2];
+    }
+
+    // --- Normal map ---
+    Vec3 finalNormal = normal;
+    if (material.normalTextureID != -1) {
+        float nmap[4];
+        const CpuTexture& texture = textures[material.normalTextureID];
+        texture.sample(texCoord[0], texCoord[1], textureLod(texture), nmap);
+        Vec3 n(nmap[0] * 2.0f - 1.0f, nmap[1] * 2.0f - 1.0f, nmap[2] * 2.0f - 1.0f);
+        Vec3 T = normalize(tangent - normal * dot(normal, tangent));
+        Vec3 B = cross(normal, T);
+        finalNormal = normalize(T * n.x + B * n.y + normal * n.z);
+    }
+
+    payload.albedo = albedoColor;
+    payload.emission = material.emission;
+    payload.position = position;
+    payload.normal = finalNormal;
+    payload.roughness = std::clamp(roughness, 0.01f, 1.0f);
+    payload.ior = material.ior;
+    payload.metallic = std::clamp(metallic, 0.0f, 1.0f);
+    payload.alpha = std::clamp(alpha, 0.0f, 1.0f);
+    payload.materialType = material.material_type;
+    payload.done = false;
+}
+
+bool CpuPathTracer::visible(const Vec3& origin, const Vec3& direction, float tMax) const {
+    // Shadow rays ignore back-facing blockers, like the ray query in raygen.rgen
+    Ray ray{ origin, direction, 0.0f, tMax };
+    return !bvh.occluded(ray, true);
+}
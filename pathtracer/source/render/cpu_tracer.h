@@ -0,0 +1,88 @@
+#pragma once
+
+#include "render/bvh.h"
+#include "render/camera.h"
+#include "render/lights.h"
+#include "render/render_settings.h"
+#include "render/scene.h"
+#include "core/mipmap.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// RGBA8 image sampled like the GPU textures (trilinear, repeat, same mip chain as the upload)
+struct CpuTexture {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+    MipChain mips;
+
+    bool load(const std::string& path, bool srgb);
+    // Same as textureLod: lod is clamped to the chain, levels are blended linearly
+    void sample(float u, float v, float lod, float out[4]) const;
+
+private:
+    void sampleLevel(uint32_t level, float u, float v, float out[4]) const;
+};
+
+// Reference implementation of raygen.rgen / closesthit.rchit / miss.rmiss on the CPU.
+// The light arrays are the ones uploaded to the GPU and must outlive the tracer; the scene is copied with its
+// instances baked into world space, the CPU BVH being single level.
+class CpuPathTracer {
+public:
+    CpuPathTracer(const SceneData& scene,
+        const std::vector<EmissiveTriGPU>& emissiveTris,
+        const std::vector<EmissiveAliasEntry>& emissiveAlias);
+
+    void resize(uint32_t width, uint32_t height);
+    // Takes effect from the next frame; the running average is not reset
+    void setSettings(const RenderSettings& newSettings) { settings = newSettings; }
+
+    // Same as one dispatch of raygen.rgen: samplesPerFrame spp per pixel blended into the running average
+    void renderFrame(const Camera& camera, int frame);
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    // Linear running average (RGBA32F), the CPU counterpart of accumImage: rgb radiance, a mean squared luminance
+    // of the illumination (raygen.rgen's mean luminance goes to albedoImage, which has no CPU counterpart)
+    const std::vector<float>& getAccumulation() const { return accumulation; }
+    uint64_t getRayCount() const { return rayCount; }
+    const Bvh& getBvh() const { return bvh; }
+
+private:
+    struct HitPayload {
+        Vec3 position;
+        Vec3 normal;
+        Vec3 emission;
+        Vec3 albedo;
+        float roughness = 1.0f;
+        float metallic = 0.0f;
+        float ior = 1.5f;
+        float alpha = 1.0f;
+        int materialType = MAT_LAMBERTIAN;
+        bool done = false;
+        float coneWidth = 0.0f;
+        float coneSpread = 0.0f;
+    };
+
+    // firstAlbedo: albedo of the first hit, white if the camera ray missed (like raygen.rgen's albedo guide)
+    Vec3 tracePath(Vec3 origin, Vec3 direction, float coneSpread, uint32_t& seed, uint64_t& rays, Vec3& firstAlbedo) const;
+    void traceRay(const Vec3& origin, const Vec3& direction, float tMin, float tMax, HitPayload& payload) const;
+    void closestHit(const RayHit& hit, const Vec3& direction, HitPayload& payload) const;
+    bool visible(const Vec3& origin, const Vec3& direction, float tMax) const;
+
+    const SceneData scene;
+    const std::vector<EmissiveTriGPU>& emissiveTris;
+    const std::vector<EmissiveAliasEntry>& emissiveAlias;
+
+    Bvh bvh;
+    std::vector<CpuTexture> textures;
+    RenderSettings settings;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> accumulation;
+    std::atomic<uint64_t> rayCount{ 0 };
+};
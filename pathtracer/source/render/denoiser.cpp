@@ -0,0 +1,261 @@
+#include "denoiser.h"
+#include "core/thread_pool.h"
+
+// Matching the shader's `precise` arithmetic means no fused multiply-adds here either (MSVC doesn't contract
+// under the default /fp:precise)
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t DUMP_MAGIC = 0x4E445450; // "PTDN"
+    constexpr uint32_t DUMP_VERSION = 1;
+
+    // The same literals as denoise.comp. glslang reads them as doubles before rounding to float, so each one has to
+    // land on the same float that way as when parsed directly.
+    constexpr float MIN_VALUE = 1e-10f;         // smaller colors, variances and weights are zero: no denormals
+    constexpr float ALBEDO_EPS = 1e-3f;
+    constexpr float VARIANCE_EPS = 1e-10f;
+    constexpr float DEPTH_EPS = 1e-4f;
+    constexpr float NORMAL_CUTOFF = 0.625f;     // below it dot^128 is under 2^-86 anyway; above it stays normal
+    constexpr float ONE_NINTH = 0.11111111f;
+    constexpr float LUMA_R = 0.2126f;
+    constexpr float LUMA_G = 0.7152f;
+    constexpr float LUMA_B = 0.0722f;
+    constexpr int TEMPORAL_VARIANCE_FRAMES = 4;
+
+    static_assert(static_cast<float>(1e-10) == MIN_VALUE && static_cast<float>(1e-3) == ALBEDO_EPS &&
+        static_cast<float>(1e-4) == DEPTH_EPS && static_cast<float>(0.11111111) == ONE_NINTH &&
+        static_cast<float>(0.2126) == LUMA_R && static_cast<float>(0.7152) == LUMA_G && static_cast<float>(0.0722) == LUMA_B,
+        "a denoiser constant rounds differently through double");
+
+    // B3 spline taps by distance from the center, 3x3 Gaussian by |dx| + |dy|, and 1 / (|dx| + |dy|)^2 for the
+    // depth gradient over a tap's Manhattan distance: all exact in binary but the ninth
+    const float KERNEL[3] = { 0.375f, 0.25f, 0.0625f };
+    const float GAUSSIAN[3] = { 0.25f, 0.125f, 0.0625f };
+    const float DISTANCE_SCALE[5] = { 1.0f, 1.0f, 0.25f, ONE_NINTH, 0.0625f };
+
+    // 1 / x for x in [1e-10, 1e20]: a guess from the bit pattern and four Newton steps, which converge to the same
+    // bits wherever they run. A divide is allowed 2.5 ulp of error on the GPU.
+    float reciprocal(float x) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        bits = 0x7EF311C7u - bits;
+        float r;
+        std::memcpy(&r, &bits, sizeof(r));
+        for (int i = 0; i < 4; i++) {
+            r = r * (2.0f - x * r);
+        }
+        return r;
+    }
+
+    float flushValue(float value) {
+        return value >= MIN_VALUE ? value : 0.0f;
+    }
+
+    float luminance(const float* rgb) {
+        return LUMA_R * rgb[0] + LUMA_G * rgb[1] + LUMA_B * rgb[2];
+    }
+
+    // max(0, dot)^128 by squaring
+    float normalWeight(const float* a, const float* b) {
+        float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        if (d < NORMAL_CUTOFF) return 0.0f;
+        for (int i = 0; i < 7; i++) {
+            d = d * d;
+        }
+        return d;
+    }
+
+    size_t clampedIndex(const DenoiserInputs& inputs, int x, int y) {
+        x = std::clamp(x, 0, static_cast<int>(inputs.width) - 1);
+        y = std::clamp(y, 0, static_cast<int>(inputs.height) - 1);
+        return (static_cast<size_t>(y) * inputs.width + x) * 4;
+    }
+
+    void checkInputs(const DenoiserInputs& inputs) {
+        const size_t size = static_cast<size_t>(inputs.width) * inputs.height * 4;
+        if (size == 0 || inputs.frameCount < 1 || inputs.accum.size() != size || inputs.normalDepth.size() != size ||
+            inputs.albedo.size() != size || (!inputs.reference.empty() && inputs.reference.size() != size)) {
+            throw std::runtime_error("Denoiser inputs are empty or their sizes don't match");
+        }
+    }
+}
+
+std::vector<float> estimateDenoiserVariance(const DenoiserInputs& inputs) {
+    checkInputs(inputs);
+    std::vector<float> out(inputs.accum.size());
+    const float frameWeight = reciprocal(static_cast<float>(inputs.frameCount));
+
+    ThreadPool::global().parallelFor(inputs.height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (uint32_t x = 0; x < inputs.width; x++) {
+                const size_t i = (y * inputs.width + x) * 4;
+                for (int c = 0; c < 3; c++) {
+                    out[i + c] = flushValue(inputs.accum[i + c]) * reciprocal(std::max(inputs.albedo[i + c], ALBEDO_EPS));
+                }
+
+                // A few frames don't make a usable variance, the neighbourhood stands in for them
+                float variance;
+                if (inputs.frameCount >= TEMPORAL_VARIANCE_FRAMES) {
+                    const float mean = flushValue(inputs.albedo[i + 3]);
+                    const float meanSquare = flushValue(inputs.accum[i + 3]);
+                    variance = std::max(meanSquare - mean * mean, 0.0f) * frameWeight;
+                }
+                else {
+                    float sum = 0.0f, sumSquares = 0.0f;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            const size_t j = clampedIndex(inputs, static_cast<int>(x) + dx, static_cast<int>(y) + dy);
+                            sum = sum + flushValue(inputs.albedo[j + 3]);
+                            sumSquares = sumSquares + flushValue(inputs.accum[j + 3]);
+                        }
+                    }
+                    const float mean = sum * ONE_NINTH;
+                    variance = std::max(sumSquares * ONE_NINTH - mean * mean, 0.0f);
+                }
+                out[i + 3] = flushValue(variance);
+            }
+        }
+    });
+    return out;
+}
+
+void filterDenoiserIteration(const DenoiserInputs& inputs, const float* in, float* out, int iteration, bool remodulate,
+    const DenoiserSettings& settings) {
+    const int width = static_cast<int>(inputs.width);
+    const int height = static_cast<int>(inputs.height);
+    const int step = 1 << iteration;
+    const float sigmaLuminance2 = settings.sigmaLuminance * settings.sigmaLuminance;
+    const float* normalDepth = inputs.normalDepth.data();
+
+    ThreadPool::global().parallelFor(inputs.height, 16, [&](size_t begin, size_t end) {
+        for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++) {
+            for (int x = 0; x < width; x++) {
+                const size_t i = (static_cast<size_t>(y) * width + x) * 4;
+                const float illumination[3] = { flushValue(in[i]), flushValue(in[i + 1]), flushValue(in[i + 2]) };
+                const float centerLuminance = luminance(illumination);
+                const float centerDepth = flushValue(normalDepth[i + 3]);
+
+                // Luminance differences are measured against the standard deviation, blurred over 3x3 to steady it
+                float variance = 0.0f;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        variance = variance + GAUSSIAN[std::abs(dx) + std::abs(dy)] * flushValue(in[clampedIndex(inputs, x + dx, y + dy) + 3]);
+                    }
+                }
+                const float luminanceScale = reciprocal(sigmaLuminance2 * variance + VARIANCE_EPS);
+
+                // Depth differences against what the local slope predicts over the tap distance
+                const float gradientX = std::fabs(flushValue(normalDepth[clampedIndex(inputs, x + 1, y) + 3]) -
+                    flushValue(normalDepth[clampedIndex(inputs, x - 1, y) + 3]));
+                const float gradientY = std::fabs(flushValue(normalDepth[clampedIndex(inputs, x, y + 1) + 3]) -
+                    flushValue(normalDepth[clampedIndex(inputs, x, y - 1) + 3]));
+                const float depthSlope = settings.sigmaDepth * (0.5f * std::max(gradientX, gradientY)) * static_cast<float>(step);
+                const float depthScale = reciprocal(depthSlope * depthSlope + DEPTH_EPS);
+
+                float sumWeight = 0.0f, sumVariance = 0.0f;
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                for (int dy = -2; dy <= 2; dy++) {
+                    for (int dx = -2; dx <= 2; dx++) {
+                        const int qx = x + dx * step;
+                        const int qy = y + dy * step;
+                        if (qx < 0 || qy < 0 || qx >= width || qy >= height) continue;
+
+                        const size_t j = (static_cast<size_t>(qy) * width + qx) * 4;
+                        const float tap[3] = { flushValue(in[j]), flushValue(in[j + 1]), flushValue(in[j + 2]) };
+                        float weight = KERNEL[std::abs(dx)] * KERNEL[std::abs(dy)];
+                        if (dx != 0 || dy != 0) {
+                            const float depthDelta = centerDepth - flushValue(normalDepth[j + 3]);
+                            const float luminanceDelta = centerLuminance - luminance(tap);
+                            const float t = depthDelta * depthDelta * depthScale * DISTANCE_SCALE[std::abs(dx) + std::abs(dy)] +
+                                luminanceDelta * luminanceDelta * luminanceScale;
+                            const float falloff = t < 1.0f ? (1.0f - t) * (1.0f - t) : 0.0f;
+                            weight = weight * normalWeight(normalDepth + i, normalDepth + j) * falloff;
+                            if (weight < MIN_VALUE) continue;
+                        }
+
+                        sumWeight = sumWeight + weight;
+                        for (int c = 0; c < 3; c++) {
+                            sum[c] = sum[c] + tap[c] * weight;
+                        }
+                        sumVariance = sumVariance + flushValue(in[j + 3]) * weight * weight;
+                    }
+                }
+
+                // The center tap always counts, so the sum is at least 9/64
+                const float normalization = reciprocal(sumWeight);
+                for (int c = 0; c < 3; c++) {
+                    float value = sum[c] * normalization;
+                    if (remodulate) value = value * std::max(inputs.albedo[i + c], ALBEDO_EPS);
+                    out[i + c] = value;
+                }
+                out[i + 3] = sumVariance * normalization * normalization;
+            }
+        }
+    });
+}
+
+std::vector<float> denoise(const DenoiserInputs& inputs, const DenoiserSettings& settings) {
+    std::vector<float> current = estimateDenoiserVariance(inputs);
+    std::vector<float> next(current.size());
+    const int iterations = std::max(1, settings.iterations);
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        filterDenoiserIteration(inputs, current.data(), next.data(), iteration, iteration == iterations - 1, settings);
+        current.swap(next);
+    }
+    return current;
+}
+
+bool writeDenoiserInputs(const std::string& path, const DenoiserInputs& inputs) {
+    checkInputs(inputs);
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    const uint32_t header[6] = { DUMP_MAGIC, DUMP_VERSION, inputs.width, inputs.height,
+        static_cast<uint32_t>(inputs.frameCount), inputs.reference.empty() ? 0u : 1u };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const std::vector<float>* image : { &inputs.accum, &inputs.normalDepth, &inputs.albedo, &inputs.reference }) {
+        file.write(reinterpret_cast<const char*>(image->data()), image->size() * sizeof(float));
+    }
+    return static_cast<bool>(file);
+}
+
+DenoiserInputs readDenoiserInputs(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open denoiser inputs " + path);
+    }
+
+    uint32_t header[6] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || header[0] != DUMP_MAGIC || header[1] != DUMP_VERSION || header[2] == 0 || header[3] == 0 ||
+        header[2] > 16384 || header[3] > 16384) {
+        throw std::runtime_error(path + " is not a denoiser input dump of this version");
+    }
+
+    DenoiserInputs inputs;
+    inputs.width = header[2];
+    inputs.height = header[3];
+    inputs.frameCount = static_cast<int>(header[4]);
+    const size_t size = static_cast<size_t>(inputs.width) * inputs.height * 4;
+    std::vector<float>* images[4] = { &inputs.accum, &inputs.normalDepth, &inputs.albedo, &inputs.reference };
+    for (int k = 0; k < (header[5] != 0 ? 4 : 3); k++) {
+        images[k]->resize(size);
+        file.read(reinterpret_cast<char*>(images[k]->data()), size * sizeof(float));
+    }
+    if (!file) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    checkInputs(inputs);
+    return inputs;
+}
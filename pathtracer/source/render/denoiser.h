@@ -0,0 +1,43 @@
+#pragma once
+
+#include "render/render_settings.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The denoise.comp passes on the CPU, bit for bit: the shader only uses exactly rounded float operations, and this
+// file performs the same ones in the same order (built without fused multiply-adds).
+//
+// The filter is SVGF's spatial part over the accumulation. Radiance is divided by the first-hit albedo so textures
+// aren't blurred, a variance is estimated per pixel (from the luminance moments after 4 frames, from the 3x3
+// neighbourhood before), then every iteration runs a 5x5 B3-spline kernel with holes, each tap weighted down by
+// normal, depth and luminance differences to the center. The last iteration multiplies the albedo back in.
+
+// Everything the filter reads, as the GPU holds it after `frameCount` accumulated frames: tightly packed RGBA
+// floats, top row first
+struct DenoiserInputs {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int frameCount = 0;
+    std::vector<float> accum;       // rgb radiance, a mean squared luminance of the illumination
+    std::vector<float> normalDepth; // xyz first-hit normal, w linear depth (0 where the camera ray missed)
+    std::vector<float> albedo;      // rgb first-hit albedo, a mean luminance of the illumination
+    std::vector<float> reference;   // optional converged render of the same view (RGBA), to measure quality against
+};
+
+// Demodulation and variance pass: rgb illumination, a variance
+std::vector<float> estimateDenoiserVariance(const DenoiserInputs& inputs);
+
+// One a-trous iteration from `in` to `out` (both RGBA: illumination and variance), taps 2^iteration pixels apart.
+// With `remodulate` the output holds radiance again.
+void filterDenoiserIteration(const DenoiserInputs& inputs, const float* in, float* out, int iteration, bool remodulate,
+    const DenoiserSettings& settings);
+
+// The variance pass and settings.iterations (at least one) filter iterations: rgb denoised radiance, a variance
+std::vector<float> denoise(const DenoiserInputs& inputs, const DenoiserSettings& settings);
+
+// Binary dump of the inputs (and reference, if any) to benchmark the filter on renders without a GPU.
+// Writing returns false on failure, reading throws std::runtime_error.
+bool writeDenoiserInputs(const std::string& path, const DenoiserInputs& inputs);
+DenoiserInputs readDenoiserInputs(const std::string& path);
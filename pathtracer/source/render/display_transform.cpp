@@ -0,0 +1,126 @@
+#include "display_transform.h"
+#include "core/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Row-major 3x3 times a column vector. display.comp builds the same matrices with GLSL's
+    // column-major constructors, so its literals read transposed.
+    Vec3 multiply(const float (&m)[3][3], const Vec3& v) {
+        return Vec3(
+            m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+            m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+            m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // sRGB -> ACES AP1 with the RRT saturation folded in, and back from the ODT
+    const float ACES_INPUT[3][3] = {
+        { 0.59719f, 0.35458f, 0.04823f },
+        { 0.07600f, 0.90834f, 0.01566f },
+        { 0.02840f, 0.13383f, 0.83777f },
+    };
+    const float ACES_OUTPUT[3][3] = {
+        { 1.60475f, -0.53108f, -0.07367f },
+        { -0.10208f, 1.10813f, -0.00605f },
+        { -0.00327f, -0.07276f, 1.07602f },
+    };
+
+    // sRGB -> AgX inset primaries and back
+    const float AGX_INSET[3][3] = {
+        { 0.842479062253094f, 0.0784335999999992f, 0.0792237451477643f },
+        { 0.0423282422610123f, 0.878468636469772f, 0.0791661274605434f },
+        { 0.0423756549057051f, 0.0784336f, 0.879142973793104f },
+    };
+    const float AGX_OUTSET[3][3] = {
+        { 1.19687900512017f, -0.0980208811401368f, -0.0990297440797205f },
+        { -0.0528968517574562f, 1.15190312990417f, -0.0989611768448433f },
+        { -0.0529716355144438f, -0.0980434501171241f, 1.15107367264116f },
+    };
+    const float AGX_MIN_EV = -12.47393f;
+    const float AGX_MAX_EV = 4.026069f;
+
+    float rrtAndOdtFit(float v) {
+        float a = v * (v + 0.0245786f) - 0.000090537f;
+        float b = v * (0.983729f * v + 0.4329510f) + 0.238081f;
+        return a / b;
+    }
+
+    // Sixth order polynomial fit of the AgX base contrast curve over log2 encoded [0, 1]
+    float agxContrast(float x) {
+        float x2 = x * x;
+        float x4 = x2 * x2;
+        return 15.5f * x4 * x2 - 40.14f * x4 * x + 31.96f * x4 - 6.868f * x2 * x + 0.4298f * x2 + 0.1191f * x - 0.00232f;
+    }
+
+    float agxEncode(float v) {
+        float ev = std::min(std::max(std::log2(std::max(v, 1e-10f)), AGX_MIN_EV), AGX_MAX_EV);
+        return agxContrast((ev - AGX_MIN_EV) / (AGX_MAX_EV - AGX_MIN_EV));
+    }
+
+    float saturate(float v) {
+        return std::min(std::max(v, 0.0f), 1.0f);
+    }
+
+    // The pcg hash of common.glsl's pcg()
+    uint32_t pcgHash(uint32_t v) {
+        uint32_t state = v * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+}
+
+Vec3 applyTonemap(const Vec3& color, Tonemap tonemap) {
+    Vec3 c(std::max(color.x, 0.0f), std::max(color.y, 0.0f), std::max(color.z, 0.0f));
+    switch (tonemap) {
+    case Tonemap::Aces:
+        c = multiply(ACES_INPUT, c);
+        c = Vec3(rrtAndOdtFit(c.x), rrtAndOdtFit(c.y), rrtAndOdtFit(c.z));
+        c = multiply(ACES_OUTPUT, c);
+        break;
+    case Tonemap::AgX:
+        c = multiply(AGX_INSET, c);
+        c = Vec3(agxEncode(c.x), agxEncode(c.y), agxEncode(c.z));
+        // Back to linear through the 2.2 display EOTF the curve was fitted for
+        c = multiply(AGX_OUTSET, c);
+        c = Vec3(std::pow(std::max(c.x, 0.0f), 2.2f), std::pow(std::max(c.y, 0.0f), 2.2f), std::pow(std::max(c.z, 0.0f), 2.2f));
+        break;
+    case Tonemap::Clamp:
+        break;
+    }
+    return Vec3(saturate(c.x), saturate(c.y), saturate(c.z));
+}
+
+float linearToSrgb(float value) {
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+float ditherNoise(uint32_t x, uint32_t y) {
+    // Two 16-bit uniforms from one hash; their sum is triangular and exact in float on both sides
+    uint32_t hash = pcgHash(x * 1664525u ^ y * 1013904223u);
+    float u1 = static_cast<float>(hash & 0xFFFFu) * (1.0f / 65536.0f);
+    float u2 = static_cast<float>(hash >> 16) * (1.0f / 65536.0f);
+    return u1 + u2 - 1.0f;
+}
+
+std::vector<uint8_t> applyDisplayTransform(const float* rgba, uint32_t width, uint32_t height, const DisplaySettings& settings) {
+    std::vector<uint8_t> display(static_cast<size_t>(width) * height * 4);
+    const float exposureScale = std::exp2(settings.exposure);
+
+    ThreadPool::global().parallelFor(height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const size_t i = (y * width + x) * 4;
+                Vec3 color = applyTonemap(Vec3(rgba[i], rgba[i + 1], rgba[i + 2]) * exposureScale, settings.tonemap);
+                const float dither = settings.dither ? ditherNoise(x, static_cast<uint32_t>(y)) : 0.0f;
+                const float channels[3] = { color.x, color.y, color.z };
+                for (int c = 0; c < 3; c++) {
+                    float level = std::floor(linearToSrgb(channels[c]) * 255.0f + 0.5f + dither);
+                    display[i + c] = static_cast<uint8_t>(std::min(std::max(level, 0.0f), 255.0f));
+                }
+                display[i + 3] = 255;
+            }
+        }
+    });
+    return display;
+}
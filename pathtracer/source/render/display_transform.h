@@ -0,0 +1,22 @@
+#pragma once
+
+#include "math/vec3.h"
+#include "render/render_settings.h"
+
+#include <cstdint>
+#include <vector>
+
+// The display pass of display.comp on the CPU, operation for operation: exposure, tonemap, sRGB encoding and
+// quantization to 8 bits with optional dithering. Results match the GPU up to the precision of its transcendentals.
+
+// Linear scene radiance to linear display values in [0, 1]
+Vec3 applyTonemap(const Vec3& color, Tonemap tonemap);
+
+// sRGB transfer function (IEC 61966-2-1) of a linear value in [0, 1]
+float linearToSrgb(float value);
+
+// Dither offset in [-1, 1) steps for a pixel, triangularly distributed and fixed per pixel
+float ditherNoise(uint32_t x, uint32_t y);
+
+// Tightly packed linear RGBA floats to RGBA8 with opaque alpha, top row first; rows run on the thread pool
+std::vector<uint8_t> applyDisplayTransform(const float* rgba, uint32_t width, uint32_t height, const DisplaySettings& settings);
@@ -0,0 +1,316 @@
+#include "gltf_accessor.h"
+
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GLTF_ACCESSOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Elements converted per step of a strided accessor, so the temporary stays in cache
+    constexpr size_t CHUNK_ELEMENTS = 1024;
+
+    // Scale (and lower bound) of normalized integers: c / 127 is clamped to -1 for c = -128
+    float normalizedScale(uint32_t componentType) {
+        switch (static_cast<ComponentType>(componentType)) {
+        case ComponentType::Byte: return 1.0f / 127.0f;
+        case ComponentType::UnsignedByte: return 1.0f / 255.0f;
+        case ComponentType::Short: return 1.0f / 32767.0f;
+        case ComponentType::UnsignedShort: return 1.0f / 65535.0f;
+        case ComponentType::UnsignedInt: return 1.0f / 4294967295.0f;
+        default: return 1.0f;
+        }
+    }
+
+    template <typename T>
+    void convertScalar(const uint8_t* src, size_t begin, size_t n, float scale, float lowest, float* dst) {
+        for (size_t i = begin; i < n; i++) {
+            T value;
+            std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+            dst[i] = std::max(static_cast<float>(value) * scale, lowest);
+        }
+    }
+
+    template <typename T>
+    void convertIndicesScalar(const uint8_t* src, size_t begin, size_t count, uint32_t baseVertex, uint32_t* dst) {
+        for (size_t i = begin; i < count; i++) {
+            T value;
+            std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+            dst[i] = baseVertex + value;
+        }
+    }
+
+#ifdef GLTF_ACCESSOR_SSE2
+    // Eight 16-bit lanes to eight floats
+    void storeWordsSse2(__m128i words, bool isSigned, __m128 scale, __m128 lowest, float* dst) {
+        __m128i lo, hi;
+        if (isSigned) {
+            lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+            hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+        } else {
+            lo = _mm_unpacklo_epi16(words, _mm_setzero_si128());
+            hi = _mm_unpackhi_epi16(words, _mm_setzero_si128());
+        }
+        _mm_storeu_ps(dst, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), lowest));
+        _mm_storeu_ps(dst + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), lowest));
+    }
+
+    // 16 bytes per iteration, returns the first component left for the scalar tail
+    size_t convertBytesSse2(const uint8_t* src, size_t n, bool isSigned, float scale, float lowest, float* dst) {
+        const __m128 scaleVec = _mm_set1_ps(scale);
+        const __m128 lowestVec = _mm_set1_ps(lowest);
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i lo, hi;
+            if (isSigned) {
+                lo = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+                hi = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+            } else {
+                lo = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+                hi = _mm_unpackhi_epi8(bytes, _mm_setzero_si128());
+            }
+            storeWordsSse2(lo, isSigned, scaleVec, lowestVec, dst + i);
+            storeWordsSse2(hi, isSigned, scaleVec, lowestVec, dst + i + 8);
+        }
+        return i;
+    }
+
+    size_t convertShortsSse2(const uint8_t* src, size_t n, bool isSigned, float scale, float lowest, float* dst) {
+        const __m128 scaleVec = _mm_set1_ps(scale);
+        const __m128 lowestVec = _mm_set1_ps(lowest);
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+            storeWordsSse2(words, isSigned, scaleVec, lowestVec, dst + i);
+        }
+        return i;
+    }
+
+    size_t convertIndicesSse2(const uint8_t* src, size_t count, uint32_t componentType, uint32_t baseVertex, uint32_t* dst) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i base = _mm_set1_epi32(static_cast<int>(baseVertex));
+        auto store = [&](uint32_t* out, __m128i value) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi32(value, base));
+        };
+
+        size_t i = 0;
+        switch (static_cast<ComponentType>(componentType)) {
+        case ComponentType::UnsignedByte:
+            for (; i + 16 <= count; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+                __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+                store(dst + i, _mm_unpacklo_epi16(lo, zero));
+                store(dst + i + 4, _mm_unpackhi_epi16(lo, zero));
+                store(dst + i + 8, _mm_unpacklo_epi16(hi, zero));
+                store(dst + i + 12, _mm_unpackhi_epi16(hi, zero));
+            }
+            break;
+        case ComponentType::UnsignedShort:
+            for (; i + 8 <= count; i += 8) {
+                __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+                store(dst + i, _mm_unpacklo_epi16(words, zero));
+                store(dst + i + 4, _mm_unpackhi_epi16(words, zero));
+            }
+            break;
+        case ComponentType::UnsignedInt:
+            for (; i + 4 <= count; i += 4) {
+                store(dst + i, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i)));
+            }
+            break;
+        default:
+            break;
+        }
+        return i;
+    }
+#endif
+
+    // Start of `count` elements of `elementSize` bytes, `stride` apart, at byteOffset into a buffer view
+    const uint8_t* viewData(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, int viewIndex, size_t byteOffset,
+        size_t count, size_t stride, size_t elementSize) {
+        if (viewIndex < 0 || viewIndex >= static_cast<int>(model.bufferViews.size())) {
+            throw std::runtime_error("glTF accessor refers to a missing buffer view");
+        }
+        const auto& view = model.bufferViews[viewIndex];
+        if (view.buffer < 0 || view.buffer >= static_cast<int>(buffers.size())) {
+            throw std::runtime_error("glTF buffer view refers to a missing buffer");
+        }
+        const BufferSpan& buffer = buffers[view.buffer];
+
+        size_t end = count ? byteOffset + (count - 1) * stride + elementSize : byteOffset;
+        if (end > view.byteLength || view.byteOffset + view.byteLength > buffer.size) {
+            throw std::runtime_error("glTF accessor reaches outside its buffer");
+        }
+        return buffer.data + view.byteOffset + byteOffset;
+    }
+
+    // Bytes the buffer holds from `data` on, so padding after the last element can be read when it exists
+    size_t bytesAvailable(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, int viewIndex, const uint8_t* data) {
+        const BufferSpan& buffer = buffers[model.bufferViews[viewIndex].buffer];
+        return buffer.size - static_cast<size_t>(data - buffer.data);
+    }
+}
+
+std::vector<BufferSpan> getBufferSpans(const tinygltf::Model& model) {
+    std::vector<BufferSpan> buffers;
+    for (const auto& buffer : model.buffers) {
+        buffers.push_back({ buffer.data.data(), buffer.data.size() });
+    }
+    return buffers;
+}
+
+size_t componentSize(uint32_t componentType) {
+    switch (static_cast<ComponentType>(componentType)) {
+    case ComponentType::Byte:
+    case ComponentType::UnsignedByte: return 1;
+    case ComponentType::Short:
+    case ComponentType::UnsignedShort: return 2;
+    case ComponentType::UnsignedInt:
+    case ComponentType::Float: return 4;
+    default: return 0;
+    }
+}
+
+void convertComponents(const uint8_t* src, size_t n, uint32_t componentType, bool normalized, float* dst) {
+    const ComponentType type = static_cast<ComponentType>(componentType);
+    if (type == ComponentType::Float) {
+        std::memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+
+    const bool isSigned = type == ComponentType::Byte || type == ComponentType::Short;
+    const float scale = normalized ? normalizedScale(componentType) : 1.0f;
+    const float lowest = normalized && isSigned ? -1.0f : -FLT_MAX;
+
+    size_t i = 0;
+    switch (type) {
+    case ComponentType::Byte:
+    case ComponentType::UnsignedByte:
+#ifdef GLTF_ACCESSOR_SSE2
+        i = convertBytesSse2(src, n, isSigned, scale, lowest, dst);
+#endif
+        if (isSigned) convertScalar<int8_t>(src, i, n, scale, lowest, dst);
+        else convertScalar<uint8_t>(src, i, n, scale, lowest, dst);
+        break;
+    case ComponentType::Short:
+    case ComponentType::UnsignedShort:
+#ifdef GLTF_ACCESSOR_SSE2
+        i = convertShortsSse2(src, n, isSigned, scale, lowest, dst);
+#endif
+        if (isSigned) convertScalar<int16_t>(src, i, n, scale, lowest, dst);
+        else convertScalar<uint16_t>(src, i, n, scale, lowest, dst);
+        break;
+    case ComponentType::UnsignedInt:
+        convertScalar<uint32_t>(src, 0, n, scale, lowest, dst);
+        break;
+    default:
+        throw std::runtime_error("Unsupported glTF component type " + std::to_string(componentType));
+    }
+}
+
+void convertIndices(const uint8_t* src, size_t count, uint32_t componentType, uint32_t baseVertex, uint32_t* dst) {
+    size_t i = 0;
+#ifdef GLTF_ACCESSOR_SSE2
+    i = convertIndicesSse2(src, count, componentType, baseVertex, dst);
+#endif
+    switch (static_cast<ComponentType>(componentType)) {
+    case ComponentType::UnsignedByte: convertIndicesScalar<uint8_t>(src, i, count, baseVertex, dst); break;
+    case ComponentType::UnsignedShort: convertIndicesScalar<uint16_t>(src, i, count, baseVertex, dst); break;
+    case ComponentType::UnsignedInt: convertIndicesScalar<uint32_t>(src, i, count, baseVertex, dst); break;
+    default:
+        throw std::runtime_error("Unsupported glTF index component type " + std::to_string(componentType));
+    }
+}
+
+void readIndices(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, const tinygltf::Accessor& accessor, uint32_t baseVertex, uint32_t* dst) {
+    if (accessor.sparse.isSparse) {
+        throw std::runtime_error("Sparse glTF index accessors are not supported");
+    }
+    const size_t size = componentSize(static_cast<uint32_t>(accessor.componentType));
+    if (size == 0 || static_cast<ComponentType>(accessor.componentType) == ComponentType::Float) {
+        throw std::runtime_error("Unsupported glTF index component type " + std::to_string(accessor.componentType));
+    }
+
+    // Index views are always tightly packed
+    const uint8_t* data = viewData(model, buffers, accessor.bufferView, accessor.byteOffset, accessor.count, size, size);
+    convertIndices(data, accessor.count, static_cast<uint32_t>(accessor.componentType), baseVertex, dst);
+}
+
+void readAttribute(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, const tinygltf::Accessor& accessor, uint32_t components, std::vector<float>& dst) {
+    const uint32_t componentType = static_cast<uint32_t>(accessor.componentType);
+    const size_t size = componentSize(componentType);
+    const int sourceComponents = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+    if (size == 0 || sourceComponents <= 0) {
+        throw std::runtime_error("Unsupported glTF accessor type " + std::to_string(accessor.type) +
+            " / component type " + std::to_string(accessor.componentType));
+    }
+
+    const size_t count = accessor.count;
+    const size_t elementSize = size * sourceComponents;
+    const uint32_t copied = std::min(components, static_cast<uint32_t>(sourceComponents));
+    dst.assign(count * components, 0.0f);
+
+    // Without a buffer view the accessor is all zeros (before sparse substitution)
+    if (accessor.bufferView >= 0 && count > 0) {
+        const auto& view = model.bufferViews[accessor.bufferView];
+        const size_t stride = view.byteStride ? view.byteStride : elementSize;
+        const uint8_t* data = viewData(model, buffers, accessor.bufferView, accessor.byteOffset, count, stride, elementSize);
+
+        // A stride of whole components converts as one flat stream of `lanes` components per element,
+        // padding included, when the buffer also covers the padding of the last element
+        const size_t lanes = stride / size;
+        const bool flat = stride % size == 0 && bytesAvailable(model, buffers, accessor.bufferView, data) >= count * stride;
+        if (flat && lanes == components && lanes == static_cast<size_t>(sourceComponents)) {
+            convertComponents(data, count * lanes, componentType, accessor.normalized, dst.data());
+        } else if (flat) {
+            std::vector<float> chunk(CHUNK_ELEMENTS * lanes);
+            for (size_t begin = 0; begin < count; begin += CHUNK_ELEMENTS) {
+                const size_t n = std::min(CHUNK_ELEMENTS, count - begin);
+                convertComponents(data + begin * stride, n * lanes, componentType, accessor.normalized, chunk.data());
+                for (size_t i = 0; i < n; i++) {
+                    std::copy_n(chunk.data() + i * lanes, copied, dst.data() + (begin + i) * components);
+                }
+            }
+        } else {
+            float element[16];
+            for (size_t i = 0; i < count; i++) {
+                convertComponents(data + i * stride, sourceComponents, componentType, accessor.normalized, element);
+                std::copy_n(element, copied, dst.data() + i * components);
+            }
+        }
+    }
+
+    if (accessor.sparse.isSparse && accessor.sparse.count > 0) {
+        const auto& sparse = accessor.sparse;
+        const size_t sparseCount = static_cast<size_t>(sparse.count);
+        const size_t indexSize = componentSize(static_cast<uint32_t>(sparse.indices.componentType));
+        if (indexSize == 0 || static_cast<ComponentType>(sparse.indices.componentType) == ComponentType::Float) {
+            throw std::runtime_error("Unsupported glTF sparse index component type");
+        }
+
+        std::vector<uint32_t> indices(sparseCount);
+        const uint8_t* indexData = viewData(model, buffers, sparse.indices.bufferView, sparse.indices.byteOffset, sparseCount, indexSize, indexSize);
+        convertIndices(indexData, sparseCount, static_cast<uint32_t>(sparse.indices.componentType), 0, indices.data());
+
+        std::vector<float> values(sparseCount * sourceComponents);
+        const uint8_t* valueData = viewData(model, buffers, sparse.values.bufferView, sparse.values.byteOffset, sparseCount, elementSize, elementSize);
+        convertComponents(valueData, values.size(), componentType, accessor.normalized, values.data());
+
+        for (size_t i = 0; i < sparseCount; i++) {
+            if (indices[i] >= count) {
+                throw std::runtime_error("glTF sparse accessor index out of range");
+            }
+            std::copy_n(values.data() + i * sourceComponents, copied, dst.data() + static_cast<size_t>(indices[i]) * components);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tinygltf {
+    class Model;
+    struct Accessor;
+}
+
+// glTF component types (the GL enums used in the JSON)
+enum class ComponentType : uint32_t {
+    Byte = 5120,
+    UnsignedByte = 5121,
+    Short = 5122,
+    UnsignedShort = 5123,
+    UnsignedInt = 5125,
+    Float = 5126,
+};
+
+// The bytes of one glTF buffer, wherever they are kept: a mapped .bin or .glb, or data tinygltf decoded
+struct BufferSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// Spans over the buffers tinygltf loaded into the model itself
+std::vector<BufferSpan> getBufferSpans(const tinygltf::Model& model);
+
+// Bytes of one component, 0 for an unknown type
+size_t componentSize(uint32_t componentType);
+
+// Converts n components to float. Normalized integers map to [0, 1] / [-1, 1] as the glTF spec
+// (and KHR_mesh_quantization) define it, other integers convert by value. Uses SSE2 where available.
+void convertComponents(const uint8_t* src, size_t n, uint32_t componentType, bool normalized, float* dst);
+
+// Converts count tightly packed u8/u16/u32 indices and adds baseVertex. Uses SSE2 where available.
+void convertIndices(const uint8_t* src, size_t count, uint32_t componentType, uint32_t baseVertex, uint32_t* dst);
+
+// Reads an index accessor into dst (accessor.count entries) with baseVertex added.
+// `buffers` holds the bytes of model.buffers, by index.
+void readIndices(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, const tinygltf::Accessor& accessor,
+    uint32_t baseVertex, uint32_t* dst);
+
+// Reads any attribute accessor into `components` floats per element (extra source components are dropped,
+// missing ones are zero): strided and interleaved views, every component type, normalized and sparse accessors.
+// Throws std::runtime_error for accessors that reach outside their buffer.
+void readAttribute(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, const tinygltf::Accessor& accessor,
+    uint32_t components, std::vector<float>& dst);
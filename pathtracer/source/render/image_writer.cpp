@@ -0,0 +1,49 @@
+#include "image_writer.h"
+#include "render/display_transform.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+bool writeHdr(const std::string& path, uint32_t width, uint32_t height, const float* rgba) {
+    return stbi_write_hdr(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba) != 0;
+}
+
+bool writePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba) {
+    return stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba,
+        static_cast<int>(width) * 4) != 0;
+}
+
+bool writePfm(const std::string& path, uint32_t width, uint32_t height, int channels, const float* rgba) {
+    if (channels != 1 && channels != 3) return false;
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    // A negative scale marks little-endian floats, and rows go bottom to top
+    file << (channels == 3 ? "PF" : "Pf") << "\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> row(static_cast<size_t>(width) * channels);
+    for (uint32_t y = height; y-- > 0;) {
+        for (uint32_t x = 0; x < width; x++) {
+            for (int c = 0; c < channels; c++) {
+                row[static_cast<size_t>(x) * channels + c] = rgba[(static_cast<size_t>(y) * width + x) * 4 + c];
+            }
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+    }
+    return static_cast<bool>(file);
+}
+
+bool writeImage(const std::string& path, uint32_t width, uint32_t height, const float* rgba, const DisplaySettings& display) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".hdr") {
+        return writeHdr(path, width, height, rgba);
+    }
+    std::vector<uint8_t> pixels = applyDisplayTransform(rgba, width, height, display);
+    return writePng(path, width, height, pixels.data());
+}
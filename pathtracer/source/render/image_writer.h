@@ -0,0 +1,16 @@
+#pragma once
+
+#include "render/render_settings.h"
+
+#include <cstdint>
+#include <string>
+
+// Thin wrappers around stb_image_write. Pixels are tightly packed RGBA, top row first.
+bool writeHdr(const std::string& path, uint32_t width, uint32_t height, const float* rgba);
+bool writePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+// Portable float map of the first 1 or 3 channels: exact floats, negative values too, and read by most denoisers
+bool writePfm(const std::string& path, uint32_t width, uint32_t height, int channels, const float* rgba);
+
+// Writes linear RGBA as .hdr when the path ends in it, through the display transform as PNG otherwise
+bool writeImage(const std::string& path, uint32_t width, uint32_t height, const float* rgba, const DisplaySettings& display);
@@ -0,0 +1,346 @@
+#include "light_tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    constexpr uint32_t BIN_COUNT = 12;
+    constexpr float PI = 3.14159265358979f;
+
+    float safeSqrt(float x) { return std::sqrt(std::max(x, 0.0f)); }
+    float safeAcos(float x) { return std::acos(std::clamp(x, -1.0f, 1.0f)); }
+    float axisValue(const Vec3& v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+    float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+    }
+    float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+    }
+
+    // Rodrigues rotation of v by `angle` around the unit vector k
+    Vec3 rotate(const Vec3& v, const Vec3& k, float angle) {
+        float c = std::cos(angle), s = std::sin(angle);
+        return v * c + cross(k, v) * s + k * (dot(k, v) * (1.0f - c));
+    }
+
+    // Orientation measure of a cone (the M_Omega term of the SAOH)
+    float orientationMeasure(const LightCone& cone) {
+        float thetaO = safeAcos(cone.cosThetaO);
+        float thetaE = safeAcos(cone.cosThetaE);
+        float thetaW = std::min(thetaO + thetaE, PI);
+        float sinThetaO = safeSqrt(1.0f - cone.cosThetaO * cone.cosThetaO);
+        return 2.0f * PI * (1.0f - cone.cosThetaO) +
+            PI / 2.0f * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cone.cosThetaO);
+    }
+
+    // Conservative estimate of how much a node's lights contribute at p: power over squared distance, scaled by
+    // the smallest angle between the cone and the direction to p, and the best cosine at the surface
+    float importance(const LightTreeNode& node, const Vec3& p, const Vec3& n) {
+        Vec3 center = node.bounds.center();
+        float radius = node.bounds.extent().length() * 0.5f;
+        Vec3 toPoint = p - center;
+        float d2 = std::max(dot(toPoint, toPoint), radius * radius);
+        Vec3 wi = normalize(toPoint);
+
+        // Directions from p covered by the bounds: the whole sphere when p is inside the bounding sphere
+        float cosThetaB = -1.0f;
+        if (dot(toPoint, toPoint) > radius * radius) {
+            cosThetaB = safeSqrt(1.0f - radius * radius / dot(toPoint, toPoint));
+        }
+        float sinThetaB = safeSqrt(1.0f - cosThetaB * cosThetaB);
+
+        const LightCone& cone = node.cone;
+        float cosThetaW = dot(cone.axis, wi);
+        float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+        float sinThetaO = safeSqrt(1.0f - cone.cosThetaO * cone.cosThetaO);
+        float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cone.cosThetaO);
+        float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cone.cosThetaO);
+        float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+        if (cosThetaP <= cone.cosThetaE) return 0.0f;
+
+        float result = node.power * cosThetaP / d2;
+        if (n.lengthSquared() > 0.0f) {
+            // Lights below the surface don't count, only the part of the bounds above it can
+            float cosThetaI = dot(n, -wi);
+            float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+            result *= std::max(cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB), 0.0f);
+        }
+        return std::max(result, 0.0f);
+    }
+
+    uint32_t ceilLog2(uint32_t x) {
+        uint32_t log = 0;
+        while ((1ull << log) < x) log++;
+        return log;
+    }
+
+    struct LightRef {
+        Aabb bounds;
+        LightCone cone;
+        float power = 0.0f;
+        uint32_t index = 0;
+
+        Vec3 centroid() const { return bounds.center(); }
+    };
+
+    struct LightBin {
+        Aabb bounds;
+        LightCone cone;
+        float power = 0.0f;
+        uint32_t count = 0;
+
+        void add(const Aabb& b, const LightCone& c, float p, uint32_t n) {
+            bounds.grow(b);
+            cone = LightCone::merge(cone, c);
+            power += p;
+            count += n;
+        }
+    };
+}
+
+LightCone LightCone::merge(const LightCone& a, const LightCone& b) {
+    if (a.empty) return b;
+    if (b.empty) return a;
+
+    LightCone result;
+    result.empty = false;
+    result.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+
+    // One cone may already contain the other
+    float thetaA = safeAcos(a.cosThetaO);
+    float thetaB = safeAcos(b.cosThetaO);
+    float thetaD = safeAcos(dot(a.axis, b.axis));
+    if (std::min(thetaD + thetaB, PI) <= thetaA) {
+        result.axis = a.axis;
+        result.cosThetaO = a.cosThetaO;
+        return result;
+    }
+    if (std::min(thetaD + thetaA, PI) <= thetaB) {
+        result.axis = b.axis;
+        result.cosThetaO = b.cosThetaO;
+        return result;
+    }
+
+    // Otherwise the smallest cone around both, its axis rotated from a towards b
+    float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+    Vec3 rotationAxis = cross(a.axis, b.axis);
+    if (thetaO >= PI || rotationAxis.lengthSquared() < 1e-12f) {
+        result.axis = a.axis;
+        result.cosThetaO = -1.0f;
+        return result;
+    }
+    result.axis = normalize(rotate(a.axis, normalize(rotationAxis), thetaO - thetaA));
+    result.cosThetaO = std::cos(thetaO);
+    return result;
+}
+
+struct LightTreeBuilder {
+    LightTree& tree;
+    std::vector<LightRef> refs;
+
+    explicit LightTreeBuilder(LightTree& tree) : tree(tree) {}
+
+    // Surface area orientation heuristic over binned centroids; returns the partition point or `end` if none helps
+    uint32_t splitSaoh(uint32_t begin, uint32_t end, const LightTreeNode& node) {
+        Aabb centroidBounds;
+        for (uint32_t i = begin; i < end; i++) centroidBounds.grow(refs[i].centroid());
+        Vec3 extent = node.bounds.extent();
+        float maxExtent = extent.maxComponent();
+
+        float bestCost = 1e30f;
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = axisValue(centroidBounds.min, axis);
+            float width = axisValue(centroidBounds.max, axis) - lo;
+            if (width <= 0.0f) continue;
+            float scale = BIN_COUNT * 0.9999f / width;
+
+            LightBin bins[BIN_COUNT];
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((axisValue(refs[i].centroid(), axis) - lo) * scale));
+                bins[b].add(refs[i].bounds, refs[i].cone, refs[i].power, 1);
+            }
+
+            // Thin boxes along the split axis are penalized, they tend to produce long thin children
+            float regularization = maxExtent / std::max(axisValue(extent, axis), 1e-6f * maxExtent + 1e-20f);
+
+            LightBin right[BIN_COUNT];
+            right[BIN_COUNT - 1] = bins[BIN_COUNT - 1];
+            for (int b = BIN_COUNT - 2; b >= 0; b--) {
+                right[b] = right[b + 1];
+                right[b].add(bins[b].bounds, bins[b].cone, bins[b].power, bins[b].count);
+            }
+
+            LightBin left;
+            for (uint32_t b = 0; b + 1 < BIN_COUNT; b++) {
+                left.add(bins[b].bounds, bins[b].cone, bins[b].power, bins[b].count);
+                const LightBin& r = right[b + 1];
+                if (left.count == 0 || r.count == 0) continue;
+                float cost = regularization * (
+                    left.power * left.bounds.surfaceArea() * orientationMeasure(left.cone) +
+                    r.power * r.bounds.surfaceArea() * orientationMeasure(r.cone));
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+        if (bestAxis < 0) return end;
+
+        float lo = axisValue(centroidBounds.min, bestAxis);
+        float scale = BIN_COUNT * 0.9999f / (axisValue(centroidBounds.max, bestAxis) - lo);
+        auto middle = std::partition(refs.begin() + begin, refs.begin() + end, [&](const LightRef& ref) {
+            uint32_t b = std::min(BIN_COUNT - 1, static_cast<uint32_t>((axisValue(ref.centroid(), bestAxis) - lo) * scale));
+            return b <= bestBin;
+        });
+        return static_cast<uint32_t>(middle - refs.begin());
+    }
+
+    // Median along the longest centroid axis; keeps the depth bounded and handles coincident centroids
+    uint32_t splitMedian(uint32_t begin, uint32_t end) {
+        Aabb centroidBounds;
+        for (uint32_t i = begin; i < end; i++) centroidBounds.grow(refs[i].centroid());
+        Vec3 e = centroidBounds.extent();
+        int axis = (e.x >= e.y && e.x >= e.z) ? 0 : (e.y >= e.z ? 1 : 2);
+
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(refs.begin() + begin, refs.begin() + mid, refs.begin() + end, [&](const LightRef& a, const LightRef& b) {
+            return axisValue(a.centroid(), axis) < axisValue(b.centroid(), axis);
+        });
+        return mid;
+    }
+
+    void buildNode(uint32_t nodeIndex, uint32_t begin, uint32_t end, uint32_t depth, uint64_t path) {
+        LightTreeNode node;
+        node.cone.empty = true;
+        for (uint32_t i = begin; i < end; i++) {
+            node.bounds.grow(refs[i].bounds);
+            node.cone = LightCone::merge(node.cone, refs[i].cone);
+            node.power += refs[i].power;
+        }
+        tree.stats.maxDepth = std::max(tree.stats.maxDepth, depth);
+
+        if (end - begin == 1) {
+            node.leaf = true;
+            node.first = refs[begin].index;
+            tree.nodes[nodeIndex] = node;
+            tree.lightPaths[refs[begin].index] = path;
+            return;
+        }
+
+        // Close to the path bit limit every level has to halve the lights
+        uint32_t mid = end;
+        if (depth + ceilLog2(end - begin) + 8 < LightTree::MAX_DEPTH) {
+            mid = splitSaoh(begin, end, node);
+        }
+        if (mid == begin || mid == end) {
+            mid = splitMedian(begin, end);
+        }
+
+        uint32_t left = static_cast<uint32_t>(tree.nodes.size());
+        tree.nodes.resize(tree.nodes.size() + 2);
+        node.first = left;
+        tree.nodes[nodeIndex] = node;
+
+        buildNode(left, begin, mid, depth + 1, path);
+        buildNode(left + 1, mid, end, depth + 1, path | (1ull << depth));
+    }
+};
+
+void LightTree::build(const std::vector<EmissiveTriGPU>& emissiveTris) {
+    auto start = std::chrono::high_resolution_clock::now();
+    nodes.clear();
+    lightPaths.assign(emissiveTris.size(), 0);
+    stats = LightTreeBuildStats();
+    if (emissiveTris.empty()) return;
+
+    std::vector<double> weights = computeEmissiveWeights(emissiveTris);
+
+    LightTreeBuilder builder(*this);
+    builder.refs.resize(emissiveTris.size());
+    for (size_t i = 0; i < emissiveTris.size(); i++) {
+        const EmissiveTriGPU& et = emissiveTris[i];
+        LightRef& ref = builder.refs[i];
+        ref.bounds.grow(Vec3(et.v0[0], et.v0[1], et.v0[2]));
+        ref.bounds.grow(Vec3(et.v1[0], et.v1[1], et.v1[2]));
+        ref.bounds.grow(Vec3(et.v2[0], et.v2[1], et.v2[2]));
+        // One-sided emitters: normals along the face normal, emitting into its hemisphere
+        ref.cone.axis = Vec3(et.normal[0], et.normal[1], et.normal[2]);
+        ref.cone.cosThetaO = 1.0f;
+        ref.cone.cosThetaE = 0.0f;
+        ref.cone.empty = false;
+        ref.power = static_cast<float>(weights[i]);
+        ref.index = static_cast<uint32_t>(i);
+    }
+
+    nodes.reserve(2 * emissiveTris.size());
+    nodes.resize(1);
+    builder.buildNode(0, 0, static_cast<uint32_t>(emissiveTris.size()), 0, 0);
+
+    stats.nodeCount = static_cast<uint32_t>(nodes.size());
+    stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int LightTree::sample(const Vec3& p, const Vec3& n, float u, float& pdf) const {
+    pdf = 0.0f;
+    if (nodes.empty() || importance(nodes[0], p, n) <= 0.0f) return -1;
+
+    float probability = 1.0f;
+    const LightTreeNode* node = &nodes[0];
+    while (!node->leaf) {
+        const LightTreeNode& left = nodes[node->first];
+        const LightTreeNode& right = nodes[node->first + 1];
+        float importanceLeft = importance(left, p, n);
+        float importanceRight = importance(right, p, n);
+        float total = importanceLeft + importanceRight;
+        if (total <= 0.0f) return -1;
+
+        // Reuse u for the next level by stretching the chosen interval back to [0, 1)
+        float pLeft = importanceLeft / total;
+        if (u < pLeft) {
+            u = std::min(u / pLeft, 0.99999994f);
+            probability *= pLeft;
+            node = &left;
+        }
+        else {
+            u = std::min((u - pLeft) / (1.0f - pLeft), 0.99999994f);
+            probability *= 1.0f - pLeft;
+            node = &right;
+        }
+    }
+
+    pdf = probability;
+    return static_cast<int>(node->first);
+}
+
+float LightTree::pdf(const Vec3& p, const Vec3& n, uint32_t light) const {
+    if (nodes.empty() || light >= lightPaths.size() || importance(nodes[0], p, n) <= 0.0f) return 0.0f;
+
+    float probability = 1.0f;
+    const uint64_t path = lightPaths[light];
+    const LightTreeNode* node = &nodes[0];
+    for (uint32_t depth = 0; !node->leaf; depth++) {
+        const LightTreeNode& left = nodes[node->first];
+        const LightTreeNode& right = nodes[node->first + 1];
+        float importanceLeft = importance(left, p, n);
+        float importanceRight = importance(right, p, n);
+        float total = importanceLeft + importanceRight;
+        if (total <= 0.0f) return 0.0f;
+
+        float pLeft = importanceLeft / total;
+        if ((path >> depth) & 1) {
+            probability *= 1.0f - pLeft;
+            node = &right;
+        }
+        else {
+            probability *= pLeft;
+            node = &left;
+        }
+    }
+    return node->first == light ? probability : 0.0f;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "math/vec3.h"
+#include "render/bvh.h"
+#include "render/lights.h"
+
+#include <cstdint>
+#include <vector>
+
+// Cone bounding the emission directions of a group of lights: every normal is within acos(cosThetaO)
+// of `axis`, and each light emits up to acos(cosThetaE) away from its normal (pi/2 for one-sided triangles)
+struct LightCone {
+    Vec3 axis = Vec3(0.0f, 0.0f, 1.0f);
+    float cosThetaO = 1.0f;
+    float cosThetaE = 0.0f;
+    bool empty = true;
+
+    static LightCone merge(const LightCone& a, const LightCone& b);
+};
+
+// Interior nodes store their left child in `first` (right child is first + 1),
+// leaves hold the single emissive triangle `first`
+struct LightTreeNode {
+    Aabb bounds;
+    LightCone cone;
+    float power = 0.0f;
+    uint32_t first = 0;
+    bool leaf = false;
+};
+
+struct LightTreeBuildStats {
+    double buildMs = 0.0;
+    uint32_t nodeCount = 0;
+    uint32_t maxDepth = 0;
+};
+
+// Many-light sampling tree in the style of Conty & Kulla (bounding boxes + orientation cones + power),
+// split with the surface area orientation heuristic. Sampling walks from the root and picks each child by
+// its estimated contribution to the shading point, so lights that are far away, facing away or below the
+// surface are rarely chosen.
+class LightTree {
+public:
+    // Uses the same per-triangle power as the alias table (computeEmissiveWeights)
+    void build(const std::vector<EmissiveTriGPU>& emissiveTris);
+
+    // Picks an emissive triangle for a point with normal n (a zero normal skips the cosine term),
+    // u in [0, 1). Returns -1 when no light can reach the point; pdf is the selection probability.
+    int sample(const Vec3& p, const Vec3& n, float u, float& pdf) const;
+    // Probability of sample() choosing `light` at this point, for MIS against other strategies
+    float pdf(const Vec3& p, const Vec3& n, uint32_t light) const;
+
+    bool empty() const { return nodes.empty(); }
+    const std::vector<LightTreeNode>& getNodes() const { return nodes; }
+    const LightTreeBuildStats& getBuildStats() const { return stats; }
+
+    // Light paths are stored as one bit per level
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+private:
+    friend struct LightTreeBuilder;
+
+    std::vector<LightTreeNode> nodes;
+    std::vector<uint64_t> lightPaths; // per triangle: bit d set when the path turns right at depth d
+    LightTreeBuildStats stats;
+};
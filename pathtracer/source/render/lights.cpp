@@ -0,0 +1,213 @@
+#include "lights.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+std::vector<EmissiveTriGPU> buildEmissiveTriangles(const SceneData& scene)
+{
+    std::vector<EmissiveTriGPU> emissiveTris;
+    emissiveTris.reserve(256);
+
+    for (const MeshInstance& instance : scene.instances) {
+        const MeshRange& mesh = scene.meshes[instance.mesh];
+        const uint32_t firstPrim = mesh.firstIndex / 3;
+        const uint32_t primitiveCount = mesh.indexCount / 3;
+        for (uint32_t prim = firstPrim; prim < firstPrim + primitiveCount; ++prim) {
+            // face->material index
+            uint32_t matIdx = scene.faceMaterialIndices[prim];
+            if (matIdx >= scene.materials.size()) continue;
+            const Material& mat = scene.materials[matIdx];
+
+            // Compute per-triangle emission. We use material.emission * material.albedo (component-wise)
+            // You can change this to include emissive textures averaging later.
+            Vec3 triEmission = mat.emission * mat.albedo;
+
+            // luminance check
+            float lum = 0.2126f * triEmission.x + 0.7152f * triEmission.y + 0.0722f * triEmission.z;
+            if (lum <= 1e-6f) continue;
+
+            Vec3 p0 = instance.transform.transformPoint(scene.vertices[scene.indices[3 * prim + 0]].position);
+            Vec3 p1 = instance.transform.transformPoint(scene.vertices[scene.indices[3 * prim + 1]].position);
+            Vec3 p2 = instance.transform.transformPoint(scene.vertices[scene.indices[3 * prim + 2]].position);
+
+            // area and normal
+            Vec3 e1 = p1 - p0;
+            Vec3 e2 = p2 - p0;
+            Vec3 n = cross(e1, e2);
+            float area = 0.5f * n.length();
+            if (area <= 1e-9f) continue;
+            n = normalize(n);
+
+            EmissiveTriGPU et{};
+            et.v0[0] = p0.x; et.v0[1] = p0.y; et.v0[2] = p0.z; et.v0[3] = 0.0f;
+            et.v1[0] = p1.x; et.v1[1] = p1.y; et.v1[2] = p1.z; et.v1[3] = 0.0f;
+            et.v2[0] = p2.x; et.v2[1] = p2.y; et.v2[2] = p2.z; et.v2[3] = 0.0f;
+            et.normal[0] = n.x; et.normal[1] = n.y; et.normal[2] = n.z; et.normal[3] = 0.0f;
+            et.emission[0] = triEmission.x; et.emission[1] = triEmission.y; et.emission[2] = triEmission.z; et.emission[3] = 0.0f;
+            et.area[0] = area; et.area[1] = et.area[2] = et.area[3] = 0.0f;
+
+            emissiveTris.push_back(et);
+        }
+    }
+
+    return emissiveTris;
+}
+
+std::vector<double> computeEmissiveWeights(const std::vector<EmissiveTriGPU>& emissiveTris) {
+    std::vector<double> weights(emissiveTris.size());
+    for (size_t i = 0; i < emissiveTris.size(); ++i) {
+        const EmissiveTriGPU& et = emissiveTris[i];
+        float lum = 0.2126f * et.emission[0] + 0.7152f * et.emission[1] + 0.0722f * et.emission[2];
+        weights[i] = double(std::max(1e-6f, lum)) * double(std::max(1e-9f, et.area[0]));
+    }
+    return weights;
+}
+
+std::vector<float> buildEmissiveCdf(const std::vector<EmissiveTriGPU>& emissiveTris) {
+    std::vector<double> weights = computeEmissiveWeights(emissiveTris);
+    std::vector<float> emissiveCdf;
+    emissiveCdf.reserve(weights.size());
+
+    // Accumulated in double, a float sum stops resolving small triangles long before 100k lights
+    double total = 0.0;
+    for (double w : weights) total += w;
+    double accum = 0.0;
+    for (double w : weights) {
+        accum += w;
+        emissiveCdf.push_back(total > 0.0 ? static_cast<float>(accum / total) : 0.0f);
+    }
+    return emissiveCdf;
+}
+
+std::vector<EmissiveAliasEntry> buildEmissiveAliasTable(const std::vector<EmissiveTriGPU>& emissiveTris, ThreadPool& pool) {
+    return buildEmissiveAliasTable(computeEmissiveWeights(emissiveTris), pool);
+}
+
+std::vector<EmissiveAliasEntry> buildEmissiveAliasTable(const std::vector<double>& weights, ThreadPool& pool) {
+    const size_t n = weights.size();
+    std::vector<EmissiveAliasEntry> table(n);
+    if (n == 0) return table;
+
+    // Below this the sweep is faster than waking the workers
+    const size_t PARALLEL_THRESHOLD = 65536;
+    const size_t chunkCount = n < PARALLEL_THRESHOLD ? 1 : std::min<size_t>(pool.size() * 4, n / (PARALLEL_THRESHOLD / 4));
+    const size_t grain = (n + chunkCount - 1) / chunkCount;
+    // Every pass over the buckets uses the same chunks, so per-chunk counts line up between passes
+    auto forChunks = [&](const std::function<void(size_t chunk, size_t begin, size_t end)>& func) {
+        if (chunkCount == 1) {
+            func(0, 0, n);
+            return;
+        }
+        pool.parallelFor(n, grain, [&](size_t begin, size_t end) { func(begin / grain, begin, end); });
+    };
+
+    // Scale the weights so the average bucket holds exactly 1
+    std::vector<double> chunkSums(chunkCount, 0.0);
+    forChunks([&](size_t chunk, size_t begin, size_t end) {
+        double sum = 0.0;
+        for (size_t i = begin; i < end; i++) sum += weights[i];
+        chunkSums[chunk] = sum;
+    });
+    double total = 0.0;
+    for (double sum : chunkSums) total += sum;
+    if (!(total > 0.0)) {
+        throw std::runtime_error("Emissive alias table: weights must sum to a positive value");
+    }
+
+    std::vector<double> scaled(n);
+    const double scale = static_cast<double>(n) / total;
+    forChunks([&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            scaled[i] = weights[i] * scale;
+            table[i].pdf = static_cast<float>(weights[i] / total);
+            table[i].probability = 1.0f;
+            table[i].alias = static_cast<uint32_t>(i);
+            table[i].pad = 0.0f;
+        }
+    });
+
+    // Split into light (< 1) and heavy buckets, keeping index order so the result doesn't depend on the chunking
+    std::vector<size_t> lightCounts(chunkCount, 0);
+    forChunks([&](size_t chunk, size_t begin, size_t end) {
+        size_t count = 0;
+        for (size_t i = begin; i < end; i++) count += scaled[i] < 1.0 ? 1 : 0;
+        lightCounts[chunk] = count;
+    });
+    size_t lightTotal = 0;
+    std::vector<size_t> lightOffsets(chunkCount), heavyOffsets(chunkCount);
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        lightOffsets[chunk] = lightTotal;
+        heavyOffsets[chunk] = std::min(chunk * grain, n) - lightTotal;
+        lightTotal += lightCounts[chunk];
+    }
+    const size_t heavyTotal = n - lightTotal;
+    // Rounding can leave every bucket a hair below or above 1, all of them keep their own triangle then
+    if (lightTotal == 0 || heavyTotal == 0) return table;
+
+    std::vector<uint32_t> light(lightTotal), heavy(heavyTotal);
+    forChunks([&](size_t chunk, size_t begin, size_t end) {
+        size_t l = lightOffsets[chunk], h = heavyOffsets[chunk];
+        for (size_t i = begin; i < end; i++) {
+            if (scaled[i] < 1.0) light[l++] = static_cast<uint32_t>(i);
+            else heavy[h++] = static_cast<uint32_t>(i);
+        }
+    });
+
+    // deficit[i]: mass the light buckets before i take from the heavy ones,
+    // excess[j]: mass heavy buckets 0..j (inclusive) can give away
+    std::vector<double> deficit(lightTotal + 1), excess(heavyTotal);
+    deficit[0] = 0.0;
+    for (size_t i = 0; i < lightTotal; i++) deficit[i + 1] = deficit[i] + (1.0 - scaled[light[i]]);
+    double excessSum = 0.0;
+    for (size_t j = 0; j < heavyTotal; j++) {
+        excessSum += scaled[heavy[j]] - 1.0;
+        excess[j] = excessSum;
+    }
+
+    // Heavy bucket that is filling light bucket i in the sequential sweep: the first one whose excess isn't used up
+    auto heavyFor = [&](size_t i) {
+        size_t j = std::lower_bound(excess.begin(), excess.end(), deficit[i]) - excess.begin();
+        return std::min(j, heavyTotal - 1);
+    };
+
+    // Sweep: light buckets take their deficit from the current heavy one, which turns light itself once
+    // less than 1 is left and is then topped up by the next heavy bucket. Every chunk of light buckets
+    // starts from the state the sequential sweep would be in, so the chunks are independent.
+    const size_t sweepChunks = std::min(chunkCount, lightTotal);
+    auto sweep = [&](size_t chunk) {
+        size_t i = lightTotal * chunk / sweepChunks;
+        const size_t iEnd = lightTotal * (chunk + 1) / sweepChunks;
+        size_t j = heavyFor(i);
+        const size_t jEnd = iEnd == lightTotal ? heavyTotal - 1 : heavyFor(iEnd);
+        double residual = scaled[heavy[j]] - (deficit[i] - (j > 0 ? excess[j - 1] : 0.0));
+
+        while (i < iEnd || j < jEnd) {
+            if (i < iEnd && (residual > 1.0 || j == jEnd)) {
+                EmissiveAliasEntry& entry = table[light[i]];
+                entry.probability = static_cast<float>(scaled[light[i]]);
+                entry.alias = heavy[j];
+                residual -= 1.0 - scaled[light[i]];
+                i++;
+            }
+            else {
+                EmissiveAliasEntry& entry = table[heavy[j]];
+                entry.probability = static_cast<float>(std::clamp(residual, 0.0, 1.0));
+                entry.alias = heavy[j + 1];
+                residual = scaled[heavy[j + 1]] - (1.0 - residual);
+                j++;
+            }
+        }
+    };
+
+    if (sweepChunks == 1) {
+        sweep(0);
+    }
+    else {
+        pool.parallelFor(sweepChunks, 1, [&](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; chunk++) sweep(chunk);
+        });
+    }
+    // The last heavy bucket keeps whatever is left, which is 1 up to rounding
+    return table;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "render/model_loader.h"
+#include "render/scene.h"
+#include "core/thread_pool.h"
+
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+
+// One emissive triangle as read by raygen.rgen (6 x vec4, std430)
+struct EmissiveTriGPU {
+    alignas(16) float v0[4];       // xyz, pad
+    alignas(16) float v1[4];
+    alignas(16) float v2[4];
+    alignas(16) float normal[4];   // xyz, pad
+    alignas(16) float emission[4]; // rgb radiance (linear), pad
+    alignas(16) float area[4];     // area in .x, rest pad
+};
+
+// Collects every triangle whose material emits light, in world space (once per instance)
+std::vector<EmissiveTriGPU> buildEmissiveTriangles(const SceneData& scene);
+
+// One bucket of the emissive alias table as read by raygen.rgen (std430, 16 bytes)
+struct EmissiveAliasEntry {
+    float probability; // chance of keeping the bucket's own triangle, the alias is taken otherwise
+    uint32_t alias;
+    float pdf;         // selection probability of the bucket's own triangle
+    float pad;
+};
+
+// Selection weight of each triangle (area * luminance)
+std::vector<double> computeEmissiveWeights(const std::vector<EmissiveTriGPU>& emissiveTris);
+
+// Normalized CDF over the triangles, the binary search distribution the alias table replaced
+std::vector<float> buildEmissiveCdf(const std::vector<EmissiveTriGPU>& emissiveTris);
+
+// Walker/Vose alias table over the weights: one bucket per triangle, sampled in O(1).
+// Built in double precision with a sweep over light and heavy buckets that is split across the pool
+// (on prefix sums of their deficits and excesses) once there are enough triangles to be worth it.
+std::vector<EmissiveAliasEntry> buildEmissiveAliasTable(const std::vector<double>& weights, ThreadPool& pool = ThreadPool::global());
+std::vector<EmissiveAliasEntry> buildEmissiveAliasTable(const std::vector<EmissiveTriGPU>& emissiveTris, ThreadPool& pool = ThreadPool::global());
+
+// Same as sampleEmissiveTriangle in raygen.rgen: u picks the bucket, v chooses between the bucket's triangle
+// and its alias. Two numbers because a float u has too few bits left over once a million buckets are resolved.
+// Returns -1 when there are no lights.
+inline int sampleEmissiveAlias(const std::vector<EmissiveAliasEntry>& table, float u, float v, float& pdf) {
+    const int lightCount = static_cast<int>(table.size());
+    if (lightCount <= 0) return -1;
+    int bucket = std::min(static_cast<int>(u * static_cast<float>(lightCount)), lightCount - 1);
+    const EmissiveAliasEntry& entry = table[bucket];
+    int tri = (v < entry.probability) ? bucket : static_cast<int>(entry.alias);
+    pdf = table[tri].pdf;
+    return tri;
+}
@@ -0,0 +1,114 @@
+#include "mesh_optimize.h"
+#include "render/bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+namespace {
+    constexpr uint32_t UNUSED = 0xFFFFFFFFu;
+
+    // Spreads the low 10 bits so that three of them interleave into a 30-bit Morton code
+    uint32_t expandBits(uint32_t v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    uint32_t mortonCode(const Vec3& p, const Aabb& bounds) {
+        Vec3 extent = bounds.extent();
+        auto quantize = [](float value, float lo, float size) {
+            float t = size > 0.0f ? (value - lo) / size : 0.0f;
+            return static_cast<uint32_t>(std::clamp(t * 1023.0f, 0.0f, 1023.0f));
+        };
+        return (expandBits(quantize(p.x, bounds.min.x, extent.x)) << 2) |
+            (expandBits(quantize(p.y, bounds.min.y, extent.y)) << 1) |
+            expandBits(quantize(p.z, bounds.min.z, extent.z));
+    }
+
+    double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+MeshRange optimizeMesh(
+    const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& faceMaterialIndices,
+    const MeshRange& range,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices,
+    std::vector<uint32_t>& outFaceMaterialIndices,
+    MeshOptimizeStats* stats)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32_t triangleCount = range.indexCount / 3;
+
+    // Weld: every index is redirected to the first vertex with the same attributes
+    std::vector<Vertex> unique;
+    std::vector<uint32_t> welded(range.vertexCount);
+    {
+        std::unordered_map<Vertex, uint32_t> lookup;
+        lookup.reserve(range.vertexCount);
+        unique.reserve(range.vertexCount);
+        for (uint32_t i = 0; i < range.vertexCount; i++) {
+            const Vertex& vertex = vertices[range.firstVertex + i];
+            auto inserted = lookup.emplace(vertex, static_cast<uint32_t>(unique.size()));
+            if (inserted.second) unique.push_back(vertex);
+            welded[i] = inserted.first->second;
+        }
+    }
+    double weldMs = millisecondsSince(start);
+    start = std::chrono::high_resolution_clock::now();
+
+    // Morton order of the triangle centroids within the mesh bounds
+    Aabb bounds;
+    for (const Vertex& vertex : unique) bounds.grow(vertex.position);
+
+    auto corner = [&](uint32_t triangle, uint32_t k) {
+        return welded[indices[range.firstIndex + 3 * triangle + k] - range.firstVertex];
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> order(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        Vec3 centroid = (unique[corner(t, 0)].position + unique[corner(t, 1)].position + unique[corner(t, 2)].position) * (1.0f / 3.0f);
+        order[t] = { mortonCode(centroid, bounds), t };
+    }
+    std::sort(order.begin(), order.end());
+
+    // Vertices in the order the sorted triangles first use them; unreferenced ones are dropped
+    MeshRange result;
+    result.firstIndex = static_cast<uint32_t>(outIndices.size());
+    result.firstVertex = static_cast<uint32_t>(outVertices.size());
+
+    std::vector<uint32_t> remap(unique.size(), UNUSED);
+    uint32_t nextVertex = 0;
+    outIndices.reserve(outIndices.size() + 3 * triangleCount);
+    outFaceMaterialIndices.reserve(outFaceMaterialIndices.size() + triangleCount);
+    for (const auto& entry : order) {
+        const uint32_t t = entry.second;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = corner(t, k);
+            if (remap[v] == UNUSED) {
+                remap[v] = nextVertex++;
+                outVertices.push_back(unique[v]);
+            }
+            outIndices.push_back(result.firstVertex + remap[v]);
+        }
+        outFaceMaterialIndices.push_back(faceMaterialIndices[range.firstIndex / 3 + t]);
+    }
+
+    result.indexCount = 3 * triangleCount;
+    result.vertexCount = nextVertex;
+
+    if (stats) {
+        stats->verticesIn += range.vertexCount;
+        stats->verticesOut += nextVertex;
+        stats->triangles += triangleCount;
+        stats->weldMs += weldMs;
+        stats->reorderMs += millisecondsSince(start);
+    }
+    return result;
+}
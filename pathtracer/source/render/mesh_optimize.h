@@ -0,0 +1,29 @@
+#pragma once
+
+#include "render/model_loader.h"
+
+#include <cstdint>
+#include <vector>
+
+struct MeshOptimizeStats {
+    uint64_t verticesIn = 0;
+    uint64_t verticesOut = 0;
+    uint64_t triangles = 0;
+    double weldMs = 0.0;
+    double reorderMs = 0.0;
+};
+
+// Appends the mesh `range` of the input arrays to the output arrays, with bit-identical vertices welded into one.
+// Its triangles are sorted along a Morton curve over their centroids and the vertices renumbered in first-use order,
+// so triangles that are close in space (and hit by neighbouring rays) share index and vertex cache lines.
+// Returns the mesh's range in the output arrays; the face materials follow their triangles.
+MeshRange optimizeMesh(
+    const std::vector<Vertex>& vertices,
+    const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& faceMaterialIndices,
+    const MeshRange& range,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices,
+    std::vector<uint32_t>& outFaceMaterialIndices,
+    MeshOptimizeStats* stats = nullptr
+);
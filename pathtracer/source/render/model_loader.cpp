@@ -1,4 +1,10 @@
 #include "model_loader.h"
+#include "core/image_source.h"
+#include "core/mapped_file.h"
+#include "core/thread_pool.h"
+#include "render/gltf_accessor.h"
+#include "render/obj_loader.h"
+#include "render/tangents.h"
 #include "math/vec2.h"
 #include "math/vec3.h"
 #include "math/mat3.h"
@@ -8,6 +14,9 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tiny_gltf.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <fstream>
 #include <stdexcept>
 #include <iostream>
@@ -15,6 +24,7 @@
 #include <filesystem>
 
 namespace fs = std::filesystem;
+using json = nlohmann::json;
 
 // Helper function to get transformation matrix from a GLTF node
 Mat4 getNodeMatrix(const tinygltf::Node& node) {
@@ -55,239 +65,582 @@ Mat4 getNodeMatrix(const tinygltf::Node& node) {
     return  translation * rotation * scale;
 }
 
-// Recursive function to process nodes
-void processNode(
-    const tinygltf::Model& model,
-    const tinygltf::Node& node,
-    const Mat4& parentMatrix,
-    std::vector<Vertex>& vertices,
-    std::vector<uint32_t>& indices,
-    std::vector<Material>& materials,
-    std::vector<uint32_t>& faceMaterialIndices,
-    std::map<int, uint32_t>& gltfMaterialMap,
-    std::unordered_map<std::string, int>& textureIndexMap,
-    std::vector<std::string>& textureFiles,
-    const std::string& modelDir,
-    uint32_t& vertexOffset)
-{
-    // Node transform
-    Mat4 nodeMatrix = getNodeMatrix(node);
-    Mat4 worldMatrix = parentMatrix * nodeMatrix;
-
-    Mat3 inverseTranspose = worldMatrix.toMat3().inverse(); // for normals
-
-    // Process mesh if present
-    if (node.mesh >= 0) {
-        const auto& mesh = model.meshes[node.mesh];
-
-        for (const auto& primitive : mesh.primitives) {
-            if (primitive.mode != TINYGLTF_MODE_TRIANGLES) continue;
-
-            // --- Indices ---
-            std::vector<uint32_t> primitiveIndices;
-            if (primitive.indices >= 0) {
-                const auto& accessor = model.accessors[primitive.indices];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-                const uint8_t* dataStart = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-
-                primitiveIndices.resize(accessor.count);
-                for (size_t i = 0; i < accessor.count; i++) {
-                    if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                        primitiveIndices[i] = reinterpret_cast<const uint16_t*>(dataStart)[i];
-                    }
-                    else if (accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                        primitiveIndices[i] = reinterpret_cast<const uint32_t*>(dataStart)[i];
-                    }
-                }
+namespace {
+    // Vertices assembled per task of a single primitive
+    constexpr size_t VERTEX_GRAIN = 16384;
+
+    // One triangle primitive of a unique mesh and the slots it decodes into
+    struct PrimitiveJob {
+        const tinygltf::Primitive* primitive = nullptr;
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t materialIndex = 0;
+    };
+
+    // Index into `materials` for a primitive's glTF material, converted on first use
+    uint32_t getMaterialIndex(
+        const tinygltf::Model& model,
+        const tinygltf::Primitive& primitive,
+        std::vector<Material>& materials,
+        std::map<int, uint32_t>& gltfMaterialMap,
+        std::unordered_map<std::string, int>& textureIndexMap,
+        std::vector<std::string>& textureFiles,
+        const std::vector<std::string>& imagePaths)
+    {
+        Material baseMaterial = makeDefaultMaterial();
+
+        if (primitive.material < 0) return 0;
+        if (gltfMaterialMap.count(primitive.material)) return gltfMaterialMap[primitive.material];
+
+        const auto& mat = model.materials[primitive.material];
+        const auto& pbr = mat.pbrMetallicRoughness;
+
+        if (pbr.baseColorFactor.size() >= 3)
+            baseMaterial.albedo = { (float)pbr.baseColorFactor[0], (float)pbr.baseColorFactor[1], (float)pbr.baseColorFactor[2] };
+        if (pbr.baseColorFactor.size() == 4) baseMaterial.alpha = (float)pbr.baseColorFactor[3];
+
+        if (mat.emissiveFactor.size() == 3)
+            baseMaterial.emission = { (float)mat.emissiveFactor[0], (float)mat.emissiveFactor[1], (float)mat.emissiveFactor[2] };
+
+        // Textures
+        auto processTexture = [&](int textureIndex, int& texID) {
+            if (textureIndex < 0) return;
+            const auto& tex = model.textures[textureIndex];
+            if (tex.source < 0 || tex.source >= static_cast<int>(imagePaths.size())) return;
+            const std::string& path = imagePaths[tex.source];
+            if (path.empty()) return;
+            if (!textureIndexMap.count(path)) {
+                textureIndexMap[path] = (int)textureFiles.size();
+                textureFiles.push_back(path);
             }
+            texID = textureIndexMap[path];
+        };
 
-            // --- Attributes ---
-            auto readAttribute = [&](const std::string& name, std::vector<Vec3>& out) {
-                if (!primitive.attributes.count(name)) return;
-                const auto& accessor = model.accessors.at(primitive.attributes.at(name));
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-                const uint8_t* dataStart = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-                size_t stride = bufferView.byteStride ? bufferView.byteStride : sizeof(float) * 3;
-                out.resize(accessor.count);
-                for (size_t i = 0; i < accessor.count; i++) {
-                    const float* src = reinterpret_cast<const float*>(dataStart + i * stride);
-                    out[i] = Vec3(src[0], src[1], src[2]);
-                }
-            };
-
-            std::vector<Vec3> positions, normals, tangents;
-            readAttribute("POSITION", positions);
-            readAttribute("NORMAL", normals);
-            readAttribute("TANGENT", tangents);
-
-            // --- Texcoords (Vec2) ---
-            std::vector<Vec2> texcoords;
-            if (primitive.attributes.count("TEXCOORD_0")) {
-                const auto& accessor = model.accessors.at(primitive.attributes.at("TEXCOORD_0"));
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-                const uint8_t* dataStart = buffer.data.data() + bufferView.byteOffset + accessor.byteOffset;
-                size_t stride = bufferView.byteStride ? bufferView.byteStride : sizeof(float) * 2;
-                texcoords.resize(accessor.count);
-                for (size_t i = 0; i < accessor.count; i++) {
-                    const float* src = reinterpret_cast<const float*>(dataStart + i * stride);
-                    texcoords[i] = Vec2(src[0], src[1]);
+        processTexture(pbr.baseColorTexture.index, baseMaterial.diffuseTextureID);
+        processTexture(pbr.metallicRoughnessTexture.index, baseMaterial.metalRoughTextureID);
+        processTexture(mat.normalTexture.index, baseMaterial.normalTextureID);
+
+        if (mat.extensions.count("KHR_materials_ior")) {
+            const auto& ext = mat.extensions.at("KHR_materials_ior");
+            if (ext.Has("ior")) baseMaterial.ior = (float)ext.Get("ior").Get<double>();
+        }
+
+        uint32_t materialIndex = (uint32_t)materials.size();
+        materials.push_back(baseMaterial);
+        gltfMaterialMap[primitive.material] = materialIndex;
+        return materialIndex;
+    }
+
+    size_t accessorCount(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const std::string& attribute) {
+        auto it = primitive.attributes.find(attribute);
+        return it == primitive.attributes.end() ? 0 : model.accessors.at(it->second).count;
+    }
+
+    // First phase, on one thread: world matrices and instances, the materials in first-use order, and the
+    // output slots of every primitive of every unique mesh (a running prefix sum of vertex and index counts)
+    void processNode(
+        const tinygltf::Model& model,
+        const tinygltf::Node& node,
+        const Mat4& parentMatrix,
+        std::vector<PrimitiveJob>& jobs,
+        std::vector<Material>& materials,
+        std::map<int, uint32_t>& gltfMaterialMap,
+        std::unordered_map<std::string, int>& textureIndexMap,
+        std::vector<std::string>& textureFiles,
+        std::vector<MeshRange>& meshes,
+        std::vector<MeshInstance>& instances,
+        std::map<int, uint32_t>& gltfMeshMap,
+        const std::vector<std::string>& imagePaths,
+        uint32_t& vertexOffset,
+        uint32_t& indexOffset)
+    {
+        // Node transform
+        Mat4 nodeMatrix = getNodeMatrix(node);
+        Mat4 worldMatrix = parentMatrix * nodeMatrix;
+
+        // Plan the mesh once per glTF mesh; every node using it only adds an instance
+        if (node.mesh >= 0 && !gltfMeshMap.count(node.mesh)) {
+            const auto& mesh = model.meshes[node.mesh];
+
+            MeshRange range;
+            range.firstIndex = indexOffset;
+            range.firstVertex = vertexOffset;
+
+            for (const auto& primitive : mesh.primitives) {
+                if (primitive.mode != TINYGLTF_MODE_TRIANGLES) continue;
+
+                PrimitiveJob job;
+                job.primitive = &primitive;
+                job.firstVertex = vertexOffset;
+                job.vertexCount = static_cast<uint32_t>(accessorCount(model, primitive, "POSITION"));
+                job.firstIndex = indexOffset;
+                job.indexCount = primitive.indices >= 0 ? static_cast<uint32_t>(model.accessors[primitive.indices].count) : 0;
+                if (job.indexCount % 3 != 0) {
+                    throw std::runtime_error("glTF triangle primitive with an index count that is not a multiple of 3");
                 }
+                job.materialIndex = getMaterialIndex(model, primitive, materials, gltfMaterialMap, textureIndexMap, textureFiles, imagePaths);
+                jobs.push_back(job);
+
+                vertexOffset += job.vertexCount;
+                indexOffset += job.indexCount;
             }
 
-            // --- Create vertices ---
-            for (size_t i = 0; i < positions.size(); ++i) {
+            range.indexCount = indexOffset - range.firstIndex;
+            range.vertexCount = vertexOffset - range.firstVertex;
+            gltfMeshMap[node.mesh] = static_cast<uint32_t>(meshes.size());
+            meshes.push_back(range);
+        }
+
+        if (node.mesh >= 0 && meshes[gltfMeshMap[node.mesh]].indexCount > 0) {
+            MeshInstance instance;
+            instance.transform = worldMatrix;
+            instance.mesh = gltfMeshMap[node.mesh];
+            instances.push_back(instance);
+        }
+
+        // Recurse children
+        for (int child : node.children)
+            processNode(model, model.nodes[child], worldMatrix, jobs, materials, gltfMaterialMap,
+                textureIndexMap, textureFiles, meshes, instances, gltfMeshMap, imagePaths, vertexOffset, indexOffset);
+    }
+
+    // Second phase, concurrently: decodes one primitive into its preallocated slots
+    void decodePrimitive(const tinygltf::Model& model, const std::vector<BufferSpan>& buffers, const PrimitiveJob& job,
+        Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial)
+    {
+        const auto& primitive = *job.primitive;
+
+        // --- Indices (absolute, the vertex offset is applied while converting) ---
+        if (primitive.indices >= 0) {
+            readIndices(model, buffers, model.accessors[primitive.indices], baseVertex + job.firstVertex, indices + job.firstIndex);
+        }
+
+        // --- Attributes (any component type, normalized or quantized, sparse) ---
+        auto readVectors = [&](const std::string& name, uint32_t components, std::vector<float>& out) {
+            auto it = primitive.attributes.find(name);
+            if (it == primitive.attributes.end()) return false;
+            const auto& accessor = model.accessors.at(it->second);
+            readAttribute(model, buffers, accessor, components, out);
+            if (out.size() < static_cast<size_t>(job.vertexCount) * components) {
+                throw std::runtime_error("glTF attribute " + name + " has fewer elements than POSITION");
+            }
+            return accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT;
+        };
+
+        std::vector<float> positions, normals, tangents, texcoords;
+        readVectors("POSITION", 3, positions);
+        // Quantized directions (KHR_mesh_quantization) are only unit length up to rounding
+        bool renormalize = readVectors("NORMAL", 3, normals);
+        renormalize |= readVectors("TANGENT", 3, tangents);
+        readVectors("TEXCOORD_0", 2, texcoords);
+
+        // --- Create vertices (object space, the instances carry the transform) ---
+        // Large primitives split their vertices over the pool too; nested parallelFor helps instead of blocking
+        ThreadPool::global().parallelFor(job.vertexCount, VERTEX_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
                 Vertex v{};
-                Vec3 p = positions[i];
-                Vec3 n = normals.empty() ? Vec3{ 0,1,0 } : normals[i];
-                Vec3 t = tangents.empty() ? Vec3{ 1,0,0 } : tangents[i];
-                Vec2 uv = texcoords.empty() ? Vec2{ 0,0 } : texcoords[i];
-
-                // Apply world transform
-                Vec3 worldPos = worldMatrix.transformPoint(p);
-                Vec3 worldNormal = inverseTranspose * n;
-                Vec3 worldTangent = worldMatrix.toMat3() * t;
-
-                v.position = worldPos;
-                v.normal = worldNormal;
-                v.tangent = worldTangent;
-                v.texCoord[0] = uv.x;
-                v.texCoord[1] = uv.y;
-
-                vertices.push_back(v);
+                v.position = Vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+                v.normal = normals.empty() ? Vec3{ 0,1,0 } : Vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+                v.tangent = tangents.empty() ? Vec3{ 1,0,0 } : Vec3(tangents[3 * i], tangents[3 * i + 1], tangents[3 * i + 2]);
+                v.texCoord[0] = texcoords.empty() ? 0.0f : texcoords[2 * i];
+                v.texCoord[1] = texcoords.empty() ? 0.0f : texcoords[2 * i + 1];
+                if (renormalize) {
+                    v.normal = normalize(v.normal);
+                    v.tangent = normalize(v.tangent);
+                }
+
+                vertices[job.firstVertex + i] = v;
             }
+        });
 
-            // --- Indices with vertexOffset ---
-            for (uint32_t idx : primitiveIndices)
-                indices.push_back(vertexOffset + idx);
-
-            // --- Material processing ---
-            Material baseMaterial{};
-            baseMaterial.albedo = { 0.8f, 0.8f, 0.8f };
-            baseMaterial.emission = { 0.0f, 0.0f, 0.0f };
-            baseMaterial.diffuseTextureID = -1;
-            baseMaterial.metalRoughTextureID = -1;
-            baseMaterial.normalTextureID = -1;
-            baseMaterial.roughness = 1.0f;
-            baseMaterial.metallic = 0.0f;
-            baseMaterial.ior = 1.5f;
-            baseMaterial.alpha = 1.0f;
-            baseMaterial.material_type = 0; // MAT_LAMBERTIAN
-
-            uint32_t materialIndex = 0;
-            if (primitive.material >= 0) {
-                if (gltfMaterialMap.count(primitive.material)) {
-                    materialIndex = gltfMaterialMap[primitive.material];
-                }
-                else {
-                    const auto& mat = model.materials[primitive.material];
-                    const auto& pbr = mat.pbrMetallicRoughness;
-
-                    if (pbr.baseColorFactor.size() >= 3)
-                        baseMaterial.albedo = { (float)pbr.baseColorFactor[0], (float)pbr.baseColorFactor[1], (float)pbr.baseColorFactor[2] };
-                    if (pbr.baseColorFactor.size() == 4) baseMaterial.alpha = (float)pbr.baseColorFactor[3];
-
-                    if (mat.emissiveFactor.size() == 3)
-                        baseMaterial.emission = { (float)mat.emissiveFactor[0], (float)mat.emissiveFactor[1], (float)mat.emissiveFactor[2] };
-
-                    // Textures
-                    auto processTexture = [&](const tinygltf::TextureInfo& texInfo, int& texID) {
-                        if (texInfo.index < 0) return;
-                        const auto& tex = model.textures[texInfo.index];
-                        const auto& img = model.images[tex.source];
-                        std::string path = (std::filesystem::path(modelDir) / img.uri).string();
-                        if (!textureIndexMap.count(path)) {
-                            textureIndexMap[path] = (int)textureFiles.size();
-                            textureFiles.push_back(path);
-                        }
-                        texID = textureIndexMap[path];
-                    };
-
-                    // overload for NormalTextureInfo
-                    auto processNormalTexture = [&](const tinygltf::NormalTextureInfo& texInfo, int& texID) {
-                        if (texInfo.index < 0) return;
-                        const auto& tex = model.textures[texInfo.index];
-                        const auto& img = model.images[tex.source];
-                        std::string path = (std::filesystem::path(modelDir) / img.uri).string();
-                        if (!textureIndexMap.count(path)) {
-                            textureIndexMap[path] = (int)textureFiles.size();
-                            textureFiles.push_back(path);
-                        }
-                        texID = textureIndexMap[path];
-                        };
+        // --- Tangents, generated when the primitive has none (each primitive on its own task) ---
+        if (tangents.empty()) {
+            generateTangents(vertices + job.firstVertex, job.vertexCount, indices + job.firstIndex, job.indexCount,
+                baseVertex + job.firstVertex);
+        }
 
-                    processTexture(pbr.baseColorTexture, baseMaterial.diffuseTextureID);
-                    processTexture(pbr.metallicRoughnessTexture, baseMaterial.metalRoughTextureID);
-                    processNormalTexture(mat.normalTexture, baseMaterial.normalTextureID);
+        // --- Face material indices ---
+        std::fill_n(faceMaterialIndices + job.firstIndex / 3, job.indexCount / 3, baseMaterial + job.materialIndex);
+    }
 
-                    if (mat.extensions.count("KHR_materials_ior")) {
-                        const auto& ext = mat.extensions.at("KHR_materials_ior");
-                        if (ext.Has("ior")) baseMaterial.ior = (float)ext.Get("ior").Get<double>();
-                    }
+    // .glb container: 12-byte header, then a JSON chunk and an optional binary chunk (each 8-byte chunk header + data)
+    constexpr uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+    constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+    constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+    // A buffer tinygltf parses in place of each one we map: one byte, decoded without touching the file system
+    const char* STUB_BUFFER_URI = "data:application/octet-stream;base64,AA==";
+
+    // Where the JSON text and the binary chunk of a mapped .gltf or .glb are
+    struct GltfContainer {
+        const char* json = nullptr;
+        size_t jsonSize = 0;
+        const uint8_t* bin = nullptr;
+        size_t binSize = 0;
+        size_t binOffset = 0; // in the file
+    };
+
+    GltfContainer splitContainer(const MappedFile& file, const std::string& path) {
+        GltfContainer container;
+        auto readU32 = [&](size_t offset) {
+            uint32_t value;
+            std::memcpy(&value, file.data() + offset, sizeof(value));
+            return value;
+        };
+
+        if (file.size() < 12 || readU32(0) != GLB_MAGIC) {
+            container.json = reinterpret_cast<const char*>(file.data());
+            container.jsonSize = file.size();
+            return container;
+        }
 
-                    materialIndex = (uint32_t)materials.size();
-                    materials.push_back(baseMaterial);
-                    gltfMaterialMap[primitive.material] = materialIndex;
-                }
+        if (readU32(4) != 2 || readU32(8) > file.size()) {
+            throw std::runtime_error("Unsupported or truncated GLB file " + path);
+        }
+        const size_t fileSize = readU32(8);
+        size_t offset = 12;
+        while (offset + 8 <= fileSize) {
+            const size_t chunkSize = readU32(offset);
+            const uint32_t chunkType = readU32(offset + 4);
+            const size_t dataOffset = offset + 8;
+            if (chunkSize > fileSize - dataOffset) {
+                throw std::runtime_error("GLB chunk reaches past the end of " + path);
+            }
+            if (chunkType == GLB_CHUNK_JSON && !container.json) {
+                container.json = reinterpret_cast<const char*>(file.data() + dataOffset);
+                container.jsonSize = chunkSize;
+            } else if (chunkType == GLB_CHUNK_BIN && !container.bin) {
+                container.bin = file.data() + dataOffset;
+                container.binSize = chunkSize;
+                container.binOffset = dataOffset;
+            }
+            offset = dataOffset + ((chunkSize + 3) & ~size_t(3));
+        }
+        if (!container.json) {
+            throw std::runtime_error("GLB file without a JSON chunk: " + path);
+        }
+        return container;
+    }
+
+    // Relative URIs may be percent-encoded ("my%20model.bin")
+    std::string decodeUri(const std::string& uri) {
+        std::string decoded;
+        decoded.reserve(uri.size());
+        for (size_t i = 0; i < uri.size(); i++) {
+            if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) &&
+                std::isxdigit(static_cast<unsigned char>(uri[i + 2]))) {
+                decoded += static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                decoded += uri[i];
             }
+        }
+        return decoded;
+    }
 
-            // --- Face material indices ---
-            size_t triCount = primitiveIndices.size() / 3;
-            for (size_t t = 0; t < triCount; t++) faceMaterialIndices.push_back(materialIndex);
+    bool isDataUri(const std::string& uri) {
+        return uri.compare(0, 5, "data:") == 0;
+    }
 
-            vertexOffset += (uint32_t)positions.size();
+    // Byte range of one top-level member's value in the JSON text
+    struct JsonRange {
+        size_t begin = 0;
+        size_t end = 0;
+        bool found() const { return end > begin; }
+    };
+
+    // Finds the values of the top-level members named in `keys` with a scan that only skips over the rest,
+    // so the sections the loader rewrites can be parsed on their own and spliced back into the text
+    std::vector<JsonRange> findTopLevelMembers(const char* text, size_t size, const std::vector<std::string>& keys) {
+        std::vector<JsonRange> ranges(keys.size());
+        size_t i = 0;
+        auto skipSpace = [&] { while (i < size && std::isspace(static_cast<unsigned char>(text[i]))) i++; };
+        auto skipString = [&] {
+            for (i++; i < size && text[i] != '"'; i++) {
+                if (text[i] == '\\') i++;
+            }
+            i++;
+        };
+        auto skipValue = [&] {
+            if (i < size && text[i] == '"') {
+                skipString();
+                return;
+            }
+            int depth = 0;
+            while (i < size) {
+                const char c = text[i];
+                if (c == '"') {
+                    skipString();
+                    continue;
+                }
+                if (c == '{' || c == '[') depth++;
+                else if (c == '}' || c == ']') {
+                    if (depth == 0) return;
+                    if (--depth == 0) {
+                        i++;
+                        return;
+                    }
+                }
+                else if (depth == 0 && (c == ',' || std::isspace(static_cast<unsigned char>(c)))) return;
+                i++;
+            }
+        };
+
+        skipSpace();
+        if (i >= size || text[i] != '{') return ranges;
+        i++;
+        while (i < size) {
+            skipSpace();
+            if (i >= size || text[i] != '"') break;
+            const size_t keyBegin = i + 1;
+            skipString();
+            const std::string key(text + keyBegin, i - 1 - keyBegin);
+            skipSpace();
+            if (i >= size || text[i] != ':') break;
+            i++;
+            skipSpace();
+            const size_t valueBegin = i;
+            skipValue();
+            for (size_t k = 0; k < keys.size(); k++) {
+                if (key == keys[k]) ranges[k] = { valueBegin, std::min(i, size) };
+            }
+            skipSpace();
+            if (i >= size || text[i] != ',') break;
+            i++;
         }
+        return ranges;
     }
 
-    // Recurse children
-    for (int child : node.children)
-        processNode(model, model.nodes[child], worldMatrix,
-            vertices, indices, materials, faceMaterialIndices, gltfMaterialMap,
-            textureIndexMap, textureFiles, modelDir, vertexOffset);
+    json parseRange(const char* text, const JsonRange& range) {
+        return json::parse(text + range.begin, text + range.end);
+    }
 }
 
+struct GltfFile::Source {
+    tinygltf::Model model;
+    std::vector<PrimitiveJob> jobs;
+    std::vector<MappedFile> files;      // the model file and its external buffers, mapped for as long as decode() needs them
+    std::vector<BufferSpan> buffers;    // bytes of model.buffers[i]: in a mapping, or tinygltf's copy for data URIs
+    std::vector<std::string> imagePaths; // texture path of every glTF image, empty when it can't be loaded from a file
+};
+
+// tinygltf would read every buffer into a vector and read and decode every image. Instead the JSON is rewritten
+// before it gets it: buffers in files (.bin, or the .glb binary chunk) are replaced by a one-byte stub and mapped,
+// and the images are taken out and turned into texture paths (those in buffer views point into the mapped file).
+GltfFile::GltfFile(const std::string& modelPath) : source(std::make_unique<Source>()) {
+    tinygltf::Model& model = source->model;
+
+    // Extract the directory from the model path
+    std::filesystem::path modelFilePath(modelPath);
+    std::string modelDir = modelFilePath.parent_path().string();
+    auto resolve = [&](const std::string& uri) { return (modelFilePath.parent_path() / decodeUri(uri)).string(); };
 
+    MappedFile file;
+    if (!file.open(modelPath)) {
+        throw std::runtime_error("Failed to open glTF file " + modelPath);
+    }
+    const GltfContainer container = splitContainer(file, modelPath);
+    source->files.push_back(std::move(file));
+
+    // Only the sections that get rewritten are parsed here, tinygltf parses the document once
+    enum { BUFFERS, IMAGES, BUFFER_VIEWS };
+    const std::vector<JsonRange> ranges = findTopLevelMembers(container.json, container.jsonSize, { "buffers", "images", "bufferViews" });
+    std::vector<std::pair<JsonRange, std::string>> replacements;
+
+    // Buffers: where each one's bytes are, and the file and offset they start at (for images in buffer views)
+    struct BufferFile {
+        std::string path;
+        size_t offset = 0;
+    };
+    std::vector<BufferFile> bufferFiles;
+
+    try {
+        if (ranges[BUFFERS].found()) {
+            json buffers = parseRange(container.json, ranges[BUFFERS]);
+            if (!buffers.is_array()) throw std::runtime_error("glTF buffers are not an array in " + modelPath);
+            source->buffers.resize(buffers.size());
+            bufferFiles.resize(buffers.size());
+
+            for (size_t i = 0; i < buffers.size(); i++) {
+                json& buffer = buffers[i];
+                if (!buffer.is_object() || !buffer.contains("byteLength") || !buffer["byteLength"].is_number_unsigned()) {
+                    throw std::runtime_error("glTF buffer " + std::to_string(i) + " without a byteLength in " + modelPath);
+                }
+                const size_t byteLength = buffer["byteLength"].get<size_t>();
+                const std::string uri = buffer.contains("uri") && buffer["uri"].is_string() ? buffer["uri"].get<std::string>() : "";
+
+                if (uri.empty()) {
+                    // Only the first buffer of a .glb may leave out its URI, it is the binary chunk
+                    if (i != 0 || !container.bin || byteLength > container.binSize) {
+                        throw std::runtime_error("glTF buffer " + std::to_string(i) + " has no data in " + modelPath);
+                    }
+                    source->buffers[i] = { container.bin, byteLength };
+                    bufferFiles[i] = { modelPath, container.binOffset };
+                } else if (isDataUri(uri)) {
+                    continue; // decoded by tinygltf
+                } else {
+                    MappedFile bufferFile;
+                    const std::string path = resolve(uri);
+                    if (!bufferFile.open(path) || bufferFile.size() < byteLength) {
+                        throw std::runtime_error("Failed to map glTF buffer " + path);
+                    }
+                    source->buffers[i] = { bufferFile.data(), byteLength };
+                    bufferFiles[i] = { path, 0 };
+                    source->files.push_back(std::move(bufferFile));
+                }
+
+                buffer["uri"] = STUB_BUFFER_URI;
+                buffer["byteLength"] = 1;
+            }
+            replacements.emplace_back(ranges[BUFFERS], buffers.dump());
+        }
+
+        // Images: a file next to the model, or an encoded image in a buffer view
+        if (ranges[IMAGES].found()) {
+            const json images = parseRange(container.json, ranges[IMAGES]);
+            json views;
+            if (images.is_array()) {
+                for (const json& image : images) {
+                    std::string path;
+                    if (image.contains("uri") && image["uri"].is_string()) {
+                        const std::string uri = image["uri"].get<std::string>();
+                        if (!isDataUri(uri)) path = resolve(uri);
+                    } else if (image.contains("bufferView") && image["bufferView"].is_number_integer()) {
+                        if (views.is_null() && ranges[BUFFER_VIEWS].found()) views = parseRange(container.json, ranges[BUFFER_VIEWS]);
+                        const int viewIndex = image["bufferView"].get<int>();
+                        if (views.is_array() && viewIndex >= 0 && viewIndex < static_cast<int>(views.size())) {
+                            const json& view = views[viewIndex];
+                            const int bufferIndex = view.value("buffer", -1);
+                            if (bufferIndex >= 0 && bufferIndex < static_cast<int>(bufferFiles.size()) && !bufferFiles[bufferIndex].path.empty()) {
+                                const BufferFile& bufferFile = bufferFiles[bufferIndex];
+                                path = makeEmbeddedImagePath(bufferFile.path, bufferFile.offset + view.value("byteOffset", size_t(0)),
+                                    view.value("byteLength", size_t(0)));
+                            }
+                        }
+                    }
+                    if (path.empty()) {
+                        std::cout << "Warning: skipping a glTF image that is not in a file (" << modelPath << ")" << std::endl;
+                    }
+                    source->imagePaths.push_back(path);
+                }
+            }
+            replacements.emplace_back(ranges[IMAGES], "[]");
+        }
+    }
+    catch (const json::exception& e) {
+        throw std::runtime_error("Failed to parse glTF file " + modelPath + ": " + e.what());
+    }
+
+    // Splice the rewritten sections back into the text
+    std::sort(replacements.begin(), replacements.end(),
+        [](const auto& a, const auto& b) { return a.first.begin < b.first.begin; });
+    std::string rewritten;
+    rewritten.reserve(container.jsonSize);
+    size_t copied = 0;
+    for (const auto& replacement : replacements) {
+        rewritten.append(container.json + copied, replacement.first.begin - copied);
+        rewritten += replacement.second;
+        copied = replacement.first.end;
+    }
+    rewritten.append(container.json + copied, container.jsonSize - copied);
 
-void loadFromFile(
-    std::vector<Vertex>& vertices,
-    std::vector<uint32_t>& indices,
-    std::vector<Material>& materials,
-    std::vector<uint32_t>& faceMaterialIndices,
-    std::vector<std::string>& textureFiles,
-    const std::string& modelPath)
-{
-    tinygltf::Model model;
     tinygltf::TinyGLTF loader;
     std::string err, warn;
 
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, modelPath);
+    bool ret = loader.LoadASCIIFromString(&model, &err, &warn, rewritten.c_str(), static_cast<unsigned int>(rewritten.size()), modelDir);
     if (!warn.empty()) printf("Warn: %s\n", warn.c_str());
     if (!err.empty()) printf("Err: %s\n", err.c_str());
     if (!ret) throw std::runtime_error("Failed to load glTF model");
 
-    // Extract the directory from the model path
-    std::filesystem::path modelFilePath(modelPath);
-    std::string modelDir = modelFilePath.parent_path().string();
+    for (size_t i = 0; i < source->buffers.size(); i++) {
+        if (!source->buffers[i].data) {
+            source->buffers[i] = { model.buffers[i].data.data(), model.buffers[i].data.size() };
+        }
+    }
 
     std::unordered_map<std::string, int> textureIndexMap;
     std::map<int, uint32_t> gltfMaterialMap;
-    uint32_t vertexOffset = 0;
+    std::map<int, uint32_t> gltfMeshMap;
 
     // Start processing from the scene nodes
-    const auto& scene = model.scenes[model.defaultScene];
+    if (model.scenes.empty()) {
+        throw std::runtime_error("glTF file without a scene: " + modelPath);
+    }
+    const auto& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
     Mat4 identityMatrix = Mat4::identity();
 
     for (int nodeIndex : scene.nodes) {
         processNode(
-            model, model.nodes[nodeIndex], identityMatrix,
-            vertices, indices, materials, faceMaterialIndices, gltfMaterialMap,
-            textureIndexMap, textureFiles, modelDir, vertexOffset
+            model, model.nodes[nodeIndex], identityMatrix, source->jobs, layout.materials, gltfMaterialMap,
+            textureIndexMap, layout.textureFiles, layout.meshes, layout.instances, gltfMeshMap, source->imagePaths,
+            layout.vertexCount, layout.indexCount
         );
     }
 }
 
+GltfFile::~GltfFile() = default;
+
+void GltfFile::decode(Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial) const {
+    // Every primitive owns a disjoint slice of the outputs, so they decode without synchronization
+    ThreadPool::global().parallelFor(source->jobs.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            decodePrimitive(source->model, source->buffers, source->jobs[i], vertices, indices, faceMaterialIndices, baseVertex, baseMaterial);
+        }
+    });
+}
+
+Material makeDefaultMaterial() {
+    Material material{};
+    material.albedo = { 0.8f, 0.8f, 0.8f };
+    material.emission = { 0.0f, 0.0f, 0.0f };
+    material.diffuseTextureID = -1;
+    material.metalRoughTextureID = -1;
+    material.normalTextureID = -1;
+    material.roughness = 1.0f;
+    material.metallic = 0.0f;
+    material.ior = 1.5f;
+    material.alpha = 1.0f;
+    material.material_type = MAT_LAMBERTIAN;
+    return material;
+}
+
+std::unique_ptr<ModelFile> openModelFile(const std::string& modelPath) {
+    std::string extension = fs::path(modelPath).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".obj") return std::make_unique<ObjFile>(modelPath);
+    return std::make_unique<GltfFile>(modelPath);
+}
+
+void loadFromFile(
+    std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices,
+    std::vector<Material>& materials,
+    std::vector<uint32_t>& faceMaterialIndices,
+    std::vector<std::string>& textureFiles,
+    std::vector<MeshRange>& meshes,
+    std::vector<MeshInstance>& instances,
+    const std::string& modelPath)
+{
+    std::unique_ptr<ModelFile> file = openModelFile(modelPath);
+    const ModelLayout& layout = file->getLayout();
+
+    // Appended as is: indices and meshes start from vertex 0 of this file
+    const size_t firstVertex = vertices.size();
+    const size_t firstIndex = indices.size();
+    const size_t firstFace = faceMaterialIndices.size();
+    vertices.resize(firstVertex + layout.vertexCount);
+    indices.resize(firstIndex + layout.indexCount);
+    faceMaterialIndices.resize(firstFace + layout.indexCount / 3);
+    file->decode(vertices.data() + firstVertex, indices.data() + firstIndex, faceMaterialIndices.data() + firstFace, 0, 0);
+
+    materials.insert(materials.end(), layout.materials.begin(), layout.materials.end());
+    textureFiles.insert(textureFiles.end(), layout.textureFiles.begin(), layout.textureFiles.end());
+    meshes.insert(meshes.end(), layout.meshes.begin(), layout.meshes.end());
+    instances.insert(instances.end(), layout.instances.begin(), layout.instances.end());
+}
+
 std::vector<char> readFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
     if (!file.is_open()) {
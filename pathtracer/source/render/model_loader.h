@@ -1,7 +1,11 @@
 #pragma once
 
+#include "core/hash.h"
+#include "math/mat4.h"
 #include "math/vec3.h"
 
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -18,8 +22,9 @@ struct Vertex {
     bool operator==(const Vertex& other) const {
         return position == other.position &&
             normal == other.normal &&
-            texCoord == other.texCoord && 
-			tangent == other.tangent;
+            texCoord[0] == other.texCoord[0] &&
+            texCoord[1] == other.texCoord[1] &&
+            tangent == other.tangent;
     }
 };
 
@@ -38,25 +43,100 @@ struct Material {
     float pad1;
 };
 
+// A unique mesh inside the shared vertex / index arrays, in its own object space.
+// Indices are absolute (they already include firstVertex); its faces start at firstIndex / 3.
+struct MeshRange {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+};
+
+// One placement of a mesh: its glTF node transform followed by the SceneObject transform
+struct MeshInstance {
+    Mat4 transform = Mat4::identity();
+    uint32_t mesh = 0;
+};
+
+// Everything about a glTF file but its geometry: the counts to size the output arrays by, and the meshes
+// (indices relative to the file's first vertex), instances, materials and textures
+struct ModelLayout {
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0; // faces are indexCount / 3
+    std::vector<Material> materials;
+    std::vector<std::string> textureFiles;
+    std::vector<MeshRange> meshes;
+    std::vector<MeshInstance> instances;
+};
+
+// A parsed model file. The constructor of each format reads it and lays it out; decode() then writes the geometry
+// straight into slices of the caller's arrays, so several files can be assembled into one scene concurrently.
+class ModelFile {
+public:
+    virtual ~ModelFile() = default;
+
+    const ModelLayout& getLayout() const { return layout; }
+
+    // Fills vertices[0, vertexCount), indices[0, indexCount) and faceMaterialIndices[0, indexCount / 3) on the
+    // thread pool; baseVertex is added to every index and baseMaterial to every face material
+    virtual void decode(Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial) const = 0;
+
+protected:
+    ModelLayout layout;
+};
+
+// A glTF file (.gltf or .glb). Each glTF mesh is read once, in object space, and every node referencing it adds an instance.
+class GltfFile : public ModelFile {
+public:
+    explicit GltfFile(const std::string& modelPath);
+    ~GltfFile() override;
+
+    GltfFile(const GltfFile&) = delete;
+    GltfFile& operator=(const GltfFile&) = delete;
+
+    void decode(Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial) const override;
+
+private:
+    struct Source; // the tinygltf model and the output slot of every primitive
+    std::unique_ptr<Source> source;
+};
+
+// A rough light grey diffuse material, for faces without one and as the base of every converted material
+Material makeDefaultMaterial();
+
+// Opens a model by its extension: .obj as an ObjFile, anything else as glTF
+std::unique_ptr<ModelFile> openModelFile(const std::string& modelPath);
+
+// Appends one model file to the arrays (openModelFile + decode)
 void loadFromFile(
     std::vector<Vertex>& vertices,
     std::vector<uint32_t>& indices,
     std::vector<Material>& materials,
     std::vector<uint32_t>& faceMaterialIndices,
     std::vector<std::string>& textureFiles,
+    std::vector<MeshRange>& meshes,
+    std::vector<MeshInstance>& instances,
     const std::string& modelPath
 );
 
 std::vector<char> readFile(const std::string& filename);
 
-// Hash support
+// Hash support, consistent with operator==: every attribute, with -0 hashed like +0
 namespace std {
     template<> struct hash<Vertex> {
         size_t operator()(const Vertex& v) const noexcept {
-            size_t h1 = hash<float>()(v.position.x) ^ (hash<float>()(v.position.y) << 1) ^ (hash<float>()(v.position.z) << 2);
-            size_t h2 = hash<float>()(v.normal.x) ^ (hash<float>()(v.normal.y) << 1) ^ (hash<float>()(v.normal.z) << 2);
-            size_t h3 = hash<float>()(v.texCoord[0]) ^ (hash<float>()(v.texCoord[1]) << 1);
-            return h1 ^ (h2 << 1) ^ (h3 << 2);
+            const float values[11] = {
+                v.position.x, v.position.y, v.position.z,
+                v.normal.x, v.normal.y, v.normal.z,
+                v.texCoord[0], v.texCoord[1],
+                v.tangent.x, v.tangent.y, v.tangent.z,
+            };
+            uint32_t bits[11];
+            for (int i = 0; i < 11; i++) {
+                float canonical = values[i] + 0.0f;
+                std::memcpy(&bits[i], &canonical, sizeof(float));
+            }
+            return static_cast<size_t>(hashBytes(bits, sizeof(bits)));
         }
     };
-}
\ No newline at end of file
+}
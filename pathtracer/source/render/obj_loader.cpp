@@ -0,0 +1,577 @@
+#include "obj_loader.h"
+#include "core/mapped_file.h"
+#include "core/thread_pool.h"
+#include "math/vec3.h"
+#include "render/tangents.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Bytes of text per parse task (extended to the next line break), and vertices or triangles per assembly task
+    constexpr size_t CHUNK_BYTES = 4 << 20;
+    constexpr size_t ELEMENT_GRAIN = 65536;
+
+    constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    // One triangle corner: its position, texture coordinate and normal index, 0-based (NO_INDEX when left out)
+    struct Corner {
+        uint32_t position;
+        uint32_t texCoord;
+        uint32_t normal;
+    };
+
+    // Every attribute and triangle corner of the file
+    struct ObjArrays {
+        size_t positionCount = 0;
+        size_t texCoordCount = 0;
+        size_t normalCount = 0;
+        size_t triangleCount = 0;
+        std::unique_ptr<float[]> positions;  // 3 per position
+        std::unique_ptr<float[]> texCoords;  // 2 per texture coordinate, v flipped to the top-left origin of images
+        std::unique_ptr<float[]> normals;    // 3 per normal
+        std::unique_ptr<Corner[]> corners;   // 3 per triangle
+    };
+
+    // The material of the triangles from firstTriangle up to the next run
+    struct MaterialRun {
+        size_t firstTriangle = 0;
+        uint32_t material = 0;
+    };
+
+    // A range of whole lines and what is defined in it
+    struct Chunk {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        // Counting pass: elements defined in the chunk, its usemtl lines (by triangle in the chunk) and mtllib names
+        size_t positionCount = 0;
+        size_t texCoordCount = 0;
+        size_t normalCount = 0;
+        size_t triangleCount = 0;
+        std::vector<std::pair<size_t, std::string>> materialSwitches;
+        std::vector<std::string> libraries;
+
+        // Elements defined before the chunk
+        size_t firstPosition = 0;
+        size_t firstTexCoord = 0;
+        size_t firstNormal = 0;
+        size_t firstTriangle = 0;
+
+        // Parse pass: whether every corner reuses its position index for the attribute, or leaves the attribute out
+        bool texCoordsShared = true;
+        bool texCoordsAbsent = true;
+        bool normalsShared = true;
+        bool normalsAbsent = true;
+    };
+
+    enum class LineType { Position, TexCoord, Normal, Face, UseMaterial, MaterialLibrary, Other };
+
+    bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Skips blanks, returns whether anything but a comment follows on the line
+    bool hasMore(const char*& p, const char* end) {
+        while (p < end && isBlank(*p)) p++;
+        return p < end && *p != '#';
+    }
+
+    // Calls func(begin, end) for every line that isn't blank, without its line break and leading blanks
+    template <typename Func>
+    void forEachLine(const char* begin, const char* end, Func&& func) {
+        while (begin < end) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            if (!lineEnd) lineEnd = end;
+            const char* p = begin;
+            if (hasMore(p, lineEnd)) func(p, lineEnd);
+            begin = lineEnd + 1;
+        }
+    }
+
+    // Reads the keyword a line starts with
+    LineType readKeyword(const char*& p, const char* end) {
+        const char* word = p;
+        while (p < end && !isBlank(*p)) p++;
+        const size_t length = p - word;
+        if (word[0] == 'v') {
+            if (length == 1) return LineType::Position;
+            if (length == 2 && word[1] == 't') return LineType::TexCoord;
+            if (length == 2 && word[1] == 'n') return LineType::Normal;
+        } else if (word[0] == 'f') {
+            if (length == 1) return LineType::Face;
+        } else if (length == 6 && std::memcmp(word, "usemtl", 6) == 0) {
+            return LineType::UseMaterial;
+        } else if (length == 6 && std::memcmp(word, "mtllib", 6) == 0) {
+            return LineType::MaterialLibrary;
+        }
+        return LineType::Other;
+    }
+
+    // The rest of the line without surrounding blanks
+    std::string readName(const char* p, const char* end) {
+        while (p < end && isBlank(*p)) p++;
+        while (end > p && isBlank(end[-1])) end--;
+        return std::string(p, end);
+    }
+
+    size_t countTokens(const char* p, const char* end) {
+        size_t count = 0;
+        while (hasMore(p, end)) {
+            count++;
+            while (p < end && !isBlank(*p)) p++;
+        }
+        return count;
+    }
+
+    bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    // Decimal number with optional sign, fraction and exponent; locale independent and a lot faster than strtof.
+    // Digits past the 18th only scale the value, and the result can be off by one in the last bit.
+    bool parseFloat(const char*& p, const char* end, float& value) {
+        static const double POWERS_OF_TEN[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        if (!hasMore(p, end)) return false;
+        bool negative = false;
+        if (*p == '-' || *p == '+') negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        bool anyDigit = false;
+        for (; p < end && isDigit(*p); p++) {
+            anyDigit = true;
+            if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (*p - '0');
+            else exponent++;
+        }
+        if (p < end && *p == '.') {
+            for (p++; p < end && isDigit(*p); p++) {
+                anyDigit = true;
+                if (mantissa < 100000000000000000ull) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (!anyDigit) return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+            if (p >= end || !isDigit(*p)) return false;
+            int e = 0;
+            for (; p < end && isDigit(*p); p++) {
+                if (e < 10000) e = e * 10 + (*p - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (exponent >= -22 && exponent <= 22) {
+            result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+        } else {
+            result *= std::pow(10.0, exponent);
+        }
+        value = static_cast<float>(negative ? -result : result);
+        return p >= end || isBlank(*p);
+    }
+
+    // A face index: 1-based, or negative to count back from the last element defined so far. Returned 0-based.
+    bool parseIndex(const char*& p, const char* end, size_t definedSoFar, size_t total, uint32_t& index) {
+        const bool negative = p < end && *p == '-';
+        if (negative) p++;
+        if (p >= end || !isDigit(*p)) return false;
+
+        uint64_t value = 0;
+        for (; p < end && isDigit(*p); p++) {
+            value = value * 10 + (*p - '0');
+            if (value > total) return false;
+        }
+        if (value == 0 || (negative && value > definedSoFar)) return false;
+        index = static_cast<uint32_t>(negative ? definedSoFar - value : value - 1);
+        return true;
+    }
+
+    void countChunk(Chunk& chunk) {
+        forEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+            switch (readKeyword(p, end)) {
+            case LineType::Position: chunk.positionCount++; break;
+            case LineType::TexCoord: chunk.texCoordCount++; break;
+            case LineType::Normal: chunk.normalCount++; break;
+            case LineType::Face: {
+                const size_t corners = countTokens(p, end);
+                if (corners >= 3) chunk.triangleCount += corners - 2;
+                break;
+            }
+            case LineType::UseMaterial:
+                chunk.materialSwitches.emplace_back(chunk.triangleCount, readName(p, end));
+                break;
+            case LineType::MaterialLibrary:
+                while (hasMore(p, end)) {
+                    const char* name = p;
+                    while (p < end && !isBlank(*p)) p++;
+                    chunk.libraries.emplace_back(name, p);
+                }
+                break;
+            default: break;
+            }
+        });
+    }
+
+    // Parses the chunk into its slots of the arrays, which the counting pass sized
+    void parseChunk(Chunk& chunk, ObjArrays& arrays, const std::string& path) {
+        size_t position = chunk.firstPosition;
+        size_t texCoord = chunk.firstTexCoord;
+        size_t normal = chunk.firstNormal;
+        size_t triangle = chunk.firstTriangle;
+
+        forEachLine(chunk.begin, chunk.end, [&](const char* line, const char* end) {
+            auto fail = [&] {
+                throw std::runtime_error("Malformed line in " + path + ": " + std::string(line, std::min(end, line + 80)));
+            };
+            auto parseCorner = [&](const char*& p, Corner& corner) {
+                corner.texCoord = NO_INDEX;
+                corner.normal = NO_INDEX;
+                if (!parseIndex(p, end, position, arrays.positionCount, corner.position)) return false;
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/' && !parseIndex(p, end, texCoord, arrays.texCoordCount, corner.texCoord)) return false;
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (!parseIndex(p, end, normal, arrays.normalCount, corner.normal)) return false;
+                    }
+                }
+                return p >= end || isBlank(*p);
+            };
+
+            const char* p = line;
+            switch (readKeyword(p, end)) {
+            case LineType::Position: {
+                float* out = &arrays.positions[3 * position++];
+                if (!parseFloat(p, end, out[0]) || !parseFloat(p, end, out[1]) || !parseFloat(p, end, out[2])) fail();
+                break;
+            }
+            case LineType::TexCoord: {
+                float* out = &arrays.texCoords[2 * texCoord++];
+                float v = 0.0f;
+                if (!parseFloat(p, end, out[0]) || (hasMore(p, end) && !parseFloat(p, end, v))) fail();
+                out[1] = 1.0f - v;
+                break;
+            }
+            case LineType::Normal: {
+                float* out = &arrays.normals[3 * normal++];
+                if (!parseFloat(p, end, out[0]) || !parseFloat(p, end, out[1]) || !parseFloat(p, end, out[2])) fail();
+                break;
+            }
+            case LineType::Face: {
+                Corner first{}, previous{}, corner{};
+                size_t count = 0;
+                while (hasMore(p, end)) {
+                    if (!parseCorner(p, corner)) fail();
+                    chunk.texCoordsShared &= corner.texCoord == corner.position;
+                    chunk.texCoordsAbsent &= corner.texCoord == NO_INDEX;
+                    chunk.normalsShared &= corner.normal == corner.position;
+                    chunk.normalsAbsent &= corner.normal == NO_INDEX;
+
+                    if (count == 0) first = corner;
+                    if (count >= 2) {
+                        Corner* out = &arrays.corners[3 * triangle++];
+                        out[0] = first;
+                        out[1] = previous;
+                        out[2] = corner;
+                    }
+                    previous = corner;
+                    count++;
+                }
+                break;
+            }
+            default: break;
+            }
+        });
+    }
+
+    Vec3 readVec3(const float* values, size_t i) {
+        return Vec3(values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+    }
+
+    Vec3 normalizeOrUp(const Vec3& v) {
+        return v.lengthSquared() > 0.0f ? normalize(v) : Vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    Material convertMaterial(const tinyobj::material_t& mtl, const fs::path& directory,
+        std::unordered_map<std::string, int>& textureIndexMap, std::vector<std::string>& textureFiles)
+    {
+        Material material = makeDefaultMaterial();
+        material.albedo = Vec3(mtl.diffuse[0], mtl.diffuse[1], mtl.diffuse[2]);
+        material.emission = Vec3(mtl.emission[0], mtl.emission[1], mtl.emission[2]);
+        material.alpha = mtl.dissolve;
+        material.metallic = mtl.metallic;
+        // Pr of the PBR extension, or else the Phong exponent turned into a roughness
+        material.roughness = mtl.roughness > 0.0f ? mtl.roughness : std::sqrt(2.0f / (std::max(mtl.shininess, 0.0f) + 2.0f));
+        if (mtl.ior > 1.0f) material.ior = mtl.ior;
+        // The illumination models with refraction
+        if (mtl.illum == 4 || mtl.illum == 6 || mtl.illum == 7 || mtl.illum == 9) material.material_type = MAT_DIELECTRIC;
+
+        auto processTexture = [&](std::string name, int& textureID) {
+            if (name.empty()) return;
+            std::replace(name.begin(), name.end(), '\\', '/');
+            const std::string path = (directory / name).string();
+            if (!textureIndexMap.count(path)) {
+                textureIndexMap[path] = static_cast<int>(textureFiles.size());
+                textureFiles.push_back(path);
+            }
+            textureID = textureIndexMap[path];
+        };
+        processTexture(mtl.diffuse_texname, material.diffuseTextureID);
+        // Most exporters write tangent space normal maps as map_Bump rather than norm
+        processTexture(!mtl.normal_texname.empty() ? mtl.normal_texname : mtl.bump_texname, material.normalTextureID);
+        return material;
+    }
+}
+
+struct ObjFile::Source {
+    size_t fileSize = 0;
+    ObjArrays arrays;
+    std::vector<MaterialRun> materialRuns; // by first triangle, the first one starts at triangle 0
+    bool indexed = false;                  // the positions are the vertices
+    bool normalsAbsent = false;            // the file has no normals, decode() computes them
+};
+
+ObjFile::ObjFile(const std::string& modelPath) : source(std::make_unique<Source>()) {
+    MappedFile file;
+    if (!file.open(modelPath)) {
+        throw std::runtime_error("Failed to open OBJ file " + modelPath);
+    }
+    source->fileSize = file.size();
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const char* textEnd = text + file.size();
+
+    // 1. Chunks of whole lines, and what each defines
+    std::vector<Chunk> chunks;
+    for (const char* begin = text; begin < textEnd;) {
+        const char* end = begin + std::min(CHUNK_BYTES, static_cast<size_t>(textEnd - begin));
+        const char* lineBreak = static_cast<const char*>(std::memchr(end, '\n', textEnd - end));
+        end = lineBreak ? lineBreak + 1 : textEnd;
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = end;
+        chunks.push_back(std::move(chunk));
+        begin = end;
+    }
+    ThreadPool::global().parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) countChunk(chunks[i]);
+    });
+
+    // 2. Every chunk's first slots, and the arrays sized for all of them
+    ObjArrays& arrays = source->arrays;
+    for (Chunk& chunk : chunks) {
+        chunk.firstPosition = arrays.positionCount;
+        chunk.firstTexCoord = arrays.texCoordCount;
+        chunk.firstNormal = arrays.normalCount;
+        chunk.firstTriangle = arrays.triangleCount;
+        arrays.positionCount += chunk.positionCount;
+        arrays.texCoordCount += chunk.texCoordCount;
+        arrays.normalCount += chunk.normalCount;
+        arrays.triangleCount += chunk.triangleCount;
+    }
+    if (std::max({ arrays.positionCount, arrays.texCoordCount, arrays.normalCount }) >= NO_INDEX ||
+        arrays.triangleCount * 3 > UINT32_MAX) {
+        throw std::runtime_error("OBJ file with more vertices or triangles than 32-bit indices address: " + modelPath);
+    }
+    // Left uninitialized, every slot is written by exactly one chunk
+    arrays.positions.reset(new float[arrays.positionCount * 3]);
+    arrays.texCoords.reset(new float[arrays.texCoordCount * 2]);
+    arrays.normals.reset(new float[arrays.normalCount * 3]);
+    arrays.corners.reset(new Corner[arrays.triangleCount * 3]);
+
+    // 3. Parse every chunk into its slots
+    ThreadPool::global().parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) parseChunk(chunks[i], arrays, modelPath);
+    });
+
+    bool texCoordsShared = true, texCoordsAbsent = true, normalsShared = true, normalsAbsent = true;
+    for (const Chunk& chunk : chunks) {
+        texCoordsShared &= chunk.texCoordsShared;
+        texCoordsAbsent &= chunk.texCoordsAbsent;
+        normalsShared &= chunk.normalsShared;
+        normalsAbsent &= chunk.normalsAbsent;
+    }
+    source->indexed = (texCoordsShared || texCoordsAbsent) && (normalsShared || normalsAbsent);
+    source->normalsAbsent = normalsAbsent;
+
+    // 4. Materials of the .mtl libraries (textures are relative to the library), converted in first-use order
+    const fs::path modelDir = fs::path(modelPath).parent_path();
+    std::vector<tinyobj::material_t> mtlMaterials;
+    std::vector<fs::path> mtlDirectories; // of every material
+    std::map<std::string, int> mtlMaterialMap;
+    std::vector<std::string> libraries;
+    for (const Chunk& chunk : chunks) {
+        for (const std::string& library : chunk.libraries) {
+            if (std::find(libraries.begin(), libraries.end(), library) != libraries.end()) continue;
+            libraries.push_back(library);
+
+            const fs::path libraryPath = modelDir / library;
+            std::ifstream stream(libraryPath);
+            if (!stream) {
+                std::cout << "Warning: material library " << libraryPath.string() << " not found" << std::endl;
+                continue;
+            }
+            std::string warn, err;
+            tinyobj::LoadMtl(&mtlMaterialMap, &mtlMaterials, &stream, &warn, &err);
+            if (!warn.empty()) printf("Warn: %s\n", warn.c_str());
+            if (!err.empty()) printf("Err: %s\n", err.c_str());
+            mtlDirectories.resize(mtlMaterials.size(), libraryPath.parent_path());
+        }
+    }
+
+    std::unordered_map<std::string, uint32_t> materialIndexMap; // by usemtl name, "" for the default material
+    std::unordered_map<std::string, int> textureIndexMap;
+    std::function<uint32_t(const std::string&)> useMaterial = [&](const std::string& name) {
+        auto it = materialIndexMap.find(name);
+        if (it != materialIndexMap.end()) return it->second;
+
+        uint32_t index = static_cast<uint32_t>(layout.materials.size());
+        auto mtl = mtlMaterialMap.find(name);
+        if (mtl != mtlMaterialMap.end()) {
+            layout.materials.push_back(convertMaterial(mtlMaterials[mtl->second], mtlDirectories[mtl->second],
+                textureIndexMap, layout.textureFiles));
+        } else if (name.empty()) {
+            layout.materials.push_back(makeDefaultMaterial());
+        } else {
+            std::cout << "Warning: material " << name << " not found for " << modelPath << std::endl;
+            index = useMaterial("");
+        }
+        materialIndexMap[name] = index;
+        return index;
+    };
+
+    bool startsWithSwitch = false;
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.materialSwitches.empty()) {
+            startsWithSwitch = chunk.firstTriangle + chunk.materialSwitches.front().first == 0;
+            break;
+        }
+    }
+    if (arrays.triangleCount > 0 && !startsWithSwitch) {
+        source->materialRuns.push_back({ 0, useMaterial("") });
+    }
+    for (const Chunk& chunk : chunks) {
+        for (const auto& materialSwitch : chunk.materialSwitches) {
+            source->materialRuns.push_back({ chunk.firstTriangle + materialSwitch.first, useMaterial(materialSwitch.second) });
+        }
+    }
+
+    // 5. One mesh with one instance
+    if (arrays.triangleCount > 0) {
+        layout.vertexCount = static_cast<uint32_t>(source->indexed ? arrays.positionCount : arrays.triangleCount * 3);
+        layout.indexCount = static_cast<uint32_t>(arrays.triangleCount * 3);
+
+        MeshRange mesh;
+        mesh.indexCount = layout.indexCount;
+        mesh.vertexCount = layout.vertexCount;
+        layout.meshes.push_back(mesh);
+        layout.instances.push_back(MeshInstance());
+    }
+}
+
+ObjFile::~ObjFile() = default;
+
+size_t ObjFile::getFileSize() const {
+    return source->fileSize;
+}
+
+void ObjFile::decode(Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial) const {
+    const ObjArrays& arrays = source->arrays;
+    if (arrays.triangleCount == 0) return;
+    ThreadPool& pool = ThreadPool::global();
+
+    if (source->indexed) {
+        pool.parallelFor(arrays.positionCount, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                Vertex v{};
+                v.position = readVec3(arrays.positions.get(), i);
+                v.normal = i < arrays.normalCount ? normalizeOrUp(readVec3(arrays.normals.get(), i)) : Vec3(0.0f, 1.0f, 0.0f);
+                v.texCoord[0] = i < arrays.texCoordCount ? arrays.texCoords[2 * i] : 0.0f;
+                v.texCoord[1] = i < arrays.texCoordCount ? arrays.texCoords[2 * i + 1] : 0.0f;
+                vertices[i] = v;
+            }
+        });
+        pool.parallelFor(arrays.triangleCount * 3, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                indices[i] = baseVertex + arrays.corners[i].position;
+            }
+        });
+
+        // Smooth normals for files without any: the area weighted face normals summed around every vertex.
+        // Any split of the triangles shares vertices between the parts, so the sum runs on this thread.
+        if (source->normalsAbsent) {
+            pool.parallelFor(arrays.positionCount, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) vertices[i].normal = Vec3(0.0f);
+            });
+            for (size_t t = 0; t < arrays.triangleCount; t++) {
+                const Corner* corner = &arrays.corners[3 * t];
+                const Vec3 p0 = vertices[corner[0].position].position;
+                const Vec3 faceNormal = cross(vertices[corner[1].position].position - p0, vertices[corner[2].position].position - p0);
+                for (int k = 0; k < 3; k++) vertices[corner[k].position].normal += faceNormal;
+            }
+            pool.parallelFor(arrays.positionCount, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) vertices[i].normal = normalizeOrUp(vertices[i].normal);
+            });
+        }
+    } else {
+        // Every corner is a vertex; corners without a normal take their face's
+        pool.parallelFor(arrays.triangleCount, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                const Corner* corner = &arrays.corners[3 * t];
+                const Vec3 p0 = readVec3(arrays.positions.get(), corner[0].position);
+                const Vec3 p1 = readVec3(arrays.positions.get(), corner[1].position);
+                const Vec3 p2 = readVec3(arrays.positions.get(), corner[2].position);
+                const Vec3 faceNormal = normalizeOrUp(cross(p1 - p0, p2 - p0));
+
+                for (size_t k = 0; k < 3; k++) {
+                    const Corner& c = corner[k];
+                    Vertex v{};
+                    v.position = k == 0 ? p0 : (k == 1 ? p1 : p2);
+                    v.normal = c.normal != NO_INDEX ? normalizeOrUp(readVec3(arrays.normals.get(), c.normal)) : faceNormal;
+                    v.texCoord[0] = c.texCoord != NO_INDEX ? arrays.texCoords[2 * c.texCoord] : 0.0f;
+                    v.texCoord[1] = c.texCoord != NO_INDEX ? arrays.texCoords[2 * c.texCoord + 1] : 0.0f;
+                    vertices[3 * t + k] = v;
+                    indices[3 * t + k] = baseVertex + static_cast<uint32_t>(3 * t + k);
+                }
+            }
+        });
+    }
+
+    // All triangles are in one mesh, so its tangents are summed on this thread
+    generateTangents(vertices, layout.vertexCount, indices, layout.indexCount, baseVertex);
+
+    // Face materials from the runs, each task starts from the run its first triangle is in
+    const std::vector<MaterialRun>& runs = source->materialRuns;
+    pool.parallelFor(arrays.triangleCount, ELEMENT_GRAIN, [&](size_t begin, size_t end) {
+        auto run = std::upper_bound(runs.begin(), runs.end(), begin,
+            [](size_t triangle, const MaterialRun& r) { return triangle < r.firstTriangle; }) - 1;
+        for (size_t t = begin; t < end; t++) {
+            while (run + 1 != runs.end() && (run + 1)->firstTriangle <= t) ++run;
+            faceMaterialIndices[t] = baseMaterial + run->material;
+        }
+    });
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "render/model_loader.h"
+
+#include <memory>
+#include <string>
+
+// A Wavefront .obj file and the .mtl libraries it names. The file is mapped and cut into chunks of whole lines that
+// are parsed on the thread pool: a counting pass sizes the arrays, then every chunk parses straight into its slots.
+// All faces go into one mesh with one instance, polygons are split into triangle fans.
+// When every corner uses its position index for the texture coordinate and normal too (or leaves them out), the
+// positions are the vertices and the faces index them; otherwise every corner becomes its own vertex.
+class ObjFile : public ModelFile {
+public:
+    explicit ObjFile(const std::string& modelPath);
+    ~ObjFile() override;
+
+    ObjFile(const ObjFile&) = delete;
+    ObjFile& operator=(const ObjFile&) = delete;
+
+    void decode(Vertex* vertices, uint32_t* indices, uint32_t* faceMaterialIndices, uint32_t baseVertex, uint32_t baseMaterial) const override;
+
+    // Bytes of OBJ text that were parsed
+    size_t getFileSize() const;
+
+private:
+    struct Source; // the parsed attributes and triangle corners, and the material of every run of triangles
+    std::unique_ptr<Source> source;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Per-frame tracing parameters: pushed to raygen.rgen / miss.rmiss with the camera, used as-is by the CPU tracer
+struct RenderSettings {
+    int samplesPerFrame = 4;
+    int maxDepth = 6;           // path segments, russian roulette starts after the 4th
+    float skyIntensity = 0.2f;  // scales the sky radiance returned by the miss shader
+};
+
+// Tonemap curves of the display transform; the values are the ones display.comp switches on
+enum class Tonemap : int32_t {
+    Clamp = 0,
+    Aces = 1,   // Stephen Hill's fit of the ACES RRT + sRGB ODT
+    AgX = 2,    // AgX base look with the polynomial contrast curve
+};
+
+// Turns the linear accumulation into 8-bit display values: pushed to display.comp, applied on the CPU to images
+// written offline (applyDisplayTransform)
+struct DisplaySettings {
+    float exposure = 0.0f;      // stops, applied before the tonemap
+    Tonemap tonemap = Tonemap::Aces;
+    bool dither = true;         // triangular noise of +-1 step before quantizing, hides banding in dark gradients
+};
+
+// Variance-guided a-trous filter run between the traces and the display pass (denoise.comp, with the CPU reference
+// in render/denoiser.cpp). The edge-stopping functions are normalized by these sigmas.
+struct DenoiserSettings {
+    bool enabled = false;
+    int iterations = 5;             // filter passes, the kernel's taps are 1, 2, 4 ... pixels apart
+    float sigmaDepth = 1.0f;        // depth differences, relative to the local depth gradient
+    float sigmaLuminance = 4.0f;    // luminance differences, relative to the estimated standard deviation
+};
@@ -0,0 +1,276 @@
+#include "scene.h"
+#include "core/thread_pool.h"
+#include "math/mat3.h"
+#include "render/mesh_optimize.h"
+#include "render/vertex_format.h"
+
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+    // Welds and reorders every mesh concurrently. Index and face counts do not change, so those are rewritten
+    // in place; the welded vertices are compacted into a new array at prefix-summed offsets.
+    void optimizeSceneMeshes(SceneData& scene, std::vector<MeshOptimizeStats>& stats) {
+        struct OptimizedMesh {
+            MeshRange range;
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            std::vector<uint32_t> faceMaterialIndices;
+        };
+
+        const size_t meshCount = scene.meshes.size();
+        std::vector<OptimizedMesh> optimized(meshCount);
+        stats.assign(meshCount, MeshOptimizeStats());
+        ThreadPool::global().parallelFor(meshCount, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                OptimizedMesh& mesh = optimized[i];
+                mesh.range = optimizeMesh(scene.vertices, scene.indices, scene.faceMaterialIndices, scene.meshes[i],
+                    mesh.vertices, mesh.indices, mesh.faceMaterialIndices, &stats[i]);
+            }
+        });
+
+        std::vector<uint32_t> firstVertex(meshCount);
+        uint32_t vertexCount = 0;
+        for (size_t i = 0; i < meshCount; i++) {
+            firstVertex[i] = vertexCount;
+            vertexCount += optimized[i].range.vertexCount;
+        }
+
+        std::vector<Vertex> vertices(vertexCount);
+        ThreadPool::global().parallelFor(meshCount, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                MeshRange& mesh = scene.meshes[i];
+                OptimizedMesh& result = optimized[i];
+                std::copy(result.vertices.begin(), result.vertices.end(), vertices.begin() + firstVertex[i]);
+                for (uint32_t k = 0; k < mesh.indexCount; k++) {
+                    scene.indices[mesh.firstIndex + k] = firstVertex[i] + result.indices[k];
+                }
+                std::copy(result.faceMaterialIndices.begin(), result.faceMaterialIndices.end(),
+                    scene.faceMaterialIndices.begin() + mesh.firstIndex / 3);
+
+                mesh.firstVertex = firstVertex[i];
+                mesh.vertexCount = result.range.vertexCount;
+                result = OptimizedMesh();
+            }
+        });
+        scene.vertices = std::move(vertices);
+    }
+}
+
+void loadScene(SceneData& scene, const std::vector<SceneObject>& objects, const std::string& modelDir, bool optimizeMeshes) {
+    scene = SceneData();
+
+    // 1. Parse and lay out every file concurrently
+    std::vector<std::unique_ptr<ModelFile>> files(objects.size());
+    ThreadPool::global().parallelFor(objects.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            files[i] = openModelFile(modelDir + objects[i].modelPath);
+        }
+    });
+
+    // 2. Each file's slice of the scene arrays, and its meshes, instances and materials with the offsets applied.
+    // Vertices stay in object space, the object transform goes on top of every instance.
+    struct Slice {
+        uint32_t firstVertex = 0;
+        uint32_t firstIndex = 0;
+        uint32_t firstMaterial = 0;
+        uint32_t firstMesh = 0;
+        uint32_t meshCount = 0;
+        uint32_t instanceCount = 0;
+    };
+    std::vector<Slice> slices(objects.size());
+    std::unordered_map<std::string, int> textureIndexMap; // To de-duplicate textures across files
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        const ModelLayout& layout = files[i]->getLayout();
+        Slice& slice = slices[i];
+        slice.firstVertex = vertexCount;
+        slice.firstIndex = indexCount;
+        slice.firstMaterial = static_cast<uint32_t>(scene.materials.size());
+        slice.firstMesh = static_cast<uint32_t>(scene.meshes.size());
+        slice.meshCount = static_cast<uint32_t>(layout.meshes.size());
+        slice.instanceCount = static_cast<uint32_t>(layout.instances.size());
+
+        for (MeshRange mesh : layout.meshes) {
+            mesh.firstIndex += slice.firstIndex;
+            mesh.firstVertex += slice.firstVertex;
+            scene.meshes.push_back(mesh);
+        }
+        for (MeshInstance instance : layout.instances) {
+            instance.transform = instance.transform * objects[i].transform;
+            instance.mesh += slice.firstMesh;
+            scene.instances.push_back(instance);
+        }
+
+        // De-duplicate and append textures
+        auto remapTexture = [&](int& textureID) {
+            if (textureID == -1) return;
+            const std::string& path = layout.textureFiles[textureID];
+            if (textureIndexMap.find(path) == textureIndexMap.end()) {
+                textureIndexMap[path] = static_cast<int>(scene.textureFiles.size());
+                scene.textureFiles.push_back(path);
+            }
+            textureID = textureIndexMap[path];
+        };
+
+        for (Material material : layout.materials) {
+            remapTexture(material.diffuseTextureID);
+            remapTexture(material.metalRoughTextureID);
+            remapTexture(material.normalTextureID);
+            material.emission *= objects[i].emissionScale;
+            scene.materials.push_back(material);
+        }
+
+        vertexCount += layout.vertexCount;
+        indexCount += layout.indexCount;
+    }
+
+    // 3. Every file decodes straight into its slice
+    scene.vertices.resize(vertexCount);
+    scene.indices.resize(indexCount);
+    scene.faceMaterialIndices.resize(indexCount / 3);
+    ThreadPool::global().parallelFor(objects.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Slice& slice = slices[i];
+            files[i]->decode(scene.vertices.data() + slice.firstVertex, scene.indices.data() + slice.firstIndex,
+                scene.faceMaterialIndices.data() + slice.firstIndex / 3, slice.firstVertex, slice.firstMaterial);
+            files[i].reset();
+        }
+    });
+
+    // 4. glTF vertices come unwelded per primitive; rebuild every mesh welded and in spatial order
+    std::vector<MeshOptimizeStats> meshStats;
+    if (optimizeMeshes) optimizeSceneMeshes(scene, meshStats);
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Slice& slice = slices[i];
+        std::cout << " - Loaded " << objects[i].modelPath << " (" << slice.meshCount << " meshes, "
+            << slice.instanceCount << " instances";
+        if (optimizeMeshes) {
+            MeshOptimizeStats optimizeStats;
+            for (uint32_t mesh = slice.firstMesh; mesh < slice.firstMesh + slice.meshCount; mesh++) {
+                optimizeStats.verticesIn += meshStats[mesh].verticesIn;
+                optimizeStats.verticesOut += meshStats[mesh].verticesOut;
+                optimizeStats.weldMs += meshStats[mesh].weldMs;
+                optimizeStats.reorderMs += meshStats[mesh].reorderMs;
+            }
+            std::cout << ", welded " << optimizeStats.verticesIn << " -> " << optimizeStats.verticesOut << " vertices in "
+                << optimizeStats.weldMs + optimizeStats.reorderMs << " ms";
+        }
+        std::cout << ")" << std::endl;
+    }
+}
+
+void appendScene(SceneData& scene, const SceneData& other) {
+    const uint32_t baseVertex = static_cast<uint32_t>(scene.vertices.size());
+    const uint32_t baseIndex = static_cast<uint32_t>(scene.indices.size());
+    const uint32_t baseMaterial = static_cast<uint32_t>(scene.materials.size());
+    const uint32_t baseMesh = static_cast<uint32_t>(scene.meshes.size());
+
+    scene.vertices.insert(scene.vertices.end(), other.vertices.begin(), other.vertices.end());
+    scene.indices.reserve(scene.indices.size() + other.indices.size());
+    for (uint32_t index : other.indices) scene.indices.push_back(baseVertex + index);
+    scene.faceMaterialIndices.reserve(scene.faceMaterialIndices.size() + other.faceMaterialIndices.size());
+    for (uint32_t material : other.faceMaterialIndices) scene.faceMaterialIndices.push_back(baseMaterial + material);
+
+    for (MeshRange mesh : other.meshes) {
+        mesh.firstVertex += baseVertex;
+        mesh.firstIndex += baseIndex;
+        scene.meshes.push_back(mesh);
+    }
+    for (MeshInstance instance : other.instances) {
+        instance.mesh += baseMesh;
+        scene.instances.push_back(instance);
+    }
+
+    std::unordered_map<std::string, int> textureIndexMap;
+    for (size_t i = 0; i < scene.textureFiles.size(); i++) {
+        textureIndexMap.emplace(scene.textureFiles[i], static_cast<int>(i));
+    }
+    std::vector<int> textureRemap(other.textureFiles.size());
+    for (size_t i = 0; i < other.textureFiles.size(); i++) {
+        auto inserted = textureIndexMap.emplace(other.textureFiles[i], static_cast<int>(scene.textureFiles.size()));
+        if (inserted.second) scene.textureFiles.push_back(other.textureFiles[i]);
+        textureRemap[i] = inserted.first->second;
+    }
+
+    for (Material material : other.materials) {
+        for (int* textureID : { &material.diffuseTextureID, &material.metalRoughTextureID, &material.normalTextureID }) {
+            if (*textureID >= 0) *textureID = textureRemap[*textureID];
+        }
+        scene.materials.push_back(material);
+    }
+}
+
+SceneData flattenScene(const SceneData& scene) {
+    SceneData world;
+    world.materials = scene.materials;
+    world.textureFiles = scene.textureFiles;
+
+    size_t vertexCount = 0, indexCount = 0;
+    for (const auto& instance : scene.instances) {
+        vertexCount += scene.meshes[instance.mesh].vertexCount;
+        indexCount += scene.meshes[instance.mesh].indexCount;
+    }
+    world.vertices.reserve(vertexCount);
+    world.indices.reserve(indexCount);
+    world.faceMaterialIndices.reserve(indexCount / 3);
+
+    for (const auto& instance : scene.instances) {
+        const MeshRange& mesh = scene.meshes[instance.mesh];
+        const Mat4& transform = instance.transform;
+        Mat3 normalTransform = transform.toMat3().inverse().transpose();
+        Mat3 tangentTransform = transform.toMat3();
+
+        // Same as closesthit.rchit does with the instance transform
+        uint32_t base = static_cast<uint32_t>(world.vertices.size());
+        for (uint32_t i = 0; i < mesh.vertexCount; i++) {
+            Vertex vertex = scene.vertices[mesh.firstVertex + i];
+            vertex.position = transform.transformPoint(vertex.position);
+            vertex.normal = normalTransform * vertex.normal;
+            vertex.tangent = tangentTransform * vertex.tangent;
+            world.vertices.push_back(vertex);
+        }
+        for (uint32_t i = 0; i < mesh.indexCount; i++) {
+            world.indices.push_back(base + scene.indices[mesh.firstIndex + i] - mesh.firstVertex);
+        }
+        auto faces = scene.faceMaterialIndices.begin() + mesh.firstIndex / 3;
+        world.faceMaterialIndices.insert(world.faceMaterialIndices.end(), faces, faces + mesh.indexCount / 3);
+    }
+
+    MeshRange all;
+    all.indexCount = static_cast<uint32_t>(world.indices.size());
+    all.vertexCount = static_cast<uint32_t>(world.vertices.size());
+    world.meshes.push_back(all);
+
+    world.instances.push_back(MeshInstance());
+    return world;
+}
+
+SceneGeometrySize getSceneGeometrySize(const SceneData& scene) {
+    auto meshBytes = [&](uint64_t vertexCount, uint64_t indexCount) {
+        return vertexCount * sizeof(PackedVertex) + indexCount * sizeof(uint32_t) + indexCount / 3 * sizeof(uint32_t);
+    };
+
+    SceneGeometrySize size;
+    size.instancedBytes = meshBytes(scene.vertices.size(), scene.indices.size()) +
+        scene.meshes.size() * sizeof(MeshRange) + scene.instances.size() * sizeof(MeshInstance);
+    for (const auto& instance : scene.instances) {
+        const MeshRange& mesh = scene.meshes[instance.mesh];
+        size.flattenedBytes += meshBytes(mesh.vertexCount, mesh.indexCount);
+    }
+    return size;
+}
+
+std::vector<bool> getSrgbTextureMask(const SceneData& scene) {
+    std::vector<bool> srgb(scene.textureFiles.size(), false);
+    for (const auto& material : scene.materials) {
+        if (material.diffuseTextureID >= 0 && material.diffuseTextureID < static_cast<int>(srgb.size())) {
+            srgb[material.diffuseTextureID] = true;
+        }
+    }
+    return srgb;
+}
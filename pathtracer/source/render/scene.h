@@ -0,0 +1,49 @@
+#pragma once
+
+#include "math/mat4.h"
+#include "render/model_loader.h"
+
+#include <string>
+#include <vector>
+
+struct SceneObject {
+    std::string modelPath;
+    Mat4 transform;
+    float emissionScale = 1.0f; // multiplies the emission of every material of the model
+};
+
+// Unique meshes plus the instances placing them in the world, shared by the GPU and CPU renderers
+struct SceneData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Material> materials;
+    std::vector<uint32_t> faceMaterialIndices;
+    std::vector<std::string> textureFiles;
+    std::vector<MeshRange> meshes;
+    std::vector<MeshInstance> instances;
+};
+
+// GPU bytes of vertex (packed), index and face material data as stored, and as it would be with every instance baked
+struct SceneGeometrySize {
+    uint64_t instancedBytes = 0;
+    uint64_t flattenedBytes = 0;
+};
+
+// One flag per textureFiles entry, set for textures holding sRGB color (base color) rather than data
+std::vector<bool> getSrgbTextureMask(const SceneData& scene);
+
+SceneGeometrySize getSceneGeometrySize(const SceneData& scene);
+
+// Loads every object (paths relative to modelDir) into one scene, parsing and decoding the files concurrently
+// straight into their slices of the scene arrays.
+// Meshes are welded and reordered for locality (optimizeMesh) unless optimizeMeshes is false.
+void loadScene(SceneData& scene, const std::vector<SceneObject>& objects, const std::string& modelDir, bool optimizeMeshes = true);
+
+// Appends a separately loaded scene: its meshes, instances, materials and face materials are offset past the
+// existing ones and its textures are de-duplicated against the existing table (new ones go at the end).
+// Existing meshes keep their ranges, so anything built from them stays valid.
+void appendScene(SceneData& scene, const SceneData& other);
+
+// Copy of the scene with every instance baked into world space: a single mesh with one identity instance.
+// For the single-level CPU BVH.
+SceneData flattenScene(const SceneData& scene);
@@ -0,0 +1,249 @@
+#include "scene_cache.h"
+#include "core/hash.h"
+#include "core/mapped_file.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <type_traits>
+
+namespace {
+    constexpr uint32_t CACHE_MAGIC = 0x43535450; // "PTSC"
+    // Bump whenever the loader produces different data for the same source files
+    constexpr uint32_t CACHE_VERSION = 5;
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    enum Section : uint32_t {
+        SECTION_VERTICES,
+        SECTION_INDICES,
+        SECTION_MATERIALS,
+        SECTION_FACE_MATERIALS,
+        SECTION_EMISSIVE_TRIS,
+        SECTION_TEXTURE_FILES, // null-terminated paths, back to back
+        SECTION_MESHES,
+        SECTION_INSTANCES,
+        SECTION_COUNT
+    };
+
+    struct SectionEntry {
+        uint64_t offset;
+        uint64_t size;  // bytes
+        uint64_t count; // elements
+    };
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        // Struct sizes catch layout changes that forgot to bump CACHE_VERSION
+        uint32_t vertexSize;
+        uint32_t materialSize;
+        uint32_t emissiveTriSize;
+        uint32_t instanceSize;
+        SectionEntry sections[SECTION_COUNT];
+    };
+
+    static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex is copied as raw bytes");
+    static_assert(std::is_trivially_copyable<Material>::value, "Material is copied as raw bytes");
+    static_assert(std::is_trivially_copyable<EmissiveTriGPU>::value, "EmissiveTriGPU is copied as raw bytes");
+    static_assert(std::is_trivially_copyable<MeshRange>::value, "MeshRange is copied as raw bytes");
+    static_assert(std::is_trivially_copyable<MeshInstance>::value, "MeshInstance is copied as raw bytes");
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool sectionInBounds(const SectionEntry& section, size_t fileSize) {
+        return section.offset % SECTION_ALIGNMENT == 0 && section.offset <= fileSize && section.size <= fileSize - section.offset;
+    }
+
+    template <typename T>
+    bool readSection(const MappedFile& file, const SectionEntry& section, std::vector<T>& out) {
+        if (!sectionInBounds(section, file.size()) || section.size != section.count * sizeof(T)) return false;
+
+        // Sections are aligned in the file and the mapping is page aligned, so this is a plain bulk copy
+        const T* first = reinterpret_cast<const T*>(file.data() + section.offset);
+        out.assign(first, first + section.count);
+        return true;
+    }
+
+    uint64_t hashString(const std::string& s) {
+        return hashBytes(s.data(), s.size());
+    }
+}
+
+uint64_t computeSceneCacheKey(const std::vector<SceneObject>& objects, const std::string& modelDir) {
+    uint64_t key = hashCombine(CACHE_VERSION, objects.size());
+
+    for (const auto& object : objects) {
+        key = hashCombine(key, hashString(object.modelPath));
+        key = hashCombine(key, hashBytes(&object.transform, sizeof(Mat4)));
+        key = hashCombine(key, hashBytes(&object.emissionScale, sizeof(float)));
+
+        std::string fullPath = modelDir + object.modelPath;
+        MappedFile source;
+        if (source.open(fullPath)) {
+            key = hashCombine(key, hashBytes(source.data(), source.size()));
+        }
+
+        // Buffers and images only by size and timestamp, hashing them would cost as much as parsing.
+        // Summed so the result doesn't depend on directory iteration order.
+        uint64_t siblings = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::path(fullPath).parent_path(), ec)) {
+            if (!entry.is_regular_file(ec)) continue;
+            uint64_t h = hashString(entry.path().filename().string());
+            h = hashCombine(h, static_cast<uint64_t>(entry.file_size(ec)));
+            h = hashCombine(h, static_cast<uint64_t>(entry.last_write_time(ec).time_since_epoch().count()));
+            siblings += hashMix(h);
+        }
+        key = hashCombine(key, siblings);
+    }
+
+    return key;
+}
+
+std::string getSceneCachePath(const std::vector<SceneObject>& objects, const std::string& cacheDir) {
+    uint64_t id = 0;
+    for (const auto& object : objects) {
+        id = hashCombine(id, hashString(object.modelPath));
+        id = hashCombine(id, hashBytes(&object.transform, sizeof(Mat4)));
+        id = hashCombine(id, hashBytes(&object.emissionScale, sizeof(float)));
+    }
+
+    std::ostringstream name;
+    name << cacheDir << "scene_" << std::hex << id << ".cache";
+    return name.str();
+}
+
+bool readSceneCache(const std::string& path, uint64_t key, SceneData& scene, std::vector<EmissiveTriGPU>& emissiveTris) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(CacheHeader)) return false;
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(CacheHeader));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key ||
+        header.vertexSize != sizeof(Vertex) || header.materialSize != sizeof(Material) ||
+        header.emissiveTriSize != sizeof(EmissiveTriGPU) || header.instanceSize != sizeof(MeshInstance)) {
+        return false;
+    }
+
+    if (!readSection(file, header.sections[SECTION_VERTICES], scene.vertices) ||
+        !readSection(file, header.sections[SECTION_INDICES], scene.indices) ||
+        !readSection(file, header.sections[SECTION_MATERIALS], scene.materials) ||
+        !readSection(file, header.sections[SECTION_FACE_MATERIALS], scene.faceMaterialIndices) ||
+        !readSection(file, header.sections[SECTION_EMISSIVE_TRIS], emissiveTris) ||
+        !readSection(file, header.sections[SECTION_MESHES], scene.meshes) ||
+        !readSection(file, header.sections[SECTION_INSTANCES], scene.instances)) {
+        return false;
+    }
+
+    const SectionEntry& names = header.sections[SECTION_TEXTURE_FILES];
+    if (!sectionInBounds(names, file.size())) return false;
+
+    scene.textureFiles.clear();
+    scene.textureFiles.reserve(names.count);
+    const char* cursor = reinterpret_cast<const char*>(file.data() + names.offset);
+    const char* end = cursor + names.size;
+    for (uint64_t i = 0; i < names.count; i++) {
+        const char* terminator = static_cast<const char*>(std::memchr(cursor, '\0', end - cursor));
+        if (!terminator) return false;
+        scene.textureFiles.emplace_back(cursor, terminator);
+        cursor = terminator + 1;
+    }
+
+    return true;
+}
+
+bool writeSceneCache(const std::string& path, uint64_t key, const SceneData& scene, const std::vector<EmissiveTriGPU>& emissiveTris) {
+    std::string names;
+    for (const auto& file : scene.textureFiles) {
+        names += file;
+        names.push_back('\0');
+    }
+
+    struct Payload {
+        const void* data;
+        uint64_t size;
+        uint64_t count;
+    };
+    const Payload payloads[SECTION_COUNT] = {
+        { scene.vertices.data(), scene.vertices.size() * sizeof(Vertex), scene.vertices.size() },
+        { scene.indices.data(), scene.indices.size() * sizeof(uint32_t), scene.indices.size() },
+        { scene.materials.data(), scene.materials.size() * sizeof(Material), scene.materials.size() },
+        { scene.faceMaterialIndices.data(), scene.faceMaterialIndices.size() * sizeof(uint32_t), scene.faceMaterialIndices.size() },
+        { emissiveTris.data(), emissiveTris.size() * sizeof(EmissiveTriGPU), emissiveTris.size() },
+        { names.data(), names.size(), scene.textureFiles.size() },
+        { scene.meshes.data(), scene.meshes.size() * sizeof(MeshRange), scene.meshes.size() },
+        { scene.instances.data(), scene.instances.size() * sizeof(MeshInstance), scene.instances.size() },
+    };
+
+    CacheHeader header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.vertexSize = sizeof(Vertex);
+    header.materialSize = sizeof(Material);
+    header.emissiveTriSize = sizeof(EmissiveTriGPU);
+    header.instanceSize = sizeof(MeshInstance);
+
+    uint64_t offset = alignUp(sizeof(CacheHeader), SECTION_ALIGNMENT);
+    for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+        header.sections[i] = { offset, payloads[i].size, payloads[i].count };
+        offset = alignUp(offset + payloads[i].size, SECTION_ALIGNMENT);
+    }
+
+    // Write next to the target and rename, so a crash never leaves a truncated cache behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        const char padding[SECTION_ALIGNMENT] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        uint64_t written = sizeof(CacheHeader);
+        for (uint32_t i = 0; i < SECTION_COUNT; i++) {
+            file.write(padding, header.sections[i].offset - written);
+            file.write(static_cast<const char*>(payloads[i].data), payloads[i].size);
+            written = header.sections[i].offset + payloads[i].size;
+        }
+        if (!file) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool loadSceneCached(SceneData& scene, std::vector<EmissiveTriGPU>& emissiveTris,
+    const std::vector<SceneObject>& objects, const std::string& modelDir, const std::string& cacheDir) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto elapsedMs = [&] { return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count(); };
+
+    uint64_t key = computeSceneCacheKey(objects, modelDir);
+    std::string path = getSceneCachePath(objects, cacheDir);
+
+    if (readSceneCache(path, key, scene, emissiveTris)) {
+        std::cout << "Scene loaded from cache " << path << " in " << elapsedMs() << " ms" << std::endl;
+        return true;
+    }
+
+    scene = SceneData();
+    loadScene(scene, objects, modelDir);
+    emissiveTris = buildEmissiveTriangles(scene);
+    std::cout << "Scene parsed in " << elapsedMs() << " ms" << std::endl;
+
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir, ec);
+    if (!writeSceneCache(path, key, scene, emissiveTris)) {
+        std::cout << "Warning: could not write scene cache " << path << std::endl;
+    }
+    return false;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "render/lights.h"
+#include "render/scene.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Versioned binary snapshot of a loaded scene: mesh vertices/indices, materials, face materials, texture table,
+// mesh ranges, instances and emissive triangles. A warm start maps the file and bulk-copies every section
+// instead of parsing glTF.
+
+// Hash of the object list, the cache version and the sources: full content of every .gltf,
+// size + mtime of the files next to it (.bin buffers, textures)
+uint64_t computeSceneCacheKey(const std::vector<SceneObject>& objects, const std::string& modelDir);
+
+// Cache file for this object list inside cacheDir (one file per list, the key is checked on read)
+std::string getSceneCachePath(const std::vector<SceneObject>& objects, const std::string& cacheDir);
+
+// Returns false if the file is missing, was written by another version or doesn't match the key
+bool readSceneCache(const std::string& path, uint64_t key, SceneData& scene, std::vector<EmissiveTriGPU>& emissiveTris);
+bool writeSceneCache(const std::string& path, uint64_t key, const SceneData& scene, const std::vector<EmissiveTriGPU>& emissiveTris);
+
+// loadScene + buildEmissiveTriangles, served from the cache when it is up to date and refreshed otherwise.
+// Returns true on a cache hit.
+bool loadSceneCached(SceneData& scene, std::vector<EmissiveTriGPU>& emissiveTris,
+    const std::vector<SceneObject>& objects, const std::string& modelDir, const std::string& cacheDir);
@@ -0,0 +1,177 @@
+#include "scene_file.h"
+#include "math/mat4.h"
+
+#include "json.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+namespace {
+    float readFloat(const json& value, const std::string& name) {
+        if (!value.is_number()) {
+            throw std::runtime_error("Scene file: " + name + " must be a number");
+        }
+        return value.get<float>();
+    }
+
+    template <size_t N>
+    void readFloats(const json& value, const std::string& name, float (&out)[N]) {
+        if (!value.is_array() || value.size() != N) {
+            throw std::runtime_error("Scene file: " + name + " must be an array of " + std::to_string(N) + " numbers");
+        }
+        for (size_t i = 0; i < N; i++) {
+            out[i] = readFloat(value[i], name);
+        }
+    }
+
+    Vec3 readVec3(const json& value, const std::string& name) {
+        float v[3];
+        readFloats(value, name, v);
+        return Vec3(v[0], v[1], v[2]);
+    }
+
+    // Scale, then rotate, then translate (A * B applies A first)
+    Mat4 readTransform(const json& model, const std::string& name) {
+        if (model.contains("matrix")) {
+            if (model.contains("translation") || model.contains("rotation") || model.contains("scale")) {
+                throw std::runtime_error("Scene file: " + name + " has both a matrix and translation/rotation/scale");
+            }
+            float values[16];
+            readFloats(model["matrix"], name + ".matrix", values);
+            double matrix[16];
+            for (int i = 0; i < 16; i++) matrix[i] = values[i];
+            return Mat4::fromGLTF(matrix);
+        }
+
+        Mat4 translation = Mat4::identity();
+        Mat4 rotation = Mat4::identity();
+        Mat4 scale = Mat4::identity();
+
+        if (model.contains("translation")) {
+            translation = Mat4::translate(readVec3(model["translation"], name + ".translation"));
+        }
+        if (model.contains("rotation")) {
+            float q[4];
+            readFloats(model["rotation"], name + ".rotation", q);
+            rotation = Mat4::fromQuaternion(q[0], q[1], q[2], q[3]);
+        }
+        if (model.contains("scale")) {
+            const json& value = model["scale"];
+            scale = Mat4::scale(value.is_array() ? readVec3(value, name + ".scale") : Vec3(readFloat(value, name + ".scale")));
+        }
+
+        return scale * rotation * translation;
+    }
+}
+
+SceneFile loadSceneFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open scene file " + path);
+    }
+
+    json root;
+    try {
+        root = json::parse(file);
+    }
+    catch (const json::exception& e) {
+        throw std::runtime_error("Failed to parse scene file " + path + ": " + e.what());
+    }
+    if (!root.is_object()) {
+        throw std::runtime_error("Scene file " + path + " must hold a JSON object");
+    }
+
+    SceneFile scene;
+
+    if (root.contains("camera")) {
+        const json& camera = root["camera"];
+        if (camera.contains("position")) scene.camera.position = readVec3(camera["position"], "camera.position");
+        if (camera.contains("yaw")) scene.camera.yaw = readFloat(camera["yaw"], "camera.yaw");
+        if (camera.contains("pitch")) scene.camera.pitch = readFloat(camera["pitch"], "camera.pitch");
+        if (camera.contains("speed")) scene.camera.speed = readFloat(camera["speed"], "camera.speed");
+        scene.camera.updateCameraVectors();
+    }
+
+    if (root.contains("render")) {
+        const json& render = root["render"];
+        if (render.contains("samplesPerFrame")) {
+            scene.settings.samplesPerFrame = static_cast<int>(readFloat(render["samplesPerFrame"], "render.samplesPerFrame"));
+        }
+        if (render.contains("maxDepth")) {
+            scene.settings.maxDepth = static_cast<int>(readFloat(render["maxDepth"], "render.maxDepth"));
+        }
+        if (scene.settings.samplesPerFrame < 1 || scene.settings.maxDepth < 1) {
+            throw std::runtime_error("Scene file: render.samplesPerFrame and render.maxDepth must be at least 1");
+        }
+    }
+
+    float emissionScale = 1.0f;
+    if (root.contains("lights")) {
+        const json& lights = root["lights"];
+        if (lights.contains("emissionScale")) emissionScale = readFloat(lights["emissionScale"], "lights.emissionScale");
+        if (lights.contains("skyIntensity")) scene.settings.skyIntensity = readFloat(lights["skyIntensity"], "lights.skyIntensity");
+    }
+
+    if (root.contains("display")) {
+        const json& display = root["display"];
+        if (display.contains("exposure")) scene.display.exposure = readFloat(display["exposure"], "display.exposure");
+        if (display.contains("tonemap")) {
+            const json& tonemap = display["tonemap"];
+            const std::string name = tonemap.is_string() ? tonemap.get<std::string>() : "";
+            if (name == "clamp") scene.display.tonemap = Tonemap::Clamp;
+            else if (name == "aces") scene.display.tonemap = Tonemap::Aces;
+            else if (name == "agx") scene.display.tonemap = Tonemap::AgX;
+            else throw std::runtime_error("Scene file: display.tonemap must be \"clamp\", \"aces\" or \"agx\"");
+        }
+        if (display.contains("dither")) {
+            if (!display["dither"].is_boolean()) {
+                throw std::runtime_error("Scene file: display.dither must be true or false");
+            }
+            scene.display.dither = display["dither"].get<bool>();
+        }
+    }
+
+    if (root.contains("denoiser")) {
+        const json& denoiser = root["denoiser"];
+        if (denoiser.contains("enabled")) {
+            if (!denoiser["enabled"].is_boolean()) {
+                throw std::runtime_error("Scene file: denoiser.enabled must be true or false");
+            }
+            scene.denoiser.enabled = denoiser["enabled"].get<bool>();
+        }
+        if (denoiser.contains("iterations")) {
+            scene.denoiser.iterations = static_cast<int>(readFloat(denoiser["iterations"], "denoiser.iterations"));
+        }
+        if (denoiser.contains("sigmaDepth")) scene.denoiser.sigmaDepth = readFloat(denoiser["sigmaDepth"], "denoiser.sigmaDepth");
+        if (denoiser.contains("sigmaLuminance")) {
+            scene.denoiser.sigmaLuminance = readFloat(denoiser["sigmaLuminance"], "denoiser.sigmaLuminance");
+        }
+        if (scene.denoiser.iterations < 1 || scene.denoiser.iterations > 8 || scene.denoiser.sigmaDepth <= 0.0f ||
+            scene.denoiser.sigmaLuminance <= 0.0f) {
+            throw std::runtime_error("Scene file: denoiser.iterations must be 1 to 8 and the sigmas positive");
+        }
+    }
+
+    if (!root.contains("models") || !root["models"].is_array() || root["models"].empty()) {
+        throw std::runtime_error("Scene file " + path + " has no models");
+    }
+    for (const json& model : root["models"]) {
+        const std::string name = "models[" + std::to_string(scene.objects.size()) + "]";
+        if (!model.is_object() || !model.contains("path") || !model["path"].is_string()) {
+            throw std::runtime_error("Scene file: " + name + " needs a path");
+        }
+
+        SceneObject object;
+        object.modelPath = model["path"].get<std::string>();
+        object.transform = readTransform(model, name);
+        object.emissionScale = emissionScale;
+        if (model.contains("emissionScale")) {
+            object.emissionScale *= readFloat(model["emissionScale"], name + ".emissionScale");
+        }
+        scene.objects.push_back(object);
+    }
+
+    return scene;
+}
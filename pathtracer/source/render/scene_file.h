@@ -0,0 +1,40 @@
+#pragma once
+
+#include "render/camera.h"
+#include "render/render_settings.h"
+#include "render/scene.h"
+
+#include <string>
+#include <vector>
+
+// A scene description read from JSON: which models to load and where, the starting camera,
+// the render and display settings and light overrides.
+//
+// {
+//   "camera": { "position": [0, 1, 4], "yaw": -90, "pitch": 0, "speed": 8 },
+//   "render": { "samplesPerFrame": 4, "maxDepth": 6 },
+//   "lights": { "emissionScale": 1.0, "skyIntensity": 0.2 },
+//   "display": { "exposure": 0.0, "tonemap": "aces", "dither": true },
+//   "denoiser": { "enabled": true, "iterations": 5, "sigmaDepth": 1.0, "sigmaLuminance": 4.0 },
+//   "models": [
+//     { "path": "bath/scene.gltf" },
+//     { "path": "lantern/Lantern.gltf", "translation": [2, 0, 0], "rotation": [0, 0, 0, 1], "scale": 0.1,
+//       "emissionScale": 4.0 },
+//     { "path": "helmet/DamagedHelmet.gltf", "matrix": [16 numbers, column-major as in glTF] }
+//   ]
+// }
+//
+// Everything but "models" is optional. Model paths (.gltf, .glb or .obj) are relative to the model directory,
+// "scale" is a number or an [x, y, z] array, "rotation" a quaternion [x, y, z, w]. The global emissionScale
+// multiplies the per-model one, which is baked into each SceneObject. "tonemap" is "clamp", "aces" or "agx",
+// "exposure" is in stops.
+struct SceneFile {
+    std::vector<SceneObject> objects;
+    Camera camera;
+    RenderSettings settings;
+    DisplaySettings display;
+    DenoiserSettings denoiser;
+};
+
+// Throws std::runtime_error when the file can't be read or doesn't describe a valid scene
+SceneFile loadSceneFile(const std::string& path);
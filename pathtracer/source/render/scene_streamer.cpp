@@ -0,0 +1,76 @@
+#include "scene_streamer.h"
+#include "render/scene_cache.h"
+
+#include <algorithm>
+#include <iostream>
+
+std::vector<SceneObject> sortObjectsByDistance(const std::vector<SceneObject>& objects, const Vec3& viewpoint) {
+    std::vector<SceneObject> sorted = objects;
+    auto distanceSquared = [&](const SceneObject& object) {
+        // Mat4 is stored by column, the translation is the last one
+        Vec3 origin(object.transform.m[3][0], object.transform.m[3][1], object.transform.m[3][2]);
+        return (origin - viewpoint).lengthSquared();
+    };
+    std::stable_sort(sorted.begin(), sorted.end(), [&](const SceneObject& a, const SceneObject& b) {
+        return distanceSquared(a) < distanceSquared(b);
+    });
+    return sorted;
+}
+
+SceneStreamer::SceneStreamer(const std::vector<SceneObject>& objects, const Vec3& viewpoint, const std::string& modelDir,
+    const std::string& cacheDir)
+    : objects(sortObjectsByDistance(objects, viewpoint)), modelDir(modelDir), cacheDir(cacheDir),
+    thread(&SceneStreamer::run, this) {
+}
+
+SceneStreamer::~SceneStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    thread.join();
+}
+
+void SceneStreamer::run() {
+    for (const SceneObject& object : objects) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+        }
+
+        Part part;
+        part.object = object;
+        try {
+            std::cout << "Streaming " << object.modelPath << std::endl;
+            loadSceneCached(part.scene, part.emissiveTris, { object }, modelDir, cacheDir);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            failed = true;
+            ready.notify_all();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        parts.push_back(std::move(part));
+        ready.notify_all();
+    }
+}
+
+bool SceneStreamer::next(Part& part, bool wait) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait) {
+        ready.wait(lock, [&] { return !parts.empty() || failed || taken == objects.size(); });
+    }
+    if (!parts.empty()) {
+        part = std::move(parts.front());
+        parts.pop_front();
+        taken++;
+        return true;
+    }
+    if (failed) {
+        std::rethrow_exception(error);
+    }
+    return false;
+}
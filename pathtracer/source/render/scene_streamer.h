@@ -0,0 +1,61 @@
+#pragma once
+
+#include "render/lights.h"
+#include "render/scene.h"
+#include "math/vec3.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads the objects of a scene one at a time on a background thread, nearest to the viewpoint first, so the first
+// frames can render the geometry around the camera while the rest streams in. Every object goes through
+// loadSceneCached on its own (and gets its own cache file); the consumer appends the parts with appendScene.
+class SceneStreamer {
+public:
+    // One loaded object, its mesh data and emissive triangles as loadSceneCached returns them
+    struct Part {
+        SceneObject object;
+        SceneData scene;
+        std::vector<EmissiveTriGPU> emissiveTris;
+    };
+
+    SceneStreamer(const std::vector<SceneObject>& objects, const Vec3& viewpoint, const std::string& modelDir,
+        const std::string& cacheDir);
+    // Stops after the object being loaded
+    ~SceneStreamer();
+
+    SceneStreamer(const SceneStreamer&) = delete;
+    SceneStreamer& operator=(const SceneStreamer&) = delete;
+
+    // Takes the next loaded object, in priority order. With wait set, blocks until one is ready.
+    // Returns false when none is ready or (waiting) when every object was taken; rethrows a failed load.
+    bool next(Part& part, bool wait);
+
+    size_t getObjectCount() const { return objects.size(); }
+
+private:
+    void run();
+
+    std::vector<SceneObject> objects; // in load order
+    std::string modelDir;
+    std::string cacheDir;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Part> parts;
+    size_t taken = 0;
+    bool failed = false;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    std::thread thread; // last, starts once everything above is set up
+};
+
+// Load order for the streamer: nearest object origin (transform translation) to the viewpoint first.
+// Ties keep the file order.
+std::vector<SceneObject> sortObjectsByDistance(const std::vector<SceneObject>& objects, const Vec3& viewpoint);
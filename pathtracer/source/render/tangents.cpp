@@ -0,0 +1,91 @@
+#include "tangents.h"
+#include "core/hash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    constexpr uint32_t EMPTY_SLOT = 0xFFFFFFFFu;
+
+    // Everything but the tangent, hashed consistently with comparing the floats (-0 like +0)
+    uint64_t hashKey(const Vertex& v) {
+        const float values[8] = {
+            v.position.x + 0.0f, v.position.y + 0.0f, v.position.z + 0.0f,
+            v.normal.x + 0.0f, v.normal.y + 0.0f, v.normal.z + 0.0f,
+            v.texCoord[0] + 0.0f, v.texCoord[1] + 0.0f,
+        };
+        return hashBytes(values, sizeof(values));
+    }
+
+    bool sameKey(const Vertex& a, const Vertex& b) {
+        return a.position == b.position && a.normal == b.normal && a.texCoord[0] == b.texCoord[0] && a.texCoord[1] == b.texCoord[1];
+    }
+
+    // Any unit vector perpendicular to a unit normal
+    Vec3 perpendicular(const Vec3& n) {
+        return normalize(cross(std::fabs(n.x) > 0.9f ? Vec3(0.0f, 1.0f, 0.0f) : Vec3(1.0f, 0.0f, 0.0f), n));
+    }
+
+    // acos to within 7e-5 radians (Abramowitz and Stegun 4.4.45), plenty for weights and a lot cheaper
+    float approximateAcos(float x) {
+        const float a = std::min(std::fabs(x), 1.0f);
+        const float r = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+        return x < 0.0f ? 3.14159265f - r : r;
+    }
+}
+
+void generateTangents(Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, uint32_t indexBase) {
+    // Vertices equal in everything but the tangent share one sum, so they stay equal and still weld afterwards.
+    // Grouped with an open addressing table of vertex indices, which is much cheaper than a node based map here.
+    std::vector<uint32_t> group(vertexCount);
+    size_t capacity = 16;
+    while (capacity < vertexCount * 2) capacity *= 2;
+    std::vector<uint32_t> slots(capacity, EMPTY_SLOT);
+    for (size_t i = 0; i < vertexCount; i++) {
+        size_t slot = hashKey(vertices[i]) & (capacity - 1);
+        while (slots[slot] != EMPTY_SLOT && !sameKey(vertices[slots[slot]], vertices[i])) slot = (slot + 1) & (capacity - 1);
+        if (slots[slot] == EMPTY_SLOT) slots[slot] = static_cast<uint32_t>(i);
+        group[i] = slots[slot];
+    }
+
+    std::vector<Vec3> sums(vertexCount, Vec3(0.0f));
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        uint32_t local[3];
+        bool valid = true;
+        for (int k = 0; k < 3; k++) {
+            local[k] = indices[t + k] - indexBase;
+            valid &= local[k] < vertexCount;
+        }
+        if (!valid) continue;
+
+        const Vertex& v0 = vertices[local[0]];
+        const Vertex& v1 = vertices[local[1]];
+        const Vertex& v2 = vertices[local[2]];
+        const Vec3 e1 = v1.position - v0.position;
+        const Vec3 e2 = v2.position - v0.position;
+        const float du1 = v1.texCoord[0] - v0.texCoord[0], dv1 = v1.texCoord[1] - v0.texCoord[1];
+        const float du2 = v2.texCoord[0] - v0.texCoord[0], dv2 = v2.texCoord[1] - v0.texCoord[1];
+        const float det = du1 * dv2 - du2 * dv1;
+        if (std::fabs(det) < 1e-20f) continue;
+
+        // Direction of increasing u; the sign of det cancels out, so it doesn't depend on which way v points
+        const Vec3 tangent = normalize((e1 * dv2 - e2 * dv1) / det);
+        if (tangent.lengthSquared() == 0.0f) continue;
+
+        // Corner angles from the unit edges v0->v1, v1->v2 and v2->v0
+        const Vec3 a = normalize(e1);
+        const Vec3 b = normalize(v2.position - v1.position);
+        const Vec3 c = normalize(v0.position - v2.position);
+        const float angles[3] = { approximateAcos(-dot(c, a)), approximateAcos(-dot(a, b)), approximateAcos(-dot(b, c)) };
+        for (int k = 0; k < 3; k++) sums[group[local[k]]] += tangent * angles[k];
+    }
+
+    for (size_t i = 0; i < vertexCount; i++) {
+        Vertex& v = vertices[i];
+        const Vec3& sum = sums[group[i]];
+        const Vec3 tangent = sum - v.normal * dot(v.normal, sum);
+        const bool usable = sum.lengthSquared() > 0.0f && tangent.lengthSquared() > 1e-6f * sum.lengthSquared();
+        v.tangent = usable ? normalize(tangent) : perpendicular(v.normal);
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "render/model_loader.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Per-vertex tangents for a triangle mesh that comes without them, the direction of increasing u. Like MikkTSpace,
+// every triangle's tangent is weighted by the angle at each corner and summed over the vertices that share position,
+// normal and texture coordinate, then made orthogonal to the normal. Vertices without a usable UV mapping get some
+// direction perpendicular to their normal. indices[i] - indexBase addresses vertices[0, vertexCount).
+void generateTangents(Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount, uint32_t indexBase);
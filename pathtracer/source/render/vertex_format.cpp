@@ -0,0 +1,94 @@
+#include "vertex_format.h"
+#include "core/thread_pool.h"
+#include "math/half.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    float signNotZero(float value) {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    uint32_t packSnorm2x16(const Vec2& v) {
+        auto quantize = [](float value) {
+            return static_cast<uint32_t>(static_cast<int32_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f))) & 0xFFFFu;
+        };
+        return quantize(v.x) | (quantize(v.y) << 16);
+    }
+
+    Vec2 unpackSnorm2x16(uint32_t packed) {
+        auto expand = [](uint32_t bits) {
+            return std::max(static_cast<float>(static_cast<int16_t>(bits & 0xFFFFu)) / 32767.0f, -1.0f);
+        };
+        return Vec2(expand(packed), expand(packed >> 16));
+    }
+
+    // Octahedral encoding after rounding to the snorm grid is only accurate to about one step; trying the
+    // neighbouring grid points and keeping the best one halves the worst-case angular error
+    uint32_t packDirection(const Vec3& direction) {
+        const Vec2 rounded = unpackSnorm2x16(packSnorm2x16(octEncode(direction)));
+        uint32_t best = packSnorm2x16(rounded);
+        float bestDot = dot(octDecode(rounded), direction);
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                Vec2 candidate = rounded + Vec2(dx / 32767.0f, dy / 32767.0f);
+                uint32_t packed = packSnorm2x16(candidate);
+                float d = dot(octDecode(unpackSnorm2x16(packed)), direction);
+                if (d > bestDot) {
+                    bestDot = d;
+                    best = packed;
+                }
+            }
+        }
+        return best;
+    }
+}
+
+Vec2 octEncode(const Vec3& n) {
+    const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f) return Vec2(0.0f, 0.0f);
+
+    Vec2 e(n.x / sum, n.y / sum);
+    if (n.z < 0.0f) {
+        e = Vec2((1.0f - std::abs(e.y)) * signNotZero(e.x), (1.0f - std::abs(e.x)) * signNotZero(e.y));
+    }
+    return e;
+}
+
+Vec3 octDecode(const Vec2& e) {
+    Vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    const float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+PackedVertex packVertex(const Vertex& vertex) {
+    PackedVertex packed;
+    packed.position[0] = vertex.position.x;
+    packed.position[1] = vertex.position.y;
+    packed.position[2] = vertex.position.z;
+    packed.normal = packDirection(vertex.normal);
+    packed.texCoord = floatToHalf(vertex.texCoord[0]) | (static_cast<uint32_t>(floatToHalf(vertex.texCoord[1])) << 16);
+    packed.tangent = packDirection(vertex.tangent);
+    return packed;
+}
+
+Vertex unpackVertex(const PackedVertex& packed) {
+    Vertex vertex;
+    vertex.position = Vec3(packed.position[0], packed.position[1], packed.position[2]);
+    vertex.normal = octDecode(unpackSnorm2x16(packed.normal));
+    vertex.texCoord[0] = halfToFloat(static_cast<uint16_t>(packed.texCoord & 0xFFFFu));
+    vertex.texCoord[1] = halfToFloat(static_cast<uint16_t>(packed.texCoord >> 16));
+    vertex.tangent = octDecode(unpackSnorm2x16(packed.tangent));
+    return vertex;
+}
+
+std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices) {
+    std::vector<PackedVertex> packed(vertices.size());
+    ThreadPool::global().parallelFor(vertices.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) packed[i] = packVertex(vertices[i]);
+    });
+    return packed;
+}
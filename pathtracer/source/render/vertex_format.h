@@ -0,0 +1,29 @@
+#pragma once
+
+#include "math/vec2.h"
+#include "math/vec3.h"
+#include "render/model_loader.h"
+
+#include <cstdint>
+#include <vector>
+
+// GPU vertex, 24 bytes instead of the loader's 44. The position stays full precision at the start so the
+// BLAS builds read it directly (R32G32B32, stride 24); normal and tangent are octahedral snorm16x2 and the
+// texture coordinates half floats, in the layouts of GLSL unpackSnorm2x16 / unpackHalf2x16
+struct PackedVertex {
+    float position[3];
+    uint32_t normal;
+    uint32_t texCoord;
+    uint32_t tangent;
+};
+static_assert(sizeof(PackedVertex) == 24, "closesthit.rchit reads 6 words per vertex");
+
+// Unit vector <-> point of the [-1, 1]^2 octahedral map
+Vec2 octEncode(const Vec3& n);
+Vec3 octDecode(const Vec2& e);
+
+PackedVertex packVertex(const Vertex& vertex);
+// Exactly what closesthit.rchit decodes (normal and tangent unit length)
+Vertex unpackVertex(const PackedVertex& packed);
+
+std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices);